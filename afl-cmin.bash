@@ -49,11 +49,11 @@ MEM_LIMIT=none
 TIMEOUT=none
 
 unset IN_DIR OUT_DIR STDIN_FILE EXTRA_PAR MEM_LIMIT_GIVEN \
-  AFL_CMIN_CRASHES_ONLY AFL_CMIN_ALLOW_ANY QEMU_MODE UNICORN_MODE
+  AFL_CMIN_CRASHES_ONLY AFL_CMIN_ALLOW_ANY QEMU_MODE UNICORN_MODE LEAK_MODE
 
 export AFL_QUIET=1
 
-while getopts "+i:o:f:m:t:eOQUCh" opt; do
+while getopts "+i:o:f:m:t:eLOQUCh" opt; do
 
   case "$opt" in 
 
@@ -80,6 +80,10 @@ while getopts "+i:o:f:m:t:eOQUCh" opt; do
     "e")
          EXTRA_PAR="$EXTRA_PAR -e"
          ;;
+    "L")
+         EXTRA_PAR="$EXTRA_PAR -L"
+         LEAK_MODE=1
+         ;;
     "C")
          export AFL_CMIN_CRASHES_ONLY=1
          ;;
@@ -130,6 +134,8 @@ Minimization settings:
 
   -C            - keep crashing inputs, reject everything else
   -e            - solve for edge coverage only, ignore hit counts
+  -L            - leakage mode: keep one input per tuple and observation
+                  class (hash of the target's stdout), not just per tuple
 
 For additional tips, please consult README.md.
 
@@ -435,7 +441,10 @@ if [ ! -s "$TRACE_DIR/.candidate_script" ]; then
 fi
 
 # The sed command converted the sorted list to a shell script that populates
-# BEST_FILE[tuple]="fname". Let's load that!
+# BEST_FILE[tuple]="fname". Let's load that! In leakage mode, tuples carry
+# an observation class suffix (tuple:class) and are no longer plain numbers.
+
+test "$LEAK_MODE" = "" || declare -A BEST_FILE
 
 . "$TRACE_DIR/.candidate_script"
 
@@ -463,7 +472,7 @@ while read -r cnt tuple; do
 
   grep -q "^$tuple\$" "$TRACE_DIR/.already_have" && continue
 
-  FN=${BEST_FILE[tuple]}
+  FN=${BEST_FILE[$tuple]}
 
 #  echo "tuple nr $CUR ($tuple cnt=$cnt) -> $FN" >> "$TRACE_DIR/.log"
   $CP_TOOL "$IN_DIR/$FN" "$OUT_DIR/$FN"
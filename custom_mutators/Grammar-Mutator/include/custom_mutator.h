@@ -32,6 +32,17 @@ typedef struct afl {
 
 } afl_t;
 
+// The part afl-fuzz wants mutated, see `afl_custom_leak_phase`. The values
+// are afl-fuzz's LEAK_PHASE_PUBLIC, LEAK_PHASE_SECRET and LEAK_PHASE_FULL.
+enum leak_phase {
+
+  LEAK_PHASE_NONE = -1,  // afl-fuzz does not tell, follow our own schedule
+  LEAK_PHASE_PUBLIC = 0,
+  LEAK_PHASE_SECRET = 1,
+  LEAK_PHASE_FULL = 2
+
+};
+
 typedef struct my_mutator {
 
   afl_t *afl;
@@ -73,12 +84,30 @@ typedef struct my_mutator {
   node_t * cur_rules_mutation_node;
   uint32_t cur_rules_mutation_rule_id;
 
+  // Leakage test cases: which parts (PUBLIC/SECRET) this grammar describes
+  bool leak_public;
+  bool leak_secret;
+
+  tree_t *secret_tree_cur;
+  tree_t *mutated_secret_tree;
+
+  // Leakage fuzzing: first the public schedule (see above), then random,
+  // random recursive and splicing mutations of the secret tree. When
+  // afl-fuzz sets the phase, only the part of that phase is mutated.
+  enum leak_phase leak_phase;
+  size_t cur_leak_fuzzing_step;
+  size_t total_public_fuzzing_steps;
+  size_t total_secret_fuzzing_steps;
+
   // Reused buffers:
   BUF_VAR(uint8_t, fuzz);
+  BUF_VAR(uint8_t, fuzz_secret);
 
   // Tree output directory
   char tree_fn_cur[PATH_MAX];
   char new_tree_fn[PATH_MAX];
+  char secret_tree_fn_cur[PATH_MAX];
+  char new_secret_tree_fn[PATH_MAX];
 
 } my_mutator_t;
 
@@ -97,6 +126,12 @@ size_t   afl_custom_fuzz(my_mutator_t *data, uint8_t *buf, size_t buf_size,
                          uint8_t **out_buf, uint8_t *add_buf,
                          size_t add_buf_size,  // add_buf can be NULL
                          size_t max_size);
+size_t   afl_custom_fuzz_leak(my_mutator_t *data, uint8_t *pub_buf,
+                              size_t pub_size, uint8_t *sec_buf,
+                              size_t sec_size, uint8_t **out_pub,
+                              uint8_t **out_sec, size_t *out_sec_size,
+                              size_t max_size);
+void     afl_custom_leak_phase(my_mutator_t *data, uint8_t phase);
 void     afl_custom_queue_new_entry(my_mutator_t * data,
                                     const uint8_t *filename_new_queue,
                                     const uint8_t *filename_orig_queue);
@@ -280,6 +280,18 @@ tree_t *read_tree_from_file(const char *filename);
  */
 tree_t *load_tree_from_test_case(const char *filename);
 
+/**
+ * Load/Parse the trees of both parts of a leakage test case file (a JSON
+ * object with base64 encoded PUBLIC and SECRET members)
+ * @param filename    The path to the fuzzing test case
+ * @param public_tree Receives the parsed public tree (NULL to skip)
+ * @param secret_tree Receives the parsed secret tree (NULL to skip)
+ * @return            0 on success, -1 if the file or a requested part cannot
+ *                    be loaded (no tree is returned then)
+ */
+int load_trees_from_test_case(const char *filename, tree_t **public_tree,
+                              tree_t **secret_tree);
+
 /**
  * Write/Serialize a tree to a file
  * @param tree     The tree to be written to the file
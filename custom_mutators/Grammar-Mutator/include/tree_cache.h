@@ -0,0 +1,48 @@
+#ifndef __TREE_CACHE_H__
+#define __TREE_CACHE_H__
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initialize the tree cache
+ * @param max_bytes The maximum number of bytes of serialized trees to keep in
+ *                  memory. The cache is flushed once this is exceeded.
+ */
+void tree_cache_init(size_t max_bytes);
+
+/**
+ * Remember the (public and secret) trees of a test case. The trees are cached
+ * in the serialized form they were last given by tree_serialize() (e.g., in
+ * write_tree_to_file()), they are not serialized again
+ * @param key         The key of the test case, i.e., its tree filename
+ * @param public_tree The public tree (may be NULL)
+ * @param secret_tree The secret tree (may be NULL)
+ */
+void tree_cache_put(const char *key, tree_t *public_tree, tree_t *secret_tree);
+
+/**
+ * Recover the trees of a cached test case
+ * @param key         The key of the test case
+ * @param public_tree Receives a newly created public tree, or NULL if none was
+ *                    cached (pass NULL to skip)
+ * @param secret_tree Receives a newly created secret tree, or NULL if none was
+ *                    cached (pass NULL to skip)
+ * @return            True (1) if the test case is cached; otherwise, false (0)
+ */
+bool tree_cache_get(const char *key, tree_t **public_tree,
+                    tree_t **secret_tree);
+
+/**
+ * Clear all cached trees
+ */
+void tree_cache_clear();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
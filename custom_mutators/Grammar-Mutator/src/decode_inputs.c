@@ -9,9 +9,11 @@
 #define SECRET_KEY "SECRET"
 
 /* Parses a testcase_buf to extract pointers and lengths for public and secret
- * segments of the testcase input. public_input and secret_input are malloced */
+ * segments of the testcase input. public_input and secret_input are malloced.
+ * Returns 0 on success and -1 if the testcase is not a PUBLIC/SECRET pair, in
+ * which case nothing is allocated. */
 
-void find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_len,
+int find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_len,
                                    uint8_t **public_input, uint32_t *public_len,
                                    uint8_t **secret_input, uint32_t *secret_len) {
 
@@ -20,6 +22,11 @@ void find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_l
   json_char *json = (json_char *)testcase_buf;
   json_value *value = json_parse(json, testcase_len);
 
+  if (!value) {
+    fprintf(stderr, "Testcase is not valid JSON: %.*s\n", testcase_len, testcase_buf);
+    return -1;
+  }
+
   switch (value->type) {
     case json_object: {
       uint32_t len = value->u.object.length;
@@ -30,9 +37,9 @@ void find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_l
 
         json_type type = value->u.object.values[i].value->type;
         if (type != json_string) {
-          printf("Saw json field %s that was not a string (type: %d)\n", name, type);
-          exit(1);
-          continue;
+          fprintf(stderr, "Saw json field %s that was not a string (type: %d)\n", name, type);
+          json_value_free(value);
+          return -1;
         }
 
         char *str = value->u.object.values[i].value->u.string.ptr;
@@ -43,26 +50,30 @@ void find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_l
         } else if (!strcmp(name, SECRET_KEY)) {
           raw_secret = str;
         } else {
-          printf("saw json string { \"%s\": \"%.*s\" }\n", name, length, str);
-          exit(1);
+          fprintf(stderr, "saw json string { \"%s\": \"%.*s\" }\n", name, length, str);
+          json_value_free(value);
+          return -1;
         }
 
       }
       break;
     }
     default:
-      printf("JSON: %*.s was not a json-object\n", testcase_len, testcase_buf);
-      exit(1);
+      fprintf(stderr, "JSON: %.*s was not a json-object\n", testcase_len, testcase_buf);
+      json_value_free(value);
+      return -1;
   }
 
   if (!raw_public) {
-    printf("Failed to find PUBLIC in json: %.*s\n", testcase_len, testcase_buf);
-    exit(1);
+    fprintf(stderr, "Failed to find PUBLIC in json: %.*s\n", testcase_len, testcase_buf);
+    json_value_free(value);
+    return -1;
   }
 
   if (!raw_secret) {
-    printf("Failed to find SECRET in json: %.*s\n", testcase_len, testcase_buf);
-    exit(1);
+    fprintf(stderr, "Failed to find SECRET in json: %.*s\n", testcase_len, testcase_buf);
+    json_value_free(value);
+    return -1;
   }
 
   *public_len = Base64decode_len(raw_public);
@@ -74,4 +85,5 @@ void find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_l
   *secret_len = Base64decode((char *)*secret_input, raw_secret);
 
   json_value_free(value);
+  return 0;
 }
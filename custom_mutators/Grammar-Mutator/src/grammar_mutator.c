@@ -31,6 +31,7 @@
 #include "tree_mutation.h"
 #include "tree_trimming.h"
 #include "chunk_store.h"
+#include "tree_cache.h"
 #include "utils.h"
 
 // default number of mutations of three mutation strategies
@@ -40,20 +41,25 @@ size_t default_random_mutation_steps = 1000;
 size_t default_random_recursive_mutation_steps = 1000;
 // env: SPLICING_MUTATION_STEPS
 size_t default_splicing_mutation_steps = 1000;
+// memory for serialized trees of visited test cases, in MB
+// env: GRAMMAR_TREE_CACHE_MB
+size_t default_tree_cache_mb = 256;
 
 static void load_env_configs() {
 
   char *ptr;
-  char *env_vars[4] = {
+  char *env_vars[5] = {
       "RANDOM_MUTATION_STEPS",
       "RANDOM_RECURSIVE_MUTATION_STEPS",
       "SPLICING_MUTATION_STEPS",
+      "GRAMMAR_TREE_CACHE_MB",
       NULL
   };
-  size_t *configs[4] = {
+  size_t *configs[5] = {
       &default_random_mutation_steps,
       &default_random_recursive_mutation_steps,
       &default_splicing_mutation_steps,
+      &default_tree_cache_mb,
       NULL
   };
   int i = 0;
@@ -72,6 +78,42 @@ static void load_env_configs() {
 
 }
 
+// Which parts of a leakage test case (PUBLIC, SECRET or both) the grammar
+// describes; the other part is left alone. A grammar specific
+// GRAMMAR_LEAK_PARTS_<grammar name> takes precedence over GRAMMAR_LEAK_PARTS,
+// so that two grammar mutators can be loaded, one for each part.
+// env: GRAMMAR_LEAK_PARTS (public, secret or both; default: public)
+static void load_leak_parts(my_mutator_t *data) {
+
+  char *ptr = NULL;
+
+#ifdef GRAMMAR_NAME
+  ptr = getenv("GRAMMAR_LEAK_PARTS_" GRAMMAR_NAME);
+#endif
+  if (!ptr || !*ptr) ptr = getenv("GRAMMAR_LEAK_PARTS");
+
+  data->leak_public = true;
+  data->leak_secret = false;
+
+  if (!ptr || !*ptr || !strcmp(ptr, "public")) return;
+
+  if (!strcmp(ptr, "secret")) {
+
+    data->leak_public = false;
+    data->leak_secret = true;
+
+  } else if (!strcmp(ptr, "both")) {
+
+    data->leak_secret = true;
+
+  } else {
+
+    fprintf(stderr, "Unknown GRAMMAR_LEAK_PARTS '%s', using 'public'\n", ptr);
+
+  }
+
+}
+
 my_mutator_t *afl_custom_init(afl_t *afl, unsigned int seed) {
 
   random_set_seed(seed);
@@ -79,6 +121,7 @@ my_mutator_t *afl_custom_init(afl_t *afl, unsigned int seed) {
   load_env_configs();
 
   chunk_store_init();
+  tree_cache_init(default_tree_cache_mb << 20);
 
   my_mutator_t *data = (my_mutator_t *)calloc(1, sizeof(my_mutator_t));
   if (!data) {
@@ -89,6 +132,8 @@ my_mutator_t *afl_custom_init(afl_t *afl, unsigned int seed) {
   }
 
   data->afl = afl;
+  data->leak_phase = LEAK_PHASE_NONE;
+  load_leak_parts(data);
 
   return data;
 
@@ -99,6 +144,8 @@ void afl_custom_deinit(my_mutator_t *data) {
   if (data->tree_cur) tree_free(data->tree_cur);
   if (data->mutated_tree) tree_free(data->mutated_tree);
   if (data->trimmed_tree) tree_free(data->trimmed_tree);
+  if (data->secret_tree_cur) tree_free(data->secret_tree_cur);
+  if (data->mutated_secret_tree) tree_free(data->mutated_secret_tree);
 
   data->cur_fuzzing_stage = 0;
   data->cur_fuzzing_step = 0;
@@ -120,9 +167,77 @@ void afl_custom_deinit(my_mutator_t *data) {
   data->total_recursive_trimming_steps = 0;
 
   free(data->fuzz_buf);
+  free(data->fuzz_secret_buf);
   free(data);
 
   chunk_store_clear();
+  tree_cache_clear();
+
+}
+
+// Read the trees of the current test case, from the cache, the tree files or
+// by parsing the test case, in that order of preference. *cached tells
+// whether the cache had them all. Trees from anywhere else are serialized,
+// ready for tree_cache_put()
+static bool load_cur_trees(my_mutator_t *data, const char *fn, bool *cached) {
+
+  tree_t **want_public = data->leak_public ? &data->tree_cur : NULL;
+  tree_t **want_secret = data->leak_secret ? &data->secret_tree_cur : NULL;
+
+  *cached = tree_cache_get(fn, want_public, want_secret) &&
+            (!want_public || data->tree_cur) &&
+            (!want_secret || data->secret_tree_cur);
+  if (*cached) return true;
+
+  // Read the corresponding serialized trees from file
+  if (want_public && !data->tree_cur && strlen(data->tree_fn_cur)) {
+
+    data->tree_cur = read_tree_from_file(data->tree_fn_cur);
+    tree_serialize(data->tree_cur);
+
+  }
+
+  if (want_secret && !data->secret_tree_cur &&
+      strlen(data->secret_tree_fn_cur)) {
+
+    data->secret_tree_cur = read_tree_from_file(data->secret_tree_fn_cur);
+    tree_serialize(data->secret_tree_cur);
+
+  }
+
+  if ((!want_public || data->tree_cur) && (!want_secret || data->secret_tree_cur))
+    return true;
+
+  // try to parse the test case, each part on its own
+  tree_t *public_tree = NULL, *secret_tree = NULL;
+  if (load_trees_from_test_case(fn,
+                                want_public && !data->tree_cur ? &public_tree : NULL,
+                                want_secret && !data->secret_tree_cur ? &secret_tree : NULL) != 0)
+    return false;
+
+  // Now that we've parsed it, cache the info from this test case in
+  // our trees folders
+  if (public_tree) {
+
+    data->tree_cur = public_tree;
+    if (strlen(data->tree_fn_cur))
+      write_tree_to_file(public_tree, data->tree_fn_cur);
+    else
+      tree_serialize(public_tree);
+
+  }
+
+  if (secret_tree) {
+
+    data->secret_tree_cur = secret_tree;
+    if (strlen(data->secret_tree_fn_cur))
+      write_tree_to_file(secret_tree, data->secret_tree_fn_cur);
+    else
+      tree_serialize(secret_tree);
+
+  }
+
+  return true;
 
 }
 
@@ -140,6 +255,14 @@ uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
 
   data->tree_cur = NULL;
 
+  if (data->secret_tree_cur) {
+
+    tree_free(data->secret_tree_cur);
+
+  }
+
+  data->secret_tree_cur = NULL;
+
   // Figure out where the "trees" folder is stashed!
   // Strip off the file portion of the filename:
   const char *slash_basename = strrchr(fn, '/');
@@ -179,32 +302,55 @@ uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
 
     // Should not reach here
     perror("No parent folder in filename (afl_custom_queue_get)");
+    free(tree_out_dir);
     return 0;
 
   }
 
+  data->tree_fn_cur[0] = '\0';
+  data->secret_tree_fn_cur[0] = '\0';
+
   // Only read or write trees if we get /queue or /_resume as the last folder!
   if (strcmp(last_dir, "/queue") != 0 && strcmp(last_dir, "/_resume") != 0) {
 
     free(tree_out_dir);
     tree_out_dir = NULL;
-    data->tree_fn_cur[0] = '\0';
 
   } else {
 
-    // Copy "/trees" (including the null) to replace the old folder name
-    memcpy(last_dir, "/trees", 7);
+    // Strip the last folder, "trees" (public or plain test cases) and
+    // "secret_trees" live next to it
+    *last_dir = '\0';
 
-    // Set up the (expected) tree filename
-    snprintf(
-        data->tree_fn_cur, PATH_MAX - 1, "%s/%s", tree_out_dir,
-        use_name);
+    // Set up the (expected) tree filenames
+    if (data->leak_public)
+      snprintf(data->tree_fn_cur, PATH_MAX - 1, "%s/trees/%s", tree_out_dir,
+               use_name);
+    if (data->leak_secret)
+      snprintf(data->secret_tree_fn_cur, PATH_MAX - 1, "%s/secret_trees/%s",
+               tree_out_dir, use_name);
 
-    // Check if we need to create the tree output directory
+    // Check if we need to create the tree output directories
     if (unlikely(data->tree_out_dir_exist == 0)) {
 
-      // Check whether the directory exists
-      if (!create_directory(tree_out_dir)) {
+      char dir[PATH_MAX];
+      bool ok = true;
+
+      if (data->leak_public) {
+
+        snprintf(dir, PATH_MAX - 1, "%s/trees", tree_out_dir);
+        ok = create_directory(dir);
+
+      }
+
+      if (ok && data->leak_secret) {
+
+        snprintf(dir, PATH_MAX - 1, "%s/secret_trees", tree_out_dir);
+        ok = create_directory(dir);
+
+      }
+
+      if (!ok) {
 
         // error
         perror("Cannot create the output directory (afl_custom_queue_get)");
@@ -213,43 +359,44 @@ uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
 
       }
 
+      data->tree_out_dir_exist = true;
+
     }
 
     free(tree_out_dir);
 
   }
 
-  if (strlen(data->tree_fn_cur)) {
-
-    // Read the corresponding serialized tree from file
-    data->tree_cur = read_tree_from_file(data->tree_fn_cur);
-    if (data->tree_cur) {
-
-      // We already had this tree in the trees folder, so compute its size and then we're done!
-      tree_get_size(data->tree_cur);
-      chunk_store_add_tree(data->tree_cur);
-      return 1;
+  bool cached;
+  if (!load_cur_trees(data, fn, &cached)) {
 
-    }
+    // parsing error, skip the current test case
+    if (data->tree_cur) tree_free(data->tree_cur);
+    if (data->secret_tree_cur) tree_free(data->secret_tree_cur);
+    data->tree_cur = NULL;
+    data->secret_tree_cur = NULL;
+    return 0;
 
   }
 
-  // try to parse the test case
-  data->tree_cur = load_tree_from_test_case(fn);
+  // Compute the sizes, and keep the trees around for splicing and for the
+  // next time we get to this test case
   if (data->tree_cur) {
 
-    // Now that we've parsed it, cache the info from this test case in
-    // our trees folder and in the chunk store
     tree_get_size(data->tree_cur);
-    if (strlen(data->tree_fn_cur)) write_tree_to_file(data->tree_cur, data->tree_fn_cur);
     chunk_store_add_tree(data->tree_cur);
-    return 1;
 
   }
 
-  // parsing error, skip the current test case
+  if (data->secret_tree_cur) {
 
-  return 0;
+    tree_get_size(data->secret_tree_cur);
+    chunk_store_add_tree(data->secret_tree_cur);
+
+  }
+
+  if (!cached) tree_cache_put(fn, data->tree_cur, data->secret_tree_cur);
+  return 1;
 
 }
 
@@ -428,6 +575,8 @@ int32_t afl_custom_post_trim(my_mutator_t *data, int success) {
     // Update the corresponding tree file
     write_tree_to_file(data->tree_cur, data->tree_fn_cur);
     chunk_store_add_tree(data->tree_cur);
+    tree_cache_put((const char *)data->filename_cur, data->tree_cur,
+                   data->secret_tree_cur);
 
   }
 
@@ -435,9 +584,7 @@ int32_t afl_custom_post_trim(my_mutator_t *data, int success) {
 
 }
 
-uint32_t afl_custom_fuzz_count(my_mutator_t *                         data,
-                               __attribute__((unused)) const uint8_t *buf,
-                               __attribute__((unused)) size_t buf_size) {
+static uint32_t public_fuzz_count(my_mutator_t *data) {
 
   if (!data->tree_cur) return 0;
 
@@ -506,6 +653,68 @@ uint32_t afl_custom_fuzz_count(my_mutator_t *                         data,
 
 }
 
+static uint32_t secret_fuzz_count(my_mutator_t *data) {
+
+  if (!data->secret_tree_cur) return 0;
+
+  tree_get_non_terminal_nodes(data->secret_tree_cur);
+  tree_get_recursion_edges(data->secret_tree_cur);
+
+  // No rules mutation, secrets get the random strategies only
+  uint32_t steps = default_random_mutation_steps + default_splicing_mutation_steps;
+  if (data->secret_tree_cur->recursion_edge_list->size > 0)
+    steps += default_random_recursive_mutation_steps;
+
+  return steps;
+
+}
+
+// Random mutations of both trees at once; only with a tree for each part
+static uint32_t full_fuzz_count(my_mutator_t *data) {
+
+  if (!data->tree_cur || !data->secret_tree_cur) return 0;
+  return default_random_mutation_steps;
+
+}
+
+uint32_t afl_custom_fuzz_count(my_mutator_t *                         data,
+                               __attribute__((unused)) const uint8_t *buf,
+                               __attribute__((unused)) size_t buf_size) {
+
+  data->cur_leak_fuzzing_step = 0;
+  data->total_public_fuzzing_steps = 0;
+  data->total_secret_fuzzing_steps = 0;
+
+  switch (data->leak_phase) {
+
+    case LEAK_PHASE_PUBLIC:
+      data->total_public_fuzzing_steps = public_fuzz_count(data);
+      break;
+    case LEAK_PHASE_SECRET:
+      data->total_secret_fuzzing_steps = secret_fuzz_count(data);
+      break;
+    case LEAK_PHASE_FULL:
+      return full_fuzz_count(data);
+    default:
+      data->total_public_fuzzing_steps = public_fuzz_count(data);
+      data->total_secret_fuzzing_steps = secret_fuzz_count(data);
+      break;
+
+  }
+
+  return data->total_public_fuzzing_steps + data->total_secret_fuzzing_steps;
+
+}
+
+// afl-fuzz tells us which part its next `afl_custom_fuzz_leak` calls are for,
+// followed by `afl_custom_fuzz_count` for the steps of that part
+void afl_custom_leak_phase(my_mutator_t *data, uint8_t phase) {
+
+  data->leak_phase = phase <= LEAK_PHASE_FULL ? (enum leak_phase)phase
+                                              : LEAK_PHASE_NONE;
+
+}
+
 // Fuzz the given test case several times, which is defined by the
 // `custom_mutator_stage` in `afl-fuzz-one.c`
 size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
@@ -688,13 +897,177 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
 
 }
 
+// Mutate the secret tree with one of the random strategies, chosen by how far
+// we are into the secret part of the schedule
+static tree_t *mutate_secret_tree(my_mutator_t *data) {
+
+  tree_t *tree = data->secret_tree_cur;
+  size_t  step = data->cur_leak_fuzzing_step - data->total_public_fuzzing_steps;
+
+  if (step < default_random_mutation_steps) return random_mutation(tree);
+  step -= default_random_mutation_steps;
+
+  if (step < default_splicing_mutation_steps ||
+      tree->recursion_edge_list->size == 0)
+    return splicing_mutation(tree);
+
+  // random recursive mutation, same growth limit as for public trees
+  const unsigned RRM_GROWTH = 10;
+  tree_t *rrm_tree = NULL;
+  tree_to_buf(tree);
+  do {
+
+    if (rrm_tree) tree_free(rrm_tree);
+    rrm_tree = random_recursive_mutation(tree, random_below(RRM_GROWTH + 1));
+    tree_to_buf(rrm_tree);
+
+  } while (rrm_tree->data_len > (1 << RRM_GROWTH) + tree->data_len);
+
+  return rrm_tree;
+
+}
+
+// Both parts at once, in the full phase: a random mutation of each tree
+static size_t fuzz_leak_full(my_mutator_t *data, size_t pub_size,
+                             uint8_t **out_pub, uint8_t **out_sec,
+                             size_t *out_sec_size, size_t max_size) {
+
+  if (data->mutated_tree) {
+
+    tree_free(data->mutated_tree);
+    data->mutated_tree = NULL;
+
+  }
+
+  if (unlikely(!data->tree_cur || !data->secret_tree_cur)) return pub_size;
+
+  tree_t *pub_tree = random_mutation(data->tree_cur);
+  tree_t *sec_tree = random_mutation(data->secret_tree_cur);
+  if (!pub_tree || !sec_tree) {
+
+    if (pub_tree) tree_free(pub_tree);
+    if (sec_tree) tree_free(sec_tree);
+    perror("mutation error, empty tree (afl_custom_fuzz_leak)");
+    return pub_size;
+
+  }
+
+  tree_to_buf(pub_tree);
+  tree_get_size(pub_tree);
+  tree_to_buf(sec_tree);
+  tree_get_size(sec_tree);
+  data->mutated_tree = pub_tree;
+  data->mutated_secret_tree = sec_tree;
+
+  size_t pub_len = pub_tree->data_len <= max_size ? pub_tree->data_len : max_size;
+  size_t sec_len = sec_tree->data_len <= max_size ? sec_tree->data_len : max_size;
+
+  uint8_t *pub = (uint8_t *)maybe_grow(BUF_PARAMS(data, fuzz), pub_len);
+  uint8_t *sec = (uint8_t *)maybe_grow(BUF_PARAMS(data, fuzz_secret), sec_len);
+  if (!pub || !sec) {
+
+    *out_pub = NULL;
+    perror("custom mutator, fuzzing buffer allocation error (afl_custom_fuzz_leak)");
+    return 0;            /* afl-fuzz will very likely error out after this. */
+
+  }
+
+  memcpy(pub, pub_tree->data_buf, pub_len);
+  memcpy(sec, sec_tree->data_buf, sec_len);
+  *out_pub = pub;
+  *out_sec = sec;
+  *out_sec_size = sec_len;
+  return pub_len;
+
+}
+
+// Fuzz a leakage test case. The public tree is mutated first, following the
+// same schedule as `afl_custom_fuzz`, then the secret tree; the part that is
+// not being mutated (or not described by our grammar) is passed through.
+// If afl-fuzz set the phase (`afl_custom_leak_phase`), `afl_custom_fuzz_count`
+// only counted the steps of that part, and the full phase mutates both.
+size_t afl_custom_fuzz_leak(my_mutator_t *data, uint8_t *pub_buf,
+                            size_t pub_size, uint8_t *sec_buf, size_t sec_size,
+                            uint8_t **out_pub, uint8_t **out_sec,
+                            size_t *out_sec_size, size_t max_size) {
+
+  if (data->mutated_secret_tree) {
+
+    // not interesting, see `afl_custom_fuzz`
+    tree_free(data->mutated_secret_tree);
+    data->mutated_secret_tree = NULL;
+
+  }
+
+  *out_pub = pub_buf;
+  *out_sec = sec_buf;
+  *out_sec_size = sec_size;
+
+  if (data->leak_phase == LEAK_PHASE_FULL) {
+
+    ++data->cur_leak_fuzzing_step;
+    return fuzz_leak_full(data, pub_size, out_pub, out_sec, out_sec_size,
+                          max_size);
+
+  }
+
+  if (data->cur_leak_fuzzing_step < data->total_public_fuzzing_steps) {
+
+    ++data->cur_leak_fuzzing_step;
+    return afl_custom_fuzz(data, pub_buf, pub_size, out_pub, NULL, 0, max_size);
+
+  }
+
+  if (unlikely(!data->secret_tree_cur)) return pub_size;
+
+  if (data->mutated_tree) {
+
+    // the public part is unchanged from now on
+    tree_free(data->mutated_tree);
+    data->mutated_tree = NULL;
+
+  }
+
+  tree_t *tree = mutate_secret_tree(data);
+  ++data->cur_leak_fuzzing_step;
+
+  if (!tree) {
+
+    perror("mutation error, empty tree (afl_custom_fuzz_leak)");
+    return pub_size;
+
+  }
+
+  tree_to_buf(tree);
+  tree_get_size(tree);
+  data->mutated_secret_tree = tree;
+  size_t mutated_size = tree->data_len <= max_size ? tree->data_len : max_size;
+
+  uint8_t *mutated_out =
+      (uint8_t *)maybe_grow(BUF_PARAMS(data, fuzz_secret), mutated_size);
+  if (!mutated_out) {
+
+    *out_sec = NULL;
+    perror("custom mutator, fuzzing buffer allocation error (afl_custom_fuzz_leak)");
+    return 0;            /* afl-fuzz will very likely error out after this. */
+
+  }
+
+  memcpy(mutated_out, tree->data_buf, mutated_size);
+  *out_sec = mutated_out;
+  *out_sec_size = mutated_size;
+  return pub_size;
+
+}
+
 // Save interesting mutated test cases
 void afl_custom_queue_new_entry(my_mutator_t * data,
                                 const uint8_t *filename_new_queue,
                                 const uint8_t *filename_orig_queue) {
 
   // If this is an initial case or sync, then we will get called with a null "filename_orig_queue".
-  if (unlikely(!filename_orig_queue || !data->mutated_tree)) {
+  if (unlikely(!filename_orig_queue ||
+               (!data->mutated_tree && !data->mutated_secret_tree))) {
 
     // In that situation, we can skip it here and let afl_custom_queue_get() import the data later,
     // or we can prefetch it here to ensure that it gets into our splicing data set (chunk_store) asap.
@@ -708,8 +1081,7 @@ void afl_custom_queue_new_entry(my_mutator_t * data,
   // NOTE: Unlike afl_custom_queue_get(), this function should ALWAYS have /queue/ as the last
   //       directory in its filename, so the following simplified parsing is acceptable.
   const char *fn = (const char *)filename_new_queue;
-  snprintf(data->new_tree_fn, PATH_MAX - 1, "%s", fn);
-  char *found = strrstr(data->new_tree_fn, "/queue/");
+  const char *found = strrstr(fn, "/queue/");
   if (unlikely(!found)) {
 
     // Should not reach here
@@ -718,17 +1090,34 @@ void afl_custom_queue_new_entry(my_mutator_t * data,
 
   }
 
-  // Replace "queue" with "trees"
-  memcpy(found, "/trees", 6);
+  // Replace "queue" with "trees" (or "secret_trees")
+  int dir_len = (int)(found - fn);
+  const char *name = found + 7;
+  snprintf(data->new_tree_fn, PATH_MAX - 1, "%.*s/trees/%s", dir_len, fn, name);
+  snprintf(data->new_secret_tree_fn, PATH_MAX - 1, "%.*s/secret_trees/%s",
+           dir_len, fn, name);
+
+  // A leakage test case only had one of its parts mutated, the other one is
+  // the part of the current test case
+  tree_t *public_tree = data->mutated_tree;
+  tree_t *secret_tree = data->mutated_secret_tree;
+  if (!public_tree && data->leak_public) public_tree = data->tree_cur;
+  if (!secret_tree && data->leak_secret) secret_tree = data->secret_tree_cur;
 
-  // Write the mutated tree to the file
-  write_tree_to_file(data->mutated_tree, data->new_tree_fn);
+  // Write the trees to the files
+  if (public_tree) write_tree_to_file(public_tree, data->new_tree_fn);
+  if (secret_tree) write_tree_to_file(secret_tree, data->new_secret_tree_fn);
 
-  // Store all subtrees in the newly added tree
-  chunk_store_add_tree(data->mutated_tree);
+  // Store all subtrees in the newly added trees
+  if (data->mutated_tree) chunk_store_add_tree(data->mutated_tree);
+  if (data->mutated_secret_tree) chunk_store_add_tree(data->mutated_secret_tree);
 
-  /* Once the test case is added into the queue, we will clear `mutated_tree` */
-  tree_free(data->mutated_tree);
+  tree_cache_put(fn, public_tree, secret_tree);
+
+  /* Once the test case is added into the queue, we will clear the mutated trees */
+  if (data->mutated_tree) tree_free(data->mutated_tree);
+  if (data->mutated_secret_tree) tree_free(data->mutated_secret_tree);
   data->mutated_tree = NULL;
+  data->mutated_secret_tree = NULL;
 
 }
@@ -830,20 +830,23 @@ tree_t *read_tree_from_file(const char *filename) {
 
 }
 
-tree_t *load_tree_from_test_case(const char *filename) {
+int load_trees_from_test_case(const char *filename, tree_t **public_tree,
+                              tree_t **secret_tree) {
 
-  tree_t *tree = NULL;
+  if (public_tree) *public_tree = NULL;
+  if (secret_tree) *secret_tree = NULL;
 
   // Read the corresponding test case from file
   int fd = open(filename, O_RDONLY);
-  if (unlikely(fd < 0)) return NULL;  // may not exist
+  if (unlikely(fd < 0)) return -1;  // may not exist
 
   struct stat info;
   if (unlikely(fstat(fd, &info) != 0)) {
 
     // error, no file info
     perror("Cannot get file information");
-    return NULL;
+    close(fd);
+    return -1;
 
   }
 
@@ -853,7 +856,8 @@ tree_t *load_tree_from_test_case(const char *filename) {
   if (unlikely(buf == MAP_FAILED)) {
 
     perror("Cannot map the test case file to the memory");
-    return NULL;
+    close(fd);
+    return -1;
 
   }
 
@@ -861,20 +865,40 @@ tree_t *load_tree_from_test_case(const char *filename) {
 
   uint8_t *public_in, *secret_in;
   uint32_t public_len, secret_len;
-  find_public_and_secret_inputs((char *)buf, file_size, &public_in, &public_len, &secret_in, &secret_len);
-  free(secret_in);
+  int      ret = find_public_and_secret_inputs((char *)buf, file_size, &public_in,
+                                               &public_len, &secret_in,
+                                               &secret_len);
+  munmap(buf, file_size);
+  if (unlikely(ret != 0)) return -1;
 
-  // Deserialize the data to recover the tree
-  tree = tree_from_buf(public_in, public_len);
+  // Parse both parts independently, each one is a test case of its own
+  if (public_tree) *public_tree = tree_from_buf(public_in, public_len);
+  if (secret_tree) *secret_tree = tree_from_buf(secret_in, secret_len);
   free(public_in);
-  munmap(buf, file_size);
-  if (unlikely(!tree)) {
+  free(secret_in);
+
+  if (unlikely((public_tree && !*public_tree) ||
+               (secret_tree && !*secret_tree))) {
 
     // error, cannot parse the data
-    return NULL;
+    if (public_tree && *public_tree) tree_free(*public_tree);
+    if (secret_tree && *secret_tree) tree_free(*secret_tree);
+    if (public_tree) *public_tree = NULL;
+    if (secret_tree) *secret_tree = NULL;
+    return -1;
 
   }
 
+  return 0;
+
+}
+
+tree_t *load_tree_from_test_case(const char *filename) {
+
+  tree_t *tree = NULL;
+
+  if (load_trees_from_test_case(filename, &tree, NULL) != 0) return NULL;
+
   return tree;
 
 }
@@ -0,0 +1,153 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   In-memory cache of serialized trees, so that revisiting a queue entry does
+   not have to read (and for leakage test cases, two) tree files again.
+
+ */
+
+#include "map.h"
+#include "tree_cache.h"
+#include "utils.h"
+
+typedef struct tree_cache_entry {
+
+  uint8_t *public_ser;
+  size_t   public_len;
+
+  uint8_t *secret_ser;
+  size_t   secret_len;
+
+} tree_cache_entry_t;
+
+typedef map_t(tree_cache_entry_t) tree_cache_map_t;
+
+static tree_cache_map_t tree_cache;
+static size_t           tree_cache_bytes;
+static size_t           tree_cache_max_bytes;
+
+// Trees are put right after they have been serialized, to be written to
+// their file or when they were read from there, so their ser_buf is taken
+// as it is
+static uint8_t *copy_serialized(tree_t *tree, size_t *len) {
+
+  *len = 0;
+  if (!tree || !tree->ser_len) return NULL;
+
+  uint8_t *buf = (uint8_t *)malloc(tree->ser_len);
+  if (unlikely(!buf)) return NULL;
+
+  memcpy(buf, tree->ser_buf, tree->ser_len);
+  *len = tree->ser_len;
+  return buf;
+
+}
+
+// A tree from its cached form, which it also keeps as its ser_buf: it is
+// serialized as it was when it was put
+static tree_t *restore_serialized(uint8_t *ser, size_t len) {
+
+  if (!ser) return NULL;
+
+  tree_t *tree = tree_deserialize(ser, len);
+  if (!tree) return NULL;
+
+  if (likely(maybe_grow(BUF_PARAMS(tree, ser), len))) {
+
+    memcpy(tree->ser_buf, ser, len);
+    tree->ser_len = len;
+
+  }
+
+  return tree;
+
+}
+
+static void free_entry(tree_cache_entry_t *entry) {
+
+  tree_cache_bytes -= entry->public_len + entry->secret_len;
+  free(entry->public_ser);
+  free(entry->secret_ser);
+
+}
+
+void tree_cache_init(size_t max_bytes) {
+
+  map_init(&tree_cache);
+  tree_cache_bytes = 0;
+  tree_cache_max_bytes = max_bytes;
+
+}
+
+void tree_cache_put(const char *key, tree_t *public_tree, tree_t *secret_tree) {
+
+  if (!key || !*key || !tree_cache_max_bytes) return;
+
+  tree_cache_entry_t entry;
+  entry.public_ser = copy_serialized(public_tree, &entry.public_len);
+  entry.secret_ser = copy_serialized(secret_tree, &entry.secret_len);
+
+  tree_cache_entry_t *old = map_get(&tree_cache, key);
+  if (old) {
+
+    free_entry(old);
+    map_remove(&tree_cache, key);
+
+  }
+
+  // Simply start over once we are out of budget: entries are cheap to
+  // recover from the tree files, and queue entries are visited in order.
+  if (tree_cache_bytes + entry.public_len + entry.secret_len >
+      tree_cache_max_bytes) {
+
+    tree_cache_clear();
+    map_init(&tree_cache);
+
+  }
+
+  tree_cache_bytes += entry.public_len + entry.secret_len;
+  map_set(&tree_cache, key, entry);
+
+}
+
+bool tree_cache_get(const char *key, tree_t **public_tree,
+                    tree_t **secret_tree) {
+
+  if (public_tree) *public_tree = NULL;
+  if (secret_tree) *secret_tree = NULL;
+
+  if (!key || !*key) return false;
+
+  tree_cache_entry_t *entry = map_get(&tree_cache, key);
+  if (!entry) return false;
+
+  if (public_tree)
+    *public_tree = restore_serialized(entry->public_ser, entry->public_len);
+  if (secret_tree)
+    *secret_tree = restore_serialized(entry->secret_ser, entry->secret_len);
+
+  return true;
+
+}
+
+void tree_cache_clear() {
+
+  const char *key;
+  map_iter_t  iter = map_iter(&tree_cache);
+  while ((key = map_next(&tree_cache, &iter))) {
+
+    free_entry(map_get(&tree_cache, key));
+
+  }
+
+  map_deinit(&tree_cache);
+  tree_cache_bytes = 0;
+
+}
@@ -0,0 +1,149 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include "f1_c_fuzz.h"
+#include "tree_cache.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+#include "gtest_ext.h"
+
+class TreeCacheTest : public ::testing::Test {
+
+ protected:
+  tree_t *public_tree;
+  tree_t *secret_tree;
+
+  TreeCacheTest() {
+
+    public_tree = nullptr;
+    secret_tree = nullptr;
+
+  }
+
+  void SetUp() override {
+
+    random_set_seed(0);
+    tree_cache_init(1 << 20);
+    public_tree = gen_init__(100);
+    secret_tree = gen_init__(100);
+
+    // The cache takes trees as they were last serialized
+    tree_serialize(public_tree);
+    tree_serialize(secret_tree);
+
+  }
+
+  void TearDown() override {
+
+    tree_free(public_tree);
+    tree_free(secret_tree);
+    tree_cache_clear();
+
+  }
+
+};
+
+TEST_F(TreeCacheTest, MissingKey) {
+
+  tree_t *a = nullptr, *b = nullptr;
+  EXPECT_FALSE(tree_cache_get("queue/id:000000", &a, &b));
+  EXPECT_EQ(a, nullptr);
+  EXPECT_EQ(b, nullptr);
+
+}
+
+TEST_F(TreeCacheTest, PutAndGetBothParts) {
+
+  tree_cache_put("queue/id:000000", public_tree, secret_tree);
+
+  tree_t *a = nullptr, *b = nullptr;
+  EXPECT_TRUE(tree_cache_get("queue/id:000000", &a, &b));
+  ASSERT_NE(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  EXPECT_TRUE(tree_equal(public_tree, a));
+  EXPECT_TRUE(tree_equal(secret_tree, b));
+
+  tree_free(a);
+  tree_free(b);
+
+}
+
+TEST_F(TreeCacheTest, HitIsSerialized) {
+
+  tree_cache_put("queue/id:000000", public_tree, nullptr);
+
+  // A recovered tree comes with its serialized form, ready to be put again
+  tree_t *a = nullptr;
+  EXPECT_TRUE(tree_cache_get("queue/id:000000", &a, nullptr));
+  ASSERT_NE(a, nullptr);
+  ASSERT_EQ(a->ser_len, public_tree->ser_len);
+  EXPECT_EQ(memcmp(a->ser_buf, public_tree->ser_buf, a->ser_len), 0);
+  tree_free(a);
+
+}
+
+TEST_F(TreeCacheTest, SinglePart) {
+
+  tree_cache_put("queue/id:000000", nullptr, secret_tree);
+
+  tree_t *a = nullptr, *b = nullptr;
+  EXPECT_TRUE(tree_cache_get("queue/id:000000", &a, &b));
+  EXPECT_EQ(a, nullptr);
+  ASSERT_NE(b, nullptr);
+  EXPECT_TRUE(tree_equal(secret_tree, b));
+  tree_free(b);
+
+  // Skipped parts are not recovered
+  EXPECT_TRUE(tree_cache_get("queue/id:000000", nullptr, nullptr));
+
+}
+
+TEST_F(TreeCacheTest, Overwrite) {
+
+  tree_cache_put("queue/id:000000", public_tree, nullptr);
+  tree_cache_put("queue/id:000000", secret_tree, nullptr);
+
+  tree_t *a = nullptr;
+  EXPECT_TRUE(tree_cache_get("queue/id:000000", &a, nullptr));
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(tree_equal(secret_tree, a));
+  tree_free(a);
+
+}
+
+TEST_F(TreeCacheTest, FlushWhenFull) {
+
+  tree_cache_clear();
+  tree_cache_init(public_tree->ser_len + 1);
+
+  tree_cache_put("queue/id:000000", public_tree, nullptr);
+  EXPECT_TRUE(tree_cache_get("queue/id:000000", nullptr, nullptr));
+
+  // Does not fit next to the first one
+  tree_cache_put("queue/id:000001", public_tree, nullptr);
+  EXPECT_FALSE(tree_cache_get("queue/id:000000", nullptr, nullptr));
+  EXPECT_TRUE(tree_cache_get("queue/id:000001", nullptr, nullptr));
+
+}
+
+TEST_F(TreeCacheTest, Disabled) {
+
+  tree_cache_clear();
+  tree_cache_init(0);
+
+  tree_cache_put("queue/id:000000", public_tree, secret_tree);
+  EXPECT_FALSE(tree_cache_get("queue/id:000000", nullptr, nullptr));
+
+}
@@ -160,6 +160,41 @@ def fuzz(buf, add_buf, max_size):
 #     '''
 #     return prob
 #
+# def fuzz_leak(public, secret, max_size):
+#     '''
+#     Called instead of `fuzz` when afl-fuzz is hunting for leaks. Mutates
+#     the public and the secret part of a testcase at the same time.
+#
+#     @type public: bytearray
+#     @param public: The public part of the test case
+#
+#     @type secret: bytearray
+#     @param secret: The secret part of the test case
+#
+#     @type max_size: int
+#     @param max_size: Maximum size of either mutated part
+#
+#     @rtype: tuple
+#     @return: A (public, secret) tuple of bytearrays
+#     '''
+#     return mutated_public, mutated_secret
+#
+# def havoc_mutation_secret(buf, max_size):
+#     '''
+#     Like `havoc_mutation`, but for the secret part of a test case when
+#     afl-fuzz is hunting for leaks.
+#
+#     @type buf: bytearray
+#     @param buf: The secret that should be mutated.
+#
+#     @type max_size: int
+#     @param max_size: Maximum size of the mutated output.
+#
+#     @rtype: bytearray
+#     @return: A new bytearray containing the mutated secret
+#     '''
+#     return mutated_buf
+#
 # def queue_get(filename):
 #     '''
 #     Called at the beginning of each fuzz iteration to determine whether the
@@ -163,6 +163,7 @@ struct queue_entry {
       was_fuzzed,                       /* historical, but needed for MOpt  */
       passed_det,                       /* Deterministic stages passed?     */
       has_new_cov,                      /* Triggers new coverage?           */
+      has_new_taint,                    /* New branches on the secret?      */
       var_behavior,                     /* Variable behavior?               */
       favored,                          /* Currently favored?               */
       fs_redundant,                     /* Marked as redundant in the fs?   */
@@ -203,6 +204,50 @@ struct queue_entry {
 
 };
 
+struct secret_entry {
+
+  u8 *buf;                              /* Secret input data                */
+  u32 len;                              /* Secret input length              */
+  u64 hash;                             /* hash64() of the secret input     */
+  u32 next;                             /* 1 + next secret with this hash   */
+
+};
+
+struct leak_bucket {
+
+  u64 signature;                        /* Output diff and coverage diff    */
+  u64 count;                            /* Confirmed leaks in this bucket   */
+  u32 id;                               /* Bucket id, starting at 1         */
+  u32 first_leak_id;                    /* First exemplar in the leak log   */
+  u32 diff_offset;                      /* First differing output byte      */
+  u32 cov_edges;                        /* Edges only one secret covers     */
+
+};
+
+/* Result of an earlier exec, see afl-fuzz-execcache.c */
+
+struct leak_exec_result {
+
+  u64 key;                              /* hash64() of the testcase, 0=free */
+  u64 cksum;                            /* Trace checksum, for n_fuzz only  */
+  u64 output_hash;                      /* Observation of the clean run     */
+
+};
+
+/* Where execs go when hunting for leaks, see leak_phase_execs */
+
+enum leak_exec_phase {
+
+  /* 00 */ LEAK_PHASE_PUBLIC,               /* Mutating the public input    */
+  /* 01 */ LEAK_PHASE_SECRET,               /* Mutating the secret input    */
+  /* 02 */ LEAK_PHASE_FULL,                 /* Mutating both                */
+  /* 03 */ LEAK_PHASE_PAIRING,              /* Secret pool pairing stage    */
+  /* 04 */ LEAK_PHASE_STABILITY,            /* Re-runs of leak candidates   */
+  /* 05 */ LEAK_PHASE_BUCKET,               /* Re-runs for leak bucketing   */
+  /* 06 */ LEAK_PHASE_COUNT
+
+};
+
 struct extra_data {
 
   u8 *data;                             /* Dictionary token data            */
@@ -244,6 +289,7 @@ enum {
   /* 18 */ STAGE_CUSTOM_MUTATOR,
   /* 19 */ STAGE_COLORIZATION,
   /* 20 */ STAGE_ITS,
+  /* 21 */ STAGE_SECRET_PAIRING,
 
   STAGE_NUM_MAX
 
@@ -340,6 +386,9 @@ enum {
   /* 11 */ PY_FUNC_QUEUE_NEW_ENTRY,
   /* 12 */ PY_FUNC_INTROSPECTION,
   /* 13 */ PY_FUNC_DESCRIBE,
+  /* 14 */ PY_FUNC_FUZZ_LEAK,
+  /* 15 */ PY_FUNC_HAVOC_MUTATION_SECRET,
+  /* 16 */ PY_FUNC_LEAK_PHASE,
   PY_FUNC_COUNT
 
 };
@@ -362,6 +411,15 @@ typedef struct py_mutator {
   u8 *   havoc_buf;
   size_t havoc_size;
 
+  u8 *   fuzz_leak_pub_buf;
+  size_t fuzz_leak_pub_size;
+
+  u8 *   fuzz_leak_sec_buf;
+  size_t fuzz_leak_sec_size;
+
+  u8 *   havoc_secret_buf;
+  size_t havoc_secret_size;
+
 } py_mutator_t;
 
 #endif
@@ -392,14 +450,17 @@ typedef struct afl_env_vars {
       afl_force_ui, afl_i_dont_care_about_missing_crashes, afl_bench_just_one,
       afl_bench_until_crash, afl_debug_child, afl_autoresume, afl_cal_fast,
       afl_cycle_schedules, afl_expand_havoc, afl_statsd, afl_cmplog_only_new,
-      afl_exit_on_seed_issues, afl_try_affinity;
+      afl_exit_on_seed_issues, afl_try_affinity, afl_leak_snapshot,
+      afl_leak_batch, afl_leak_obs_map, afl_leak_dual_fsrv;
 
   u8 *afl_tmpdir, *afl_custom_mutator_library, *afl_python_module, *afl_path,
       *afl_hang_tmout, *afl_forksrv_init_tmout, *afl_preload,
       *afl_max_det_extras, *afl_statsd_host, *afl_statsd_port,
       *afl_crash_exitcode, *afl_statsd_tags_flavor, *afl_testcache_size,
       *afl_testcache_entries, *afl_kill_signal, *afl_target_env,
-      *afl_persistent_record, *afl_exit_on_time;
+      *afl_persistent_record, *afl_exit_on_time, *afl_leak_secrets_dir,
+      *afl_leak_secret_spec,
+      *afl_leak_bucket_exemplars, *afl_leak_exec_cache;
 
 } afl_env_vars_t;
 
@@ -425,6 +486,7 @@ typedef struct afl_state {
   afl_forkserver_t fsrv;
   sharedmem_t      shm;
   sharedmem_t *    shm_fuzz;
+  sharedmem_t *    shm_leak_obs;
   afl_env_vars_t   afl_env;
 
   char **argv;                                            /* argv if needed */
@@ -766,11 +828,75 @@ typedef struct afl_state {
   u32   bitsmap_size;
 #endif
 
-  struct hashmap *public_input_to_output_map;
+  struct leak_iomap *public_input_to_output_map;
 
   u32 detected_leaks_count;
   u32 stored_hypertest_leaks_count;
 
+  /* Independent pool of secret inputs, paired with public inputs */
+  struct secret_entry *secret_pool;
+  u32                  secret_pool_cnt,     /* Secrets in the pool          */
+      secret_pool_cursor,                   /* Next secret to pair with     */
+      secret_pool_grown;                    /* Secrets added while fuzzing  */
+  struct hashmap *secret_pool_map;          /* Pool index by secret hash    */
+
+  /* Append-only log of confirmed leaks in leaks/ */
+  struct leak_log *leak_log;
+
+  /* Confirmed leaks, bucketed by root cause */
+  struct leak_bucket *leak_buckets;
+  struct hashmap *    leak_bucket_map;      /* Signature to bucket index    */
+  u8 *                leak_bucket_trace;    /* Scratch copy of trace_bits   */
+  u8 *                leak_bucket_saved;    /* ... and of the run's output  */
+  u32                 leak_buckets_cnt,     /* Buckets seen so far          */
+      leak_bucket_exemplars;                /* Leaks logged per bucket      */
+  u64 confirmed_leaks_count;                /* Including unlogged ones      */
+
+  /* Leakage statistics */
+  u64 last_leak_time,                       /* Last confirmed leak (ms)     */
+      leak_unstable_rejects,                /* Candidates with flaky output */
+      leaks_imported,                       /* Logged from other instances  */
+      leak_io_map_bytes,                    /* Buffers held by the io map   */
+      leak_phase_execs[LEAK_PHASE_COUNT];   /* Execs per leak_exec_phase    */
+  u8 leak_exec_phase;                       /* Phase of the current exec    */
+
+  /* MOpt operator stats of the havoc phases (public, secret, full), -L */
+  u64 leak_mopt_cycles[LEAK_PHASE_FULL + 1][operator_num],
+      leak_mopt_finds[LEAK_PHASE_FULL + 1][operator_num];
+
+  /* Results of recent execs, by testcase hash */
+  struct leak_exec_result *leak_exec_cache;
+  u32                      leak_exec_cache_size;  /* Entries, power of 2    */
+  u64 leak_exec_cache_lookups,              /* Execs that asked the cache   */
+      leak_exec_cache_hits;                 /* ... and did not need to run  */
+
+  /* Batches of secrets run in-process by the target, see leak_obs.h */
+  u8  leak_batch;                           /* Target takes batches         */
+  u64 leak_batch_execs,                     /* Batch execs                  */
+      leak_batch_secrets,                   /* Secrets they covered         */
+      leak_batch_reruns;                    /* ... that had to run alone    */
+
+  /* What a valid secret looks like, from AFL_LEAK_SECRET_SPEC */
+  struct leak_secret_spec *secret_spec;
+  u64 leak_secret_fitted;                   /* Secrets made to fit it       */
+
+  /* Fork server for the second secret of a pair, with AFL_LEAK_DUAL_FSRV */
+  afl_forkserver_t leak_fsrv;
+  sharedmem_t      leak_shm, *leak_shm_fuzz, *leak_shm_obs;
+  u64              leak_dual_pairs;         /* Pairs run side by side       */
+
+  /* Branches on the secret, for targets built with AFL_USE_DFSAN */
+  u8  leak_taint;                           /* Target reports them          */
+  u8 *virgin_taint;                         /* Taint map edges not seen yet */
+  u32 leak_taint_edges,                     /* Tainted edges seen so far    */
+      queued_with_taint;                    /* Entries that found new ones  */
+
+  /* Output classes per path, with AFL_LEAK_OBS_MAP */
+  u8 *leak_obs_seen;                        /* (cksum, output) pairs seen   */
+  u8 *leak_obs_path_cnt;                    /* Classes queued per path slot */
+  u32 leak_obs_classes,                     /* Pairs seen so far            */
+      queued_with_obs;                      /* Entries queued only for one  */
+
 } afl_state_t;
 
 struct custom_mutator {
@@ -841,6 +967,49 @@ struct custom_mutator {
   size_t (*afl_custom_fuzz)(void *data, u8 *buf, size_t buf_size, u8 **out_buf,
                             u8 *add_buf, size_t add_buf_size, size_t max_size);
 
+  /**
+   * Perform custom mutations on a leakage testcase, i.e. on its public and
+   * secret parts at the same time. If present, this is used instead of
+   * afl_custom_fuzz when afl-fuzz is hunting for leaks, so the mutator never
+   * has to deal with the serialized testcase format.
+   *
+   * (Optional)
+   *
+   * @param data pointer returned in afl_custom_init by this custom mutator
+   * @param[in] pub_buf Public part of the input
+   * @param[in] pub_size Size of the public part
+   * @param[in] sec_buf Secret part of the input
+   * @param[in] sec_size Size of the secret part
+   * @param[out] out_pub the new public buffer. May reuse pub_buf.
+   *             *out_pub = NULL is treated as FATAL.
+   * @param[out] out_sec the new secret buffer. May reuse sec_buf.
+   *             *out_sec = NULL is treated as FATAL.
+   * @param[out] out_sec_size Size of the mutated secret part
+   * @param[in] max_size Maximum size of either mutated part.
+   * @return Size of the mutated public part. If either part is empty, the
+   *         result is not run (with a warning the first time).
+   */
+  size_t (*afl_custom_fuzz_leak)(void *data, u8 *pub_buf, size_t pub_size,
+                                 u8 *sec_buf, size_t sec_size, u8 **out_pub,
+                                 u8 **out_sec, size_t *out_sec_size,
+                                 size_t max_size);
+
+  /**
+   * Tell a leakage-aware mutator which part afl-fuzz wants mutated by the
+   * afl_custom_fuzz_leak calls that follow: LEAK_PHASE_PUBLIC (0),
+   * LEAK_PHASE_SECRET (1) or LEAK_PHASE_FULL (2). If present, the custom
+   * mutator stage goes through the three phases in this order, calling
+   * this and then afl_custom_fuzz_count (if present) at the start of each.
+   * Without it, afl_custom_fuzz_leak is called in a single LEAK_PHASE_FULL
+   * pass and picks the part itself.
+   *
+   * (Optional)
+   *
+   * @param data pointer returned in afl_custom_init by this custom mutator
+   * @param[in] phase The LEAK_PHASE_* of the calls that follow
+   */
+  void (*afl_custom_leak_phase)(void *data, u8 phase);
+
   /**
    * Describe the current testcase, generated by the last mutation.
    * This will be called, for example, to give the written testcase a name
@@ -961,6 +1130,25 @@ struct custom_mutator {
    */
   u8 (*afl_custom_havoc_mutation_probability)(void *data);
 
+  /**
+   * Perform a single custom mutation on the secret part of a leakage
+   * testcase. Stacked with the other mutations while havoc works on secrets,
+   * with the same probability as afl_custom_havoc_mutation.
+   *
+   * (Optional)
+   *
+   * @param[in] data pointer returned in afl_custom_init by this custom mutator
+   * @param[in] buf Pointer to the secret to be mutated
+   * @param[in] buf_size Size of the secret
+   * @param[out] out_buf The new buffer. It's legal to reuse *buf if it's <
+   * buf_size.
+   * @param[in] max_size Maximum size of the mutated output.
+   * @return Size of the mutated output (out_size).
+   */
+  size_t (*afl_custom_havoc_mutation_secret)(void *data, u8 *buf,
+                                             size_t buf_size, u8 **out_buf,
+                                             size_t max_size);
+
   /**
    * Determine whether the fuzzer should fuzz the current queue entry or not.
    *
@@ -1007,6 +1195,8 @@ void afl_states_request_skip(void);
 
 /* Setup shmem for testcase delivery */
 void setup_testcase_shmem(afl_state_t *afl);
+void setup_leak_obs_shmem(afl_state_t *afl);
+void setup_leak_fsrv(afl_state_t *afl);
 
 void read_afl_environment(afl_state_t *, char **);
 
@@ -1030,6 +1220,10 @@ s32         init_trim_py(void *, u8 *, size_t);
 s32         post_trim_py(void *, u8);
 size_t      trim_py(void *, u8 **);
 size_t      havoc_mutation_py(void *, u8 *, size_t, u8 **, size_t);
+size_t      fuzz_leak_py(void *, u8 *, size_t, u8 *, size_t, u8 **, u8 **,
+                         size_t *, size_t);
+size_t      havoc_mutation_secret_py(void *, u8 *, size_t, u8 **, size_t);
+void        leak_phase_py(void *, u8);
 u8          havoc_mutation_probability_py(void *);
 u8          queue_get_py(void *, const u8 *);
 const char *introspection_py(void *);
@@ -1069,7 +1263,10 @@ u8 *describe_op(afl_state_t *, u8, size_t);
 #endif
 u8 save_if_interesting(afl_state_t *, void *, u32, u8);
 u8 has_new_bits(afl_state_t *, u8 *);
+u8 has_new_bits_fsrv(afl_state_t *, afl_forkserver_t *, u8 *);
 u8 has_new_bits_unclassified(afl_state_t *, u8 *);
+u8 has_new_bits_unclassified_fsrv(afl_state_t *, afl_forkserver_t *, u8 *);
+u8 skim_new_bits(afl_state_t *, u8 *);
 
 /* Extras */
 
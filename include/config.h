@@ -392,6 +392,8 @@
 #define AS_LOOP_ENV_VAR "__AFL_AS_LOOPCHECK"
 #define PERSIST_ENV_VAR "__AFL_PERSISTENT"
 #define DEFER_ENV_VAR "__AFL_DEFER_FORKSRV"
+#define LEAK_SNAPSHOT_ENV_VAR "__AFL_LEAK_SNAPSHOT"
+#define LEAK_OBS_SHM_ENV_VAR "__AFL_LEAK_OBS_SHM_ID"
 
 /* In-code signatures for deferred and persistent mode. */
 
@@ -415,6 +417,12 @@
 
 #define FORKSRV_FD 198
 
+/* Control and status pipe of the secret snapshot process, see
+   __afl_leak_snapshot() (the application will use LEAK_SNAPSHOT_FD and
+   LEAK_SNAPSHOT_FD + 1): */
+
+#define LEAK_SNAPSHOT_FD (FORKSRV_FD + 2)
+
 /* Fork server init timeout multiplier: we'll wait the user-selected
    timeout plus this much for the fork server to spin up. */
 
@@ -506,5 +514,72 @@
 
 #define AFL_TXT_STRING_MAX_MUTATIONS 6
 
+/* Leakage hunting */
+
+/* Maximum number of entries kept in the independent secret pool: */
+
+#define SECRET_POOL_MAX 4096
+
+/* Number of pooled secrets each public input is paired with per fuzz_one: */
+
+#define SECRET_PAIRING_BATCH 16
+
+/* Most secrets a batch harness runs per exec, see leak_obs.h (must be at
+   least SECRET_PAIRING_BATCH): */
+
+#define LEAK_BATCH_MAX 16
+
+/* Write buffer size for each of the two leak log files (leaks/index and
+   leaks/blobs), see leak_log.h: */
+
+#define LEAK_LOG_BUF_SIZE (64 * 1024)
+
+/* Confirmed leaks written to the leak log per root cause bucket, the rest
+   are only counted (AFL_LEAK_BUCKET_EXEMPLARS, 0 = log all): */
+
+#define LEAK_BUCKET_EXEMPLARS 3
+
+/* Output bytes before the first difference that go into a leak bucket
+   signature: */
+
+#define LEAK_BUCKET_CONTEXT 16
+
+/* Entries in the cache of recent exec results that lets repeated testcases
+   skip the target (AFL_LEAK_EXEC_CACHE, 0 = off; rounded up to a power of
+   2): */
+
+#define LEAK_EXEC_CACHE_SIZE 65536
+
+/* Descriptors utils/libleakobs can observe (AFL_LEAK_OBS_FDS, 0 up to this
+   value minus one): */
+
+#define LEAK_OBS_MAX_FD 1024
+
+/* Size of the map of edges between secret-tainted branches that targets
+   built with AFL_USE_DFSAN report (power of 2): */
+
+#define LEAK_TAINT_MAP_SIZE 4096
+
+/* Most bytes of __AFL_LEAK_OBSERVE() observations afl-fuzz gets back through
+   the observation shm when it stores a leak, see leak_obs.h: */
+
+#define LEAK_OBS_BYTES_SIZE MAX_FILE
+
+/* Bits in the map of (coverage, output) pairs seen so far that
+   AFL_LEAK_OBS_MAP adds (power of 2, 2^20 bits take 128 kB): */
+
+#define LEAK_OBS_MAP_SIZE (1 << 20)
+
+/* Most output classes a single path can add to the queue through that map,
+   counted per slot of a table of LEAK_OBS_PATHS (power of 2): */
+
+#define LEAK_OBS_PATH_CLASSES 8
+#define LEAK_OBS_PATHS 65536
+
+/* Most ranges per clause, and bytes@ clauses, in AFL_LEAK_SECRET_SPEC: */
+
+#define LEAK_SPEC_MAX_RANGES 16
+#define LEAK_SPEC_MAX_AT 32
+
 #endif                                                  /* ! _HAVE_CONFIG_H */
 
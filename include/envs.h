@@ -101,6 +101,15 @@ static char *afl_environment_variables[] = {
     "AFL_REAL_LD",
     "AFL_LD_PRELOAD",
     "AFL_LD_VERBOSE",
+    "AFL_LEAK_BATCH",
+    "AFL_LEAK_BUCKET_EXEMPLARS",
+    "AFL_LEAK_DUAL_FSRV",
+    "AFL_LEAK_EXEC_CACHE",
+    "AFL_LEAK_OBS_MAP",
+    "AFL_LEAK_OBS_FDS",
+    "AFL_LEAK_SECRETS_DIR",
+    "AFL_LEAK_SECRET_SPEC",
+    "AFL_LEAK_SNAPSHOT",
     "AFL_LLVM_ALLOWLIST",
     "AFL_LLVM_DENYLIST",
     "AFL_LLVM_BLOCKLIST",
@@ -201,6 +210,7 @@ static char *afl_environment_variables[] = {
     "AFL_USE_UBSAN",
     "AFL_USE_CFISAN",
     "AFL_USE_LSAN",
+    "AFL_USE_DFSAN",
     "AFL_WINE_PATH",
     "AFL_NO_SNAPSHOT",
     "AFL_EXPAND_HAVOC_NOW",
@@ -77,6 +77,26 @@ typedef struct afl_forkserver {
   u32 stdout_raw_buffer_len;          /* Length of raw stdout output stored */
   u32 stdout_raw_buffer_alloced;   /* Allocated bytes for stdout_raw_buffer */
 
+  bool leak_snapshot;                   /* Fork runs from a secret snapshot */
+  s32  leak_snap_ctl_fd,                /* Control pipe of snapshot process */
+      leak_snap_st_fd;                  /* Status pipe of snapshot process  */
+  s32 leak_snap_pid;                    /* Snapshot process, 0 if none      */
+  u64 leak_snap_key,                    /* Public input of the next run     */
+      leak_snap_last_key,               /* Public input of the last run     */
+      leak_snap_taken_key;              /* Public input of the snapshot     */
+  u8  leak_snap_requested;              /* Request waiting in the pipe      */
+  u8  leak_snap_running;                /* Current run forked from snapshot */
+  u64 leak_snap_execs;                  /* Runs forked from a snapshot      */
+  u8 *leak_snap_prefix;                 /* Output written before snapshot   */
+  u32 leak_snap_prefix_len;             /* Length of leak_snap_prefix       */
+  u8  leak_snap_bypass;                 /* Run without the snapshot         */
+
+  struct leak_obs_map *leak_obs;        /* Observations shared with target  */
+  u8  leak_obs_digested;                /* Last run published a digest only */
+  u64 leak_obs_digest;                  /* ... and this is it               */
+  u8  leak_obs_cut_warned;              /* Warned about a cut observation   */
+  bool leak_taint;                      /* Target reports tainted branches  */
+
   bool use_shmem_fuzz;                  /* use shared mem for test cases    */
 
   bool support_shmem_fuzz;              /* set by afl-fuzz                  */
@@ -146,6 +166,11 @@ void afl_fsrv_start(afl_forkserver_t *fsrv, char **argv,
 u32  afl_fsrv_get_mapsize(afl_forkserver_t *fsrv, char **argv,
                           volatile u8 *stop_soon_p, u8 debug_child_output);
 void afl_fsrv_write_to_testcase(afl_forkserver_t *fsrv, u8 *buf, size_t len);
+void afl_fsrv_read_stdout(afl_forkserver_t *fsrv);
+u8 afl_fsrv_run_target_start(afl_forkserver_t *fsrv, volatile u8 *stop_soon_p);
+fsrv_run_result_t afl_fsrv_run_target_finish(afl_forkserver_t *fsrv,
+                                             u32               timeout,
+                                             volatile u8 *     stop_soon_p);
 fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
                                       volatile u8 *stop_soon_p);
 void              afl_fsrv_killall(void);
@@ -0,0 +1,77 @@
+/*
+   american fuzzy lop++ - leak log format
+   --------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Confirmed leaks are appended to two files in <out_dir>/leaks:
+
+     index - a leak_log_header, followed by one fixed-size leak_log_record
+             per leak. Record n (counting from 0) holds leak id n + 1.
+
+     blobs - content-addressed storage. Every public input, secret input and
+             target output is stored once, as a leak_log_blob header followed
+             by the data. Records refer to blobs by offset, identical data
+             shared by several leaks is only written the first time.
+
+   Both files are append-only and written in host byte order. afl-fuzz
+   always flushes blobs before the index, so a reader never sees a record
+   whose data is missing. Use afl-leak-export to turn records back into
+   reproducers.
+
+ */
+
+#ifndef _AFL_LEAK_LOG_H
+#define _AFL_LEAK_LOG_H
+
+#include "types.h"
+
+#define LEAK_LOG_INDEX "index"
+#define LEAK_LOG_BLOBS "blobs"
+
+#define LEAK_LOG_MAGIC 0x31474f4c4b41454cULL          /* "LEAKLOG1" on LE */
+#define LEAK_LOG_VERSION 1
+
+struct leak_log_header {
+
+  u64 magic;                            /* LEAK_LOG_MAGIC                   */
+  u32 version;                          /* LEAK_LOG_VERSION                 */
+  u32 record_size;                      /* sizeof(struct leak_log_record)   */
+
+};
+
+struct leak_log_blob {
+
+  u64 hash;                             /* hash64() of the data             */
+  u32 len;                              /* Length of the data that follows  */
+  u32 reserved;
+
+};
+
+struct leak_log_ref {
+
+  u64 offset;                           /* Of the leak_log_blob in blobs    */
+  u32 len;                              /* Length of the data               */
+  u32 reserved;
+
+};
+
+struct leak_log_record {
+
+  u32 id;                               /* Leak id, starting at 1           */
+  u32 bucket;                           /* Root cause bucket, see buckets   */
+  u64 time_ms;                          /* Time since start of the campaign */
+  u64 output_hash[2];                   /* Observations for both secrets    */
+
+  struct leak_log_ref public_input;     /* Shared public input              */
+  struct leak_log_ref secret_input[2];  /* The two secrets                  */
+  struct leak_log_ref output[2];        /* Target output for each secret    */
+
+};
+
+#endif                                                  /* !_AFL_LEAK_LOG_H */
+
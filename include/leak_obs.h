@@ -0,0 +1,60 @@
+/*
+   american fuzzy lop++ - leakage observation shm
+   ----------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   In leakage hunting mode afl-fuzz shares a leak_obs_map with the target
+   (LEAK_OBS_SHM_ENV_VAR, __afl_leak_obs in afl-compiler-rt). A target that
+   observes itself leaves count digests there, each hash64(output, len,
+   HASH_CONST) of what a normal run would write to stdout, and afl-fuzz
+   skips the stdout pipe. Batch harnesses set batch_max and run one
+   leak_batch_header testcase per batch. DFSan targets set taint_active and
+   mark taint_map. bytes[] holds the observed bytes of a want_bytes run.
+
+   See utils/leakage_driver, utils/libleakobs, utils/afl_network_proxy and
+   instrumentation/README.leak_{observe,taint}.md for the writers.
+
+ */
+
+#ifndef _AFL_LEAK_OBS_H
+#define _AFL_LEAK_OBS_H
+
+#include "config.h"
+#include "types.h"
+
+#define LEAK_BATCH_MAGIC 0x484354424b41454cULL          /* "LEAKBTCH" on LE */
+
+#define LEAK_NET_FRAME 0xfe000000U                   /* Network proxy frame */
+#define LEAK_NET_WANT_BYTES 0x1U                   /* ... also wants output */
+
+struct leak_obs_map {
+
+  u32 batch_max;                        /* Secrets per batch the target runs*/
+  u32 count;                            /* Digests written by the last run  */
+  u32 want_bytes;                       /* Set: also write output to stdout */
+  u64 digest[LEAK_BATCH_MAX];           /* One per secret, in batch order   */
+  u32 len[LEAK_BATCH_MAX];              /* Length of each observation       */
+  u32 taint_active;                     /* Target labels its secret (DFSan) */
+  u8  taint_map[LEAK_TAINT_MAP_SIZE];   /* Edges between tainted branches   */
+  u32 kept_bytes;                       /* Run put its output in bytes[]    */
+  u32 bytes_len;                        /* ... this much of it              */
+  u8  bytes[LEAK_OBS_BYTES_SIZE];       /* Explicit observations, want_bytes*/
+
+};
+
+struct leak_batch_header {
+
+  u64 magic;                            /* LEAK_BATCH_MAGIC                 */
+  u32 count;                            /* Secrets in the batch             */
+  u32 public_len;                       /* Length of the public input       */
+  u32 secret_len[LEAK_BATCH_MAX];       /* Lengths of the secrets           */
+
+};
+
+#endif                                                  /* !_AFL_LEAK_OBS_H */
+
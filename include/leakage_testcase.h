@@ -0,0 +1,27 @@
+#ifndef AFLPLUSPLUS_LEAKAGE_TESTCASE_H
+#define AFLPLUSPLUS_LEAKAGE_TESTCASE_H
+
+#include <stdint.h>
+
+// Decode a {"PUBLIC": ..., "SECRET": ...} testcase [MALLOCs both inputs]
+void find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_len,
+                                   uint8_t **public_start_pos, uint32_t *public_len,
+                                   uint8_t **secret_start_pos, uint32_t *secret_len);
+
+// Same, but returns what is wrong with a broken testcase instead of aborting,
+// NULL on success [MALLOCs both inputs on success]
+const char *parse_public_and_secret_inputs(const char *testcase_buf,
+                                           uint32_t testcase_len,
+                                           uint8_t **public_start_pos,
+                                           uint32_t *public_len,
+                                           uint8_t **secret_start_pos,
+                                           uint32_t *secret_len);
+
+// Encode public and secret inputs as a testcase [ck_allocs combined_buf]
+void create_buffer_from_public_and_secret_inputs(
+    const uint8_t *public_input, uint32_t public_input_len,
+    const uint8_t *secret_input, uint32_t secret_input_len,
+    char **combined_buf, uint32_t *combined_buf_len
+);
+
+#endif  // AFLPLUSPLUS_LEAKAGE_TESTCASE_H
@@ -7,15 +7,7 @@
 
 #include <stdint.h>
 
-void find_public_and_secret_inputs(const char *testcase_buf, uint32_t testcase_len,
-                                   uint8_t **public_start_pos, uint32_t *public_len,
-                                   uint8_t **secret_start_pos, uint32_t *secret_len);
-
-void create_buffer_from_public_and_secret_inputs(
-    const uint8_t *public_input, uint32_t public_input_len,
-    const uint8_t *secret_input, uint32_t secret_input_len,
-    char **combined_buf, uint32_t *combined_buf_len
-);
+#include "leakage_testcase.h"
 
 // Fetch decoded (ie not base64) public input for queue entry [MALLOCs]
 void public_input_for_queue_entry(struct queue_entry *q, char **public_input, u32 *public_len);
@@ -29,12 +21,35 @@ u8 leakage_fuzz_stuff(afl_state_t *afl,
                       u8 *secret_in_buf,
                       u32 secret_len);
 
-u8 leakage_save_if_interesting(afl_state_t *afl,
+u8 leakage_fuzz_pair(afl_state_t *afl, u8 *public_in_buf, u32 public_len,
+                     u8 *secret_a_buf, u32 secret_a_len, u8 *secret_b_buf,
+                     u32 secret_b_len);
+
+// Write a testcase for fsrv, which may be afl->leak_fsrv
+void leak_write_to_testcase(afl_state_t *afl, afl_forkserver_t *fsrv,
+                            void *buf, u32 len);
+
+u8 leakage_save_if_interesting(afl_state_t *afl, afl_forkserver_t *fsrv,
                                void *combined_buf, u32 combined_len,
                                u8 *public_input_buf, u32 public_len,
                                u8 *secret_input_buf, u32 secret_len,
                                u8 fault);
 
+// Independent secret pool, see afl-fuzz-secrets.c
+u8   add_to_secret_pool(afl_state_t *afl, u8 *buf, u32 len);
+void load_secret_pool(afl_state_t *afl, u8 *dir);
+void resume_secret_pool(afl_state_t *afl);
+u8   secret_pairing_stage(afl_state_t *afl, u8 *public_buf, u32 public_len);
+
+// Secret format constraints, see afl-fuzz-secretspec.c
+void load_secret_spec(afl_state_t *afl, u8 *spec_str);
+void destroy_secret_spec(afl_state_t *afl);
+u8 * apply_secret_spec(afl_state_t *afl, u8 *buf, u32 *len);
+
+// Secrets run in-process by batch harnesses, see afl-fuzz-leakbatch.c
+u8 leakage_fuzz_batch(afl_state_t *afl, u8 *public_buf, u32 public_len,
+                      u8 **secret_bufs, u32 *secret_lens, u32 cnt);
+
 #define SECRET_BUFS_COUNT 2
 struct input_output_hashes {
   u64 public_input_hash;
@@ -52,8 +67,57 @@ struct input_output_hashes {
   u32 public_output_buf_len[SECRET_BUFS_COUNT];
 };
 
-uint64_t input_hash(const void *input_str_w_len, uint64_t seed0, uint64_t seed1);
+// Table behind the io map, keyed by public_input_hash, see afl-fuzz-iomap.c
+struct leak_iomap *         leak_iomap_new(void);
+struct input_output_hashes *leak_iomap_get(struct leak_iomap *m, u64 key);
+struct input_output_hashes *leak_iomap_put(struct leak_iomap *         m,
+                                           struct input_output_hashes *e);
+u32                         leak_iomap_count(struct leak_iomap *m);
+u64                         leak_iomap_mem(struct leak_iomap *m);
+void                        leak_iomap_free(struct leak_iomap *m);
+
+// Hash of the last run's output on fsrv, or the digest a preloaded
+// libleakobs published for it
+u64 leak_output_hash(afl_forkserver_t *fsrv);
+
+// New edges between branches on the secret in the taint map of fsrv? With
+// update, they are taken out of virgin_taint
+u8 leak_taint_new_bits(afl_state_t *afl, afl_forkserver_t *fsrv, u8 update);
+
+// Size of the io map, for the stats
+u32 leak_io_map_count(afl_state_t *afl);
+u64 leak_io_map_mem(afl_state_t *afl);
+
+// Would this secret and output leave the io map unchanged?
+u8 leak_io_map_settled(afl_state_t *afl, u64 public_input_hash,
+                       u8 *secret_input_buf, u32 secret_len, u64 output_hash);
+
+// Results of recent execs, see afl-fuzz-execcache.c
+u8   leak_exec_cache_lookup(afl_state_t *afl, u64 key, u8 *public_input_buf,
+                            u32 public_len, u8 *secret_input_buf,
+                            u32 secret_len, u8 *fault);
+void leak_exec_cache_add(afl_state_t *afl, afl_forkserver_t *fsrv, u64 key,
+                          u8 fault);
+
+// Append-only leak log in <out_dir>/leaks, see afl-fuzz-leaklog.c
+void leak_log_open(afl_state_t *afl);
+void leak_log_add(afl_state_t *afl, struct input_output_hashes *leak,
+                  u32 bucket);
+u8   leak_log_seen(afl_state_t *afl, u64 public_input_hash);
+void leak_log_sync(afl_state_t *afl, u8 *peer);
+void leak_log_flush(afl_state_t *afl);
+void leak_log_close(afl_state_t *afl);
+
+// Output classes per path, with AFL_LEAK_OBS_MAP
+u8 leak_obs_new_class(afl_state_t *afl, afl_forkserver_t *fsrv,
+                      u64 output_hash);
 
-int32_t input_compare(const void *a, const void *b, void *udata);
+// Root cause buckets for confirmed leaks, see afl-fuzz-leakbucket.c
+struct leak_bucket *leak_bucket_classify(afl_state_t *afl,
+                                         afl_forkserver_t *fsrv,
+                                         struct input_output_hashes *leak);
+void write_leak_buckets(afl_state_t *afl);
+void load_leak_buckets(afl_state_t *afl);
+void leak_buckets_deinit(afl_state_t *afl);
 
 #endif  // AFLPLUSPLUS_LEAKAGE_UTILS_H
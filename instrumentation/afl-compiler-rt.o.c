@@ -14,14 +14,23 @@
 
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+  #define _GNU_SOURCE                                   /* dl_iterate_phdr() */
+#endif
+
 #ifdef __ANDROID__
   #include "android-ashmem.h"
 #endif
 #include "config.h"
 #include "types.h"
 #include "cmplog.h"
+#include "leak_obs.h"
 #include "llvm-alternative-coverage.h"
 
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#undef XXH_INLINE_ALL
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -42,6 +51,8 @@
 #endif
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/select.h>
+#include <sys/ioctl.h>
 
 #if !__GNUC__
   #include "llvm/Config/llvm-config.h"
@@ -49,6 +60,7 @@
 
 #ifdef __linux__
   #include "snapshot-inl.h"
+  #include <link.h>
 #endif
 
 /* This is a somewhat ugly hack for the experimental 'trace-pc-guard' mode.
@@ -118,6 +130,10 @@ int __afl_sharedmem_fuzzing __attribute__((weak));
 struct cmp_map *__afl_cmp_map;
 struct cmp_map *__afl_cmp_map_backup;
 
+/* Observations for afl-fuzz in leakage hunting mode, see leak_obs.h */
+
+struct leak_obs_map *__afl_leak_obs;
+
 /* Child pid? */
 
 static s32 child_pid;
@@ -571,6 +587,46 @@ static void __afl_map_shm(void) {
 
   }
 
+  id_str = getenv(LEAK_OBS_SHM_ENV_VAR);
+
+  if (__afl_debug) {
+
+    fprintf(stderr, "DEBUG: leak obs id_str %s\n",
+            id_str == NULL ? "<null>" : id_str);
+
+  }
+
+  if (id_str) {
+
+#ifdef USEMMAP
+    int shm_fd = shm_open(id_str, O_RDWR, DEFAULT_PERMISSION);
+    if (shm_fd == -1) {
+
+      perror("shm_open() failed\n");
+      send_forkserver_error(FS_ERROR_SHM_OPEN);
+      exit(1);
+
+    }
+
+    __afl_leak_obs = mmap(0, sizeof(struct leak_obs_map),
+                          PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (__afl_leak_obs == MAP_FAILED) { __afl_leak_obs = NULL; }
+#else
+    __afl_leak_obs = (struct leak_obs_map *)shmat(atoi(id_str), NULL, 0);
+    if (__afl_leak_obs == (void *)-1) { __afl_leak_obs = NULL; }
+#endif
+
+    if (!__afl_leak_obs) {
+
+      perror("shmat for leak observations");
+      send_forkserver_error(FS_ERROR_SHM_OPEN);
+      _exit(1);
+
+    }
+
+  }
+
 }
 
 /* unmap SHM. */
@@ -622,6 +678,22 @@ static void __afl_unmap_shm(void) {
 
   }
 
+  if (__afl_leak_obs) {
+
+#ifdef USEMMAP
+
+    munmap((void *)__afl_leak_obs, sizeof(struct leak_obs_map));
+
+#else
+
+    shmdt((void *)__afl_leak_obs);
+
+#endif
+
+    __afl_leak_obs = NULL;
+
+  }
+
   __afl_already_initialized_shm = 0;
 
 }
@@ -1230,6 +1302,346 @@ void __afl_manual_init(void) {
 
 }
 
+/* Running digest of the explicit observations, see __afl_leak_observe(). */
+
+static XXH64_state_t __afl_leak_observe_state;
+static u64           __afl_leak_observe_len;
+static u8            __afl_leak_observe_used;
+
+/* Secret snapshot, called by the target right before it first reads the
+   secret. If afl-fuzz asked for one, a copy of the process is parked here
+   and forks a new child whenever afl-fuzz runs a testcase with the same
+   public input (see LEAK_SNAPSHOT_FD). Returns 1 in such a child: the
+   testcase was replaced, and the secret has to be read from it again.
+   Returns 0 everywhere else.
+
+   What the target wrote to stdout before this point is not written again by
+   the children, so afl-fuzz is told how much of it there is, and puts it in
+   front of their output. Observations made before this point carry over
+   into the children as the start of their digest. */
+
+int __afl_leak_snapshot(void) {
+
+  static u8      done;
+  fd_set         readfds;
+  struct timeval timeout = {0, 0};
+  u8 *           prefix_map;
+  s32            snap_pid, status;
+  u32            cmd, report[2];
+  int            prefix_len = 0;
+  u8             observed;
+
+  if (done || is_persistent || !getenv(LEAK_SNAPSHOT_ENV_VAR)) { return 0; }
+  done = 1;
+
+  /* Runs that store a leak want the bytes of every observation, and a
+     digest that did not come from __afl_leak_observe() cannot be carried
+     over: leave the request to a later run. */
+
+  if (__afl_leak_obs &&
+      (__afl_leak_obs->want_bytes ||
+       (__afl_leak_obs->count && !__afl_leak_observe_used))) {
+
+    return 0;
+
+  }
+
+  observed = __afl_leak_obs && __afl_leak_obs->count;
+
+  FD_ZERO(&readfds);
+  FD_SET(LEAK_SNAPSHOT_FD, &readfds);
+
+  if (select(LEAK_SNAPSHOT_FD + 1, &readfds, NULL, NULL, &timeout) <= 0 ||
+      read(LEAK_SNAPSHOT_FD, &cmd, 4) != 4) {
+
+    return 0;
+
+  }
+
+  /* Coverage up to this point will not be in the map of the runs forked
+     from the snapshot, so keep a copy. */
+
+  prefix_map = malloc(__afl_map_size);
+  if (!prefix_map) { return 0; }
+  memcpy(prefix_map, __afl_area_ptr, __afl_map_size);
+
+  /* Nothing buffered may be inherited, or every child would write it. */
+
+  fflush(stdout);
+  if (ioctl(STDOUT_FILENO, FIONREAD, &prefix_len) < 0 || prefix_len < 0) {
+
+    prefix_len = 0;
+
+  }
+
+  snap_pid = fork();
+
+  if (snap_pid < 0) {
+
+    free(prefix_map);
+    return 0;
+
+  }
+
+  if (snap_pid) {
+
+    /* Tell afl-fuzz before this run can end, then carry on with it. */
+
+    free(prefix_map);
+    report[0] = snap_pid;
+    report[1] = prefix_len;
+    if (write(LEAK_SNAPSHOT_FD + 1, report, 8) != 8) {
+
+      kill(snap_pid, SIGKILL);
+
+    }
+
+    close(LEAK_SNAPSHOT_FD);
+    close(LEAK_SNAPSHOT_FD + 1);
+    return 0;
+
+  }
+
+  /* The snapshot process: a small fork server of its own. */
+
+  while (1) {
+
+    if (read(LEAK_SNAPSHOT_FD, &cmd, 4) != 4) { _exit(0); }
+
+    memcpy(__afl_area_ptr, prefix_map, __afl_map_size);
+
+    child_pid = fork();
+    if (child_pid < 0) { _exit(1); }
+
+    if (!child_pid) {
+
+      close(LEAK_SNAPSHOT_FD);
+      close(LEAK_SNAPSHOT_FD + 1);
+
+      if (observed) {
+
+        __afl_leak_obs->digest[0] = XXH64_digest(&__afl_leak_observe_state);
+        __afl_leak_obs->len[0] = __afl_leak_observe_len;
+        __afl_leak_obs->count = 1;
+
+      }
+
+      return 1;
+
+    }
+
+    if (write(LEAK_SNAPSHOT_FD + 1, &child_pid, 4) != 4 ||
+        waitpid(child_pid, &status, 0) < 0 ||
+        write(LEAK_SNAPSHOT_FD + 1, &status, 4) != 4) {
+
+      _exit(1);
+
+    }
+
+  }
+
+}
+
+/* Secret taint, for targets built with AFL_USE_DFSAN. The DataFlowSanitizer
+   runtime is linked in then, and DFSan puts a conditional callback in front
+   of every branch. afl-cc has the linker send those straight here (--wrap),
+   so the return address is right behind the branch. Without DFSan, labelling
+   the secret does nothing. */
+
+__attribute__((weak)) void dfsan_set_label(u8 label, void *addr, size_t size);
+
+static uintptr_t __afl_leak_taint_prev;
+
+#ifdef __linux__
+
+/* Modules that tainted branches were found in, so that a branch is known by
+   its offset into its module. Load addresses change with ASLR, and from one
+   fork server to the next. */
+
+  #define LEAK_TAINT_MODULES 8
+
+struct __afl_leak_taint_module {
+
+  uintptr_t lo, hi, base;
+
+};
+
+static struct __afl_leak_taint_module
+    __afl_leak_taint_modules[LEAK_TAINT_MODULES];
+static u32 __afl_leak_taint_modules_cnt;
+
+/* Fill in the segment that m->lo lies in. */
+
+static int __afl_leak_taint_find_module(struct dl_phdr_info *info,
+                                        size_t size, void *data) {
+
+  struct __afl_leak_taint_module *m = data;
+
+  (void)size;
+
+  for (u32 i = 0; i < info->dlpi_phnum; ++i) {
+
+    const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+    uintptr_t lo = info->dlpi_addr + ph->p_vaddr;
+
+    if (ph->p_type == PT_LOAD && m->lo >= lo && m->lo < lo + ph->p_memsz) {
+
+      m->lo = lo;
+      m->hi = lo + ph->p_memsz;
+      m->base = info->dlpi_addr;
+      return 1;
+
+    }
+
+  }
+
+  return 0;
+
+}
+
+static uintptr_t __afl_leak_taint_offset(uintptr_t pc) {
+
+  struct __afl_leak_taint_module m = {.lo = pc};
+  u32                            i;
+
+  for (i = 0; i < __afl_leak_taint_modules_cnt; ++i) {
+
+    if (pc - __afl_leak_taint_modules[i].lo <
+        __afl_leak_taint_modules[i].hi - __afl_leak_taint_modules[i].lo) {
+
+      return pc - __afl_leak_taint_modules[i].base;
+
+    }
+
+  }
+
+  if (!dl_iterate_phdr(__afl_leak_taint_find_module, &m)) { return pc; }
+
+  if (__afl_leak_taint_modules_cnt < LEAK_TAINT_MODULES) {
+
+    __afl_leak_taint_modules[__afl_leak_taint_modules_cnt++] = m;
+
+  }
+
+  return pc - m.base;
+
+}
+
+#else
+
+static uintptr_t __afl_leak_taint_offset(uintptr_t pc) {
+
+  return pc;
+
+}
+
+#endif                                                        /* __linux__ */
+
+static void __afl_leak_taint_branch(uintptr_t pc) {
+
+  uintptr_t cur;
+
+  if (!__afl_leak_obs) { return; }
+
+  cur = __afl_leak_taint_offset(pc);
+  cur = (cur >> 4) ^ (cur << 8);
+  __afl_leak_obs->taint_map[(cur ^ __afl_leak_taint_prev) &
+                            (LEAK_TAINT_MAP_SIZE - 1)] = 1;
+  __afl_leak_taint_prev = cur >> 1;
+
+}
+
+/* What DFSan calls in the instrumented code, instead of its runtime. Most
+   branches do not depend on any label. */
+
+void __wrap___dfsan_conditional_callback(u8 label) {
+
+  if (label) {
+
+    __afl_leak_taint_branch((uintptr_t)__builtin_return_address(0));
+
+  }
+
+}
+
+void __wrap___dfsan_conditional_callback_origin(u8 label, u32 origin) {
+
+  (void)origin;
+
+  if (label) {
+
+    __afl_leak_taint_branch((uintptr_t)__builtin_return_address(0));
+
+  }
+
+}
+
+/* Label the secret of the current testcase, see __AFL_LEAK_SECRET(). */
+
+void __afl_leak_secret(void *secret, size_t len) {
+
+  if (!dfsan_set_label) { return; }
+
+  if (__afl_leak_obs) { __afl_leak_obs->taint_active = 1; }
+  __afl_leak_taint_prev = 0;
+
+  if (len) { dfsan_set_label(1, secret, len); }
+
+}
+
+/* Explicit observations, see __AFL_LEAK_OBSERVE(). Everything observed in a
+   run is fed into one running XXH64, published after every call as the only
+   observation of the run (count 1), like utils/libleakobs does for what the
+   target writes. afl-fuzz zeroes count before every run, so that is where a
+   new digest starts. While afl-fuzz sets want_bytes, to store a leak, the
+   bytes are kept in the shm as well: stdout would mix them with whatever
+   else the target prints. */
+
+void __afl_leak_observe(const void *ptr, size_t len) {
+
+  if (!__afl_leak_obs) { return; }
+  __afl_leak_observe_used = 1;
+
+  if (!__afl_leak_obs->count) {
+
+    XXH64_reset(&__afl_leak_observe_state, HASH_CONST);
+    __afl_leak_observe_len = 0;
+    __afl_leak_obs->kept_bytes = __afl_leak_obs->want_bytes;
+    __afl_leak_obs->bytes_len = 0;
+
+  }
+
+  XXH64_update(&__afl_leak_observe_state, ptr, len);
+  __afl_leak_observe_len += len;
+
+  if (__afl_leak_obs->kept_bytes) {
+
+    u32 room = LEAK_OBS_BYTES_SIZE - __afl_leak_obs->bytes_len;
+    u32 n = len < room ? len : room;
+
+    if (n) {
+
+      memcpy(__afl_leak_obs->bytes + __afl_leak_obs->bytes_len, ptr, n);
+      __afl_leak_obs->bytes_len += n;
+
+    }
+
+  }
+
+  __afl_leak_obs->digest[0] = XXH64_digest(&__afl_leak_observe_state);
+  __afl_leak_obs->len[0] = __afl_leak_observe_len;
+  __afl_leak_obs->count = 1;
+
+}
+
+/* Observe a value, as its 8 bytes in host byte order. */
+
+void __afl_leak_observe_u64(u64 v) {
+
+  __afl_leak_observe(&v, sizeof(v));
+
+}
+
 /* Initialization of the forkserver - latest possible */
 
 __attribute__((constructor())) void __afl_auto_init(void) {
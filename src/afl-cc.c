@@ -856,6 +856,28 @@ static void edit_params(u32 argc, char **argv, char **envp) {
 
   }
 
+  if (getenv("AFL_USE_DFSAN")) {
+
+    if (compiler_mode != LLVM && compiler_mode != LTO)
+      FATAL("AFL_USE_DFSAN is only available in LLVM and LTO mode");
+
+    if (getenv("AFL_USE_ASAN") || getenv("AFL_USE_MSAN"))
+      FATAL("DFSAN and ASAN/MSAN are mutually exclusive");
+
+    cc_params[cc_par_cnt++] = "-fsanitize=dataflow";
+    cc_params[cc_par_cnt++] = alloc_printf(
+        "-fsanitize-dataflow-abilist=%s/afl-dfsan-abilist.txt", obj_path);
+    cc_params[cc_par_cnt++] = "-mllvm";
+    cc_params[cc_par_cnt++] = "-dfsan-conditional-callbacks=1";
+
+    /* The callbacks go to afl-compiler-rt, called right from the branch, not
+       through the DFSan runtime. */
+
+    cc_params[cc_par_cnt++] = "-Wl,--wrap=__dfsan_conditional_callback";
+    cc_params[cc_par_cnt++] = "-Wl,--wrap=__dfsan_conditional_callback_origin";
+
+  }
+
   if (getenv("AFL_USE_CFISAN")) {
 
     if (!lto_mode) {
@@ -997,6 +1019,55 @@ static void edit_params(u32 argc, char **argv, char **envp) {
 #endif                                                        /* ^__APPLE__ */
       "_I(); } while (0)";
 
+  cc_params[cc_par_cnt++] =
+      "-D__AFL_LEAK_SNAPSHOT()="
+      "({ "
+#ifdef __APPLE__
+      "__attribute__((visibility(\"default\"))) "
+      "int _S(void) __asm__(\"___afl_leak_snapshot\"); "
+#else
+      "__attribute__((visibility(\"default\"))) "
+      "int _S(void) __asm__(\"__afl_leak_snapshot\"); "
+#endif                                                        /* ^__APPLE__ */
+      "_S(); })";
+
+  cc_params[cc_par_cnt++] =
+      "-D__AFL_LEAK_SECRET(_p, _l)="
+      "({ "
+#ifdef __APPLE__
+      "__attribute__((visibility(\"default\"))) "
+      "void _T(void *, unsigned long) __asm__(\"___afl_leak_secret\"); "
+#else
+      "__attribute__((visibility(\"default\"))) "
+      "void _T(void *, unsigned long) __asm__(\"__afl_leak_secret\"); "
+#endif                                                        /* ^__APPLE__ */
+      "_T((void *)(_p), (_l)); })";
+
+  cc_params[cc_par_cnt++] =
+      "-D__AFL_LEAK_OBSERVE(_p, _l)="
+      "({ "
+#ifdef __APPLE__
+      "__attribute__((visibility(\"default\"))) "
+      "void _O(const void *, unsigned long) "
+      "__asm__(\"___afl_leak_observe\"); "
+#else
+      "__attribute__((visibility(\"default\"))) "
+      "void _O(const void *, unsigned long) __asm__(\"__afl_leak_observe\"); "
+#endif                                                        /* ^__APPLE__ */
+      "_O((const void *)(_p), (_l)); })";
+
+  cc_params[cc_par_cnt++] =
+      "-D__AFL_LEAK_OBSERVE_U64(_v)="
+      "({ "
+#ifdef __APPLE__
+      "__attribute__((visibility(\"default\"))) "
+      "void _U(unsigned long long) __asm__(\"___afl_leak_observe_u64\"); "
+#else
+      "__attribute__((visibility(\"default\"))) "
+      "void _U(unsigned long long) __asm__(\"__afl_leak_observe_u64\"); "
+#endif                                                        /* ^__APPLE__ */
+      "_U((unsigned long long)(_v)); })";
+
   if (x_set) {
 
     cc_params[cc_par_cnt++] = "-x";
@@ -1786,7 +1857,9 @@ int main(int argc, char **argv, char **envp) {
           "  AFL_USE_CFISAN: activate control flow sanitizer\n"
           "  AFL_USE_MSAN: activate memory sanitizer\n"
           "  AFL_USE_UBSAN: activate undefined behaviour sanitizer\n"
-          "  AFL_USE_LSAN: activate leak-checker sanitizer\n");
+          "  AFL_USE_LSAN: activate leak-checker sanitizer\n"
+          "  AFL_USE_DFSAN: label the secret with DFSan and report tainted "
+          "branches\n");
 
       if (have_gcc_plugin)
         SAYF(
@@ -26,6 +26,10 @@
 
  */
 
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE 1
+#endif
+
 #include "config.h"
 #include "types.h"
 #include "debug.h"
@@ -33,6 +37,7 @@
 #include "list.h"
 #include "forkserver.h"
 #include "hash.h"
+#include "leak_obs.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -360,7 +365,8 @@ static void report_error_and_exit(int error) {
 void afl_fsrv_start(afl_forkserver_t *fsrv, char **argv,
                     volatile u8 *stop_soon_p, u8 debug_child_output) {
 
-  int   st_pipe[2], ctl_pipe[2], stdout_pipe[2];
+  int   st_pipe[2], ctl_pipe[2], stdout_pipe[2], snap_ctl_pipe[2],
+      snap_st_pipe[2];
   s32   status;
   s32   rlen;
   char *ignore_autodict = getenv("AFL_NO_AUTODICT");
@@ -403,6 +409,11 @@ void afl_fsrv_start(afl_forkserver_t *fsrv, char **argv,
   if (fsrv->leakage_hunting) {
     if (pipe(stdout_pipe)) { PFATAL("pipe() stdout failed"); }
   }
+  if (fsrv->leak_snapshot) {
+    if (pipe(snap_ctl_pipe) || pipe(snap_st_pipe)) {
+      PFATAL("pipe() snapshot failed");
+    }
+  }
 
   fsrv->last_run_timed_out = 0;
   fsrv->fsrv_pid = fork();
@@ -505,6 +516,23 @@ void afl_fsrv_start(afl_forkserver_t *fsrv, char **argv,
     close(st_pipe[1]);
     if (fsrv->leakage_hunting) { close(stdout_pipe[0]); }
 
+    if (fsrv->leak_snapshot) {
+
+      if (dup2(snap_ctl_pipe[0], LEAK_SNAPSHOT_FD) < 0 ||
+          dup2(snap_st_pipe[1], LEAK_SNAPSHOT_FD + 1) < 0) {
+
+        PFATAL("dup2() failed");
+
+      }
+
+      close(snap_ctl_pipe[0]);
+      close(snap_ctl_pipe[1]);
+      close(snap_st_pipe[0]);
+      close(snap_st_pipe[1]);
+      setenv(LEAK_SNAPSHOT_ENV_VAR, "1", 1);
+
+    }
+
     close(fsrv->out_dir_fd);
     close(fsrv->dev_null_fd);
     close(fsrv->dev_urandom_fd);
@@ -622,6 +650,17 @@ void afl_fsrv_start(afl_forkserver_t *fsrv, char **argv,
     fcntl(fsrv->fsrv_stdout_fd, F_SETFL, flags | O_NONBLOCK);
   }
 
+  if (fsrv->leak_snapshot) {
+
+    close(snap_ctl_pipe[0]);
+    close(snap_st_pipe[1]);
+    fsrv->leak_snap_ctl_fd = snap_ctl_pipe[1];
+    fsrv->leak_snap_st_fd = snap_st_pipe[0];
+    fsrv->leak_snap_pid = 0;
+    fsrv->leak_snap_requested = 0;
+
+  }
+
   /* Wait for the fork server to come up, but don't wait too long. */
 
   rlen = 0;
@@ -1075,14 +1114,29 @@ void afl_fsrv_kill(afl_forkserver_t *fsrv) {
   fsrv->fsrv_pid = -1;
   fsrv->child_pid = -1;
 
+  if (fsrv->leak_snapshot) {
+
+    if (fsrv->leak_snap_pid > 0) { kill(fsrv->leak_snap_pid, SIGKILL); }
+    close(fsrv->leak_snap_ctl_fd);
+    close(fsrv->leak_snap_st_fd);
+    fsrv->leak_snap_pid = 0;
+
+  }
+
   if (fsrv->leakage_hunting) {
     close(fsrv->fsrv_stdout_fd);
     if (fsrv->stdout_file)
       fclose(fsrv->stdout_file);
+    fsrv->stdout_file = NULL;
 
     ck_free(fsrv->stdout_raw_buffer);
+    fsrv->stdout_raw_buffer = NULL;
     fsrv->stdout_raw_buffer_alloced = 0;
     fsrv->stdout_raw_buffer_len = 0;
+
+    ck_free(fsrv->leak_snap_prefix);
+    fsrv->leak_snap_prefix = NULL;
+    fsrv->leak_snap_prefix_len = 0;
   }
 
 }
@@ -1099,8 +1153,166 @@ u32 afl_fsrv_get_mapsize(afl_forkserver_t *fsrv, char **argv,
 
 /* Delete the current testcase and write the buf to the testcase file */
 
+/* Secret snapshots: a target that calls __AFL_LEAK_SNAPSHOT() right before
+   it first touches the secret gets a copy of itself parked at that point,
+   and runs that only change the secret are forked from there instead of
+   starting over. A snapshot is requested once two runs in a row share their
+   public input, and dropped as soon as the public input changes. */
+
+/* Identify the public input of a leakage testcase by its base64 text, so
+   nothing needs to be decoded. 0 if buf does not look like a testcase. */
+
+static u64 leak_snapshot_key(u8 *buf, size_t len) {
+
+  static const char tag[] = "\"PUBLIC\": \"";
+
+  u8 *start = memmem(buf, len, tag, sizeof(tag) - 1);
+  if (!start) { return 0; }
+  start += sizeof(tag) - 1;
+
+  u8 *end = memchr(start, '"', buf + len - start);
+  if (!end) { return 0; }
+
+  return hash64(start, end - start, HASH_CONST) | 1;
+
+}
+
+/* Throw away whatever is left in the snapshot status pipe. A snapshot
+   process that gets dropped may have written part of a reply (the pid of
+   its child but not its status), or a late reply; left there, those bytes
+   would be taken for the report of the next snapshot. */
+
+static void leak_snapshot_drain(afl_forkserver_t *fsrv) {
+
+  fd_set         readfds;
+  struct timeval timeout = {0, 0};
+  u8             buf[64];
+
+  while (1) {
+
+    FD_ZERO(&readfds);
+    FD_SET(fsrv->leak_snap_st_fd, &readfds);
+
+    if (select(fsrv->leak_snap_st_fd + 1, &readfds, NULL, NULL, &timeout) <=
+            0 ||
+        read(fsrv->leak_snap_st_fd, buf, sizeof(buf)) <= 0) {
+
+      break;
+
+    }
+
+  }
+
+}
+
+/* Kill a snapshot process that is no longer wanted. */
+
+static void leak_snapshot_drop(afl_forkserver_t *fsrv) {
+
+  kill(fsrv->leak_snap_pid, SIGKILL);
+  fsrv->leak_snap_pid = 0;
+  leak_snapshot_drain(fsrv);
+
+}
+
+/* Hand the next run to the snapshot process if it was taken with the same
+   public input; otherwise drop it, and ask for a new one if the public
+   input did not change since the last run. Returns 1 if the snapshot
+   process took the run. With leak_snap_bypass set, the run goes to the
+   fork server and the snapshot is kept for later. */
+
+static u8 leak_snapshot_start(afl_forkserver_t *fsrv,
+                              volatile u8 *     stop_soon_p) {
+
+  fsrv->leak_snap_running = 0;
+
+  if (fsrv->leak_snap_bypass) { return 0; }
+
+  if (fsrv->leak_snap_pid) {
+
+    if (fsrv->leak_snap_key == fsrv->leak_snap_taken_key &&
+        write(fsrv->leak_snap_ctl_fd, &fsrv->last_run_timed_out, 4) == 4) {
+
+      u32 time_ms = read_s32_timed(fsrv->leak_snap_st_fd, &fsrv->child_pid,
+                                   fsrv->exec_tmout, stop_soon_p);
+
+      if (time_ms && time_ms <= fsrv->exec_tmout && fsrv->child_pid > 0) {
+
+        fsrv->last_run_timed_out = 0;
+        fsrv->leak_snap_running = 1;
+        ++fsrv->leak_snap_execs;
+        return 1;
+
+      }
+
+    }
+
+    leak_snapshot_drop(fsrv);
+
+  }
+
+  if (fsrv->leak_snap_key && fsrv->leak_snap_key == fsrv->leak_snap_last_key &&
+      !fsrv->leak_snap_requested) {
+
+    /* A process dropped during an earlier run is gone by now; nothing it
+       wrote may pass for the reply to this request. */
+
+    leak_snapshot_drain(fsrv);
+
+    u32 request = 1;
+    if (write(fsrv->leak_snap_ctl_fd, &request, 4) == 4) {
+
+      fsrv->leak_snap_requested = 1;
+
+    }
+
+  }
+
+  fsrv->leak_snap_last_key = fsrv->leak_snap_key;
+  return 0;
+
+}
+
+/* After a regular run: did the target take a snapshot? The target reports
+   the pid of the snapshot process before it continues, so it is there by
+   the time the run is over, together with how much it had written to
+   stdout by then. That much of the output of this run is kept, to go in
+   front of the output of the runs forked from the snapshot. */
+
+static void leak_snapshot_check(afl_forkserver_t *fsrv) {
+
+  fd_set         readfds;
+  struct timeval timeout = {0, 0};
+  u32            report[2];
+
+  FD_ZERO(&readfds);
+  FD_SET(fsrv->leak_snap_st_fd, &readfds);
+
+  if (select(fsrv->leak_snap_st_fd + 1, &readfds, NULL, NULL, &timeout) > 0 &&
+      read(fsrv->leak_snap_st_fd, report, 8) == 8 && (s32)report[0] > 0) {
+
+    fsrv->leak_snap_pid = report[0];
+    fsrv->leak_snap_taken_key = fsrv->leak_snap_key;
+    fsrv->leak_snap_requested = 0;
+
+    fsrv->leak_snap_prefix_len = MIN(report[1], fsrv->stdout_raw_buffer_len);
+    fsrv->leak_snap_prefix =
+        ck_realloc(fsrv->leak_snap_prefix, fsrv->leak_snap_prefix_len + 1);
+    memcpy(fsrv->leak_snap_prefix, fsrv->stdout_raw_buffer,
+           fsrv->leak_snap_prefix_len);
+
+  }
+
+}
+
 void afl_fsrv_write_to_testcase(afl_forkserver_t *fsrv, u8 *buf, size_t len) {
 
+  if (unlikely(fsrv->leak_snapshot)) {
+
+    fsrv->leak_snap_key = leak_snapshot_key(buf, len);
+
+  }
+
 #ifdef AFL_PERSISTENT_RECORD
   if (unlikely(fsrv->persistent_record)) {
 
@@ -1225,14 +1437,111 @@ char *findLast(const char *haystack, const char *needle) {
   return NULL;
 }
 
-/* Execute target application, monitoring for timeouts. Return status
-   information. The called program will update afl->fsrv->trace_bits. */
+/* Drain what the last run wrote to stdout into stdout_raw_buffer. If a
+   preloaded libleakobs kept the output to itself, take its digest. */
 
-fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
-                                      volatile u8 *stop_soon_p) {
+void afl_fsrv_read_stdout(afl_forkserver_t *fsrv) {
+
+  if (!fsrv->stdout_raw_buffer) {
+    fsrv->stdout_raw_buffer_alloced = 65536;
+    fsrv->stdout_raw_buffer = ck_alloc(fsrv->stdout_raw_buffer_alloced);
+  }
+
+  ssize_t num_bytes = 0;
+  u32 len = 0;
+
+  /* A run forked from the snapshot starts with what the target wrote
+     before the snapshot was taken. */
+
+  if (fsrv->leak_snap_running && fsrv->leak_snap_prefix_len) {
+
+    len = fsrv->leak_snap_prefix_len;
+    if (len + 65536 > fsrv->stdout_raw_buffer_alloced) {
+
+      fsrv->stdout_raw_buffer_alloced = len + 65536;
+      fsrv->stdout_raw_buffer = ck_realloc(fsrv->stdout_raw_buffer,
+                                           fsrv->stdout_raw_buffer_alloced);
+
+    }
+
+    memcpy(fsrv->stdout_raw_buffer, fsrv->leak_snap_prefix, len);
+
+  }
+
+  do {
+    num_bytes = read(fsrv->fsrv_stdout_fd, fsrv->stdout_raw_buffer + len, 65536);
+    if (num_bytes == -1) {
+      // printf("read failed with errno: %d\n", errno);
+      num_bytes = 0;
+      break;
+    }
+
+    fflush(stdout);
+    len += num_bytes;
+
+    if (len >= fsrv->stdout_raw_buffer_alloced) {
+      printf("Reallocing fsrv->stdout_raw_buffer to %u bytes\n", len * 2);
+      fsrv->stdout_raw_buffer_alloced = len * 2;  // round up to next power of 2
+      fsrv->stdout_raw_buffer = ck_realloc(fsrv->stdout_raw_buffer, fsrv->stdout_raw_buffer_alloced);
+    }
+  } while (num_bytes == 65536);
+
+  fsrv->stdout_raw_buffer_len = len;
+
+  /* The output of a target that observes itself with __AFL_LEAK_OBSERVE()
+     is what it observed, not what it printed. */
+
+  if (fsrv->leak_obs && fsrv->leak_obs->want_bytes &&
+      fsrv->leak_obs->count == 1 && fsrv->leak_obs->kept_bytes) {
+
+    len = fsrv->leak_obs->bytes_len;
+
+    if (len < fsrv->leak_obs->len[0] && !fsrv->leak_obs_cut_warned) {
+
+      WARNF("Observations of more than %u bytes are cut short, such leaks "
+            "cannot be stored.", LEAK_OBS_BYTES_SIZE);
+      fsrv->leak_obs_cut_warned = 1;
+
+    }
+
+    if (len > fsrv->stdout_raw_buffer_alloced) {
+
+      fsrv->stdout_raw_buffer_alloced = len;
+      fsrv->stdout_raw_buffer =
+          ck_realloc(fsrv->stdout_raw_buffer, fsrv->stdout_raw_buffer_alloced);
+
+    }
+
+    memcpy(fsrv->stdout_raw_buffer, fsrv->leak_obs->bytes, len);
+    fsrv->stdout_raw_buffer_len = len;
+
+  }
+
+  /* A preloaded libleakobs kept the output to itself, see leak_obs.h. */
+
+  if (fsrv->leak_obs && fsrv->leak_obs->count == 1 &&
+      !fsrv->leak_obs->want_bytes) {
+
+    fsrv->leak_obs_digested = 1;
+    fsrv->leak_obs_digest = fsrv->leak_obs->digest[0];
+
+  } else {
+
+    fsrv->leak_obs_digested = 0;
+
+  }
+
+}
+
+/* Have the fork server spawn a new child for the current testcase, without
+   waiting for it. Returns 1 if we were asked to stop. Splitting this from
+   afl_fsrv_run_target_finish() lets callers keep several fork servers busy
+   at the same time. */
+
+u8 afl_fsrv_run_target_start(afl_forkserver_t *fsrv,
+                             volatile u8 *     stop_soon_p) {
 
   s32 res;
-  u32 exec_ms;
   u32 write_value = fsrv->last_run_timed_out;
 
   /* After this memset, fsrv->trace_bits[] are effectively volatile, so we
@@ -1240,15 +1549,33 @@ fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
      territory. */
 
   memset(fsrv->trace_bits, 0, fsrv->map_size);
+  if (fsrv->leak_obs) {
+
+    fsrv->leak_obs->count = 0;
+    fsrv->leak_obs->kept_bytes = 0;
+    if (fsrv->leak_taint) {
+
+      memset(fsrv->leak_obs->taint_map, 0, LEAK_TAINT_MAP_SIZE);
+
+    }
+
+  }
 
   MEM_BARRIER();
 
+  if (unlikely(fsrv->leak_snapshot) &&
+      leak_snapshot_start(fsrv, stop_soon_p)) {
+
+    return 0;
+
+  }
+
   /* we have the fork server (or faux server) up and running
   First, tell it if the previous run timed out. */
 
   if ((res = write(fsrv->fsrv_ctl_fd, &write_value, 4)) != 4) {
 
-    if (*stop_soon_p) { return 0; }
+    if (*stop_soon_p) { return 1; }
     RPFATAL(res, "Unable to request new process from fork server (OOM?)");
 
   }
@@ -1257,7 +1584,7 @@ fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
 
   if ((res = read(fsrv->fsrv_st_fd, &fsrv->child_pid, 4)) != 4) {
 
-    if (*stop_soon_p) { return 0; }
+    if (*stop_soon_p) { return 1; }
     RPFATAL(res, "Unable to request new process from fork server (OOM?)");
 
   }
@@ -1284,7 +1611,7 @@ fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
 
   if (fsrv->child_pid <= 0) {
 
-    if (*stop_soon_p) { return 0; }
+    if (*stop_soon_p) { return 1; }
 
     if ((fsrv->child_pid & FS_OPT_ERROR) &&
         FS_OPT_GET_ERROR(fsrv->child_pid) == FS_ERROR_SHM_OPEN)
@@ -1296,8 +1623,23 @@ fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
 
   }
 
-  exec_ms = read_s32_timed(fsrv->fsrv_st_fd, &fsrv->child_status, timeout,
-                           stop_soon_p);
+  return 0;
+
+}
+
+/* Wait for the child spawned by afl_fsrv_run_target_start(), monitoring for
+   timeouts. Return status information. */
+
+fsrv_run_result_t afl_fsrv_run_target_finish(afl_forkserver_t *fsrv,
+                                             u32               timeout,
+                                             volatile u8 *     stop_soon_p) {
+
+  s32 res = 0;
+  u32 exec_ms;
+  s32 st_fd =
+      fsrv->leak_snap_running ? fsrv->leak_snap_st_fd : fsrv->fsrv_st_fd;
+
+  exec_ms = read_s32_timed(st_fd, &fsrv->child_status, timeout, stop_soon_p);
 
   if (exec_ms > timeout) {
 
@@ -1306,7 +1648,7 @@ fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
 
     kill(fsrv->child_pid, fsrv->kill_signal);
     fsrv->last_run_timed_out = 1;
-    if (read(fsrv->fsrv_st_fd, &fsrv->child_status, 4) < 4) { exec_ms = 0; }
+    if (read(st_fd, &fsrv->child_status, 4) < 4) { exec_ms = 0; }
 
   }
 
@@ -1343,32 +1685,14 @@ fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
   fsrv->total_execs++;
 
   if (fsrv->leakage_hunting) {
-    if (!fsrv->stdout_raw_buffer) {
-      fsrv->stdout_raw_buffer_alloced = 65536;
-      fsrv->stdout_raw_buffer = ck_alloc(fsrv->stdout_raw_buffer_alloced);
-    }
 
-    ssize_t num_bytes = 0;
-    u32 len = 0;
-    do {
-      num_bytes = read(fsrv->fsrv_stdout_fd, fsrv->stdout_raw_buffer + len, 65536);
-      if (num_bytes == -1) {
-        // printf("read failed with errno: %d\n", errno);
-        num_bytes = 0;
-        break;
-      }
+    afl_fsrv_read_stdout(fsrv);
 
-      fflush(stdout);
-      len += num_bytes;
+    if (unlikely(fsrv->leak_snapshot) && !fsrv->leak_snap_running) {
 
-      if (len >= fsrv->stdout_raw_buffer_alloced) {
-        printf("Reallocing fsrv->stdout_raw_buffer to %u bytes\n", len * 2);
-        fsrv->stdout_raw_buffer_alloced = len * 2;  // round up to next power of 2
-        fsrv->stdout_raw_buffer = ck_realloc(fsrv->stdout_raw_buffer, fsrv->stdout_raw_buffer_alloced);
-      }
-    } while (num_bytes == 65536);
+      leak_snapshot_check(fsrv);
 
-    fsrv->stdout_raw_buffer_len = len;
+    }
 
 //    printf("Output (%u): %.*s", len, len, (char *)fsrv->stdout_raw_buffer);
 
@@ -1459,6 +1783,17 @@ fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
 
 }
 
+/* Execute target application, monitoring for timeouts. Return status
+   information. The called program will update afl->fsrv->trace_bits. */
+
+fsrv_run_result_t afl_fsrv_run_target(afl_forkserver_t *fsrv, u32 timeout,
+                                      volatile u8 *stop_soon_p) {
+
+  if (afl_fsrv_run_target_start(fsrv, stop_soon_p)) { return 0; }
+  return afl_fsrv_run_target_finish(fsrv, timeout, stop_soon_p);
+
+}
+
 void afl_fsrv_killall() {
 
   LIST_FOREACH(&fsrv_list, afl_forkserver_t, {
@@ -205,19 +205,28 @@ void init_count_class16(void) {
 
 inline u8 has_new_bits(afl_state_t *afl, u8 *virgin_map) {
 
+  return has_new_bits_fsrv(afl, &afl->fsrv, virgin_map);
+
+}
+
+/* The same for the trace of fsrv, which need not be afl->fsrv. */
+
+inline u8 has_new_bits_fsrv(afl_state_t *afl, afl_forkserver_t *fsrv,
+                            u8 *virgin_map) {
+
 #ifdef WORD_SIZE_64
 
-  u64 *current = (u64 *)afl->fsrv.trace_bits;
+  u64 *current = (u64 *)fsrv->trace_bits;
   u64 *virgin = (u64 *)virgin_map;
 
-  u32 i = (afl->fsrv.map_size >> 3);
+  u32 i = (fsrv->map_size >> 3);
 
 #else
 
-  u32 *current = (u32 *)afl->fsrv.trace_bits;
+  u32 *current = (u32 *)fsrv->trace_bits;
   u32 *virgin = (u32 *)virgin_map;
 
-  u32 i = (afl->fsrv.map_size >> 2);
+  u32 i = (fsrv->map_size >> 2);
 
 #endif                                                     /* ^WORD_SIZE_64 */
 
@@ -250,22 +259,49 @@ inline u8 has_new_bits(afl_state_t *afl, u8 *virgin_map) {
 
 inline u8 has_new_bits_unclassified(afl_state_t *afl, u8 *virgin_map) {
 
+  return has_new_bits_unclassified_fsrv(afl, &afl->fsrv, virgin_map);
+
+}
+
+inline u8 has_new_bits_unclassified_fsrv(afl_state_t *afl,
+                                         afl_forkserver_t *fsrv,
+                                         u8 *virgin_map) {
+
   /* Handle the hot path first: no new coverage */
-  u8 *end = afl->fsrv.trace_bits + afl->fsrv.map_size;
+  u8 *end = fsrv->trace_bits + fsrv->map_size;
 
 #ifdef WORD_SIZE_64
 
-  if (!skim((u64 *)virgin_map, (u64 *)afl->fsrv.trace_bits, (u64 *)end))
+  if (!skim((u64 *)virgin_map, (u64 *)fsrv->trace_bits, (u64 *)end))
     return 0;
 
 #else
 
-  if (!skim((u32 *)virgin_map, (u32 *)afl->fsrv.trace_bits, (u32 *)end))
+  if (!skim((u32 *)virgin_map, (u32 *)fsrv->trace_bits, (u32 *)end))
     return 0;
 
 #endif                                                     /* ^WORD_SIZE_64 */
-  classify_counts(&afl->fsrv);
-  return has_new_bits(afl, virgin_map);
+  classify_counts(fsrv);
+  return has_new_bits_fsrv(afl, fsrv, virgin_map);
+
+}
+
+/* Would trace_bits add anything to virgin_map? Unlike the above, neither
+   the trace nor the virgin map are changed. */
+
+u8 skim_new_bits(afl_state_t *afl, u8 *virgin_map) {
+
+  u8 *end = afl->fsrv.trace_bits + afl->fsrv.map_size;
+
+#ifdef WORD_SIZE_64
+
+  return !!skim((u64 *)virgin_map, (u64 *)afl->fsrv.trace_bits, (u64 *)end);
+
+#else
+
+  return !!skim((u32 *)virgin_map, (u32 *)afl->fsrv.trace_bits, (u32 *)end);
+
+#endif                                                     /* ^WORD_SIZE_64 */
 
 }
 
@@ -289,7 +325,8 @@ void minimize_bits(afl_state_t *afl, u8 *dst, u8 *src) {
 #ifndef SIMPLE_FILES
 
 /* Construct a file name for a new test case, capturing the operation
-   that led to its discovery. Returns a ptr to afl->describe_op_buf_256. */
+   that led to its discovery. Bit 2 of new_bits marks new branches on the
+   secret. Returns a ptr to afl->describe_op_buf_256. */
 
 u8 *describe_op(afl_state_t *afl, u8 new_bits, size_t max_description_len) {
 
@@ -370,7 +407,9 @@ u8 *describe_op(afl_state_t *afl, u8 new_bits, size_t max_description_len) {
 
   }
 
-  if (new_bits == 2) { strcat(ret, ",+cov"); }
+  if ((new_bits & 3) == 2) { strcat(ret, ",+cov"); }
+  if (new_bits & 4) { strcat(ret, ",+taint"); }
+  if (new_bits & 8) { strcat(ret, ",+obs"); }
 
   if (unlikely(strlen(ret) >= max_description_len))
     FATAL("describe string is too long");
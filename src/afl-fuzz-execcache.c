@@ -0,0 +1,94 @@
+/*
+   american fuzzy lop++ - exec result cache
+   ----------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Havoc on short public and secret inputs keeps producing testcases that
+   were run moments ago. For a deterministic target, running such a testcase
+   again cannot add coverage, and it only matters to the io map if the map
+   changed since. This direct-mapped cache remembers the last result for
+   each slot, so that leakage_fuzz_stuff() can skip the target when neither
+   is the case.
+
+   Only clean runs are cached. A timeout or a crash may not happen again,
+   and their bookkeeping is best left to leakage_save_if_interesting().
+
+ */
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+
+/* Look up the testcase with hash key. Returns 1 and sets fault if the exec
+   can be skipped, 0 if the target has to run. */
+
+u8 leak_exec_cache_lookup(afl_state_t *afl, u64 key, u8 *public_input_buf,
+                          u32 public_len, u8 *secret_input_buf,
+                          u32 secret_len, u8 *fault) {
+
+  struct leak_exec_result *e =
+      &afl->leak_exec_cache[key & (afl->leak_exec_cache_size - 1)];
+
+  ++afl->leak_exec_cache_lookups;
+
+  if (e->key != key) { return 0; }
+
+  u64 public_input_hash = hash64(public_input_buf, public_len, HASH_CONST);
+
+  if (!leak_io_map_settled(afl, public_input_hash, secret_input_buf,
+                           secret_len, e->output_hash)) {
+
+    return 0;
+
+  }
+
+  /* What leakage_save_if_interesting() would have done for a run that
+     turns up nothing new. */
+
+  if (e->cksum && afl->n_fuzz[e->cksum % N_FUZZ_SIZE] < 0xFFFFFFFF) {
+
+    afl->n_fuzz[e->cksum % N_FUZZ_SIZE]++;
+
+  }
+
+  ++afl->leak_exec_cache_hits;
+  *fault = FSRV_RUN_OK;
+  return 1;
+
+}
+
+/* Remember the result of the exec that just finished on fsrv. Must be
+   called before anything else runs the target there. */
+
+void leak_exec_cache_add(afl_state_t *afl, afl_forkserver_t *fsrv, u64 key,
+                         u8 fault) {
+
+  struct leak_exec_result *e =
+      &afl->leak_exec_cache[key & (afl->leak_exec_cache_size - 1)];
+
+  if (fault != FSRV_RUN_OK) {
+
+    if (e->key == key) { e->key = 0; }
+    return;
+
+  }
+
+  e->key = key;
+  e->output_hash = leak_output_hash(fsrv);
+
+  if (unlikely(afl->schedule >= FAST && afl->schedule <= RARE)) {
+
+    e->cksum = hash64(fsrv->trace_bits, fsrv->map_size, HASH_CONST);
+
+  } else {
+
+    e->cksum = 0;
+
+  }
+
+}
+
@@ -27,6 +27,7 @@
 #include <limits.h>
 #include "cmplog.h"
 #include "leakage_utils.h"
+#include "leak_obs.h"
 
 #ifdef HAVE_AFFINITY
 
@@ -1807,6 +1808,45 @@ static void handle_existing_out_dir(afl_state_t *afl) {
   if (delete_files(fn, CASE_PREFIX)) { goto dir_cleanup_failed; }
   ck_free(fn);
 
+  /* Pooled secrets are rebuilt from AFL_LEAK_SECRETS_DIR and new finds. On
+     in-place resume, the old pool is moved aside like queue/ and loaded
+     again by resume_secret_pool(). Unlike queue/, the pool has no other
+     copy, so if it cannot be moved (say, a resume that was interrupted
+     left _resume_secrets/ behind), stop before it gets deleted below. */
+
+  fn = alloc_printf("%s/secrets", afl->out_dir);
+
+  if (afl->in_place_resume) {
+
+    u8 *nfn = alloc_printf("%s/_resume_secrets", afl->out_dir);
+
+    if (rename(fn, nfn) && errno != ENOENT) {
+
+      PFATAL(
+          "Unable to move '%s' to '%s' - if the latter is left over from an "
+          "interrupted resume, merge the two by hand first",
+          fn, nfn);
+
+    }
+
+    ck_free(nfn);
+
+  }
+
+  if (delete_files(fn, CASE_PREFIX)) { goto dir_cleanup_failed; }
+  ck_free(fn);
+
+  /* The leak log, and per-leak files left behind by older versions. An
+     in-place resume keeps appending to the log, see leak_log_open(). */
+
+  if (!afl->in_place_resume) {
+
+    fn = alloc_printf("%s/leaks", afl->out_dir);
+    if (delete_files(fn, NULL)) { goto dir_cleanup_failed; }
+    ck_free(fn);
+
+  }
+
   /* And now, for some finishing touches. */
 
   if (afl->file_extension) {
@@ -2023,6 +2063,31 @@ void setup_dirs_fds(afl_state_t *afl) {
   if (mkdir(tmp, 0700)) { PFATAL("Unable to create '%s'", tmp); }
   ck_free(tmp);
 
+  /* Pooled secrets for leakage hunting. */
+
+  if (afl->fsrv.leakage_hunting) {
+
+    tmp = alloc_printf("%s/secrets", afl->out_dir);
+    if (mkdir(tmp, 0700)) { PFATAL("Unable to create '%s'", tmp); }
+    ck_free(tmp);
+
+    /* Log of confirmed leaks. */
+
+    tmp = alloc_printf("%s/leaks", afl->out_dir);
+
+    if (mkdir(tmp, 0700) && (!afl->in_place_resume || errno != EEXIST)) {
+
+      PFATAL("Unable to create '%s'", tmp);
+
+    }
+
+    ck_free(tmp);
+
+    leak_log_open(afl);
+    if (afl->in_place_resume) { load_leak_buckets(afl); }
+
+  }
+
   /* Generally useful file descriptors. */
 
   afl->fsrv.dev_null_fd = open("/dev/null", O_RDWR);
@@ -2048,7 +2113,11 @@ void setup_dirs_fds(afl_state_t *afl) {
         afl->fsrv.plot_file,
         "# relative_time, cycles_done, cur_path, paths_total, "
         "pending_total, pending_favs, map_size, unique_crashes, "
-        "unique_hangs, max_depth, execs_per_sec, total_execs, edges_found\n");
+        "unique_hangs, max_depth, execs_per_sec, total_execs, edges_found%s\n",
+        afl->fsrv.leakage_hunting
+            ? ", leaks_candidates, leaks_confirmed, leak_buckets, "
+              "io_map_entries"
+            : "");
 
   } else {
 
@@ -2568,6 +2637,159 @@ void setup_testcase_shmem(afl_state_t *afl) {
 
 }
 
+/* Create the shm that targets publish their observations in, see
+   leak_obs.h. */
+
+void setup_leak_obs_shmem(afl_state_t *afl) {
+
+  afl->shm_leak_obs = ck_alloc(sizeof(sharedmem_t));
+
+  // same as above, SHM_ENV_VAR already belongs to the coverage map
+  u8 *map = afl_shm_init(afl->shm_leak_obs, sizeof(struct leak_obs_map), 1);
+
+  if (!map) { FATAL("BUG: Zero return from afl_shm_init."); }
+
+#ifdef USEMMAP
+  setenv(LEAK_OBS_SHM_ENV_VAR, afl->shm_leak_obs->g_shm_file_path, 1);
+#else
+  u8 *shm_str = alloc_printf("%d", afl->shm_leak_obs->shm_id);
+  setenv(LEAK_OBS_SHM_ENV_VAR, shm_str, 1);
+  ck_free(shm_str);
+#endif
+  afl->fsrv.leak_obs = (struct leak_obs_map *)map;
+
+}
+
+static void shm_setenv(const char *name, sharedmem_t *shm) {
+
+#ifdef USEMMAP
+  setenv(name, shm->g_shm_file_path, 1);
+#else
+  u8 *shm_str = alloc_printf("%d", shm->shm_id);
+  setenv(name, shm_str, 1);
+  ck_free(shm_str);
+#endif
+
+}
+
+/* Start a second fork server for the B leg of secret pairs. It gets its own
+   coverage map, testcase and observation shm, and a copy of the command line
+   with the main testcase file swapped for its own. The environment is put
+   back afterwards, the main fork server may need restarting. */
+
+void setup_leak_fsrv(afl_state_t *afl) {
+
+  afl_forkserver_t *fsrv = &afl->leak_fsrv;
+  u32               argc = 0, i;
+  u8                replaced = 0;
+  u8 *              out_file;
+
+  if (afl->file_extension) {
+
+    out_file =
+        alloc_printf("%s/.cur_input_b.%s", afl->tmp_dir, afl->file_extension);
+
+  } else {
+
+    out_file = alloc_printf("%s/.cur_input_b", afl->tmp_dir);
+
+  }
+
+  while (afl->argv[argc]) {
+
+    ++argc;
+
+  }
+
+  char **argv = ck_alloc((argc + 1) * sizeof(char *));
+
+  for (i = 0; i < argc; ++i) {
+
+    char *at = strstr(afl->argv[i], afl->fsrv.out_file);
+
+    if (at) {
+
+      argv[i] = alloc_printf("%.*s%s%s", (int)(at - afl->argv[i]),
+                             afl->argv[i], out_file,
+                             at + strlen(afl->fsrv.out_file));
+      replaced = 1;
+
+    } else {
+
+      argv[i] = ck_strdup(afl->argv[i]);
+
+    }
+
+  }
+
+  if (!afl->fsrv.use_stdin && !afl->fsrv.use_shmem_fuzz && !replaced) {
+
+    WARNF(
+        "AFL_LEAK_DUAL_FSRV needs the testcase on stdin, in shared memory or "
+        "in an @@ argument, ignoring it.");
+
+    for (i = 0; i < argc; ++i) {
+
+      ck_free(argv[i]);
+
+    }
+
+    ck_free(argv);
+    ck_free(out_file);
+    return;
+
+  }
+
+  afl_fsrv_init_dup(fsrv, &afl->fsrv);
+  fsrv->qemu_mode = afl->fsrv.qemu_mode;
+  fsrv->frida_mode = afl->fsrv.frida_mode;
+  fsrv->target_path = afl->fsrv.target_path;
+  fsrv->leakage_hunting = true;
+  fsrv->leak_snapshot = afl->fsrv.leak_snapshot;
+  fsrv->leak_taint = afl->fsrv.leak_taint;
+
+  unlink(out_file);                                        /* Ignore errors */
+  fsrv->out_file = out_file;
+  fsrv->out_fd = open(out_file, O_RDWR | O_CREAT | O_EXCL, DEFAULT_PERMISSION);
+  if (fsrv->out_fd < 0) { PFATAL("Unable to create '%s'", out_file); }
+
+  fsrv->trace_bits =
+      afl_shm_init(&afl->leak_shm, fsrv->map_size, afl->non_instrumented_mode);
+
+  if (afl->fsrv.use_shmem_fuzz) {
+
+    afl->leak_shm_fuzz = ck_alloc(sizeof(sharedmem_t));
+
+    u8 *map = afl_shm_init(afl->leak_shm_fuzz, MAX_FILE + sizeof(u32), 1);
+    afl->leak_shm_fuzz->shmemfuzz_mode = 1;
+
+    if (!map) { FATAL("BUG: Zero return from afl_shm_init."); }
+
+    shm_setenv(SHM_FUZZ_ENV_VAR, afl->leak_shm_fuzz);
+    fsrv->support_shmem_fuzz = 1;
+    fsrv->shmem_fuzz_len = (u32 *)map;
+    fsrv->shmem_fuzz = map + sizeof(u32);
+
+  }
+
+  afl->leak_shm_obs = ck_alloc(sizeof(sharedmem_t));
+
+  u8 *obs = afl_shm_init(afl->leak_shm_obs, sizeof(struct leak_obs_map), 1);
+  if (!obs) { FATAL("BUG: Zero return from afl_shm_init."); }
+
+  shm_setenv(LEAK_OBS_SHM_ENV_VAR, afl->leak_shm_obs);
+  fsrv->leak_obs = (struct leak_obs_map *)obs;
+
+  afl_fsrv_start(fsrv, argv, &afl->stop_soon, afl->afl_env.afl_debug_child);
+
+  if (!afl->non_instrumented_mode) { shm_setenv(SHM_ENV_VAR, &afl->shm); }
+  if (afl->shm_fuzz) { shm_setenv(SHM_FUZZ_ENV_VAR, afl->shm_fuzz); }
+  shm_setenv(LEAK_OBS_SHM_ENV_VAR, afl->shm_leak_obs);
+
+  OKF("Second fork server up, secret pairs run side by side.");
+
+}
+
 /* Do a PATH search and find target binary to see that it exists and
    isn't a shell script - a common and painful mistake. We also check for
    a valid ELF header and for evidence of AFL instrumentation. */
@@ -0,0 +1,292 @@
+/*
+   american fuzzy lop++ - io map table
+   -----------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   The io map is looked up once per exec in leakage hunting mode, always by
+   the 64 bit hash of a public input. That key is a hash already, so this
+   table uses it as is: the top bits pick a group of slots to start at, the
+   low 7 bits are kept in a control byte per slot. A lookup compares a whole
+   group of control bytes at once (32 with AVX2, 16 with SSE2, 8 otherwise)
+   and only looks at the keys whose control byte matches, the way Swiss
+   tables do. Nothing is ever deleted, so there are no tombstones.
+
+   The entries themselves live in chunks that never move, in insertion
+   order. Growing the table only rehashes the keys and entry indices, and
+   pointers to entries stay valid for the lifetime of the table.
+
+ */
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+  #define IOMAP_GROUP 32
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+  #define IOMAP_GROUP 16
+#else
+  #define IOMAP_GROUP 8
+#endif
+
+#define IOMAP_EMPTY 0x80                   /* Control byte of a free slot   */
+#define IOMAP_MIN_SLOTS 1024
+#define IOMAP_CHUNK_BITS 14                /* Entries per chunk: 2^14       */
+
+struct leak_iomap {
+
+  u8  *ctrl;                               /* Control byte per slot         */
+  u64 *keys;                               /* Key per slot                  */
+  u32 *idx;                                /* Entry index per slot          */
+  u32  group_mask;                         /* Number of groups - 1          */
+  u32  growth_left;                        /* Inserts until the next grow   */
+
+  struct input_output_hashes **chunks;
+  u32                          chunks_alloced;
+  u32                          count;
+
+};
+
+/* Bit i of the result is set if control byte i of the group is c. */
+
+static inline u32 group_match(const u8 *ctrl, u8 c) {
+
+#if defined(__AVX2__)
+  __m256i group = _mm256_loadu_si256((const __m256i *)ctrl);
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(group, _mm256_set1_epi8(c)));
+#elif defined(__SSE2__)
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+  u64 group, x;
+  memcpy(&group, ctrl, sizeof(group));
+
+  /* Zero bytes of x get their top bit set. A borrow can flag the byte
+     above a match as well, the key comparison sorts that out. */
+
+  x = group ^ (0x0101010101010101ULL * c);
+  x = (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+  return ((x >> 7) * 0x0102040810204080ULL) >> 56;
+#endif
+
+}
+
+/* Control bytes of used slots never have the top bit set. */
+
+static inline u32 group_empty(const u8 *ctrl) {
+
+#if defined(__AVX2__)
+  return _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)ctrl));
+#elif defined(__SSE2__)
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+  u64 group;
+  memcpy(&group, ctrl, sizeof(group));
+  return (((group & 0x8080808080808080ULL) >> 7) * 0x0102040810204080ULL) >>
+         56;
+#endif
+
+}
+
+static inline struct input_output_hashes *entry_at(struct leak_iomap *m,
+                                                   u32                idx) {
+
+  return &m->chunks[idx >> IOMAP_CHUNK_BITS]
+                   [idx & ((1 << IOMAP_CHUNK_BITS) - 1)];
+
+}
+
+static void alloc_slots(struct leak_iomap *m, u32 slots) {
+
+  m->ctrl = ck_alloc_nozero(slots);
+  m->keys = ck_alloc_nozero(slots * sizeof(u64));
+  m->idx = ck_alloc_nozero(slots * sizeof(u32));
+  memset(m->ctrl, IOMAP_EMPTY, slots);
+
+  m->group_mask = slots / IOMAP_GROUP - 1;
+  m->growth_left = slots / 8 * 7 - m->count;
+
+}
+
+/* The first free slot for key. The probe sequence visits groups 0, 1, 3,
+   6, ... after the first one, which covers all of them. */
+
+static inline u32 find_free(struct leak_iomap *m, u64 key) {
+
+  u32 g = (key >> 7) & m->group_mask, step = 0;
+
+  while (1) {
+
+    u32 empty = group_empty(m->ctrl + g * IOMAP_GROUP);
+    if (empty) { return g * IOMAP_GROUP + __builtin_ctz(empty); }
+    g = (g + ++step) & m->group_mask;
+
+  }
+
+}
+
+static void grow(struct leak_iomap *m) {
+
+  u8  *ctrl = m->ctrl;
+  u64 *keys = m->keys;
+  u32 *idx = m->idx, slots = (m->group_mask + 1) * IOMAP_GROUP, i;
+
+  alloc_slots(m, slots * 2);
+
+  for (i = 0; i < slots; ++i) {
+
+    if (ctrl[i] & IOMAP_EMPTY) { continue; }
+
+    u32 pos = find_free(m, keys[i]);
+    m->ctrl[pos] = ctrl[i];
+    m->keys[pos] = keys[i];
+    m->idx[pos] = idx[i];
+
+  }
+
+  ck_free(ctrl);
+  ck_free(keys);
+  ck_free(idx);
+
+}
+
+struct leak_iomap *leak_iomap_new(void) {
+
+  struct leak_iomap *m = ck_alloc(sizeof(struct leak_iomap));
+  alloc_slots(m, IOMAP_MIN_SLOTS);
+  return m;
+
+}
+
+struct input_output_hashes *leak_iomap_get(struct leak_iomap *m, u64 key) {
+
+  u32 g = (key >> 7) & m->group_mask, step = 0;
+  u8  h2 = key & 0x7f;
+
+  while (1) {
+
+    const u8 *ctrl = m->ctrl + g * IOMAP_GROUP;
+    u32       match = group_match(ctrl, h2);
+
+    while (match) {
+
+      u32 pos = g * IOMAP_GROUP + __builtin_ctz(match);
+      if (likely(m->keys[pos] == key)) { return entry_at(m, m->idx[pos]); }
+      match &= match - 1;
+
+    }
+
+    /* A free slot ends the probe sequence: key would have gone there. */
+
+    if (likely(group_empty(ctrl))) { return NULL; }
+    g = (g + ++step) & m->group_mask;
+
+  }
+
+}
+
+/* Add a copy of e under e->public_input_hash, unless the key is there
+   already. Returns the entry in the table either way. */
+
+struct input_output_hashes *leak_iomap_put(struct leak_iomap *        m,
+                                           struct input_output_hashes *e) {
+
+  u64                         key = e->public_input_hash;
+  struct input_output_hashes *found = leak_iomap_get(m, key);
+
+  if (found) { return found; }
+
+  if (unlikely(!m->growth_left)) { grow(m); }
+
+  if (unlikely(!(m->count & ((1 << IOMAP_CHUNK_BITS) - 1)))) {
+
+    u32 chunk = m->count >> IOMAP_CHUNK_BITS;
+
+    if (chunk >= m->chunks_alloced) {
+
+      m->chunks_alloced = m->chunks_alloced ? m->chunks_alloced * 2 : 16;
+      m->chunks = ck_realloc(m->chunks, m->chunks_alloced * sizeof(void *));
+
+    }
+
+    m->chunks[chunk] = ck_alloc_nozero(sizeof(struct input_output_hashes)
+                                       << IOMAP_CHUNK_BITS);
+
+  }
+
+  u32 pos = find_free(m, key);
+  m->ctrl[pos] = key & 0x7f;
+  m->keys[pos] = key;
+  m->idx[pos] = m->count;
+  --m->growth_left;
+
+  found = entry_at(m, m->count++);
+  memcpy(found, e, sizeof(*found));
+  return found;
+
+}
+
+u32 leak_iomap_count(struct leak_iomap *m) {
+
+  return m->count;
+
+}
+
+/* Memory held by the table and its entries, not counting the inputs and
+   outputs the entries point to. */
+
+u64 leak_iomap_mem(struct leak_iomap *m) {
+
+  u64 slots = (u64)(m->group_mask + 1) * IOMAP_GROUP;
+  u32 chunks = (m->count + (1 << IOMAP_CHUNK_BITS) - 1) >> IOMAP_CHUNK_BITS;
+
+  return slots * (1 + sizeof(u64) + sizeof(u32)) +
+         ((u64)chunks * sizeof(struct input_output_hashes)
+          << IOMAP_CHUNK_BITS);
+
+}
+
+/* Free the table, along with the inputs and outputs its entries hold. */
+
+void leak_iomap_free(struct leak_iomap *m) {
+
+  u32 i;
+  s32 j;
+
+  if (!m) { return; }
+
+  for (i = 0; i < m->count; ++i) {
+
+    struct input_output_hashes *e = entry_at(m, i);
+
+    ck_free(e->public_input_buf);
+
+    for (j = 0; j < e->secret_input_bufs_filled; ++j) {
+
+      ck_free(e->secret_input_bufs[j]);
+      ck_free(e->public_output_bufs[j]);
+
+    }
+
+  }
+
+  for (i = 0; i < m->count; i += 1 << IOMAP_CHUNK_BITS) {
+
+    ck_free(m->chunks[i >> IOMAP_CHUNK_BITS]);
+
+  }
+
+  ck_free(m->chunks);
+  ck_free(m->ctrl);
+  ck_free(m->keys);
+  ck_free(m->idx);
+  ck_free(m);
+
+}
+
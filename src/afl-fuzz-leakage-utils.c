@@ -5,73 +5,7 @@
 #include "../include/afl-fuzz.h"
 #include "../include/leakage_utils.h"
 #include "../include/json.h"
-
-#define PUBLIC_KEY "PUBLIC"
-#define SECRET_KEY "SECRET"
-
-/* Parses a testcase_buf to extract pointers and lengths for public and secret
- * segments of the testcase input. public_input and secret_input are malloced */
-
-void find_public_and_secret_inputs(const char *testcase_buf, u32 testcase_len,
-                                   uint8_t **public_input, uint32_t *public_len,
-                                   uint8_t **secret_input, uint32_t *secret_len) {
-
-  char *raw_public = NULL, *raw_secret = NULL;
-
-  json_char *json = (json_char *)testcase_buf;
-  json_value *value = json_parse(json, testcase_len);
-
-  switch (value->type) {
-    case json_object: {
-      u32 len = value->u.object.length;
-
-      for (u32 i = 0; i < len; i++) {
-
-        char *name = value->u.object.values[i].name;
-        // printf("found name %s\n", name);
-
-        json_type type = value->u.object.values[i].value->type;
-        if (type != json_string) {
-          printf("Saw json field %s that was not a string (type: %d)\n", name, type);
-          continue;
-        }
-
-        char *str = value->u.object.values[i].value->u.string.ptr;
-        u32 length = value->u.object.values[i].value->u.string.length;
-
-        if (!strcmp(name, PUBLIC_KEY)) {
-          raw_public = str;
-        } else if (!strcmp(name, SECRET_KEY)) {
-          raw_secret = str;
-        } else {
-          printf("saw json string { \"%s\": \"%.*s\" }\n", name, length, str);
-        }
-
-      }
-      break;
-    }
-    default:
-      FATAL("JSON: %*.s was not a json-object", testcase_len, testcase_buf);
-  }
-
-  if (!raw_public) {
-    FATAL("Failed to find PUBLIC in json: %.*s\n", testcase_len, testcase_buf);
-  }
-
-  if (!raw_secret) {
-    FATAL("Failed to find SECRET in json: %.*s\n", testcase_len, testcase_buf);
-  }
-
-  *public_len = Base64decode_len(raw_public);
-  *public_input = malloc(*public_len);
-  *public_len = Base64decode((char *)*public_input, raw_public);
-
-  *secret_len = Base64decode_len(raw_secret);
-  *secret_input = malloc(*secret_len);
-  *secret_len = Base64decode((char *)*secret_input, raw_secret);
-
-  json_value_free(value);
-}
+#include "../include/leak_obs.h"
 
 void locate_public_and_secret_inputs(struct queue_entry *q) {
   if (!q->testcase_buf) {
@@ -102,37 +36,6 @@ void locate_public_and_secret_inputs(struct queue_entry *q) {
 
 }
 
-void create_buffer_from_public_and_secret_inputs(const uint8_t *public_input, u32 public_input_len,
-                                                 const uint8_t *secret_input, u32 secret_input_len,
-                                                 char **combined_buf, u32 *combined_buf_len) {
-
-  const char *json_out_template = "{\n  \"" PUBLIC_KEY "\": \"%s\",\n  \"" SECRET_KEY "\": \"%s\"\n}";
-
-  u32 expected_len = strlen(json_out_template) +
-                     Base64encode_len((int)public_input_len) +
-                     Base64encode_len((int)secret_input_len);
-
-  char *encoded_public = ck_alloc(expected_len);
-  Base64encode(encoded_public, public_input, (int)public_input_len);
-
-  char *encoded_secret = ck_alloc(expected_len);
-  Base64encode(encoded_secret, secret_input, (int)secret_input_len);
-
-  *combined_buf = ck_alloc(expected_len);
-  *combined_buf_len = snprintf(*combined_buf,
-                               expected_len,
-                               json_out_template,
-                               encoded_public,
-                               encoded_secret);
-
-  if (*combined_buf_len >= expected_len) {
-    FATAL("Would expect the output str to be shorter than %u characters, was %u chars\nRAW: %s", expected_len, *combined_buf_len, *combined_buf);
-  }
-
-  ck_free(encoded_public);
-  ck_free(encoded_secret);
-}
-
 void public_input_for_queue_entry(struct queue_entry *q, char **public_input, u32 *public_len) {
   if (!q->testcase_buf) {
     FATAL("testcase_buf not loaded for queue_entry!");
@@ -167,19 +70,44 @@ void secret_input_for_queue_entry(struct queue_entry *q, char **secret_input, u3
   q->secret_input_start[q->secret_input_len] = tmp;
 }
 
-// HASHMAP FUNCTIONS
-
-uint64_t input_hash(const void *io_hash,
-                    __attribute__((unused)) uint64_t seed0,
-                    __attribute__((unused)) uint64_t seed1) {
-  return ((const struct input_output_hashes *)io_hash)->public_input_hash;
+u32 leak_io_map_count(afl_state_t *afl) {
+  if (!afl->public_input_to_output_map) { return 0; }
+  return leak_iomap_count(afl->public_input_to_output_map);
 }
 
-int32_t input_compare(const void *a, const void *b, __attribute__((unused)) void *udata) {
-  const struct input_output_hashes *io1 = a, *io2 = b;
-  return io1->public_input_hash < io2->public_input_hash;
+/* Memory held by the io map: the table, plus the inputs and outputs kept
+   for leak candidates. */
+
+u64 leak_io_map_mem(afl_state_t *afl) {
+  if (!afl->public_input_to_output_map) { return 0; }
+  return leak_iomap_mem(afl->public_input_to_output_map) +
+         afl->leak_io_map_bytes;
 }
 
+/* Would leakage_save_if_interesting() leave the io map alone for this
+   secret and output? Mirrors its checks, without running anything. */
+
+u8 leak_io_map_settled(afl_state_t *afl, u64 public_input_hash,
+                       u8 *secret_input_buf, u32 secret_len, u64 output_hash) {
+  struct input_output_hashes *found =
+      leak_iomap_get(afl->public_input_to_output_map, public_input_hash);
+
+  if (!found) { return 0; }
+
+  if (!found->secret_input_bufs_filled) {
+    return output_hash == found->output_hashes[0];
+  }
+
+  for (int i = 0; i < found->secret_input_bufs_filled; i++) {
+    if (output_hash == found->output_hashes[i] ||
+        (secret_len == found->secret_input_buf_len[i] &&
+         !memcmp(secret_input_buf, found->secret_input_bufs[i], secret_len))) {
+      return 1;
+    }
+  }
+
+  return found->secret_input_bufs_filled >= SECRET_BUFS_COUNT;
+}
 
 /* Adds the new queue entry to the cache. */
 
@@ -246,26 +174,97 @@ static inline void leakage_queue_testcase_store_mem(afl_state_t *afl, struct que
 
 }
 
-u8 check_for_instability(afl_state_t *afl, const u8 *in_buf, u32 in_len) {
+/* Hash of what the last run let an attacker see. */
+
+u64 leak_output_hash(afl_forkserver_t *fsrv) {
+
+  if (fsrv->leak_obs_digested) { return fsrv->leak_obs_digest; }
+
+  return hash64(fsrv->stdout_raw_buffer, fsrv->stdout_raw_buffer_len,
+                HASH_CONST);
+
+}
+
+u8 leak_taint_new_bits(afl_state_t *afl, afl_forkserver_t *fsrv, u8 update) {
+
+  u64 *cur = (u64 *)fsrv->leak_obs->taint_map;
+  u64 *virgin = (u64 *)afl->virgin_taint;
+  u8   ret = 0;
+  u32  i, j;
+
+  for (i = 0; i < LEAK_TAINT_MAP_SIZE / 8; ++i) {
+
+    if (likely(!(cur[i] & virgin[i]))) { continue; }
+    if (!update) { return 1; }
+
+    u8 *c = (u8 *)&cur[i], *v = (u8 *)&virgin[i];
+
+    for (j = 0; j < 8; ++j) {
+
+      if (c[j] && v[j]) {
+
+        v[j] = 0;
+        ++afl->leak_taint_edges;
+
+      }
+
+    }
+
+    ret = 1;
+
+  }
+
+  return ret;
+
+}
+
+/* Is the last run's output new for the path it took? The (coverage, output)
+   pair picks a bit in a fixed size map, a new one counts unless the path
+   has had LEAK_OBS_PATH_CLASSES of them already: targets that echo their
+   public input would otherwise queue every exec. Needs a classified trace.
+   Marks the pair as seen. */
+
+u8 leak_obs_new_class(afl_state_t *afl, afl_forkserver_t *fsrv,
+                      u64 output_hash) {
+
+  u64 cksum = hash64(fsrv->trace_bits, fsrv->map_size, HASH_CONST);
+  u64 bit = (cksum ^ (output_hash << 32 | output_hash >> 32)) &
+            (LEAK_OBS_MAP_SIZE - 1);
+  u8 *path_cnt = &afl->leak_obs_path_cnt[cksum & (LEAK_OBS_PATHS - 1)];
+
+  if (likely(afl->leak_obs_seen[bit >> 3] & (1 << (bit & 7)))) { return 0; }
+
+  afl->leak_obs_seen[bit >> 3] |= 1 << (bit & 7);
+  ++afl->leak_obs_classes;
+
+  if (*path_cnt >= LEAK_OBS_PATH_CLASSES) { return 0; }
+  ++*path_cnt;
+  return 1;
+
+}
+
+static u8 check_output_stable(afl_state_t *afl, afl_forkserver_t *fsrv,
+                              const u8 *in_buf, u32 in_len) {
   static u8 *expected_out_buf = NULL;
   static u32 expected_out_len = 0;
 
-  if (afl->fsrv.stdout_raw_buffer_len > expected_out_len) {
-    expected_out_buf = ck_realloc(expected_out_buf, afl->fsrv.stdout_raw_buffer_len);
+  if (fsrv->stdout_raw_buffer_len > expected_out_len) {
+    expected_out_buf = ck_realloc(expected_out_buf, fsrv->stdout_raw_buffer_len);
   }
-  expected_out_len = afl->fsrv.stdout_raw_buffer_len;
-  memcpy(expected_out_buf, afl->fsrv.stdout_raw_buffer, afl->fsrv.stdout_raw_buffer_len);
+  expected_out_len = fsrv->stdout_raw_buffer_len;
+  memcpy(expected_out_buf, fsrv->stdout_raw_buffer, fsrv->stdout_raw_buffer_len);
 
   for (int i = 0; i < 100; i++) {
-    write_to_testcase(afl, (void *)in_buf, in_len);
-    u8 fault = fuzz_run_target(afl, &afl->fsrv, afl->fsrv.exec_tmout);
+    leak_write_to_testcase(afl, fsrv, (void *)in_buf, in_len);
+    u8 fault = fuzz_run_target(afl, fsrv, afl->fsrv.exec_tmout);
+    ++afl->leak_phase_execs[LEAK_PHASE_STABILITY];
     if (fault) {
       printf("Discarding potential leaky input as it gave a fault\n");
       return 1;
     }
 
-    if (afl->fsrv.stdout_raw_buffer_len != expected_out_len ||
-        memcmp(afl->fsrv.stdout_raw_buffer, expected_out_buf, expected_out_len)) {
+    if (fsrv->stdout_raw_buffer_len != expected_out_len ||
+        memcmp(fsrv->stdout_raw_buffer, expected_out_buf, expected_out_len)) {
 
       if (!expected_out_len) {
         // silently return 1, as empty output seems to be a forkserver issue
@@ -277,7 +276,7 @@ u8 check_for_instability(afl_state_t *afl, const u8 *in_buf, u32 in_len) {
       printf("Input:\n%.*s\n", in_len, in_buf);
 
       printf("First run output (%d bytes), ", expected_out_len);
-      printf("Repeat %d run output (%d bytes).\n", i, afl->fsrv.stdout_raw_buffer_len);
+      printf("Repeat %d run output (%d bytes).\n", i, fsrv->stdout_raw_buffer_len);
 
       return 1;
     }
@@ -286,12 +285,52 @@ u8 check_for_instability(afl_state_t *afl, const u8 *in_buf, u32 in_len) {
   return 0;
 }
 
+/* Rerun a leak candidate to see whether its output is for real. If the
+   target only published a digest of it, fetch the bytes first: the leak
+   gets stored with them. Either way, they are in stdout_raw_buffer when
+   this returns 0. The reruns do not use the secret snapshot, so a leak
+   that only shows in runs forked from it is not confirmed. The reruns go to
+   fsrv, the fork server of the run that found the candidate. */
+
+u8 check_for_instability(afl_state_t *afl, afl_forkserver_t *fsrv,
+                         const u8 *in_buf, u32 in_len) {
+
+  u8 unstable;
+
+  fsrv->leak_snap_bypass = 1;
+
+  if (!fsrv->leak_obs_digested) {
+
+    unstable = check_output_stable(afl, fsrv, in_buf, in_len);
+
+  } else {
+
+    u64 digest = fsrv->leak_obs_digest;
+
+    fsrv->leak_obs->want_bytes = 1;
+
+    leak_write_to_testcase(afl, fsrv, (void *)in_buf, in_len);
+    unstable = fuzz_run_target(afl, fsrv, afl->fsrv.exec_tmout) ||
+               hash64(fsrv->stdout_raw_buffer,
+                      fsrv->stdout_raw_buffer_len, HASH_CONST) != digest ||
+               check_output_stable(afl, fsrv, in_buf, in_len);
+    ++afl->leak_phase_execs[LEAK_PHASE_STABILITY];
+
+    fsrv->leak_obs->want_bytes = 0;
+
+  }
+
+  fsrv->leak_snap_bypass = 0;
+  return unstable;
+
+}
+
 /* Check if the result of an execve() during routine fuzzing is interesting,
    save or queue the input test case for further analysis if so. Returns 1 if
    entry is saved, 0 otherwise. */
 
 u8 __attribute__((hot))
-leakage_save_if_interesting(afl_state_t *afl,
+leakage_save_if_interesting(afl_state_t *afl, afl_forkserver_t *fsrv,
                             void *combined_buf, u32 combined_len,
                             u8 *public_input_buf, u32 public_len,
                             u8 *secret_input_buf, u32 secret_len,
@@ -302,7 +341,7 @@ leakage_save_if_interesting(afl_state_t *afl,
   u8 *queue_fn = "";
   u8  new_bits = '\0';
   s32 fd;
-  u8  keeping = 0, res, classified = 0;
+  u8  keeping = 0, res, classified = 0, new_taint = 0, new_obs = 0;
   u64 cksum = 0;
 
   u8 fn[PATH_MAX];
@@ -313,7 +352,7 @@ leakage_save_if_interesting(afl_state_t *afl,
      only be used for special schedules */
   if (unlikely(afl->schedule >= FAST && afl->schedule <= RARE)) {
 
-    cksum = hash64(afl->fsrv.trace_bits, afl->fsrv.map_size, HASH_CONST);
+    cksum = hash64(fsrv->trace_bits, fsrv->map_size, HASH_CONST);
 
     /* Saturated increment */
     if (afl->n_fuzz[cksum % N_FUZZ_SIZE] < 0xFFFFFFFF)
@@ -322,20 +361,15 @@ leakage_save_if_interesting(afl_state_t *afl,
   }
 
   u64 input_hash = hash64(public_input_buf, public_len, HASH_CONST);
-  struct input_output_hashes sought = { .public_input_hash = input_hash };
-  struct input_output_hashes *found = hashmap_get(
-      afl->public_input_to_output_map,
-      &sought
-  );
+  struct input_output_hashes *found =
+      leak_iomap_get(afl->public_input_to_output_map, input_hash);
 
-  u64 output_hash = hash64(afl->fsrv.stdout_raw_buffer,
-                           afl->fsrv.stdout_raw_buffer_len,
-                           HASH_CONST);
+  u64 output_hash = leak_output_hash(fsrv);
 
   if (!found) {
 
-    u64 secret_input_hash = hash64(secret_input_buf, secret_len, HASH_CONST);
-    sought.secret_input_hash = secret_input_hash;
+    struct input_output_hashes sought = { .public_input_hash = input_hash };
+    sought.secret_input_hash = hash64(secret_input_buf, secret_len, HASH_CONST);
     sought.output_hashes[0] = output_hash;
 
 //    {
@@ -357,7 +391,7 @@ leakage_save_if_interesting(afl_state_t *afl,
 //      free(tmp);
 //    }
 
-    hashmap_set(afl->public_input_to_output_map, &sought);
+    leak_iomap_put(afl->public_input_to_output_map, &sought);
 //    printf("Added to io_map { L: %llu, H: %llu, OUT: %llu }\n",
 //           sought.public_input_hash, sought.secret_input_hash, sought.output_hash);
 
@@ -383,15 +417,19 @@ leakage_save_if_interesting(afl_state_t *afl,
       goto skip_leak_check;
     }
 
-    u8 unstable = check_for_instability(afl, combined_buf, combined_len);
+    u8 unstable = check_for_instability(afl, fsrv, combined_buf, combined_len);
 
-    if (unstable) goto skip_leak_check;
+    if (unstable) {
+      ++afl->leak_unstable_rejects;
+      goto skip_leak_check;
+    }
 
     if (!found->public_input_buf) {
       // Store a copy of the public input
       found->public_input_buf_len = public_len;
       found->public_input_buf = ck_alloc(public_len);
       memcpy(found->public_input_buf, public_input_buf, public_len);
+      afl->leak_io_map_bytes += public_len;
     }
 
     // Store a copy of the secret input
@@ -402,105 +440,31 @@ leakage_save_if_interesting(afl_state_t *afl,
     found->output_hashes[pos] = output_hash;
     found->secret_input_bufs_filled++;
 
+    // This secret changed the observation for a known public input - keep it
+    afl->secret_pool_grown += add_to_secret_pool(afl, secret_input_buf, secret_len);
+
     // Store a copy of the output
-    found->public_output_buf_len[pos] = afl->fsrv.stdout_raw_buffer_len;
-    found->public_output_bufs[pos] = ck_alloc(afl->fsrv.stdout_raw_buffer_len);
-    memcpy(found->public_output_bufs[pos], afl->fsrv.stdout_raw_buffer, afl->fsrv.stdout_raw_buffer_len);
+    found->public_output_buf_len[pos] = fsrv->stdout_raw_buffer_len;
+    found->public_output_bufs[pos] = ck_alloc(fsrv->stdout_raw_buffer_len);
+    memcpy(found->public_output_bufs[pos], fsrv->stdout_raw_buffer, fsrv->stdout_raw_buffer_len);
+    afl->leak_io_map_bytes += secret_len + fsrv->stdout_raw_buffer_len;
 
     if (found->secret_input_bufs_filled <= 1) {
       afl->detected_leaks_count++;
     } else {
-      char buf[280];
-      snprintf(buf, 280, "%s/leaks", afl->out_dir);
-
-      if (!afl->stored_hypertest_leaks_count) {
-        DIR *leaks_dir = opendir(buf);
-
-        if (leaks_dir) {
-          if (delete_files((u8 *)buf, (u8 *)"leak")) {
-            FATAL("Failed to delete files in %s", buf);
-          }
+      afl->confirmed_leaks_count++;
+      afl->last_leak_time = get_cur_time();
+
+      // Only log the first few leaks with the same root cause
+      struct leak_bucket *bucket = leak_bucket_classify(afl, fsrv, found);
+      if ((!afl->leak_bucket_exemplars ||
+           bucket->count <= afl->leak_bucket_exemplars) &&
+          !leak_log_seen(afl, found->public_input_hash)) {
+        afl->stored_hypertest_leaks_count++;
+        if (!bucket->first_leak_id) {
+          bucket->first_leak_id = afl->stored_hypertest_leaks_count;
         }
-
-        if (mkdir(buf, 0777)) { FATAL("Failed to create dir %s", buf); }
-
-        leaks_dir = opendir(buf);
-        if (!leaks_dir) { FATAL("Failed to open dir %s after mkdir??", buf); }
-
-        closedir(leaks_dir);
-      }
-
-      afl->stored_hypertest_leaks_count++;
-
-      uint64_t currTime = get_cur_time() + afl->prev_run_time - afl->start_time;
-
-      char *leak_input = (char *)alloc_printf(
-         "%s/leak_id:%04u,time:%lu,input_1",
-         buf,
-         afl->stored_hypertest_leaks_count,
-         currTime
-      );
-      printf("storing to %s\n", leak_input);
-      fd = open(leak_input, O_WRONLY | O_CREAT | O_EXCL, DEFAULT_PERMISSION);
-      if (unlikely(fd < 0)) { PFATAL("Unable to create '%s'", leak_input); }
-
-      char *leak_full = (char *)alloc_printf(
-         "%s/leak_id:%04u,time:%lu,full",
-         buf,
-         afl->stored_hypertest_leaks_count,
-         currTime
-      );
-      int full_fd = open(leak_full, O_WRONLY | O_CREAT | O_EXCL, DEFAULT_PERMISSION);
-      if (unlikely(fd < 0)) { PFATAL("Unable to create '%s'", leak_full); }
-
-      char *comb_buf;
-      u32   comb_len;
-      create_buffer_from_public_and_secret_inputs(
-          found->public_input_buf, found->public_input_buf_len,
-          found->secret_input_bufs[0], found->secret_input_buf_len[0],
-          &comb_buf, &comb_len);
-      ck_write(fd, comb_buf, comb_len, leak_input);
-      ck_write(full_fd, comb_buf, comb_len, leak_full);
-      close(fd);
-      ck_free(comb_buf);
-
-      char newlines[2] = { '\n', '\n' };
-      ck_write(full_fd, newlines, 2, leak_full);
-      ck_write(full_fd, found->public_output_bufs[0], found->public_output_buf_len[0], leak_full);
-      char hashStr[80];
-      snprintf(hashStr, 80, "\n%llu", found->output_hashes[0]);
-      ck_write(full_fd, hashStr, strlen(hashStr), leak_full);
-      ck_write(full_fd, newlines, 2, leak_full);
-
-      leak_input = (char *)alloc_printf(
-         "%s/leak_id:%04u,time:%lu,input_2",
-         buf,
-         afl->stored_hypertest_leaks_count,
-         currTime
-      );
-
-      printf("storing to %s\n", leak_input);
-      fd = open(leak_input, O_WRONLY | O_CREAT | O_EXCL, DEFAULT_PERMISSION);
-      if (unlikely(fd < 0)) { PFATAL("Unable to create '%s'", leak_input); }
-
-      create_buffer_from_public_and_secret_inputs(
-          found->public_input_buf, found->public_input_buf_len,
-          found->secret_input_bufs[1], found->secret_input_buf_len[1],
-          &comb_buf, &comb_len);
-      ck_write(fd, comb_buf, comb_len, leak_input);
-      ck_write(full_fd, comb_buf, comb_len, leak_full);
-      close(fd);
-      ck_free(comb_buf);
-
-      ck_write(full_fd, newlines, 2, leak_full);
-      ck_write(full_fd, found->public_output_bufs[1], found->public_output_buf_len[1], leak_full);
-      snprintf(hashStr, 80, "\n%llu", found->output_hashes[1]);
-      ck_write(full_fd, hashStr, strlen(hashStr), leak_full);
-      close(full_fd);
-
-      if (afl->stored_hypertest_leaks_count >= 9999) {
-        printf("Found 9999 leaking input pairs - stopping to save space!\n");
-        afl->stop_soon = 1;
+        leak_log_add(afl, found, bucket->id);
       }
     }
   }
@@ -512,22 +476,46 @@ skip_leak_check:
     /* Keep only if there are new bits in the map, add to queue for
        future fuzzing, etc. */
 
-    new_bits = has_new_bits_unclassified(afl, afl->virgin_bits);
+    if (unlikely(afl->leak_obs_seen)) {
+
+      classify_counts(fsrv);
+      classified = 1;
+      new_bits = has_new_bits_fsrv(afl, fsrv, afl->virgin_bits);
+
+    } else {
+
+      new_bits = has_new_bits_unclassified_fsrv(afl, fsrv, afl->virgin_bits);
+      classified = new_bits;
+
+    }
+
+    /* The secret steering a branch somewhere new is worth an entry of its
+       own, even without new coverage. */
+
+    if (unlikely(afl->leak_taint)) { new_taint = leak_taint_new_bits(afl, fsrv, 1); }
+
+    /* So is an output the path has not produced before. */
 
-    if (likely(!new_bits)) {
+    if (unlikely(afl->leak_obs_seen)) {
+
+      new_obs = leak_obs_new_class(afl, fsrv, output_hash) && !new_bits &&
+                !new_taint;
+
+    }
+
+    if (likely(!new_bits && !new_taint && !new_obs)) {
 
       if (unlikely(afl->crash_mode)) { ++afl->total_crashes; }
       return 0;
 
     }
 
-    classified = new_bits;
-
 #ifndef SIMPLE_FILES
 
     queue_fn = alloc_printf(
         "%s/queue/id:%06u,%s", afl->out_dir, afl->queued_paths,
-        describe_op(afl, new_bits, NAME_MAX - strlen("id:000000,")));
+        describe_op(afl, new_bits | (new_taint << 2) | (new_obs << 3),
+                    NAME_MAX - strlen("id:000000,")));
 
 #else
 
@@ -579,6 +567,15 @@ skip_leak_check:
 
     }
 
+    if (new_taint) {
+
+      afl->queue_top->has_new_taint = 1;
+      ++afl->queued_with_taint;
+
+    }
+
+    if (new_obs) { ++afl->queued_with_obs; }
+
     /* AFLFast schedule? update the new queue entry */
     if (cksum) {
 
@@ -589,10 +586,11 @@ skip_leak_check:
 
     /* due to classify counts we have to recalculate the checksum */
     cksum = afl->queue_top->exec_cksum =
-        hash64(afl->fsrv.trace_bits, afl->fsrv.map_size, HASH_CONST);
+        hash64(fsrv->trace_bits, fsrv->map_size, HASH_CONST);
 
     /* Try to calibrate inline; this also calls update_bitmap_score() when
-       successful. */
+       successful. Calibration runs on the main fork server, which is where
+       the output is taken from below. */
 
     res = calibrate_case(afl, afl->queue_top, combined_buf, afl->queue_cycle - 1, 0);
 
@@ -641,14 +639,18 @@ skip_leak_check:
 
         if (!classified) {
 
-          classify_counts(&afl->fsrv);
+          classify_counts(fsrv);
           classified = 1;
 
         }
 
-        simplify_trace(afl, afl->fsrv.trace_bits);
+        simplify_trace(afl, fsrv->trace_bits);
+
+        if (!has_new_bits_fsrv(afl, fsrv, afl->virgin_tmout)) {
+
+          return keeping;
 
-        if (!has_new_bits(afl, afl->virgin_tmout)) { return keeping; }
+        }
 
       }
 
@@ -740,11 +742,15 @@ skip_leak_check:
 
       if (likely(!afl->non_instrumented_mode)) {
 
-        if (!classified) { classify_counts(&afl->fsrv); }
+        if (!classified) { classify_counts(fsrv); }
+
+        simplify_trace(afl, fsrv->trace_bits);
 
-        simplify_trace(afl, afl->fsrv.trace_bits);
+        if (!has_new_bits_fsrv(afl, fsrv, afl->virgin_crash)) {
 
-        if (!has_new_bits(afl, afl->virgin_crash)) { return keeping; }
+          return keeping;
+
+        }
 
       }
 
@@ -753,7 +759,7 @@ skip_leak_check:
 #ifndef SIMPLE_FILES
 
       snprintf(fn, PATH_MAX, "%s/crashes/id:%06llu,sig:%02u,%s", afl->out_dir,
-               afl->unique_crashes, afl->fsrv.last_kill_signal,
+               afl->unique_crashes, fsrv->last_kill_signal,
                describe_op(afl, 0, NAME_MAX - strlen("id:000000,sig:00,")));
 
 #else
@@ -0,0 +1,136 @@
+/*
+   american fuzzy lop++ - in-process secret batches
+   ------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Pairing a public input with n secrets normally takes n execs, each one
+   paying for the fork server round trip and the stdout drain. Targets built
+   with utils/leakage_driver take the whole batch in a single exec instead:
+   they run the target function once per secret, in-process, and leave a
+   digest of every observation in the leak_obs_map (see leak_obs.h).
+
+   The digests are checked against the io map right away. Only secrets that
+   would change it, i.e. leak candidates, run again on their own to get the
+   output bytes and the stability check. A batch that does not end cleanly
+   or has new coverage is run secret by secret, so that queue entries,
+   crashes and hangs keep referring to a single testcase. The batch trace
+   holds the highest hit count of any of its runs, so a lower hit count
+   bucket reached by one secret can go unnoticed while pairing.
+
+ */
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+#include "leak_obs.h"
+
+/* Run the public input against cnt secrets. Returns 1 if fuzzing of the
+   entry should be abandoned, like leakage_fuzz_stuff(). */
+
+u8 leakage_fuzz_batch(afl_state_t *afl, u8 *public_buf, u32 public_len,
+                      u8 **secret_bufs, u32 *secret_lens, u32 cnt) {
+
+  struct leak_obs_map *   obs = afl->fsrv.leak_obs;
+  struct leak_batch_header hdr = {
+
+      .magic = LEAK_BATCH_MAGIC, .count = cnt, .public_len = public_len};
+
+  u64 digest[LEAK_BATCH_MAX];
+  u32 len = sizeof(hdr) + public_len, i;
+  u8  fault, *buf, *pos;
+
+  if (unlikely(cnt > LEAK_BATCH_MAX)) { FATAL("Batch of %u secrets", cnt); }
+
+  for (i = 0; i < cnt; ++i) {
+
+    hdr.secret_len[i] = secret_lens[i];
+    len += secret_lens[i];
+
+  }
+
+  if (unlikely(len > MAX_FILE)) { goto one_by_one; }
+
+  buf = pos = ck_alloc_nozero(len);
+  memcpy(pos, &hdr, sizeof(hdr));
+  pos += sizeof(hdr);
+  memcpy(pos, public_buf, public_len);
+  pos += public_len;
+
+  for (i = 0; i < cnt; ++i) {
+
+    memcpy(pos, secret_bufs[i], secret_lens[i]);
+    pos += secret_lens[i];
+
+  }
+
+  write_to_testcase(afl, buf, len);
+  ck_free(buf);
+
+  obs->count = 0;
+  fault = fuzz_run_target(afl, &afl->fsrv, afl->fsrv.exec_tmout * cnt);
+  ++afl->leak_phase_execs[afl->leak_exec_phase];
+  ++afl->leak_batch_execs;
+
+  if (afl->stop_soon) { return 1; }
+
+  if (fault != FSRV_RUN_OK || obs->count != cnt ||
+      skim_new_bits(afl, afl->virgin_bits) ||
+      (afl->leak_taint && leak_taint_new_bits(afl, &afl->fsrv, 0))) {
+
+    goto one_by_one;
+
+  }
+
+  /* Runs below overwrite the shm. */
+
+  memcpy(digest, obs->digest, cnt * sizeof(u64));
+  afl->leak_batch_secrets += cnt;
+
+  u64 public_hash = hash64(public_buf, public_len, HASH_CONST);
+
+  for (i = 0; i < cnt; ++i) {
+
+    if (leak_io_map_settled(afl, public_hash, secret_bufs[i], secret_lens[i],
+                            digest[i])) {
+
+      continue;
+
+    }
+
+    afl->stage_cur = i;
+    ++afl->leak_batch_reruns;
+
+    if (leakage_fuzz_stuff(afl, public_buf, public_len, secret_bufs[i],
+                           secret_lens[i])) {
+
+      return 1;
+
+    }
+
+  }
+
+  return 0;
+
+one_by_one:
+
+  for (i = 0; i < cnt; ++i) {
+
+    afl->stage_cur = i;
+
+    if (leakage_fuzz_stuff(afl, public_buf, public_len, secret_bufs[i],
+                           secret_lens[i])) {
+
+      return 1;
+
+    }
+
+  }
+
+  return 0;
+
+}
+
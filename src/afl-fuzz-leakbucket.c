@@ -0,0 +1,296 @@
+/*
+   american fuzzy lop++ - leak bucketing
+   -------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A single leaking code path is usually reachable from many public inputs,
+   and every one of them becomes a confirmed leak. Much like virgin_crash
+   does for crashes, confirmed leaks are bucketed here by a signature of
+   where the leak shows:
+
+     - the first offset at which the two outputs differ, plus a hash of the
+       output bytes leading up to it, and
+
+     - the set of edges that only one of the two secrets covers.
+
+   Only the first AFL_LEAK_BUCKET_EXEMPLARS leaks of each bucket are written
+   to the leak log, the rest are just counted. Per-bucket counts end up in
+   leaks/buckets.
+
+ */
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+#include "hashmap.h"
+#include "leak_obs.h"
+
+struct leak_bucket_entry {
+
+  u64 signature;
+  u32 idx;                              /* Into afl->leak_buckets           */
+
+};
+
+static uint64_t bucket_entry_hash(const void *item, uint64_t seed0,
+                                  uint64_t seed1) {
+
+  const struct leak_bucket_entry *e = item;
+  (void)seed1;
+  return e->signature ^ seed0;
+
+}
+
+static int bucket_entry_compare(const void *a, const void *b, void *udata) {
+
+  const struct leak_bucket_entry *ea = a, *eb = b;
+  (void)udata;
+  return ea->signature != eb->signature;
+
+}
+
+/* Append a bucket with the next id, the caller fills in the rest. */
+
+static struct leak_bucket *new_bucket(afl_state_t *afl, u64 signature) {
+
+  if (unlikely(!afl->leak_bucket_map)) {
+
+    afl->leak_bucket_map =
+        hashmap_new(sizeof(struct leak_bucket_entry), 0, 0, 0,
+                    bucket_entry_hash, bucket_entry_compare, NULL, NULL);
+
+  }
+
+  afl->leak_buckets = ck_realloc(
+      afl->leak_buckets, (afl->leak_buckets_cnt + 1) * sizeof(struct leak_bucket));
+
+  struct leak_bucket *     b = &afl->leak_buckets[afl->leak_buckets_cnt];
+  struct leak_bucket_entry e = {.signature = signature,
+                                .idx = afl->leak_buckets_cnt++};
+
+  hashmap_set(afl->leak_bucket_map, &e);
+
+  b->signature = signature;
+  b->id = afl->leak_buckets_cnt;
+  return b;
+
+}
+
+/* Hash the set of edges hit by exactly one of the two traces. Hit counts
+   are ignored, loop iterations that depend on the secret would otherwise
+   split a single leak into many buckets. */
+
+static u64 coverage_diff_hash(u8 *a, u8 *b, u32 map_size, u32 *edges) {
+
+  u64 h = 0xcbf29ce484222325ULL;
+  u32 i;
+
+  *edges = 0;
+
+  for (i = 0; i < map_size; ++i) {
+
+    if (!a[i] != !b[i]) {
+
+      h = (h ^ i) * 0x100000001b3ULL;
+      ++*edges;
+
+    }
+
+  }
+
+  return h;
+
+}
+
+/* Work out the bucket of a confirmed leak, i.e. an io-map entry with both
+   secrets filled in. Must be called right after the run of the second
+   secret on fsrv, with its trace still in trace_bits; the first secret is
+   run once more on fsrv to get its coverage. Of what that run leaves in
+   fsrv, trace_bits, stdout_raw_buffer(_len), leak_obs_digested/_digest and
+   the leak_obs map (up to the observed bytes it kept) are put back as the
+   second secret left them. Not restored: the testcase (out_file or shared
+   memory) holds the first secret, and child_status, last_run_timed_out and
+   total_execs are those of the extra run. */
+
+struct leak_bucket *leak_bucket_classify(afl_state_t *afl,
+                                         afl_forkserver_t *fsrv,
+                                         struct input_output_hashes *leak) {
+
+  u8 *out0 = leak->public_output_bufs[0], *out1 = leak->public_output_bufs[1];
+  u32 len0 = leak->public_output_buf_len[0],
+      len1 = leak->public_output_buf_len[1];
+  u32 diff_offset = 0, cov_edges;
+
+  while (diff_offset < len0 && diff_offset < len1 &&
+         out0[diff_offset] == out1[diff_offset]) {
+
+    ++diff_offset;
+
+  }
+
+  u32 ctx_start =
+      diff_offset > LEAK_BUCKET_CONTEXT ? diff_offset - LEAK_BUCKET_CONTEXT : 0;
+
+  if (unlikely(!afl->leak_bucket_trace)) {
+
+    afl->leak_bucket_trace = ck_alloc(fsrv->map_size);
+
+  }
+
+  memcpy(afl->leak_bucket_trace, fsrv->trace_bits, fsrv->map_size);
+
+  u32 out_len = fsrv->stdout_raw_buffer_len, obs_len = 0;
+  u8  obs_digested = fsrv->leak_obs_digested;
+  u64 obs_digest = fsrv->leak_obs_digest;
+
+  if (fsrv->leak_obs) {
+
+    obs_len = offsetof(struct leak_obs_map, bytes);
+    if (fsrv->leak_obs->kept_bytes) { obs_len += fsrv->leak_obs->bytes_len; }
+
+  }
+
+  afl->leak_bucket_saved =
+      ck_realloc(afl->leak_bucket_saved, out_len + obs_len + 1);
+  memcpy(afl->leak_bucket_saved, fsrv->stdout_raw_buffer, out_len);
+  if (obs_len) {
+
+    memcpy(afl->leak_bucket_saved + out_len, fsrv->leak_obs, obs_len);
+
+  }
+
+  char *comb_buf;
+  u32   comb_len;
+  create_buffer_from_public_and_secret_inputs(
+      leak->public_input_buf, leak->public_input_buf_len,
+      leak->secret_input_bufs[0], leak->secret_input_buf_len[0], &comb_buf,
+      &comb_len);
+  leak_write_to_testcase(afl, fsrv, comb_buf, comb_len);
+  (void)fuzz_run_target(afl, fsrv, afl->fsrv.exec_tmout);
+  ++afl->leak_phase_execs[LEAK_PHASE_BUCKET];
+  ck_free(comb_buf);
+
+  u64 sig[3] = {
+
+      diff_offset,
+      hash64(out0 + ctx_start, diff_offset - ctx_start, HASH_CONST),
+      coverage_diff_hash(afl->leak_bucket_trace, fsrv->trace_bits,
+                         fsrv->map_size, &cov_edges)
+
+  };
+
+  memcpy(fsrv->trace_bits, afl->leak_bucket_trace, fsrv->map_size);
+
+  /* The extra run only ever grows stdout_raw_buffer. */
+
+  memcpy(fsrv->stdout_raw_buffer, afl->leak_bucket_saved, out_len);
+  fsrv->stdout_raw_buffer_len = out_len;
+  fsrv->leak_obs_digested = obs_digested;
+  fsrv->leak_obs_digest = obs_digest;
+  if (obs_len) {
+
+    memcpy(fsrv->leak_obs, afl->leak_bucket_saved + out_len, obs_len);
+
+  }
+
+  struct leak_bucket_entry  sought = {.signature =
+                                         hash64((u8 *)sig, sizeof(sig),
+                                                HASH_CONST)};
+  struct leak_bucket_entry *found;
+
+  found =
+      afl->leak_bucket_map ? hashmap_get(afl->leak_bucket_map, &sought) : NULL;
+
+  if (found) {
+
+    struct leak_bucket *b = &afl->leak_buckets[found->idx];
+    ++b->count;
+    return b;
+
+  }
+
+  struct leak_bucket *b = new_bucket(afl, sought.signature);
+
+  b->diff_offset = diff_offset;
+  b->cov_edges = cov_edges;
+  b->count = 1;
+  b->first_leak_id = 0;
+
+  return b;
+
+}
+
+/* Write per-bucket counts to leaks/buckets. */
+
+void write_leak_buckets(afl_state_t *afl) {
+
+  u8    fn[PATH_MAX];
+  FILE *f;
+
+  snprintf(fn, PATH_MAX, "%s/leaks/buckets", afl->out_dir);
+  f = create_ffile(fn);
+
+  fprintf(f, "# bucket,leaks,first_leak,diff_offset,cov_diff_edges,signature\n");
+
+  for (u32 i = 0; i < afl->leak_buckets_cnt; ++i) {
+
+    struct leak_bucket *b = &afl->leak_buckets[i];
+
+    fprintf(f, "%u,%llu,%u,%u,%u,%016llx\n", b->id, b->count, b->first_leak_id,
+            b->diff_offset, b->cov_edges, b->signature);
+
+  }
+
+  fclose(f);
+
+}
+
+/* On in-place resume, take the buckets of the last session back from
+   leaks/buckets, so the bucket ids in the leak log keep their meaning. */
+
+void load_leak_buckets(afl_state_t *afl) {
+
+  u8    fn[PATH_MAX], line[MAX_LINE];
+  FILE *f;
+
+  snprintf(fn, PATH_MAX, "%s/leaks/buckets", afl->out_dir);
+  f = fopen(fn, "r");
+  if (!f) { return; }
+
+  while (fgets(line, sizeof(line), f)) {
+
+    struct leak_bucket b;
+
+    if (line[0] == '#') { continue; }
+
+    if (sscanf(line, "%u,%llu,%u,%u,%u,%llx", &b.id, &b.count,
+               &b.first_leak_id, &b.diff_offset, &b.cov_edges,
+               &b.signature) != 6 ||
+        b.id != afl->leak_buckets_cnt + 1) {
+
+      WARNF("Stopped reading '%s' at a damaged line", fn);
+      break;
+
+    }
+
+    *new_bucket(afl, b.signature) = b;
+
+  }
+
+  fclose(f);
+
+}
+
+void leak_buckets_deinit(afl_state_t *afl) {
+
+  if (afl->leak_bucket_map) { hashmap_free(afl->leak_bucket_map); }
+  ck_free(afl->leak_buckets);
+  ck_free(afl->leak_bucket_trace);
+  ck_free(afl->leak_bucket_saved);
+
+}
+
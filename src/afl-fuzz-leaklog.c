@@ -0,0 +1,656 @@
+/*
+   american fuzzy lop++ - leak log writer
+   --------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Appends confirmed leaks to <out_dir>/leaks/{index,blobs}, see leak_log.h
+   for the on-disk format. Both files go through a small write buffer that
+   is pushed to disk from show_stats() and on exit, so finding a burst of
+   leaks costs a few memcpy()s instead of three file creations each.
+
+   With -M/-S, leak_log_sync() also takes over the leaks other instances
+   logged, so that every log ends up with the campaign-wide set.
+
+ */
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+#include "leak_log.h"
+#include "hashmap.h"
+
+struct leak_log_writer {
+
+  s32 fd;
+  u8 *fn;
+  u8 *buf;                              /* Pending data, LEAK_LOG_BUF_SIZE  */
+  u32 used;                             /* Bytes pending in buf             */
+  u64 size;                             /* File size, including pending     */
+
+};
+
+struct leak_log {
+
+  struct leak_log_writer index, blobs;
+  struct hashmap *       blob_map;      /* Known blobs, by content hash     */
+  struct hashmap *       seen_map;      /* Leaking public inputs, by hash   */
+
+};
+
+struct leak_log_blob_entry {
+
+  u64 hash;
+  u32 len;
+  u64 offset;
+
+};
+
+static uint64_t blob_entry_hash(const void *item, uint64_t seed0,
+                                uint64_t seed1) {
+
+  const struct leak_log_blob_entry *e = item;
+  (void)seed1;
+  return e->hash ^ seed0;
+
+}
+
+static int blob_entry_compare(const void *a, const void *b, void *udata) {
+
+  const struct leak_log_blob_entry *ea = a, *eb = b;
+  (void)udata;
+  return !(ea->hash == eb->hash && ea->len == eb->len);
+
+}
+
+struct leak_log_seen_entry {
+
+  u64 public_input_hash;
+
+};
+
+static uint64_t seen_entry_hash(const void *item, uint64_t seed0,
+                                uint64_t seed1) {
+
+  const struct leak_log_seen_entry *e = item;
+  (void)seed1;
+  return e->public_input_hash ^ seed0;
+
+}
+
+static int seen_entry_compare(const void *a, const void *b, void *udata) {
+
+  const struct leak_log_seen_entry *ea = a, *eb = b;
+  (void)udata;
+  return ea->public_input_hash != eb->public_input_hash;
+
+}
+
+/* Create fn, or with resume, append to what is there already. */
+
+static void writer_open(struct leak_log_writer *w, u8 *fn, u8 resume) {
+
+  w->fn = fn;
+  w->fd = open(fn, O_RDWR | O_CREAT | (resume ? O_APPEND : O_EXCL),
+               DEFAULT_PERMISSION);
+  if (unlikely(w->fd < 0)) { PFATAL("Unable to open '%s'", fn); }
+  w->buf = ck_alloc_nozero(LEAK_LOG_BUF_SIZE);
+  w->used = 0;
+
+  struct stat st;
+  if (fstat(w->fd, &st)) { PFATAL("fstat() failed"); }
+  w->size = st.st_size;
+
+}
+
+static void writer_flush(struct leak_log_writer *w) {
+
+  if (!w->used) { return; }
+  ck_write(w->fd, w->buf, w->used, w->fn);
+  w->used = 0;
+
+}
+
+static void writer_append(struct leak_log_writer *w, void *data, u32 len) {
+
+  if (w->used + len > LEAK_LOG_BUF_SIZE) { writer_flush(w); }
+
+  if (len > LEAK_LOG_BUF_SIZE) {
+
+    ck_write(w->fd, data, len, w->fn);
+
+  } else {
+
+    memcpy(w->buf + w->used, data, len);
+    w->used += len;
+
+  }
+
+  w->size += len;
+
+}
+
+/* Do the len bytes at offset hold data? Whatever is no longer pending is
+   read back from the file. */
+
+static u8 writer_matches(struct leak_log_writer *w, u64 offset, u8 *data,
+                         u32 len) {
+
+  u64 pending = w->size - w->used;
+  u8  chunk[4096];
+
+  while (len && offset < pending) {
+
+    u32 n = MIN(MIN(len, sizeof(chunk)), pending - offset);
+
+    if (pread(w->fd, chunk, n, offset) != (ssize_t)n ||
+        memcmp(chunk, data, n)) {
+
+      return 0;
+
+    }
+
+    offset += n;
+    data += n;
+    len -= n;
+
+  }
+
+  return !len || !memcmp(w->buf + (offset - pending), data, len);
+
+}
+
+static void writer_close(struct leak_log_writer *w) {
+
+  writer_flush(w);
+  close(w->fd);
+  ck_free(w->buf);
+  ck_free(w->fn);
+
+}
+
+/* Store data in blobs unless identical data is already there. */
+
+static void add_blob(struct leak_log *log, u8 *data, u32 len,
+                     struct leak_log_ref *ref) {
+
+  struct leak_log_blob_entry  sought = {.hash = hash64(data, len, HASH_CONST),
+                                       .len = len};
+  struct leak_log_blob_entry *found = hashmap_get(log->blob_map, &sought);
+
+  ref->len = len;
+  ref->reserved = 0;
+
+  /* Same hash and length, but only the same bytes make it the same blob.
+     Otherwise the new one is stored and takes over the map entry. */
+
+  if (found && writer_matches(&log->blobs,
+                              found->offset + sizeof(struct leak_log_blob),
+                              data, len)) {
+
+    ref->offset = found->offset;
+    return;
+
+  }
+
+  struct leak_log_blob hdr = {.hash = sought.hash, .len = len};
+
+  sought.offset = log->blobs.size;
+  writer_append(&log->blobs, &hdr, sizeof(hdr));
+  writer_append(&log->blobs, data, len);
+  hashmap_set(log->blob_map, &sought);
+
+  ref->offset = sought.offset;
+
+}
+
+static void mark_seen(struct leak_log *log, u64 public_input_hash) {
+
+  struct leak_log_seen_entry e = {.public_input_hash = public_input_hash};
+  hashmap_set(log->seen_map, &e);
+
+}
+
+/* Take a record of the last session back into the blob and seen maps.
+   Returns 0 if it refers to blobs that are not there. */
+
+static u8 resume_record(struct leak_log *log, struct leak_log_record *rec) {
+
+  struct leak_log_ref *refs[] = {&rec->public_input, &rec->secret_input[0],
+                                 &rec->secret_input[1], &rec->output[0],
+                                 &rec->output[1]};
+  struct leak_log_blob hdr;
+
+  for (u32 i = 0; i < sizeof(refs) / sizeof(refs[0]); ++i) {
+
+    if (refs[i]->offset + sizeof(hdr) + refs[i]->len > log->blobs.size ||
+        pread(log->blobs.fd, &hdr, sizeof(hdr), refs[i]->offset) !=
+            sizeof(hdr) ||
+        hdr.len != refs[i]->len) {
+
+      return 0;
+
+    }
+
+    struct leak_log_blob_entry e = {
+
+        .hash = hdr.hash, .len = hdr.len, .offset = refs[i]->offset};
+    hashmap_set(log->blob_map, &e);
+
+    /* The blob hash of the public input is its io-map key. */
+
+    if (!i) { mark_seen(log, hdr.hash); }
+
+  }
+
+  return 1;
+
+}
+
+/* Pick up the log of the last session. Records past the first one that
+   does not check out, e.g. torn by a crash, are dropped. */
+
+static void resume_log(afl_state_t *afl, struct leak_log *log) {
+
+  struct leak_log_header hdr;
+  struct leak_log_record rec;
+  u32                    cnt, i;
+
+  if (pread(log->index.fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+      hdr.magic != LEAK_LOG_MAGIC || hdr.version != LEAK_LOG_VERSION ||
+      hdr.record_size != sizeof(struct leak_log_record)) {
+
+    FATAL(
+        "'%s' is not a leak log of this version of afl-fuzz, move '%s/leaks' "
+        "away to resume",
+        log->index.fn, afl->out_dir);
+
+  }
+
+  cnt = (log->index.size - sizeof(hdr)) / sizeof(rec);
+
+  for (i = 0; i < cnt; ++i) {
+
+    if (pread(log->index.fd, &rec, sizeof(rec),
+              sizeof(hdr) + (u64)i * sizeof(rec)) != sizeof(rec) ||
+        rec.id != i + 1 || !resume_record(log, &rec)) {
+
+      break;
+
+    }
+
+  }
+
+  if (i < cnt) {
+
+    WARNF("Dropping %u damaged records at the end of '%s'", cnt - i,
+          log->index.fn);
+
+  }
+
+  log->index.size = sizeof(hdr) + (u64)i * sizeof(rec);
+  if (ftruncate(log->index.fd, log->index.size)) {
+
+    PFATAL("Unable to truncate '%s'", log->index.fn);
+
+  }
+
+  afl->stored_hypertest_leaks_count = i;
+  OKF("Resuming the leak log with %u leaks.", i);
+
+}
+
+/* Open the leak log in <out_dir>/leaks. A fresh start creates it, an
+   in-place resume keeps appending to the log of the last session. */
+
+void leak_log_open(afl_state_t *afl) {
+
+  struct leak_log *log = ck_alloc(sizeof(struct leak_log));
+  u8 *index_fn = alloc_printf("%s/leaks/" LEAK_LOG_INDEX, afl->out_dir);
+  u8  resume = afl->in_place_resume && !access(index_fn, F_OK);
+
+  writer_open(&log->index, index_fn, resume);
+  writer_open(&log->blobs,
+              alloc_printf("%s/leaks/" LEAK_LOG_BLOBS, afl->out_dir), resume);
+
+  log->blob_map = hashmap_new(sizeof(struct leak_log_blob_entry), 0, 0, 0,
+                              blob_entry_hash, blob_entry_compare, NULL, NULL);
+  log->seen_map = hashmap_new(sizeof(struct leak_log_seen_entry), 0, 0, 0,
+                              seen_entry_hash, seen_entry_compare, NULL, NULL);
+
+  /* A log that did not even get its header out is started over. */
+
+  if (resume && log->index.size) {
+
+    resume_log(afl, log);
+
+  } else {
+
+    struct leak_log_header hdr = {
+
+        .magic = LEAK_LOG_MAGIC,
+        .version = LEAK_LOG_VERSION,
+        .record_size = sizeof(struct leak_log_record)};
+
+    writer_append(&log->index, &hdr, sizeof(hdr));
+    writer_flush(&log->index);
+
+  }
+
+  afl->leak_log = log;
+
+}
+
+/* Append a confirmed leak, i.e. an io-map entry with both secrets filled
+   in. The record gets id stored_hypertest_leaks_count. */
+
+void leak_log_add(afl_state_t *afl, struct input_output_hashes *leak,
+                  u32 bucket) {
+
+  struct leak_log *log = afl->leak_log;
+  if (unlikely(!log)) { return; }
+
+  struct leak_log_record rec;
+  memset(&rec, 0, sizeof(rec));
+
+  rec.id = afl->stored_hypertest_leaks_count;
+  rec.bucket = bucket;
+  rec.time_ms = get_cur_time() + afl->prev_run_time - afl->start_time;
+
+  add_blob(log, leak->public_input_buf, leak->public_input_buf_len,
+           &rec.public_input);
+  mark_seen(log, leak->public_input_hash);
+
+  for (u32 i = 0; i < SECRET_BUFS_COUNT; ++i) {
+
+    rec.output_hash[i] = leak->output_hashes[i];
+    add_blob(log, leak->secret_input_bufs[i], leak->secret_input_buf_len[i],
+             &rec.secret_input[i]);
+    add_blob(log, leak->public_output_bufs[i], leak->public_output_buf_len[i],
+             &rec.output[i]);
+
+  }
+
+  /* Never let a record reach the disk before the blobs it refers to. */
+
+  if (log->index.used + sizeof(rec) > LEAK_LOG_BUF_SIZE) {
+
+    writer_flush(&log->blobs);
+
+  }
+
+  writer_append(&log->index, &rec, sizeof(rec));
+
+}
+
+/* Has a leak for this public input been logged or imported already? */
+
+u8 leak_log_seen(afl_state_t *afl, u64 public_input_hash) {
+
+  struct leak_log *log = afl->leak_log;
+  if (!log) { return 0; }
+
+  struct leak_log_seen_entry sought = {.public_input_hash = public_input_hash};
+  return !!hashmap_get(log->seen_map, &sought);
+
+}
+
+/* Read a blob from another instance's log. Returns NULL if the blob does
+   not match the reference or its hash, optionally passes the hash on. */
+
+static u8 *read_peer_blob(s32 fd, struct leak_log_ref *ref, u64 *hash) {
+
+  struct leak_log_blob hdr;
+  u8 *                 buf = ck_alloc(ref->len + 1);
+
+  if (pread(fd, &hdr, sizeof(hdr), ref->offset) != sizeof(hdr) ||
+      hdr.len != ref->len ||
+      pread(fd, buf, ref->len, ref->offset + sizeof(hdr)) !=
+          (ssize_t)ref->len ||
+      hash64(buf, ref->len, HASH_CONST) != hdr.hash) {
+
+    ck_free(buf);
+    return NULL;
+
+  }
+
+  if (hash) { *hash = hdr.hash; }
+  return buf;
+
+}
+
+/* Import one record of another instance. The blob hash of the public input
+   is the io-map key, so it doubles as the dedup key. Both secrets are run
+   again, and the leak is only taken over if they still give the outputs
+   the peer logged, and those differ. The second secret runs last, since
+   bucketing needs its trace. An imported leak goes into the io map like
+   one found here, which then owns its buffers. */
+
+static void import_record(afl_state_t *afl, s32 blobs_fd,
+                          struct leak_log_record *rec) {
+
+  struct input_output_hashes leak;
+  memset(&leak, 0, sizeof(leak));
+
+  leak.public_input_buf =
+      read_peer_blob(blobs_fd, &rec->public_input, &leak.public_input_hash);
+  if (!leak.public_input_buf ||
+      leak_log_seen(afl, leak.public_input_hash) ||
+      rec->output_hash[0] == rec->output_hash[1]) {
+
+    goto free_leak;
+
+  }
+
+  leak.public_input_buf_len = rec->public_input.len;
+
+  for (u32 i = 0; i < SECRET_BUFS_COUNT; ++i) {
+
+    leak.secret_input_bufs[i] =
+        read_peer_blob(blobs_fd, &rec->secret_input[i], NULL);
+    leak.public_output_bufs[i] = read_peer_blob(blobs_fd, &rec->output[i], NULL);
+    if (!leak.secret_input_bufs[i] || !leak.public_output_bufs[i]) {
+
+      goto free_leak;
+
+    }
+
+    leak.secret_input_buf_len[i] = rec->secret_input[i].len;
+    leak.public_output_buf_len[i] = rec->output[i].len;
+    leak.output_hashes[i] = rec->output_hash[i];
+
+  }
+
+  leak.secret_input_bufs_filled = SECRET_BUFS_COUNT;
+  leak.secret_input_hash = hash64(leak.secret_input_bufs[0],
+                                  leak.secret_input_buf_len[0], HASH_CONST);
+
+  for (u32 i = 0; i < SECRET_BUFS_COUNT; ++i) {
+
+    char *comb_buf;
+    u32   comb_len;
+    u8    fault;
+
+    create_buffer_from_public_and_secret_inputs(
+        leak.public_input_buf, leak.public_input_buf_len,
+        leak.secret_input_bufs[i], leak.secret_input_buf_len[i], &comb_buf,
+        &comb_len);
+    write_to_testcase(afl, comb_buf, comb_len);
+    fault = fuzz_run_target(afl, &afl->fsrv, afl->fsrv.exec_tmout);
+    ++afl->leak_phase_execs[LEAK_PHASE_STABILITY];
+    ck_free(comb_buf);
+
+    if (fault || afl->stop_soon ||
+        leak_output_hash(&afl->fsrv) != rec->output_hash[i]) {
+
+      goto free_leak;
+
+    }
+
+  }
+
+  struct leak_bucket *bucket = leak_bucket_classify(afl, &afl->fsrv, &leak);
+
+  if (!afl->leak_bucket_exemplars ||
+      bucket->count <= afl->leak_bucket_exemplars) {
+
+    afl->stored_hypertest_leaks_count++;
+    if (!bucket->first_leak_id) {
+
+      bucket->first_leak_id = afl->stored_hypertest_leaks_count;
+
+    }
+
+    leak_log_add(afl, &leak, bucket->id);
+    ++afl->leaks_imported;
+
+  } else {
+
+    mark_seen(afl->leak_log, leak.public_input_hash);
+
+  }
+
+  /* Unless the public input is known here already, the io map takes the
+     leak over, buffers and all. */
+
+  if (!leak_iomap_get(afl->public_input_to_output_map,
+                      leak.public_input_hash)) {
+
+    leak_iomap_put(afl->public_input_to_output_map, &leak);
+    afl->leak_io_map_bytes += leak.public_input_buf_len;
+    for (u32 i = 0; i < SECRET_BUFS_COUNT; ++i) {
+
+      afl->leak_io_map_bytes +=
+          leak.secret_input_buf_len[i] + leak.public_output_buf_len[i];
+
+    }
+
+    return;
+
+  }
+
+free_leak:
+  ck_free(leak.public_input_buf);
+  for (u32 i = 0; i < SECRET_BUFS_COUNT; ++i) {
+
+    ck_free(leak.secret_input_bufs[i]);
+    ck_free(leak.public_output_bufs[i]);
+
+  }
+
+}
+
+/* Take over the leaks that the instance peer logged since the last call.
+   Progress is kept as a record count in <out_dir>/.synced/<peer>.leaks,
+   next to the queue id that sync_fuzzers() keeps for the same peer. */
+
+void leak_log_sync(afl_state_t *afl, u8 *peer) {
+
+  struct leak_log_header hdr;
+  struct stat            st;
+  s32                    index_fd, blobs_fd = -1, mark_fd = -1;
+  u32                    done = 0, cnt;
+
+  if (!afl->leak_log) { return; }
+
+  u8 *index_fn =
+      alloc_printf("%s/%s/leaks/" LEAK_LOG_INDEX, afl->sync_dir, peer);
+  u8 *blobs_fn =
+      alloc_printf("%s/%s/leaks/" LEAK_LOG_BLOBS, afl->sync_dir, peer);
+  u8 *mark_fn = alloc_printf("%s/.synced/%s.leaks", afl->out_dir, peer);
+
+  /* Not hunting leaks, not started yet, or written by another version. */
+
+  index_fd = open(index_fn, O_RDONLY);
+  if (index_fd < 0) { goto free_names; }
+
+  if (read(index_fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+      hdr.magic != LEAK_LOG_MAGIC || hdr.version != LEAK_LOG_VERSION ||
+      hdr.record_size != sizeof(struct leak_log_record)) {
+
+    goto close_fds;
+
+  }
+
+  blobs_fd = open(blobs_fn, O_RDONLY);
+  if (blobs_fd < 0) { goto close_fds; }
+
+  if (fstat(index_fd, &st)) { PFATAL("fstat() failed"); }
+  cnt = (st.st_size - sizeof(hdr)) / sizeof(struct leak_log_record);
+
+  mark_fd = open(mark_fn, O_RDWR | O_CREAT, DEFAULT_PERMISSION);
+  if (mark_fd < 0) { PFATAL("Unable to create '%s'", mark_fn); }
+
+  /* A log shorter than the mark was started over; dedup makes a rescan
+     harmless. */
+
+  if (read(mark_fd, &done, sizeof(u32)) != sizeof(u32) || done > cnt) {
+
+    done = 0;
+
+  }
+
+  for (; done < cnt; ++done) {
+
+    struct leak_log_record rec;
+
+    if (pread(index_fd, &rec, sizeof(rec),
+              sizeof(hdr) + (u64)done * sizeof(rec)) != sizeof(rec)) {
+
+      break;
+
+    }
+
+    /* An interrupted import is retried next time. */
+
+    import_record(afl, blobs_fd, &rec);
+    if (afl->stop_soon) { break; }
+
+  }
+
+  lseek(mark_fd, 0, SEEK_SET);
+  ck_write(mark_fd, &done, sizeof(u32), mark_fn);
+
+close_fds:
+  close(index_fd);
+  if (blobs_fd >= 0) { close(blobs_fd); }
+  if (mark_fd >= 0) { close(mark_fd); }
+
+free_names:
+  ck_free(index_fn);
+  ck_free(blobs_fn);
+  ck_free(mark_fn);
+
+}
+
+/* Push everything buffered to disk, blobs first. Cheap if nothing is
+   pending, so it is fine to call this from show_stats(). */
+
+void leak_log_flush(afl_state_t *afl) {
+
+  struct leak_log *log = afl->leak_log;
+  if (!log) { return; }
+
+  writer_flush(&log->blobs);
+  writer_flush(&log->index);
+
+}
+
+void leak_log_close(afl_state_t *afl) {
+
+  struct leak_log *log = afl->leak_log;
+  if (!log) { return; }
+
+  writer_close(&log->blobs);
+  writer_close(&log->index);
+  hashmap_free(log->blob_map);
+  hashmap_free(log->seen_map);
+  ck_free(log);
+
+  afl->leak_log = NULL;
+
+}
+
@@ -176,6 +176,14 @@ struct custom_mutator *load_custom_mutator(afl_state_t *afl, const char *fn) {
 
   }
 
+  /* "afl_custom_fuzz_leak", optional */
+  mutator->afl_custom_fuzz_leak = dlsym(dh, "afl_custom_fuzz_leak");
+  if (!mutator->afl_custom_fuzz_leak) {
+
+    ACTF("optional symbol 'afl_custom_fuzz_leak' not found.");
+
+  }
+
   /* "afl_custom_introspection", optional */
 #ifdef INTROSPECTION
   mutator->afl_custom_introspection = dlsym(dh, "afl_custom_introspection");
@@ -264,6 +272,23 @@ struct custom_mutator *load_custom_mutator(afl_state_t *afl, const char *fn) {
 
   }
 
+  /* "afl_custom_havoc_mutation_secret", optional */
+  mutator->afl_custom_havoc_mutation_secret =
+      dlsym(dh, "afl_custom_havoc_mutation_secret");
+  if (!mutator->afl_custom_havoc_mutation_secret) {
+
+    ACTF("optional symbol 'afl_custom_havoc_mutation_secret' not found.");
+
+  }
+
+  /* "afl_custom_leak_phase", optional */
+  mutator->afl_custom_leak_phase = dlsym(dh, "afl_custom_leak_phase");
+  if (!mutator->afl_custom_leak_phase) {
+
+    ACTF("optional symbol 'afl_custom_leak_phase' not found.");
+
+  }
+
   /* "afl_custom_queue_get", optional */
   mutator->afl_custom_queue_get = dlsym(dh, "afl_custom_queue_get");
   if (!mutator->afl_custom_queue_get) {
@@ -29,7 +29,7 @@
 #include "cmplog.h"
 #include "leakage_utils.h"
 
-u8 leakage_fuzz_one_original(afl_state_t *afl);
+u8 leakage_fuzz_one_original(afl_state_t *afl, MOpt_globals_t *MOpt_globals);
 
 /* MOpt */
 
@@ -2872,6 +2872,145 @@ abandon_entry:
 }
 
 
+/* End of an entry in MOpt mode: leave pacemaker fuzzing if it stopped
+   paying off, and once the period is over, rate the operators and move on to
+   the next swarm (pilot) or to the PSO update (core). hit_cnt counts the
+   finds so far. */
+
+static void mopt_update(afl_state_t *afl, MOpt_globals_t MOpt_globals,
+                        u64 hit_cnt) {
+
+  u32 i;
+
+  if (afl->key_puppet == 1) {
+
+    if (unlikely(hit_cnt >
+                 hit_cnt * limit_time_bound + afl->orig_hit_cnt_puppet)) {
+
+      afl->key_puppet = 0;
+      afl->orig_hit_cnt_puppet = 0;
+      afl->last_limit_time_start = 0;
+
+    }
+
+  }
+
+  if (unlikely(*MOpt_globals.pTime > MOpt_globals.period)) {
+
+    afl->total_pacemaker_time += *MOpt_globals.pTime;
+    *MOpt_globals.pTime = 0;
+
+    if (MOpt_globals.is_pilot_mode) {
+
+      afl->swarm_fitness[afl->swarm_now] =
+          (double)(afl->total_puppet_find - afl->temp_puppet_find) /
+          ((double)(afl->tmp_pilot_time) / afl->period_pilot_tmp);
+
+    }
+
+    afl->temp_puppet_find = afl->total_puppet_find;
+    u64 temp_stage_finds_puppet = 0;
+    for (i = 0; i < operator_num; ++i) {
+
+      if (MOpt_globals.is_pilot_mode) {
+
+        double temp_eff = 0.0;
+
+        if (MOpt_globals.cycles_v2[i] > MOpt_globals.cycles[i]) {
+
+          temp_eff =
+              (double)(MOpt_globals.finds_v2[i] - MOpt_globals.finds[i]) /
+              (double)(MOpt_globals.cycles_v2[i] - MOpt_globals.cycles[i]);
+
+        }
+
+        if (afl->eff_best[afl->swarm_now][i] < temp_eff) {
+
+          afl->eff_best[afl->swarm_now][i] = temp_eff;
+          afl->L_best[afl->swarm_now][i] = afl->x_now[afl->swarm_now][i];
+
+        }
+
+      }
+
+      MOpt_globals.finds[i] = MOpt_globals.finds_v2[i];
+      MOpt_globals.cycles[i] = MOpt_globals.cycles_v2[i];
+      temp_stage_finds_puppet += MOpt_globals.finds[i];
+
+    }                                    /* for i = 0; i < operator_num */
+
+    if (MOpt_globals.is_pilot_mode) {
+
+      afl->swarm_now = afl->swarm_now + 1;
+      if (afl->swarm_now == swarm_num) {
+
+        afl->key_module = 1;
+        for (i = 0; i < operator_num; ++i) {
+
+          afl->core_operator_cycles_puppet_v2[i] =
+              afl->core_operator_cycles_puppet[i];
+          afl->core_operator_cycles_puppet_v3[i] =
+              afl->core_operator_cycles_puppet[i];
+          afl->core_operator_finds_puppet_v2[i] =
+              afl->core_operator_finds_puppet[i];
+
+        }
+
+        double swarm_eff = 0.0;
+        afl->swarm_now = 0;
+        for (i = 0; i < swarm_num; ++i) {
+
+          if (afl->swarm_fitness[i] > swarm_eff) {
+
+            swarm_eff = afl->swarm_fitness[i];
+            afl->swarm_now = i;
+
+          }
+
+        }
+
+        if (afl->swarm_now < 0 || afl->swarm_now > swarm_num - 1) {
+
+          PFATAL("swarm_now error number  %d", afl->swarm_now);
+
+        }
+
+      }                               /* if afl->swarm_now == swarm_num */
+
+      /* adjust pointers dependent on 'afl->swarm_now' */
+      afl->mopt_globals_pilot.finds =
+          afl->stage_finds_puppet[afl->swarm_now];
+      afl->mopt_globals_pilot.finds_v2 =
+          afl->stage_finds_puppet_v2[afl->swarm_now];
+      afl->mopt_globals_pilot.cycles =
+          afl->stage_cycles_puppet[afl->swarm_now];
+      afl->mopt_globals_pilot.cycles_v2 =
+          afl->stage_cycles_puppet_v2[afl->swarm_now];
+      afl->mopt_globals_pilot.cycles_v3 =
+          afl->stage_cycles_puppet_v3[afl->swarm_now];
+
+    } else {
+
+      for (i = 0; i < operator_num; i++) {
+
+        afl->core_operator_finds_puppet[i] =
+            afl->core_operator_finds_puppet_v2[i];
+        afl->core_operator_cycles_puppet[i] =
+            afl->core_operator_cycles_puppet_v2[i];
+        temp_stage_finds_puppet += afl->core_operator_finds_puppet[i];
+
+      }
+
+      afl->key_module = 2;
+
+      afl->old_hit_count = hit_cnt;
+
+    }                                                  /* if pilot_mode */
+
+  }         /* if (unlikely(*MOpt_globals.pTime > MOpt_globals.period)) */
+
+}
+
 /* MOpt mode */
 static u8 mopt_common_fuzzing(afl_state_t *afl, MOpt_globals_t MOpt_globals) {
 
@@ -5206,135 +5345,8 @@ pacemaker_fuzzing:
 
       orig_in = NULL;
 
-      if (afl->key_puppet == 1) {
-
-        if (unlikely(
-                afl->queued_paths + afl->unique_crashes >
-                ((afl->queued_paths + afl->unique_crashes) * limit_time_bound +
-                 afl->orig_hit_cnt_puppet))) {
-
-          afl->key_puppet = 0;
-          afl->orig_hit_cnt_puppet = 0;
-          afl->last_limit_time_start = 0;
-
-        }
-
-      }
-
-      if (unlikely(*MOpt_globals.pTime > MOpt_globals.period)) {
-
-        afl->total_pacemaker_time += *MOpt_globals.pTime;
-        *MOpt_globals.pTime = 0;
-        new_hit_cnt = afl->queued_paths + afl->unique_crashes;
-
-        if (MOpt_globals.is_pilot_mode) {
-
-          afl->swarm_fitness[afl->swarm_now] =
-              (double)(afl->total_puppet_find - afl->temp_puppet_find) /
-              ((double)(afl->tmp_pilot_time) / afl->period_pilot_tmp);
-
-        }
-
-        afl->temp_puppet_find = afl->total_puppet_find;
-        u64 temp_stage_finds_puppet = 0;
-        for (i = 0; i < operator_num; ++i) {
-
-          if (MOpt_globals.is_pilot_mode) {
-
-            double temp_eff = 0.0;
-
-            if (MOpt_globals.cycles_v2[i] > MOpt_globals.cycles[i]) {
-
-              temp_eff =
-                  (double)(MOpt_globals.finds_v2[i] - MOpt_globals.finds[i]) /
-                  (double)(MOpt_globals.cycles_v2[i] - MOpt_globals.cycles[i]);
-
-            }
-
-            if (afl->eff_best[afl->swarm_now][i] < temp_eff) {
-
-              afl->eff_best[afl->swarm_now][i] = temp_eff;
-              afl->L_best[afl->swarm_now][i] = afl->x_now[afl->swarm_now][i];
-
-            }
-
-          }
-
-          MOpt_globals.finds[i] = MOpt_globals.finds_v2[i];
-          MOpt_globals.cycles[i] = MOpt_globals.cycles_v2[i];
-          temp_stage_finds_puppet += MOpt_globals.finds[i];
-
-        }                                    /* for i = 0; i < operator_num */
-
-        if (MOpt_globals.is_pilot_mode) {
-
-          afl->swarm_now = afl->swarm_now + 1;
-          if (afl->swarm_now == swarm_num) {
-
-            afl->key_module = 1;
-            for (i = 0; i < operator_num; ++i) {
-
-              afl->core_operator_cycles_puppet_v2[i] =
-                  afl->core_operator_cycles_puppet[i];
-              afl->core_operator_cycles_puppet_v3[i] =
-                  afl->core_operator_cycles_puppet[i];
-              afl->core_operator_finds_puppet_v2[i] =
-                  afl->core_operator_finds_puppet[i];
-
-            }
-
-            double swarm_eff = 0.0;
-            afl->swarm_now = 0;
-            for (i = 0; i < swarm_num; ++i) {
-
-              if (afl->swarm_fitness[i] > swarm_eff) {
-
-                swarm_eff = afl->swarm_fitness[i];
-                afl->swarm_now = i;
-
-              }
-
-            }
-
-            if (afl->swarm_now < 0 || afl->swarm_now > swarm_num - 1) {
-
-              PFATAL("swarm_now error number  %d", afl->swarm_now);
-
-            }
-
-          }                               /* if afl->swarm_now == swarm_num */
-
-          /* adjust pointers dependent on 'afl->swarm_now' */
-          afl->mopt_globals_pilot.finds =
-              afl->stage_finds_puppet[afl->swarm_now];
-          afl->mopt_globals_pilot.finds_v2 =
-              afl->stage_finds_puppet_v2[afl->swarm_now];
-          afl->mopt_globals_pilot.cycles =
-              afl->stage_cycles_puppet[afl->swarm_now];
-          afl->mopt_globals_pilot.cycles_v2 =
-              afl->stage_cycles_puppet_v2[afl->swarm_now];
-          afl->mopt_globals_pilot.cycles_v3 =
-              afl->stage_cycles_puppet_v3[afl->swarm_now];
-
-        } else {
-
-          for (i = 0; i < operator_num; i++) {
-
-            afl->core_operator_finds_puppet[i] =
-                afl->core_operator_finds_puppet_v2[i];
-            afl->core_operator_cycles_puppet[i] =
-                afl->core_operator_cycles_puppet_v2[i];
-            temp_stage_finds_puppet += afl->core_operator_finds_puppet[i];
-
-          }
-
-          afl->key_module = 2;
-
-          afl->old_hit_count = new_hit_cnt;
-
-        }                                                  /* if pilot_mode */
-
-      }         /* if (unlikely(*MOpt_globals.pTime > MOpt_globals.period)) */
+      mopt_update(afl, MOpt_globals,
+                  afl->queued_paths + afl->unique_crashes);
 
     }                                                              /* block */
 
@@ -5348,12 +5360,24 @@ pacemaker_fuzzing:
 
 u8 core_fuzzing(afl_state_t *afl) {
 
+  if (afl->fsrv.leakage_hunting) {
+
+    return leakage_fuzz_one_original(afl, &afl->mopt_globals_core);
+
+  }
+
   return mopt_common_fuzzing(afl, afl->mopt_globals_core);
 
 }
 
 u8 pilot_fuzzing(afl_state_t *afl) {
 
+  if (afl->fsrv.leakage_hunting) {
+
+    return leakage_fuzz_one_original(afl, &afl->mopt_globals_pilot);
+
+  }
+
   return mopt_common_fuzzing(afl, afl->mopt_globals_pilot);
 
 }
@@ -5479,7 +5503,7 @@ u8 fuzz_one(afl_state_t *afl) {
 
   if (afl->limit_time_sig <= 0) {
     if (afl->fsrv.leakage_hunting) {
-      key_val_lv_1 = leakage_fuzz_one_original(afl);
+      key_val_lv_1 = leakage_fuzz_one_original(afl, NULL);
     } else {
       key_val_lv_1 = fuzz_one_original(afl);
     }
@@ -5534,11 +5558,142 @@ u8 *raw_combined_scratch_buf = NULL;
 u8 *mutate_buf = NULL;
 u8 *leakage_scratch_buf = NULL;
 
+/* With -L, MOpt picks the operators of the leakage havoc below. Confirmed
+   leaks count as finds for it, they are what we are after. */
+
+static inline u64 leakage_hit_cnt(afl_state_t *afl) {
+
+  return afl->queued_paths + afl->unique_crashes + afl->confirmed_leaks_count;
+
+}
+
+#define LEAK_MOPT_APPLIED 0xffffffff
+
+/* Let MOpt pick the next operator for buf. The result is the case of the
+   leakage havoc that implements it, or LEAK_MOPT_APPLIED for the multi-bit
+   flips the havoc has no case for, which are done right here. */
+
+static u32 leakage_mopt_pick(afl_state_t *afl, MOpt_globals_t *MOpt_globals,
+                             u32 r_max, u8 *buf, u32 len) {
+
+  u32 op = select_algorithm(afl, r_max), bits = 0, pos, i;
+
+  ++MOpt_globals->cycles_v2[op];
+  ++afl->leak_mopt_cycles[afl->leak_exec_phase][op];
+
+  switch (op) {
+
+    case STAGE_FLIP1:
+      return 0;
+
+    case STAGE_FLIP2:
+    case STAGE_FLIP4:
+      bits = op == STAGE_FLIP2 ? 2 : 4;
+      if (len < 2) { break; }
+      pos = rand_below(afl, (len << 3) - bits + 1);
+      for (i = pos; i < pos + bits; ++i) {
+
+        buf[i >> 3] ^= 128 >> (i & 7);
+
+      }
+
+      break;
+
+    case STAGE_FLIP8:
+      buf[rand_below(afl, len)] ^= 0xFF;
+      break;
+
+    case STAGE_FLIP16:
+      if (len < 2) { break; }
+      *(u16 *)(buf + rand_below(afl, len - 1)) ^= 0xFFFF;
+      break;
+
+    case STAGE_FLIP32:
+      if (len < 4) { break; }
+      *(u32 *)(buf + rand_below(afl, len - 3)) ^= 0xFFFFFFFF;
+      break;
+
+    case STAGE_ARITH8:
+      return 16 + rand_below(afl, 8);
+
+    case STAGE_ARITH16:
+      return 24 + rand_below(afl, 8);
+
+    case STAGE_ARITH32:
+      return 32 + rand_below(afl, 8);
+
+    case STAGE_INTEREST8:
+      return 4;
+
+    case STAGE_INTEREST16:
+      return 8 + rand_below(afl, 4);
+
+    case STAGE_INTEREST32:
+      return 12 + rand_below(afl, 4);
+
+    case STAGE_RANDOMBYTE:
+      return 40;
+
+    case STAGE_DELETEBYTE:
+      return 52;
+
+    case STAGE_Clone75:
+      return rand_below(afl, 4) ? 44 : 47;
+
+    case STAGE_OverWrite75:
+      return rand_below(afl, 4) ? 48 : 51;
+
+    case STAGE_OverWriteExtra:
+    case STAGE_InsertExtra:
+      /* Same dice as MOpt: an auto extra if there are no user extras, or
+         half of the time if there are both. */
+      pos = op == STAGE_InsertExtra ? 2 : 0;
+      if (!afl->extras_cnt || (afl->a_extras_cnt && rand_below(afl, 2))) {
+
+        pos += afl->extras_cnt ? 4 : 0;
+
+      }
+
+      return MAX_HAVOC_ENTRY + 1 + pos;
+
+    default:
+      if (afl->ready_for_splicing_count < 2) { break; }
+      return MAX_HAVOC_ENTRY + 1 + (afl->extras_cnt ? 4 : 0) +
+             (afl->a_extras_cnt ? 4 : 0);
+
+  }
+
+  return LEAK_MOPT_APPLIED;
+
+}
+
+/* Credit the operators used for the last exec with its finds. */
+
+static void leakage_mopt_credit(afl_state_t *afl, MOpt_globals_t *MOpt_globals,
+                                u64 finds) {
+
+  u32 i;
+
+  afl->total_puppet_find += finds;
+
+  for (i = 0; i < operator_num; ++i) {
+
+    if (MOpt_globals->cycles_v2[i] > MOpt_globals->cycles_v3[i]) {
+
+      MOpt_globals->finds_v2[i] += finds;
+      afl->leak_mopt_finds[afl->leak_exec_phase][i] += finds;
+
+    }
+
+  }
+
+}
+
 /* Take the current entry from the queue, fuzz it for a while. This
    function is a tad too long... returns 0 if fuzzed successfully, 1 if
-   skipped or bailed out. */
+   skipped or bailed out. MOpt_globals is set when MOpt does the havoc. */
 
-u8 leakage_fuzz_one_original(afl_state_t *afl) {
+u8 leakage_fuzz_one_original(afl_state_t *afl, MOpt_globals_t *MOpt_globals) {
 
   u32 len, temp_len;
   // u32 j;
@@ -5742,6 +5897,17 @@ u8 leakage_fuzz_one_original(afl_state_t *afl) {
   leak_input.raw_combined_buf = ck_alloc(len);
   memcpy(leak_input.raw_combined_buf, leak_input.mutation_seed_combined_buf, len);
 
+  /******************
+   * SECRET PAIRING *
+   ******************/
+
+  if (secret_pairing_stage(afl, leak_input.orig_public_buf,
+                           leak_input.orig_public_len)) {
+
+    goto abandon_entry;
+
+  }
+
   /*********************
    * PERFORMANCE SCORE *
    *********************/
@@ -5789,6 +5955,25 @@ u8 leakage_fuzz_one_original(afl_state_t *afl) {
 //
 //  }
 
+  /* Go to pacemaker fuzzing if MOpt is doing well */
+
+  if (MOpt_globals) {
+
+    u64 cur_ms_lv = get_cur_time();
+
+    if (!(afl->key_puppet == 0 &&
+          ((cur_ms_lv - afl->last_path_time < (u32)afl->limit_time_puppet) ||
+           (afl->last_crash_time != 0 &&
+            cur_ms_lv - afl->last_crash_time < (u32)afl->limit_time_puppet) ||
+           afl->last_path_time == 0))) {
+
+      afl->key_puppet = 1;
+      goto havoc_stage;
+
+    }
+
+  }
+
   /* Skip right away if -d is given, if it has not been chosen sufficiently
      often to warrant the expensive deterministic stage (fuzz_level), or
      if it has gone through deterministic testing in earlier, resumed runs
@@ -7033,126 +7218,222 @@ custom_mutator_stage:
 
   LIST_FOREACH(&afl->custom_mutator_list, struct custom_mutator, {
 
-    if (el->afl_custom_fuzz) {
+    if (el->afl_custom_fuzz || el->afl_custom_fuzz_leak) {
 
       afl->current_custom_fuzz = el;
 
-      if (el->afl_custom_fuzz_count) {
+      /* Leakage-aware mutators that follow the phase get each part in
+         turn, like havoc does; the others pick the part themselves. */
+      u8 phase = LEAK_PHASE_PUBLIC;
+      u8 last_phase = LEAK_PHASE_PUBLIC;
 
-        afl->stage_max = el->afl_custom_fuzz_count(el->data, mutate_buf, cur_len);
+      if (el->afl_custom_fuzz_leak) {
 
-      } else {
+        if (el->afl_custom_leak_phase) {
 
-        afl->stage_max = saved_max;
+          last_phase = LEAK_PHASE_FULL;
+
+        } else {
+
+          phase = last_phase = LEAK_PHASE_FULL;
+
+        }
 
       }
 
-      has_custom_fuzz = true;
+      for (; phase <= last_phase; ++phase) {
 
-      afl->stage_short = el->name_short;
+        afl->leak_exec_phase = phase;
 
-      if (afl->stage_max) {
+        if (el->afl_custom_fuzz_leak && el->afl_custom_leak_phase) {
 
-        for (afl->stage_cur = 0; afl->stage_cur < afl->stage_max;
-             ++afl->stage_cur) {
+          el->afl_custom_leak_phase(el->data, phase);
 
-          struct queue_entry *target = NULL;
-          u32                 tid;
-          u8 *                new_buf = NULL;
-          u32                 target_len = 0;
+        }
 
-          /* check if splicing makes sense yet (enough entries) */
-          if (likely(afl->ready_for_splicing_count > 1)) {
+        if (el->afl_custom_fuzz_count) {
 
-            /* Pick a random other queue entry for passing to external API
-               that has the necessary length */
+          afl->stage_max = el->afl_custom_fuzz_count(el->data, mutate_buf, cur_len);
 
-            do {
+        } else {
 
-              tid = rand_below(afl, afl->queued_paths);
+          afl->stage_max = saved_max;
 
-            } while (unlikely(tid == afl->current_entry ||
+        }
 
-                              afl->queue_buf[tid]->len < 4));
+        has_custom_fuzz = true;
 
-            target = afl->queue_buf[tid];
-            afl->splicing_with = tid;
+        afl->stage_short = el->name_short;
 
-            /* Read the additional testcase into a new buffer. */
-            new_buf = queue_testcase_get(afl, target);
+        if (afl->stage_max) {
 
-            u8 *new_public_buf; u8 *new_secret_buf;
-            u32 new_public_len; u32 new_secret_len;
-            find_public_and_secret_inputs(new_buf, target->len,
-                                          &new_public_buf, &new_public_len,
-                                          &new_secret_buf, &new_secret_len);
-            u32 new_combined_len = new_public_len + new_secret_len;
-            u8 *new_combined_buf = ck_alloc(new_combined_len);
+          for (afl->stage_cur = 0; afl->stage_cur < afl->stage_max;
+               ++afl->stage_cur) {
 
-            memcpy(new_combined_buf, new_public_buf, new_public_len);
-            memcpy(new_combined_buf + new_public_len, new_secret_buf, new_secret_len);
+            struct queue_entry *target = NULL;
+            u32                 tid;
+            u8 *                new_buf = NULL;
+            u32                 target_len = 0;
 
-            ck_free(new_public_buf);
-            ck_free(new_secret_buf);
+            /* Leakage-aware mutators get both halves and produce both halves,
+               no serialized testcase or splice partner involved. */
+            if (el->afl_custom_fuzz_leak) {
 
-            new_buf = new_combined_buf;
+              u8 *   out_pub = NULL;
+              u8 *   out_sec = NULL;
+              size_t out_sec_size = 0;
 
-            target_len = target->len;
+              size_t out_pub_size = el->afl_custom_fuzz_leak(
+                  el->data, mutate_buf, cur_len,
+                  leak_input.mutation_seed_combined_buf +
+                      leak_input.mutation_seed_public_len,
+                  leak_input.mutation_seed_secret_len, &out_pub, &out_sec,
+                  &out_sec_size, max_seed_size);
 
-          }
+              if (unlikely(!out_pub || !out_sec)) {
 
-          u8 *mutated_buf = NULL;
+                FATAL("Error in custom_fuzz_leak. Size returned: %zu",
+                      out_pub_size);
 
-          size_t mutated_size =
-              el->afl_custom_fuzz(el->data, mutate_buf, cur_len, &mutated_buf, new_buf,
-                                  target_len, max_seed_size);
+              }
 
-          if (unlikely(!mutated_buf)) {
+              /* A testcase needs both parts, so a result with an empty one
+                 is not run. Say so once, a mutator that keeps doing it does
+                 not fuzz at all. */
+              if (unlikely(!out_pub_size || !out_sec_size)) {
 
-            FATAL("Error in custom_fuzz. Size returned: %zu", mutated_size);
+                static u8 empty_warned;
 
-          }
+                if (!empty_warned) {
 
-          if (mutated_size > 0) {
+                  WARNF(
+                      "custom_fuzz_leak returned an empty %s part, such "
+                      "results are not run",
+                      out_pub_size ? "secret" : "public");
+                  empty_warned = 1;
 
-            if (leakage_fuzz_stuff(afl,
-                                   mutated_buf,
-                                   (u32)mutated_size,
-                                   leak_input.mutation_seed_combined_buf + leak_input.mutation_seed_public_len,
-                                   leak_input.mutation_seed_secret_len)) {
+                }
 
-              goto abandon_entry;
+                memcpy(mutate_buf, leak_input.mutation_seed_combined_buf,
+                       cur_len);
+                continue;
+
+              }
+
+              u32 out_sec_len = out_sec_size;
+
+              if (afl->secret_spec) {
+
+                out_sec = apply_secret_spec(afl, out_sec, &out_sec_len);
+
+              }
+
+              if (leakage_fuzz_stuff(afl, out_pub, (u32)out_pub_size, out_sec,
+                                     out_sec_len)) {
+
+                goto abandon_entry;
+
+              }
+
+              memcpy(mutate_buf, leak_input.mutation_seed_combined_buf, cur_len);
+              continue;
 
             }
 
-            if (!el->afl_custom_fuzz_count) {
+            /* check if splicing makes sense yet (enough entries) */
+            if (likely(afl->ready_for_splicing_count > 1)) {
 
-              /* If we're finding new stuff, let's run for a bit longer, limits
-                permitting. */
+              /* Pick a random other queue entry for passing to external API
+                 that has the necessary length */
 
-              if (afl->queued_paths != havoc_queued) {
+              do {
 
-                if (perf_score <= afl->havoc_max_mult * 100) {
+                tid = rand_below(afl, afl->queued_paths);
 
-                  afl->stage_max *= 2;
-                  perf_score *= 2;
+              } while (unlikely(tid == afl->current_entry ||
 
-                }
+                                afl->queue_buf[tid]->len < 4));
 
-                havoc_queued = afl->queued_paths;
+              target = afl->queue_buf[tid];
+              afl->splicing_with = tid;
+
+              /* Read the additional testcase into a new buffer. */
+              new_buf = queue_testcase_get(afl, target);
+
+              u8 *new_public_buf; u8 *new_secret_buf;
+              u32 new_public_len; u32 new_secret_len;
+              find_public_and_secret_inputs(new_buf, target->len,
+                                            &new_public_buf, &new_public_len,
+                                            &new_secret_buf, &new_secret_len);
+              u32 new_combined_len = new_public_len + new_secret_len;
+              u8 *new_combined_buf = ck_alloc(new_combined_len);
+
+              memcpy(new_combined_buf, new_public_buf, new_public_len);
+              memcpy(new_combined_buf + new_public_len, new_secret_buf, new_secret_len);
+
+              ck_free(new_public_buf);
+              ck_free(new_secret_buf);
+
+              new_buf = new_combined_buf;
+
+              target_len = target->len;
+
+            }
+
+            u8 *mutated_buf = NULL;
+
+            size_t mutated_size =
+                el->afl_custom_fuzz(el->data, mutate_buf, cur_len, &mutated_buf, new_buf,
+                                    target_len, max_seed_size);
+
+            if (unlikely(!mutated_buf)) {
+
+              FATAL("Error in custom_fuzz. Size returned: %zu", mutated_size);
+
+            }
+
+            if (mutated_size > 0) {
+
+              if (leakage_fuzz_stuff(afl,
+                                     mutated_buf,
+                                     (u32)mutated_size,
+                                     leak_input.mutation_seed_combined_buf + leak_input.mutation_seed_public_len,
+                                     leak_input.mutation_seed_secret_len)) {
+
+                goto abandon_entry;
+
+              }
+
+              if (!el->afl_custom_fuzz_count) {
+
+                /* If we're finding new stuff, let's run for a bit longer, limits
+                  permitting. */
+
+                if (afl->queued_paths != havoc_queued) {
+
+                  if (perf_score <= afl->havoc_max_mult * 100) {
+
+                    afl->stage_max *= 2;
+                    perf_score *= 2;
+
+                  }
+
+                  havoc_queued = afl->queued_paths;
+
+                }
 
               }
 
             }
 
-          }
+            /* `(afl->)out_buf` may have been changed by the call to custom_fuzz
+             */
+            /* TODO: Only do this when `mutated_buf` == `out_buf`? Branch vs
+             * Memcpy.
+             */
+            memcpy(mutate_buf, leak_input.mutation_seed_combined_buf, cur_len);
 
-          /* `(afl->)out_buf` may have been changed by the call to custom_fuzz
-           */
-          /* TODO: Only do this when `mutated_buf` == `out_buf`? Branch vs
-           * Memcpy.
-           */
-          memcpy(mutate_buf, leak_input.mutation_seed_combined_buf, cur_len);
+          }
 
         }
 
@@ -7193,8 +7474,9 @@ havoc_stage:
 
   if (!splice_cycle) {
 
-    afl->stage_name = "havoc";
-    afl->stage_short = "havoc";
+    afl->stage_name = MOpt_globals ? MOpt_globals->havoc_stagename : "havoc";
+    afl->stage_short =
+        MOpt_globals ? MOpt_globals->havoc_stagenameshort : "havoc";
     afl->stage_max = (doing_det ? HAVOC_CYCLES_INIT : HAVOC_CYCLES) *
                      perf_score / afl->havoc_div / 100;
 
@@ -7202,9 +7484,12 @@ havoc_stage:
 
     perf_score = orig_perf;
 
-    snprintf(afl->stage_name_buf, STAGE_BUF_SIZE, "splice %u", splice_cycle);
+    snprintf(afl->stage_name_buf, STAGE_BUF_SIZE,
+             MOpt_globals ? MOpt_globals->splice_stageformat : "splice %u",
+             splice_cycle);
     afl->stage_name = afl->stage_name_buf;
-    afl->stage_short = "splice";
+    afl->stage_short =
+        MOpt_globals ? MOpt_globals->splice_stagenameshort : "splice";
     afl->stage_max = SPLICE_HAVOC * perf_score / afl->havoc_div / 100;
 
   }
@@ -7217,11 +7502,24 @@ havoc_stage:
 
   havoc_queued = afl->queued_paths;
 
+  if (MOpt_globals && afl->key_puppet == 1 &&
+      unlikely(afl->orig_hit_cnt_puppet == 0)) {
+
+    afl->orig_hit_cnt_puppet = leakage_hit_cnt(afl);
+    afl->last_limit_time_start = get_cur_time();
+    afl->SPLICE_CYCLES_puppet =
+        (rand_below(afl,
+                    SPLICE_CYCLES_puppet_up - SPLICE_CYCLES_puppet_low + 1) +
+         SPLICE_CYCLES_puppet_low);
+
+  }
+
   if (afl->custom_mutators_count) {
 
     LIST_FOREACH(&afl->custom_mutator_list, struct custom_mutator, {
 
-      if (el->stacked_custom && el->afl_custom_havoc_mutation_probability) {
+      if ((el->stacked_custom || el->afl_custom_havoc_mutation_secret) &&
+          el->afl_custom_havoc_mutation_probability) {
 
         el->stacked_custom_prob =
             el->afl_custom_havoc_mutation_probability(el->data);
@@ -7268,6 +7566,16 @@ havoc_stage:
 
   }
 
+  /* MOpt has its own operator numbering, see leakage_mopt_pick() */
+
+  u32 mopt_r_max = 15 + ((afl->extras_cnt + afl->a_extras_cnt) ? 2 : 0);
+
+  if (unlikely(afl->expand_havoc && afl->ready_for_splicing_count > 1)) {
+
+    ++mopt_r_max;
+
+  }
+
   u32 leakage_stages = afl->fsrv.leakage_hunting ? 2 * afl->stage_max : 0;
 
   for (afl->stage_cur = 0; afl->stage_cur < afl->stage_max + leakage_stages; ++afl->stage_cur) {
@@ -7279,6 +7587,14 @@ havoc_stage:
       leak_fuzz_phase = LEAKAGE_FUZZ_MUTATE_FULL_INPUT;
     }
 
+    if (leak_fuzz_phase == LEAKAGE_FUZZ_MUTATE_PUBLIC) {
+      afl->leak_exec_phase = LEAK_PHASE_PUBLIC;
+    } else if (leak_fuzz_phase == LEAKAGE_FUZZ_MUTATE_SECRET) {
+      afl->leak_exec_phase = LEAK_PHASE_SECRET;
+    } else {
+      afl->leak_exec_phase = LEAK_PHASE_FULL;
+    }
+
     u32 temp_public_len = leak_input.mutation_seed_public_len;
     u32 temp_secret_len = leak_input.mutation_seed_secret_len;
 
@@ -7321,9 +7637,17 @@ havoc_stage:
 
     afl->stage_cur_val = use_stacking;
 
+    if (MOpt_globals) {
+
+      memcpy(MOpt_globals->cycles_v3, MOpt_globals->cycles_v2,
+             operator_num * sizeof(u64));
+
+    }
+
 #ifdef INTROSPECTION
-    snprintf(afl->mutation, sizeof(afl->mutation), "%s HAVOC-%u",
-             afl->queue_cur->fname, use_stacking);
+    snprintf(afl->mutation, sizeof(afl->mutation), "%s %s-%u",
+             afl->queue_cur->fname, MOpt_globals ? "MOPT_HAVOC" : "HAVOC",
+             use_stacking);
 #endif
 
     for (i = 0; i < use_stacking; ++i) {
@@ -7362,9 +7686,64 @@ havoc_stage:
           }
         });
 
+      } else if (afl->custom_mutators_count) {
+
+        /* The secret is the whole buffer in the SECRET phase and its tail in
+           the FULL_INPUT phase; the public part in front stays untouched. */
+        u32 sec_off =
+            leak_fuzz_phase == LEAKAGE_FUZZ_MUTATE_FULL_INPUT ? temp_public_len
+                                                              : 0;
+
+        LIST_FOREACH(&afl->custom_mutator_list, struct custom_mutator, {
+
+          if (el->afl_custom_havoc_mutation_secret && temp_secret_len &&
+              rand_below(afl, 100) < el->stacked_custom_prob) {
+
+            u8 *   custom_havoc_buf = NULL;
+            size_t new_len = el->afl_custom_havoc_mutation_secret(
+                el->data, mutate_buf + sec_off, temp_secret_len,
+                &custom_havoc_buf, MAX_FILE);
+            if (unlikely(!custom_havoc_buf)) {
+
+              FATAL("Error in custom_havoc_secret (return %zu)", new_len);
+
+            }
+
+            if (likely(new_len > 0)) {
+
+              u8 *new_buf = ck_realloc(leakage_scratch_buf, sec_off + new_len);
+              if (unlikely(!new_buf)) { PFATAL("alloc"); }
+              memcpy(new_buf, mutate_buf, sec_off);
+              memcpy(new_buf + sec_off, custom_havoc_buf, new_len);
+
+              u8 *tmp = mutate_buf;
+              mutate_buf = new_buf;
+              leakage_scratch_buf = tmp;
+
+              temp_secret_len = new_len;
+              temp_combined_len = sec_off + new_len;
+
+            }
+
+          }
+
+        });
+
       }
 
-      switch ((r = rand_below(afl, r_max))) {
+      if (MOpt_globals) {
+
+        r = leakage_mopt_pick(afl, MOpt_globals, mopt_r_max, mutate_buf,
+                              temp_combined_len);
+        if (r == LEAK_MOPT_APPLIED) { continue; }
+
+      } else {
+
+        r = rand_below(afl, r_max);
+
+      }
+
+      switch (r) {
 
         case 0 ... 3: {
 
@@ -8193,13 +8572,20 @@ havoc_stage:
 
     }
 
+    u64 hit_cnt_before = leakage_hit_cnt(afl);
+    if (MOpt_globals) { ++*MOpt_globals->pTime; }
+
     u8 res = 0;
     if (leak_fuzz_phase == LEAKAGE_FUZZ_MUTATE_FULL_INPUT) {
+      u8 *secret_buf = mutate_buf + temp_public_len;
+      if (afl->secret_spec) {
+        secret_buf = apply_secret_spec(afl, secret_buf, &temp_secret_len);
+      }
       fflush(stdout);
       res = leakage_fuzz_stuff(afl,
                                mutate_buf,
                                temp_public_len,
-                               mutate_buf + temp_public_len,
+                               secret_buf,
                                temp_secret_len);
     } else if (leak_fuzz_phase == LEAKAGE_FUZZ_MUTATE_PUBLIC) {
       res = leakage_fuzz_stuff(afl,
@@ -8208,10 +8594,14 @@ havoc_stage:
                                leak_input.mutation_seed_combined_buf + leak_input.mutation_seed_public_len,
                                leak_input.mutation_seed_secret_len);
     } else {
+      u8 *secret_buf = mutate_buf;
+      if (afl->secret_spec) {
+        secret_buf = apply_secret_spec(afl, secret_buf, &temp_secret_len);
+      }
       res = leakage_fuzz_stuff(afl,
                                leak_input.mutation_seed_combined_buf,
                                leak_input.mutation_seed_public_len,
-                               mutate_buf,
+                               secret_buf,
                                temp_secret_len);
     }
 
@@ -8219,6 +8609,13 @@ havoc_stage:
       goto abandon_entry;
     }
 
+    if (MOpt_globals && leakage_hit_cnt(afl) > hit_cnt_before) {
+
+      leakage_mopt_credit(afl, MOpt_globals,
+                          leakage_hit_cnt(afl) - hit_cnt_before);
+
+    }
+
     u32 len = afl->fsrv.stdout_raw_buffer_len;
     char *tmp = malloc(len * 2);
     u32 tmp_len = 0;
@@ -8361,7 +8758,9 @@ havoc_stage:
 
 retry_splicing:
 
-  if (afl->use_splicing && splice_cycle++ < SPLICE_CYCLES &&
+  if (afl->use_splicing &&
+      splice_cycle++ <
+          (MOpt_globals ? (u32)afl->SPLICE_CYCLES_puppet : SPLICE_CYCLES) &&
       afl->ready_for_splicing_count > 1 && afl->queue_cur->len >= 4) {
 
     // printf("REGULAR splice\n");
@@ -8557,6 +8956,21 @@ abandon_entry:
 
   afl->splicing_with = -1;
 
+  if (MOpt_globals) {
+
+    if ((s64)splice_cycle >= afl->SPLICE_CYCLES_puppet) {
+
+      afl->SPLICE_CYCLES_puppet =
+          (rand_below(
+               afl, SPLICE_CYCLES_puppet_up - SPLICE_CYCLES_puppet_low + 1) +
+           SPLICE_CYCLES_puppet_low);
+
+    }
+
+    mopt_update(afl, *MOpt_globals, leakage_hit_cnt(afl));
+
+  }
+
   /* Update afl->pending_not_fuzzed count if we made it through the calibration
      cycle and have not seen this entry before. */
 
@@ -204,6 +204,12 @@ static py_mutator_t *init_py_module(afl_state_t *afl, u8 *module_name) {
         PyObject_GetAttrString(py_module, "havoc_mutation");
     py_functions[PY_FUNC_HAVOC_MUTATION_PROBABILITY] =
         PyObject_GetAttrString(py_module, "havoc_mutation_probability");
+    py_functions[PY_FUNC_FUZZ_LEAK] =
+        PyObject_GetAttrString(py_module, "fuzz_leak");
+    py_functions[PY_FUNC_HAVOC_MUTATION_SECRET] =
+        PyObject_GetAttrString(py_module, "havoc_mutation_secret");
+    py_functions[PY_FUNC_LEAK_PHASE] =
+        PyObject_GetAttrString(py_module, "leak_phase");
     py_functions[PY_FUNC_QUEUE_GET] =
         PyObject_GetAttrString(py_module, "queue_get");
     py_functions[PY_FUNC_QUEUE_NEW_ENTRY] =
@@ -420,6 +426,24 @@ struct custom_mutator *load_custom_mutator_py(afl_state_t *afl,
 
   }
 
+  if (py_functions[PY_FUNC_FUZZ_LEAK]) {
+
+    mutator->afl_custom_fuzz_leak = fuzz_leak_py;
+
+  }
+
+  if (py_functions[PY_FUNC_HAVOC_MUTATION_SECRET]) {
+
+    mutator->afl_custom_havoc_mutation_secret = havoc_mutation_secret_py;
+
+  }
+
+  if (py_functions[PY_FUNC_LEAK_PHASE]) {
+
+    mutator->afl_custom_leak_phase = leak_phase_py;
+
+  }
+
   if (py_functions[PY_FUNC_QUEUE_GET]) {
 
     mutator->afl_custom_queue_get = queue_get_py;
@@ -716,6 +740,212 @@ size_t havoc_mutation_py(void *py_mutator, u8 *buf, size_t buf_size,
 
 }
 
+size_t fuzz_leak_py(void *py_mutator, u8 *pub_buf, size_t pub_size,
+                    u8 *sec_buf, size_t sec_size, u8 **out_pub, u8 **out_sec,
+                    size_t *out_sec_size, size_t max_size) {
+
+  size_t    pub_out_size, sec_out_size;
+  PyObject *py_args, *py_value, *py_pub, *py_sec;
+  py_args = PyTuple_New(3);
+  py_mutator_t *py = (py_mutator_t *)py_mutator;
+
+  /* public */
+  py_value = PyByteArray_FromStringAndSize(pub_buf, pub_size);
+  if (!py_value) {
+
+    Py_DECREF(py_args);
+    FATAL("Failed to convert arguments");
+
+  }
+
+  PyTuple_SetItem(py_args, 0, py_value);
+
+  /* secret */
+  py_value = PyByteArray_FromStringAndSize(sec_buf, sec_size);
+  if (!py_value) {
+
+    Py_DECREF(py_args);
+    FATAL("Failed to convert arguments");
+
+  }
+
+  PyTuple_SetItem(py_args, 1, py_value);
+
+  /* max_size */
+  #if PY_MAJOR_VERSION >= 3
+  py_value = PyLong_FromLong(max_size);
+  #else
+  py_value = PyInt_FromLong(max_size);
+  #endif
+  if (!py_value) {
+
+    Py_DECREF(py_args);
+    FATAL("Failed to convert arguments");
+
+  }
+
+  PyTuple_SetItem(py_args, 2, py_value);
+
+  py_value = PyObject_CallObject(py->py_functions[PY_FUNC_FUZZ_LEAK], py_args);
+
+  Py_DECREF(py_args);
+
+  if (py_value == NULL) {
+
+    PyErr_Print();
+    FATAL("python custom fuzz_leak: call failed");
+
+  }
+
+  /* Expect a (public, secret) tuple of bytearrays back */
+  if (!PyTuple_Check(py_value) || PyTuple_Size(py_value) != 2) {
+
+    Py_DECREF(py_value);
+    FATAL("python custom fuzz_leak: must return a (public, secret) tuple");
+
+  }
+
+  py_pub = PyTuple_GetItem(py_value, 0);
+  py_sec = PyTuple_GetItem(py_value, 1);
+  if (!PyByteArray_Check(py_pub) || !PyByteArray_Check(py_sec)) {
+
+    Py_DECREF(py_value);
+    FATAL("python custom fuzz_leak: public and secret must be bytearrays");
+
+  }
+
+  pub_out_size = PyByteArray_Size(py_pub);
+  sec_out_size = PyByteArray_Size(py_sec);
+
+  /* An empty part is not run, see the custom mutator stage; there is
+     nothing to copy then, and afl_realloc() does not take a size of 0. */
+  if (unlikely(!pub_out_size || !sec_out_size)) {
+
+    Py_DECREF(py_value);
+    *out_pub = pub_buf;
+    *out_sec = sec_buf;
+    *out_sec_size = sec_out_size;
+    return pub_out_size;
+
+  }
+
+  *out_pub = afl_realloc(BUF_PARAMS(fuzz_leak_pub), pub_out_size);
+  *out_sec = afl_realloc(BUF_PARAMS(fuzz_leak_sec), sec_out_size);
+  if (unlikely(!*out_pub || !*out_sec)) { PFATAL("alloc"); }
+
+  memcpy(*out_pub, PyByteArray_AsString(py_pub), pub_out_size);
+  memcpy(*out_sec, PyByteArray_AsString(py_sec), sec_out_size);
+  Py_DECREF(py_value);
+
+  *out_sec_size = sec_out_size;
+  return pub_out_size;
+
+}
+
+void leak_phase_py(void *py_mutator, u8 phase) {
+
+  PyObject *py_args, *py_value;
+
+  py_args = PyTuple_New(1);
+
+  #if PY_MAJOR_VERSION >= 3
+  py_value = PyLong_FromLong(phase);
+  #else
+  py_value = PyInt_FromLong(phase);
+  #endif
+  if (!py_value) {
+
+    Py_DECREF(py_args);
+    FATAL("Failed to convert arguments");
+
+  }
+
+  PyTuple_SetItem(py_args, 0, py_value);
+
+  py_value = PyObject_CallObject(
+      ((py_mutator_t *)py_mutator)->py_functions[PY_FUNC_LEAK_PHASE], py_args);
+  Py_DECREF(py_args);
+
+  if (py_value == NULL) {
+
+    PyErr_Print();
+    FATAL("python custom leak_phase: call failed");
+
+  }
+
+  Py_DECREF(py_value);
+
+}
+
+size_t havoc_mutation_secret_py(void *py_mutator, u8 *buf, size_t buf_size,
+                                u8 **out_buf, size_t max_size) {
+
+  size_t    mutated_size;
+  PyObject *py_args, *py_value;
+  py_args = PyTuple_New(2);
+
+  /* buf */
+  py_value = PyByteArray_FromStringAndSize(buf, buf_size);
+  if (!py_value) {
+
+    Py_DECREF(py_args);
+    FATAL("Failed to convert arguments");
+
+  }
+
+  PyTuple_SetItem(py_args, 0, py_value);
+
+  /* max_size */
+  #if PY_MAJOR_VERSION >= 3
+  py_value = PyLong_FromLong(max_size);
+  #else
+  py_value = PyInt_FromLong(max_size);
+  #endif
+  if (!py_value) {
+
+    Py_DECREF(py_args);
+    FATAL("Failed to convert arguments");
+
+  }
+
+  PyTuple_SetItem(py_args, 1, py_value);
+
+  py_value = PyObject_CallObject(
+      ((py_mutator_t *)py_mutator)->py_functions[PY_FUNC_HAVOC_MUTATION_SECRET],
+      py_args);
+
+  Py_DECREF(py_args);
+
+  if (py_value != NULL) {
+
+    mutated_size = PyByteArray_Size(py_value);
+    if (mutated_size <= buf_size) {
+
+      /* We reuse the input buf here. */
+      *out_buf = buf;
+
+    } else {
+
+      /* A new buf is needed... */
+      *out_buf = afl_realloc(BUF_PARAMS(havoc_secret), mutated_size);
+      if (unlikely(!*out_buf)) { PFATAL("alloc"); }
+
+    }
+
+    memcpy(*out_buf, PyByteArray_AsString(py_value), mutated_size);
+
+    Py_DECREF(py_value);
+    return mutated_size;
+
+  } else {
+
+    PyErr_Print();
+    FATAL("Call failed");
+
+  }
+
+}
+
 u8 havoc_mutation_probability_py(void *py_mutator) {
 
   PyObject *py_args, *py_value;
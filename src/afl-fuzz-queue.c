@@ -60,6 +60,7 @@ double compute_weight(afl_state_t *afl, struct queue_entry *q,
   weight *= (1 + (q->tc_ref / avg_top_size));
   if (unlikely(q->favored)) { weight *= 5; }
   if (unlikely(!q->was_fuzzed)) { weight *= 2; }
+  if (unlikely(q->has_new_taint)) { weight *= 2; }
 
   return weight;
 
@@ -975,6 +976,10 @@ u32 calculate_score(afl_state_t *afl, struct queue_entry *q) {
 
   }
 
+  /* The secret reached new branches here, where leaks are to be found. */
+
+  if (unlikely(q->has_new_taint)) { perf_score *= 2; }
+
   // MOpt mode
   if (afl->limit_time_sig != 0 && afl->max_depth - q->depth < 3) {
 
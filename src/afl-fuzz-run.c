@@ -585,6 +585,8 @@ void sync_fuzzers(afl_state_t *afl) {
         open(qd_synced_path, O_RDWR | O_CREAT | O_TRUNC, DEFAULT_PERMISSION);
     if (id_fd >= 0) close(id_fd);
 
+    if (afl->fsrv.leakage_hunting) { leak_log_sync(afl, sd_ent->d_name); }
+
     /* Skip anything that doesn't have a queue/ subdirectory. */
 
     sprintf(qd_path, "%s/%s/queue", afl->sync_dir, sd_ent->d_name);
@@ -965,25 +967,14 @@ common_fuzz_stuff(afl_state_t *afl, u8 *out_buf, u32 len) {
 
 }
 
-/* Write a modified test case, run program, process results. Handle
-   error conditions, returning 1 if it's time to bail out. This is
-   a helper function for fuzz_one(). */
-
-u8 __attribute__((hot))
-leakage_fuzz_stuff(afl_state_t *afl, u8 *public_in_buf, u32 public_len, u8 *secret_in_buf, u32 secret_len) {
-
-  u8 fault;
-
-  char *combined_buf;
-  u32 combined_len;
-  create_buffer_from_public_and_secret_inputs(public_in_buf, public_len,
-                                              secret_in_buf, secret_len,
-                                              &combined_buf, &combined_len);
-//  printf("Combined: %.*s\n", combined_len, combined_buf);
-
-  write_to_testcase(afl, combined_buf, combined_len);
+/* Process the result of a leakage exec on fsrv, returning 1 if it's time to
+   bail out. Cached results only count towards the timeouts. */
 
-  fault = fuzz_run_target(afl, &afl->fsrv, afl->fsrv.exec_tmout);
+static u8 leakage_fuzz_result(afl_state_t *afl, afl_forkserver_t *fsrv,
+                              char *combined_buf,
+                              u32 combined_len, u8 *public_in_buf,
+                              u32 public_len, u8 *secret_in_buf,
+                              u32 secret_len, u8 fault, u8 cached) {
 
   if (afl->stop_soon) { return 1; }
 
@@ -1015,15 +1006,17 @@ leakage_fuzz_stuff(afl_state_t *afl, u8 *public_in_buf, u32 public_len, u8 *secr
 
   /* This handles FAULT_ERROR for us: */
 
-  afl->queued_discovered += leakage_save_if_interesting(
-      afl,
-      combined_buf, combined_len,
-      public_in_buf, public_len,
-      secret_in_buf, secret_len,
-      fault
-  );
+  if (!cached) {
 
-  free(combined_buf);
+    afl->queued_discovered += leakage_save_if_interesting(
+        afl, fsrv,
+        combined_buf, combined_len,
+        public_in_buf, public_len,
+        secret_in_buf, secret_len,
+        fault
+    );
+
+  }
 
   if (!(afl->stage_cur % afl->stats_update_freq) ||
       afl->stage_cur + 1 == afl->stage_max) {
@@ -1035,3 +1028,182 @@ leakage_fuzz_stuff(afl_state_t *afl, u8 *public_in_buf, u32 public_len, u8 *secr
   return 0;
 
 }
+
+/* Write a modified test case, run program, process results. Handle
+   error conditions, returning 1 if it's time to bail out. This is
+   a helper function for fuzz_one(). */
+
+u8 __attribute__((hot))
+leakage_fuzz_stuff(afl_state_t *afl, u8 *public_in_buf, u32 public_len, u8 *secret_in_buf, u32 secret_len) {
+
+  u8  fault, cached = 0, ret;
+  u64 exec_key = 0;
+
+  char *combined_buf;
+  u32 combined_len;
+  create_buffer_from_public_and_secret_inputs(public_in_buf, public_len,
+                                              secret_in_buf, secret_len,
+                                              &combined_buf, &combined_len);
+//  printf("Combined: %.*s\n", combined_len, combined_buf);
+
+  /* Repeated testcases with nothing left to tell us skip the target. */
+
+  if (afl->leak_exec_cache) {
+
+    exec_key = hash64((u8 *)combined_buf, combined_len, HASH_CONST);
+    cached = leak_exec_cache_lookup(afl, exec_key, public_in_buf, public_len,
+                                    secret_in_buf, secret_len, &fault);
+
+  }
+
+  if (!cached) {
+
+    write_to_testcase(afl, combined_buf, combined_len);
+
+    fault = fuzz_run_target(afl, &afl->fsrv, afl->fsrv.exec_tmout);
+    ++afl->leak_phase_execs[afl->leak_exec_phase];
+
+    if (exec_key) { leak_exec_cache_add(afl, &afl->fsrv, exec_key, fault); }
+
+  }
+
+  ret = leakage_fuzz_result(afl, &afl->fsrv, combined_buf, combined_len,
+                            public_in_buf, public_len, secret_in_buf,
+                            secret_len, fault, cached);
+
+  free(combined_buf);
+  return ret;
+
+}
+
+/* write_to_testcase() for either fork server. Custom post-processing is
+   for the main one only, leakage_fuzz_pair() leaves it to that. */
+
+void leak_write_to_testcase(afl_state_t *afl, afl_forkserver_t *fsrv,
+                            void *buf, u32 len) {
+
+  if (fsrv == &afl->fsrv) {
+
+    write_to_testcase(afl, buf, len);
+
+  } else {
+
+    afl_fsrv_write_to_testcase(fsrv, buf, len);
+
+  }
+
+}
+
+/* Fold the execs of the second fork server into the main one, where the
+   stats look for them. */
+
+static void leak_fsrv_count_execs(afl_state_t *afl) {
+
+  afl->fsrv.total_execs += afl->leak_fsrv.total_execs;
+  afl->fsrv.leak_snap_execs += afl->leak_fsrv.leak_snap_execs;
+  afl->leak_fsrv.total_execs = afl->leak_fsrv.leak_snap_execs = 0;
+
+}
+
+/* Run one public input with two secrets at the same time, the second one on
+   afl->leak_fsrv (AFL_LEAK_DUAL_FSRV). Both results are in before either is
+   looked at. The second one is processed from afl->leak_fsrv, where the
+   rechecks of a candidate also run; afl->fsrv is left alone for it.
+   Returns 1 if it's time to bail out. */
+
+u8 __attribute__((hot))
+leakage_fuzz_pair(afl_state_t *afl, u8 *public_in_buf, u32 public_len,
+                  u8 *secret_a_buf, u32 secret_a_len, u8 *secret_b_buf,
+                  u32 secret_b_len) {
+
+  char *            bufs[2];
+  u32               lens[2];
+  u64               keys[2] = {0, 0};
+  fsrv_run_result_t faults[2] = {FSRV_RUN_OK, FSRV_RUN_OK};
+  u8                fault, ret;
+
+  create_buffer_from_public_and_secret_inputs(public_in_buf, public_len,
+                                              secret_a_buf, secret_a_len,
+                                              &bufs[0], &lens[0]);
+
+  /* Whether the second secret could skip the target depends on what the
+     first one does to the io map, so only the first one asks the cache.
+     Custom post-processing is for the main fork server only. */
+
+  if (afl->leak_exec_cache) {
+
+    keys[0] = hash64((u8 *)bufs[0], lens[0], HASH_CONST);
+
+    if (leak_exec_cache_lookup(afl, keys[0], public_in_buf, public_len,
+                               secret_a_buf, secret_a_len, &fault)) {
+
+      ret = leakage_fuzz_result(afl, &afl->fsrv, bufs[0], lens[0],
+                                public_in_buf, public_len, secret_a_buf,
+                                secret_a_len, fault, 1);
+      free(bufs[0]);
+
+      return ret || leakage_fuzz_stuff(afl, public_in_buf, public_len,
+                                       secret_b_buf, secret_b_len);
+
+    }
+
+  }
+
+  if (afl->custom_mutators_count) {
+
+    free(bufs[0]);
+
+    return leakage_fuzz_stuff(afl, public_in_buf, public_len, secret_a_buf,
+                              secret_a_len) ||
+           leakage_fuzz_stuff(afl, public_in_buf, public_len, secret_b_buf,
+                              secret_b_len);
+
+  }
+
+  create_buffer_from_public_and_secret_inputs(public_in_buf, public_len,
+                                              secret_b_buf, secret_b_len,
+                                              &bufs[1], &lens[1]);
+  if (keys[0]) { keys[1] = hash64((u8 *)bufs[1], lens[1], HASH_CONST); }
+
+  write_to_testcase(afl, bufs[0], lens[0]);
+  afl_fsrv_write_to_testcase(&afl->leak_fsrv, (u8 *)bufs[1], lens[1]);
+
+  if (!afl_fsrv_run_target_start(&afl->fsrv, &afl->stop_soon) &&
+      !afl_fsrv_run_target_start(&afl->leak_fsrv, &afl->stop_soon)) {
+
+    faults[0] = afl_fsrv_run_target_finish(&afl->fsrv, afl->fsrv.exec_tmout,
+                                           &afl->stop_soon);
+    faults[1] = afl_fsrv_run_target_finish(
+        &afl->leak_fsrv, afl->fsrv.exec_tmout, &afl->stop_soon);
+
+  }
+
+  leak_fsrv_count_execs(afl);
+  afl->leak_phase_execs[afl->leak_exec_phase] += 2;
+  ++afl->leak_dual_pairs;
+
+  if (keys[0]) { leak_exec_cache_add(afl, &afl->fsrv, keys[0], faults[0]); }
+  ret = leakage_fuzz_result(afl, &afl->fsrv, bufs[0], lens[0], public_in_buf,
+                            public_len, secret_a_buf, secret_a_len, faults[0],
+                            0);
+
+  if (!ret) {
+
+    if (keys[1]) {
+
+      leak_exec_cache_add(afl, &afl->leak_fsrv, keys[1], faults[1]);
+
+    }
+
+    ret = leakage_fuzz_result(afl, &afl->leak_fsrv, bufs[1], lens[1],
+                              public_in_buf, public_len, secret_b_buf,
+                              secret_b_len, faults[1], 0);
+    leak_fsrv_count_execs(afl);
+
+  }
+
+  free(bufs[0]);
+  free(bufs[1]);
+  return ret;
+
+}
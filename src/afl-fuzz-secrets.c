@@ -0,0 +1,332 @@
+/*
+   american fuzzy lop++ - secret pool for leakage hunting
+   ------------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   In leakage hunting mode every testcase carries a PUBLIC and a SECRET
+   part. Secrets that are expensive to rediscover (valid keys, well-formed
+   configs, ...) would otherwise only survive glued to the public input they
+   were found with. The secret pool keeps them independently: it is seeded
+   from AFL_LEAK_SECRETS_DIR, grows with every secret that produced a new
+   observation for some public input, and the pairing stage tests public
+   inputs against a rotating batch of pooled secrets. Targets that take
+   batches (AFL_LEAK_BATCH) run the whole batch in one exec, see
+   afl-fuzz-leakbatch.c.
+
+ */
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+#include "hashmap.h"
+
+struct secret_pool_entry {
+
+  u64 hash;
+  u32 idx;                              /* Into afl->secret_pool            */
+
+};
+
+static uint64_t pool_entry_hash(const void *item, uint64_t seed0,
+                                uint64_t seed1) {
+
+  const struct secret_pool_entry *e = item;
+  (void)seed1;
+  return e->hash ^ seed0;
+
+}
+
+static int pool_entry_compare(const void *a, const void *b, void *udata) {
+
+  const struct secret_pool_entry *ea = a, *eb = b;
+  (void)udata;
+  return ea->hash != eb->hash;
+
+}
+
+/* Add a secret to the pool, unless we already have it. Returns 1 if the
+   secret was added. The pool is indexed by secret hash; secrets that share
+   a hash are chained through secret_entry.next, starting at the one in the
+   index. */
+
+u8 add_to_secret_pool(afl_state_t *afl, u8 *buf, u32 len) {
+
+  if (unlikely(!len)) { return 0; }
+
+  if (unlikely(!afl->secret_pool_map)) {
+
+    afl->secret_pool_map =
+        hashmap_new(sizeof(struct secret_pool_entry), 0, 0, 0,
+                    pool_entry_hash, pool_entry_compare, NULL, NULL);
+
+  }
+
+  u64                       hash = hash64(buf, len, HASH_CONST);
+  struct secret_pool_entry  sought = {.hash = hash};
+  struct secret_pool_entry *found = hashmap_get(afl->secret_pool_map, &sought);
+  u32                       tail = 0;
+
+  if (found) {
+
+    struct secret_entry *e;
+
+    for (tail = found->idx;; tail = e->next - 1) {
+
+      e = &afl->secret_pool[tail];
+      if (e->len == len && !memcmp(e->buf, buf, len)) { return 0; }
+      if (!e->next) { break; }
+
+    }
+
+  }
+
+  if (unlikely(afl->secret_pool_cnt >= SECRET_POOL_MAX)) { return 0; }
+
+  afl->secret_pool =
+      afl_realloc((void **)&afl->secret_pool,
+                  (afl->secret_pool_cnt + 1) * sizeof(struct secret_entry));
+  if (unlikely(!afl->secret_pool)) { PFATAL("alloc"); }
+
+  if (found) {
+
+    afl->secret_pool[tail].next = afl->secret_pool_cnt + 1;
+
+  } else {
+
+    sought.idx = afl->secret_pool_cnt;
+    hashmap_set(afl->secret_pool_map, &sought);
+
+  }
+
+  struct secret_entry *s = &afl->secret_pool[afl->secret_pool_cnt];
+
+  s->buf = ck_alloc_nozero(len);
+  memcpy(s->buf, buf, len);
+  s->len = len;
+  s->hash = hash;
+  s->next = 0;
+
+  /* Keep a copy in the output directory, like queue/ does for inputs. */
+
+  if (likely(afl->out_dir)) {
+
+#ifndef SIMPLE_FILES
+    u8 *fn = alloc_printf("%s/secrets/id:%06u", afl->out_dir,
+                          afl->secret_pool_cnt);
+#else
+    u8 *fn = alloc_printf("%s/secrets/id_%06u", afl->out_dir,
+                          afl->secret_pool_cnt);
+#endif                                                    /* ^!SIMPLE_FILES */
+
+    s32 fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, DEFAULT_PERMISSION);
+    if (unlikely(fd < 0)) { PFATAL("Unable to create '%s'", fn); }
+    ck_write(fd, buf, len, fn);
+    close(fd);
+    ck_free(fn);
+
+  }
+
+  ++afl->secret_pool_cnt;
+  return 1;
+
+}
+
+/* Read all regular files in dir into the secret pool. */
+
+void load_secret_pool(afl_state_t *afl, u8 *dir) {
+
+  struct dirent **nl;
+  s32             nl_cnt, i;
+
+  ACTF("Loading secrets from '%s'...", dir);
+
+  nl_cnt = scandir(dir, &nl, NULL, alphasort);
+  if (nl_cnt < 0) { PFATAL("Unable to open '%s'", dir); }
+
+  for (i = 0; i < nl_cnt; ++i) {
+
+    struct stat st;
+    u8 *        fn = alloc_printf("%s/%s", dir, nl[i]->d_name);
+
+    free(nl[i]);                                             /* not tracked */
+
+    if (lstat(fn, &st) || access(fn, R_OK)) {
+
+      PFATAL("Unable to access '%s'", fn);
+
+    }
+
+    if (!S_ISREG(st.st_mode) || !st.st_size || strstr(fn, "/README.txt")) {
+
+      ck_free(fn);
+      continue;
+
+    }
+
+    u32 len = MIN(st.st_size, (off_t)MAX_FILE);
+    u8 *buf = ck_alloc_nozero(len);
+    s32 fd = open(fn, O_RDONLY);
+    if (fd < 0) { PFATAL("Unable to open '%s'", fn); }
+    ck_read(fd, buf, len, fn);
+    close(fd);
+
+    add_to_secret_pool(afl, buf, len);
+
+    ck_free(buf);
+    ck_free(fn);
+
+  }
+
+  free(nl);                                                  /* not tracked */
+
+  if (!afl->secret_pool_cnt) {
+
+    WARNF("No usable secrets in '%s'", dir);
+
+  } else {
+
+    OKF("Loaded %u secrets into the secret pool.", afl->secret_pool_cnt);
+
+  }
+
+}
+
+/* On in-place resume, load the pool of the last session back in, from where
+   handle_existing_out_dir() moved it, and drop the old copy. */
+
+void resume_secret_pool(afl_state_t *afl) {
+
+  u8 *dir = alloc_printf("%s/_resume_secrets", afl->out_dir);
+
+  if (!access(dir, F_OK)) {
+
+    load_secret_pool(afl, dir);
+    if (delete_files(dir, CASE_PREFIX)) {
+
+      PFATAL("Unable to delete '%s'", dir);
+
+    }
+
+  }
+
+  ck_free(dir);
+
+}
+
+/* Run the public input against the next batch of pooled secrets. The cursor
+   keeps rotating across queue entries, so every secret gets paired with new
+   public inputs over time. Returns 1 if fuzzing of the entry should be
+   abandoned. */
+
+u8 secret_pairing_stage(afl_state_t *afl, u8 *public_buf, u32 public_len) {
+
+  if (!afl->secret_pool_cnt) { return 0; }
+
+  u64 orig_hit_cnt, new_hit_cnt;
+
+  afl->stage_name = "secret pairing";
+  afl->stage_short = "pair";
+  afl->stage_max = MIN(afl->secret_pool_cnt, (u32)SECRET_PAIRING_BATCH);
+  afl->stage_val_type = STAGE_VAL_NONE;
+  afl->stage_cur_byte = -1;
+  afl->leak_exec_phase = LEAK_PHASE_PAIRING;
+
+  orig_hit_cnt = afl->queued_paths + afl->unique_crashes;
+
+  if (afl->leak_batch) {
+
+    u8 *bufs[SECRET_PAIRING_BATCH];
+    u32 lens[SECRET_PAIRING_BATCH];
+
+    for (u32 i = 0; i < afl->stage_max; ++i) {
+
+      bufs[i] = afl->secret_pool[afl->secret_pool_cursor].buf;
+      lens[i] = afl->secret_pool[afl->secret_pool_cursor].len;
+
+      if (++afl->secret_pool_cursor >= afl->secret_pool_cnt) {
+
+        afl->secret_pool_cursor = 0;
+
+      }
+
+    }
+
+#ifdef INTROSPECTION
+    snprintf(afl->mutation, sizeof(afl->mutation), "%s SECRET_PAIR-%u",
+             afl->queue_cur->fname, afl->secret_pool_cursor);
+#endif
+
+    if (leakage_fuzz_batch(afl, public_buf, public_len, bufs, lens,
+                           afl->stage_max)) {
+
+      return 1;
+
+    }
+
+    goto pairing_done;
+
+  }
+
+  for (afl->stage_cur = 0; afl->stage_cur < afl->stage_max; ++afl->stage_cur) {
+
+    struct secret_entry *s = &afl->secret_pool[afl->secret_pool_cursor];
+
+    if (++afl->secret_pool_cursor >= afl->secret_pool_cnt) {
+
+      afl->secret_pool_cursor = 0;
+
+    }
+
+#ifdef INTROSPECTION
+    snprintf(afl->mutation, sizeof(afl->mutation), "%s SECRET_PAIR-%u",
+             afl->queue_cur->fname, afl->secret_pool_cursor);
+#endif
+
+    /* With a second fork server, the next secret runs alongside. */
+
+    if (afl->leak_fsrv.fsrv_pid && afl->stage_cur + 1 < afl->stage_max) {
+
+      struct secret_entry *t = &afl->secret_pool[afl->secret_pool_cursor];
+
+      if (++afl->secret_pool_cursor >= afl->secret_pool_cnt) {
+
+        afl->secret_pool_cursor = 0;
+
+      }
+
+      ++afl->stage_cur;
+
+      if (leakage_fuzz_pair(afl, public_buf, public_len, s->buf, s->len,
+                            t->buf, t->len)) {
+
+        return 1;
+
+      }
+
+      continue;
+
+    }
+
+    if (leakage_fuzz_stuff(afl, public_buf, public_len, s->buf, s->len)) {
+
+      return 1;
+
+    }
+
+  }
+
+pairing_done:
+
+  new_hit_cnt = afl->queued_paths + afl->unique_crashes;
+
+  afl->stage_finds[STAGE_SECRET_PAIRING] += new_hit_cnt - orig_hit_cnt;
+  afl->stage_cycles[STAGE_SECRET_PAIRING] += afl->stage_max;
+
+  return 0;
+
+}
+
@@ -0,0 +1,345 @@
+/*
+   american fuzzy lop++ - secret format constraints
+   ------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Many targets reject a secret that is not a well-formed key before they
+   do anything with it, so havoc on the secret mostly tests the same early
+   exit. AFL_LEAK_SECRET_SPEC describes what a valid secret looks like, and
+   every secret the havoc stage or a leakage-aware custom mutator comes up
+   with is made to fit it before it runs:
+
+     len=16,32          allowed lengths, N or N-M, comma separated
+     bytes=0x30-0x39    allowed values of every byte, V or V-W
+     bytes@-1=0-127     allowed values at one offset, from the end if < 0
+     fixup=lib.so       afl_leak_secret_fixup(u8 *buf, size_t len) of this
+                        library gets the last word, e.g. for a checksum
+
+   Clauses are separated by blanks, newlines or ';', '#' starts a comment.
+   The variable holds either the spec or the name of a file with it.
+
+   A secret of the wrong length is cut or padded with random allowed bytes
+   to the nearest allowed length, and bytes out of range are mapped onto
+   allowed values, so that different mutations mostly stay different.
+
+ */
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+
+#include <dlfcn.h>
+
+struct leak_secret_spec {
+
+  u32 len_cnt;                          /* Allowed length ranges            */
+  u32 len_min[LEAK_SPEC_MAX_RANGES], len_max[LEAK_SPEC_MAX_RANGES];
+
+  u8  has_bytes;                        /* bytes= was given                 */
+  u8  byte_map[256];                    /* Value -> allowed value           */
+
+  u32 at_cnt;                           /* bytes@ clauses                   */
+  s32 at_off[LEAK_SPEC_MAX_AT];
+  u8  at_map[LEAK_SPEC_MAX_AT][256];
+
+  void *fixup_dh;
+  void (*fixup)(u8 *buf, size_t len);
+
+  u8 *buf;                              /* The secret, made to fit          */
+
+};
+
+/* Parse "R[,R...]" with R = N or N-M into min/max. Returns the count. */
+
+static u32 parse_ranges(u8 *val, u32 *min, u32 *max, u32 limit, u8 *clause) {
+
+  u32 cnt = 0;
+
+  while (*val) {
+
+    char *end;
+
+    if (cnt == limit) { FATAL("Too many ranges in '%s'", clause); }
+
+    min[cnt] = max[cnt] = strtoul((char *)val, &end, 0);
+    if ((u8 *)end == val) { FATAL("Bad range in '%s'", clause); }
+    val = (u8 *)end;
+
+    if (*val == '-') {
+
+      max[cnt] = strtoul((char *)++val, &end, 0);
+      if ((u8 *)end == val || max[cnt] < min[cnt]) {
+
+        FATAL("Bad range in '%s'", clause);
+
+      }
+
+      val = (u8 *)end;
+
+    }
+
+    ++cnt;
+
+    if (*val == ',') {
+
+      ++val;
+
+    } else if (*val) {
+
+      FATAL("Bad range in '%s'", clause);
+
+    }
+
+  }
+
+  if (!cnt) { FATAL("Empty range in '%s'", clause); }
+  return cnt;
+
+}
+
+/* Turn the byte ranges of a clause into a map from any value to an allowed
+   one. */
+
+static void parse_byte_map(u8 *val, u8 *map, u8 *clause) {
+
+  u32 min[LEAK_SPEC_MAX_RANGES], max[LEAK_SPEC_MAX_RANGES];
+  u32 cnt = parse_ranges(val, min, max, LEAK_SPEC_MAX_RANGES, clause);
+  u8  allowed[256] = {0}, vals[256];
+  u32 i, j, n = 0;
+
+  for (i = 0; i < cnt; ++i) {
+
+    if (max[i] > 255) { FATAL("Byte value out of range in '%s'", clause); }
+    for (j = min[i]; j <= max[i]; ++j) {
+
+      allowed[j] = 1;
+
+    }
+
+  }
+
+  for (i = 0; i < 256; ++i) {
+
+    if (allowed[i]) { vals[n++] = i; }
+
+  }
+
+  for (i = 0; i < 256; ++i) {
+
+    map[i] = allowed[i] ? i : vals[i % n];
+
+  }
+
+}
+
+static void parse_clause(struct leak_secret_spec *spec, u8 *clause) {
+
+  u8 *val = (u8 *)strchr((char *)clause, '=');
+
+  if (!val) { FATAL("Bad AFL_LEAK_SECRET_SPEC clause '%s'", clause); }
+  *val++ = 0;
+
+  if (!strcmp((char *)clause, "len")) {
+
+    spec->len_cnt = parse_ranges(val, spec->len_min, spec->len_max,
+                                 LEAK_SPEC_MAX_RANGES, clause);
+
+    for (u32 i = 0; i < spec->len_cnt; ++i) {
+
+      if (!spec->len_max[i] || spec->len_min[i] > MAX_FILE) {
+
+        FATAL("Secret length out of range in '%s'", clause);
+
+      }
+
+      if (!spec->len_min[i]) { spec->len_min[i] = 1; }
+      if (spec->len_max[i] > MAX_FILE) { spec->len_max[i] = MAX_FILE; }
+
+    }
+
+  } else if (!strcmp((char *)clause, "bytes")) {
+
+    parse_byte_map(val, spec->byte_map, clause);
+    spec->has_bytes = 1;
+
+  } else if (!strncmp((char *)clause, "bytes@", 6)) {
+
+    char *end;
+
+    if (spec->at_cnt == LEAK_SPEC_MAX_AT) {
+
+      FATAL("Too many bytes@ clauses in AFL_LEAK_SECRET_SPEC");
+
+    }
+
+    spec->at_off[spec->at_cnt] = strtol((char *)clause + 6, &end, 0);
+    if ((u8 *)end == clause + 6 || *end) {
+
+      FATAL("Bad offset in '%s'", clause);
+
+    }
+
+    parse_byte_map(val, spec->at_map[spec->at_cnt], clause);
+    ++spec->at_cnt;
+
+  } else if (!strcmp((char *)clause, "fixup")) {
+
+    spec->fixup_dh = dlopen((char *)val, RTLD_NOW);
+    if (!spec->fixup_dh) { FATAL("%s", dlerror()); }
+
+    spec->fixup = dlsym(spec->fixup_dh, "afl_leak_secret_fixup");
+    if (!spec->fixup) { FATAL("Symbol 'afl_leak_secret_fixup' not found."); }
+
+  } else {
+
+    FATAL("Unknown AFL_LEAK_SECRET_SPEC clause '%s'", clause);
+
+  }
+
+}
+
+/* Read the spec from AFL_LEAK_SECRET_SPEC, or from the file it names. */
+
+void load_secret_spec(afl_state_t *afl, u8 *spec_str) {
+
+  struct leak_secret_spec *spec = ck_alloc(sizeof(struct leak_secret_spec));
+  u8 *                     text, *pos;
+  struct stat              st;
+
+  if (!stat((char *)spec_str, &st) && S_ISREG(st.st_mode)) {
+
+    s32 fd = open((char *)spec_str, O_RDONLY);
+    if (fd < 0) { PFATAL("Unable to open '%s'", spec_str); }
+
+    text = ck_alloc(st.st_size + 1);
+    ck_read(fd, text, st.st_size, spec_str);
+    close(fd);
+
+  } else {
+
+    text = ck_strdup(spec_str);
+
+  }
+
+  pos = text;
+
+  while (*pos) {
+
+    pos += strspn((char *)pos, " \t\r\n;");
+
+    if (*pos == '#') {
+
+      pos += strcspn((char *)pos, "\n");
+      continue;
+
+    }
+
+    u32 len = strcspn((char *)pos, " \t\r\n;#");
+    if (!len) { continue; }
+
+    u8 *clause = ck_alloc(len + 1);
+    memcpy(clause, pos, len);
+    parse_clause(spec, clause);
+    ck_free(clause);
+
+    pos += len;
+
+  }
+
+  ck_free(text);
+
+  spec->buf = ck_alloc(MAX_FILE);
+  afl->secret_spec = spec;
+
+  OKF("Secrets are kept to %u length range(s), %s byte map, %u offset "
+      "rule(s)%s.",
+      spec->len_cnt, spec->has_bytes ? "a" : "no", spec->at_cnt,
+      spec->fixup ? " and a fixup hook" : "");
+
+}
+
+void destroy_secret_spec(afl_state_t *afl) {
+
+  struct leak_secret_spec *spec = afl->secret_spec;
+
+  if (!spec) { return; }
+  if (spec->fixup_dh) { dlclose(spec->fixup_dh); }
+  ck_free(spec->buf);
+  ck_free(spec);
+  afl->secret_spec = NULL;
+
+}
+
+/* Make the secret in buf fit the spec. Returns buf if it did already,
+   otherwise a buffer of the spec with the fitted secret, which stays valid
+   until the next call. *len is updated. */
+
+u8 *apply_secret_spec(afl_state_t *afl, u8 *buf, u32 *len) {
+
+  struct leak_secret_spec *spec = afl->secret_spec;
+  u32                      i, new_len = *len, best = 0xffffffff;
+
+  /* The nearest allowed length, the first range listed wins a tie. */
+
+  for (i = 0; i < spec->len_cnt && best; ++i) {
+
+    u32 fit = *len < spec->len_min[i]   ? spec->len_min[i]
+              : *len > spec->len_max[i] ? spec->len_max[i]
+                                        : *len;
+    u32 dist = fit > *len ? fit - *len : *len - fit;
+
+    if (dist < best) {
+
+      best = dist;
+      new_len = fit;
+
+    }
+
+  }
+
+  if (new_len > MAX_FILE) { new_len = MAX_FILE; }
+
+  memcpy(spec->buf, buf, MIN(*len, new_len));
+
+  for (i = *len; i < new_len; ++i) {
+
+    spec->buf[i] = rand_below(afl, 256);
+
+  }
+
+  if (spec->has_bytes) {
+
+    for (i = 0; i < new_len; ++i) {
+
+      spec->buf[i] = spec->byte_map[spec->buf[i]];
+
+    }
+
+  }
+
+  for (i = 0; i < spec->at_cnt; ++i) {
+
+    s32 off = spec->at_off[i] < 0 ? (s32)new_len + spec->at_off[i]
+                                  : spec->at_off[i];
+
+    if (off >= 0 && (u32)off < new_len) {
+
+      spec->buf[off] = spec->at_map[i][spec->buf[off]];
+
+    }
+
+  }
+
+  if (spec->fixup) { spec->fixup(spec->buf, new_len); }
+
+  if (new_len == *len && !memcmp(spec->buf, buf, new_len)) { return buf; }
+
+  ++afl->leak_secret_fitted;
+  *len = new_len;
+  return spec->buf;
+
+}
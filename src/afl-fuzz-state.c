@@ -25,6 +25,7 @@
 
 #include "afl-fuzz.h"
 #include "envs.h"
+#include "leakage_utils.h"
 
 s8  interesting_8[] = {INTERESTING_8};
 s16 interesting_16[] = {INTERESTING_8, INTERESTING_16};
@@ -473,6 +474,62 @@ void read_afl_environment(afl_state_t *afl, char **envp) {
             afl->afl_env.afl_target_env =
                 (u8 *)get_afl_env(afl_environment_variables[i]);
 
+          } else if (!strncmp(env, "AFL_LEAK_SECRETS_DIR",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_secrets_dir =
+                (u8 *)get_afl_env(afl_environment_variables[i]);
+
+          } else if (!strncmp(env, "AFL_LEAK_BUCKET_EXEMPLARS",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_bucket_exemplars =
+                (u8 *)get_afl_env(afl_environment_variables[i]);
+
+          } else if (!strncmp(env, "AFL_LEAK_BATCH",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_batch =
+                get_afl_env(afl_environment_variables[i]) ? 1 : 0;
+
+          } else if (!strncmp(env, "AFL_LEAK_SECRET_SPEC",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_secret_spec =
+                (u8 *)get_afl_env(afl_environment_variables[i]);
+
+          } else if (!strncmp(env, "AFL_LEAK_DUAL_FSRV",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_dual_fsrv =
+                get_afl_env(afl_environment_variables[i]) ? 1 : 0;
+
+          } else if (!strncmp(env, "AFL_LEAK_SNAPSHOT",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_snapshot =
+                get_afl_env(afl_environment_variables[i]) ? 1 : 0;
+
+          } else if (!strncmp(env, "AFL_LEAK_EXEC_CACHE",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_exec_cache =
+                (u8 *)get_afl_env(afl_environment_variables[i]);
+
+          } else if (!strncmp(env, "AFL_LEAK_OBS_MAP",
+
+                              afl_environment_variable_len)) {
+
+            afl->afl_env.afl_leak_obs_map =
+                get_afl_env(afl_environment_variables[i]) ? 1 : 0;
+
           }
 
         } else {
@@ -565,6 +622,23 @@ void afl_state_deinit(afl_state_t *afl) {
   ck_free(afl->first_trace);
   ck_free(afl->map_tmp_buf);
 
+  for (u32 i = 0; i < afl->secret_pool_cnt; ++i) {
+
+    ck_free(afl->secret_pool[i].buf);
+
+  }
+
+  afl_free(afl->secret_pool);
+  if (afl->secret_pool_map) { hashmap_free(afl->secret_pool_map); }
+
+  leak_buckets_deinit(afl);
+  destroy_secret_spec(afl);
+  leak_iomap_free(afl->public_input_to_output_map);
+  ck_free(afl->leak_exec_cache);
+  ck_free(afl->virgin_taint);
+  ck_free(afl->leak_obs_seen);
+  ck_free(afl->leak_obs_path_cnt);
+
   list_remove(&afl_states, afl);
 
 }
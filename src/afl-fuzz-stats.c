@@ -25,6 +25,7 @@
 
 #include "afl-fuzz.h"
 #include "envs.h"
+#include "leakage_utils.h"
 #include <limits.h>
 
 /* Write fuzzer setup file */
@@ -171,6 +172,11 @@ void load_stats_file(afl_state_t *afl) {
             afl->unique_hangs = strtoull(lptr, &nptr, 10);
           break;
         default:
+          /* Leakage hunting stats have no fixed line */
+          if (!strcmp(keystring, "leaks_confirmed   "))
+            afl->confirmed_leaks_count = strtoull(lptr, &nptr, 10);
+          if (!strcmp(keystring, "secrets_grown     "))
+            afl->secret_pool_grown = strtoul(lptr, &nptr, 10);
           break;
 
       }
@@ -321,6 +327,93 @@ void write_stats_file(afl_state_t *afl, u32 t_bytes, double bitmap_cvg,
               : "default",
           afl->orig_cmdline);
 
+  if (afl->fsrv.leakage_hunting) {
+
+    fprintf(f,
+            "leaks_candidates  : %u\n"
+            "leaks_confirmed   : %llu\n"
+            "leaks_logged      : %u\n"
+            "leaks_imported    : %llu\n"
+            "leaks_unstable    : %llu\n"
+            "leak_buckets      : %u\n"
+            "last_leak         : %llu\n"
+            "io_map_entries    : %u\n"
+            "io_map_bytes      : %llu\n"
+            "leak_exec_public  : %llu\n"
+            "leak_exec_secret  : %llu\n"
+            "leak_exec_full    : %llu\n"
+            "leak_exec_pairing : %llu\n"
+            "leak_exec_recheck : %llu\n"
+            "leak_exec_bucket  : %llu\n"
+            "exec_cache_hits   : %llu\n"
+            "exec_cache_lookups: %llu\n"
+            "leak_exec_snapshot: %llu\n"
+            "leak_batch_execs  : %llu\n"
+            "leak_batch_secrets: %llu\n"
+            "leak_batch_reruns : %llu\n"
+            "leak_dual_pairs   : %llu\n"
+            "leak_secret_fitted: %llu\n"
+            "leak_taint_edges  : %u\n"
+            "queued_with_taint : %u\n"
+            "leak_obs_classes  : %u\n"
+            "queued_with_obs   : %u\n"
+            "secrets_pooled    : %u\n"
+            "secrets_grown     : %u\n",
+            afl->detected_leaks_count, afl->confirmed_leaks_count,
+            afl->stored_hypertest_leaks_count, afl->leaks_imported,
+            afl->leak_unstable_rejects,
+            afl->leak_buckets_cnt, afl->last_leak_time / 1000,
+            leak_io_map_count(afl), leak_io_map_mem(afl),
+            afl->leak_phase_execs[LEAK_PHASE_PUBLIC],
+            afl->leak_phase_execs[LEAK_PHASE_SECRET],
+            afl->leak_phase_execs[LEAK_PHASE_FULL],
+            afl->leak_phase_execs[LEAK_PHASE_PAIRING],
+            afl->leak_phase_execs[LEAK_PHASE_STABILITY],
+            afl->leak_phase_execs[LEAK_PHASE_BUCKET],
+            afl->leak_exec_cache_hits, afl->leak_exec_cache_lookups,
+            afl->fsrv.leak_snap_execs, afl->leak_batch_execs,
+            afl->leak_batch_secrets, afl->leak_batch_reruns,
+            afl->leak_dual_pairs, afl->leak_secret_fitted,
+            afl->leak_taint_edges, afl->queued_with_taint,
+            afl->leak_obs_classes, afl->queued_with_obs,
+            afl->secret_pool_cnt, afl->secret_pool_grown);
+
+    if (afl->limit_time_sig) {
+
+      static const char *phase_names[LEAK_PHASE_FULL + 1] = {"public", "secret",
+                                                             "full"};
+
+      char name[32];
+      u32  p, op;
+
+      for (p = 0; p <= LEAK_PHASE_FULL; ++p) {
+
+        snprintf(name, sizeof(name), "mopt_%s_cycles", phase_names[p]);
+        fprintf(f, "%-18s:", name);
+        for (op = 0; op < operator_num; ++op) {
+
+          fprintf(f, " %llu", afl->leak_mopt_cycles[p][op]);
+
+        }
+
+        snprintf(name, sizeof(name), "mopt_%s_finds", phase_names[p]);
+        fprintf(f, "\n%-18s:", name);
+        for (op = 0; op < operator_num; ++op) {
+
+          fprintf(f, " %llu", afl->leak_mopt_finds[p][op]);
+
+        }
+
+        fprintf(f, "\n");
+
+      }
+
+    }
+
+    write_leak_buckets(afl);
+
+  }
+
   /* ignore errors */
 
   if (afl->debug) {
@@ -390,17 +483,31 @@ void maybe_update_plot_file(afl_state_t *afl, u32 t_bytes, double bitmap_cvg,
 
      relative_time, afl->cycles_done, cur_path, paths_total, paths_not_fuzzed,
      favored_not_fuzzed, unique_crashes, unique_hangs, max_depth,
-     execs_per_sec, edges_found */
+     execs_per_sec, edges_found
+
+     and when hunting for leaks:
+
+     leaks_candidates, leaks_confirmed, leak_buckets, io_map_entries */
 
   fprintf(afl->fsrv.plot_file,
           "%llu, %llu, %u, %u, %u, %u, %0.02f%%, %llu, %llu, %u, %0.02f, %llu, "
-          "%u\n",
+          "%u",
           ((afl->prev_run_time + get_cur_time() - afl->start_time) / 1000),
           afl->queue_cycle - 1, afl->current_entry, afl->queued_paths,
           afl->pending_not_fuzzed, afl->pending_favored, bitmap_cvg,
           afl->unique_crashes, afl->unique_hangs, afl->max_depth, eps,
           afl->plot_prev_ed, t_bytes);                     /* ignore errors */
 
+  if (afl->fsrv.leakage_hunting) {
+
+    fprintf(afl->fsrv.plot_file, ", %u, %llu, %u, %u",
+            afl->detected_leaks_count, afl->confirmed_leaks_count,
+            afl->leak_buckets_cnt, leak_io_map_count(afl));
+
+  }
+
+  fputc('\n', afl->fsrv.plot_file);
+
   fflush(afl->fsrv.plot_file);
 
 }
@@ -533,6 +640,10 @@ void show_stats(afl_state_t *afl) {
 
   }
 
+  /* Leak records are buffered, get them to disk soon after they are found. */
+
+  leak_log_flush(afl);
+
   /* Roughly every minute, update fuzzer stats and save auto tokens. */
 
   if (unlikely(afl->force_ui_update ||
@@ -877,77 +988,124 @@ void show_stats(afl_state_t *afl) {
   SAYF(bVR bH cCYA bSTOP " fuzzing strategy yields " bSTG bH10 bH2 bHT bH10 bH2
            bH bHB bH bSTOP cCYA " path geometry " bSTG bH5 bH2 bVL "\n");
 
-  if (unlikely(afl->custom_only)) {
+  if (afl->fsrv.leakage_hunting) {
+
+    /* The deterministic stages are not used when hunting for leaks, so
+       their rows show leakage statistics instead. */
+
+    sprintf(tmp, "%s confirmed, %s buckets",
+            u_stringify_int(IB(0), afl->confirmed_leaks_count),
+            u_stringify_int(IB(1), afl->leak_buckets_cnt));
 
-    strcpy(tmp, "disabled (custom-mutator-only mode)");
+    SAYF(bV bSTOP "       leaks : %s%-36s " bSTG bV bSTOP
+                  "    levels : " cRST "%-10s" bSTG       bV "\n",
+         afl->confirmed_leaks_count ? cLRD : cRST, tmp,
+         u_stringify_int(IB(0), afl->max_depth));
 
-  } else if (likely(afl->skip_deterministic)) {
+    sprintf(tmp, "%s, %s unstable",
+            u_stringify_int(IB(0), afl->detected_leaks_count),
+            u_stringify_int(IB(1), afl->leak_unstable_rejects));
+
+    SAYF(bV bSTOP "  candidates : " cRST "%-36s " bSTG bV bSTOP
+                  "   pending : " cRST "%-10s" bSTG       bV "\n",
+         tmp, u_stringify_int(IB(0), afl->pending_not_fuzzed));
+
+    sprintf(tmp, "%s entries, %s",
+            u_stringify_int(IB(0), leak_io_map_count(afl)),
+            u_stringify_mem_size(IB(1), leak_io_map_mem(afl)));
+
+    if (afl->leak_exec_cache_lookups) {
+
+      sprintf(tmp + strlen(tmp), ", %0.01f%% cached",
+              ((double)afl->leak_exec_cache_hits * 100) /
+                  afl->leak_exec_cache_lookups);
+
+    }
 
-    strcpy(tmp, "disabled (default, enable with -D)");
+    SAYF(bV bSTOP "      io map : " cRST "%-36s " bSTG bV bSTOP
+                  "  pend fav : " cRST "%-10s" bSTG       bV "\n",
+         tmp, u_stringify_int(IB(0), afl->pending_favored));
+
+    u_stringify_time_diff(time_tmp, cur_ms, afl->last_leak_time);
+    SAYF(bV bSTOP "   last leak : " cRST "%-36s " bSTG bV bSTOP
+                  " own finds : " cRST "%-10s" bSTG       bV "\n",
+         time_tmp, u_stringify_int(IB(0), afl->queued_discovered));
 
   } else {
 
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            u_stringify_int(IB(0), afl->stage_finds[STAGE_FLIP1]),
-            u_stringify_int(IB(1), afl->stage_cycles[STAGE_FLIP1]),
-            u_stringify_int(IB(2), afl->stage_finds[STAGE_FLIP2]),
-            u_stringify_int(IB(3), afl->stage_cycles[STAGE_FLIP2]),
-            u_stringify_int(IB(4), afl->stage_finds[STAGE_FLIP4]),
-            u_stringify_int(IB(5), afl->stage_cycles[STAGE_FLIP4]));
+    if (unlikely(afl->custom_only)) {
 
-  }
+      strcpy(tmp, "disabled (custom-mutator-only mode)");
 
-  SAYF(bV bSTOP "   bit flips : " cRST "%-36s " bSTG bV bSTOP
-                "    levels : " cRST "%-10s" bSTG       bV "\n",
-       tmp, u_stringify_int(IB(0), afl->max_depth));
+    } else if (likely(afl->skip_deterministic)) {
 
-  if (unlikely(!afl->skip_deterministic)) {
+      strcpy(tmp, "disabled (default, enable with -D)");
 
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            u_stringify_int(IB(0), afl->stage_finds[STAGE_FLIP8]),
-            u_stringify_int(IB(1), afl->stage_cycles[STAGE_FLIP8]),
-            u_stringify_int(IB(2), afl->stage_finds[STAGE_FLIP16]),
-            u_stringify_int(IB(3), afl->stage_cycles[STAGE_FLIP16]),
-            u_stringify_int(IB(4), afl->stage_finds[STAGE_FLIP32]),
-            u_stringify_int(IB(5), afl->stage_cycles[STAGE_FLIP32]));
+    } else {
 
-  }
+      sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+              u_stringify_int(IB(0), afl->stage_finds[STAGE_FLIP1]),
+              u_stringify_int(IB(1), afl->stage_cycles[STAGE_FLIP1]),
+              u_stringify_int(IB(2), afl->stage_finds[STAGE_FLIP2]),
+              u_stringify_int(IB(3), afl->stage_cycles[STAGE_FLIP2]),
+              u_stringify_int(IB(4), afl->stage_finds[STAGE_FLIP4]),
+              u_stringify_int(IB(5), afl->stage_cycles[STAGE_FLIP4]));
 
-  SAYF(bV bSTOP "  byte flips : " cRST "%-36s " bSTG bV bSTOP
-                "   pending : " cRST "%-10s" bSTG       bV "\n",
-       tmp, u_stringify_int(IB(0), afl->pending_not_fuzzed));
+    }
 
-  if (unlikely(!afl->skip_deterministic)) {
+    SAYF(bV bSTOP "   bit flips : " cRST "%-36s " bSTG bV bSTOP
+                  "    levels : " cRST "%-10s" bSTG       bV "\n",
+         tmp, u_stringify_int(IB(0), afl->max_depth));
 
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            u_stringify_int(IB(0), afl->stage_finds[STAGE_ARITH8]),
-            u_stringify_int(IB(1), afl->stage_cycles[STAGE_ARITH8]),
-            u_stringify_int(IB(2), afl->stage_finds[STAGE_ARITH16]),
-            u_stringify_int(IB(3), afl->stage_cycles[STAGE_ARITH16]),
-            u_stringify_int(IB(4), afl->stage_finds[STAGE_ARITH32]),
-            u_stringify_int(IB(5), afl->stage_cycles[STAGE_ARITH32]));
+    if (unlikely(!afl->skip_deterministic)) {
 
-  }
+      sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+              u_stringify_int(IB(0), afl->stage_finds[STAGE_FLIP8]),
+              u_stringify_int(IB(1), afl->stage_cycles[STAGE_FLIP8]),
+              u_stringify_int(IB(2), afl->stage_finds[STAGE_FLIP16]),
+              u_stringify_int(IB(3), afl->stage_cycles[STAGE_FLIP16]),
+              u_stringify_int(IB(4), afl->stage_finds[STAGE_FLIP32]),
+              u_stringify_int(IB(5), afl->stage_cycles[STAGE_FLIP32]));
+
+    }
 
-  SAYF(bV bSTOP " arithmetics : " cRST "%-36s " bSTG bV bSTOP
-                "  pend fav : " cRST "%-10s" bSTG       bV "\n",
-       tmp, u_stringify_int(IB(0), afl->pending_favored));
+    SAYF(bV bSTOP "  byte flips : " cRST "%-36s " bSTG bV bSTOP
+                  "   pending : " cRST "%-10s" bSTG       bV "\n",
+         tmp, u_stringify_int(IB(0), afl->pending_not_fuzzed));
 
-  if (unlikely(!afl->skip_deterministic)) {
+    if (unlikely(!afl->skip_deterministic)) {
 
-    sprintf(tmp, "%s/%s, %s/%s, %s/%s",
-            u_stringify_int(IB(0), afl->stage_finds[STAGE_INTEREST8]),
-            u_stringify_int(IB(1), afl->stage_cycles[STAGE_INTEREST8]),
-            u_stringify_int(IB(2), afl->stage_finds[STAGE_INTEREST16]),
-            u_stringify_int(IB(3), afl->stage_cycles[STAGE_INTEREST16]),
-            u_stringify_int(IB(4), afl->stage_finds[STAGE_INTEREST32]),
-            u_stringify_int(IB(5), afl->stage_cycles[STAGE_INTEREST32]));
+      sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+              u_stringify_int(IB(0), afl->stage_finds[STAGE_ARITH8]),
+              u_stringify_int(IB(1), afl->stage_cycles[STAGE_ARITH8]),
+              u_stringify_int(IB(2), afl->stage_finds[STAGE_ARITH16]),
+              u_stringify_int(IB(3), afl->stage_cycles[STAGE_ARITH16]),
+              u_stringify_int(IB(4), afl->stage_finds[STAGE_ARITH32]),
+              u_stringify_int(IB(5), afl->stage_cycles[STAGE_ARITH32]));
 
-  }
+    }
+
+    SAYF(bV bSTOP " arithmetics : " cRST "%-36s " bSTG bV bSTOP
+                  "  pend fav : " cRST "%-10s" bSTG       bV "\n",
+         tmp, u_stringify_int(IB(0), afl->pending_favored));
 
-  SAYF(bV bSTOP "  known ints : " cRST "%-36s " bSTG bV bSTOP
-                " own finds : " cRST "%-10s" bSTG       bV "\n",
-       tmp, u_stringify_int(IB(0), afl->queued_discovered));
+    if (unlikely(!afl->skip_deterministic)) {
+
+      sprintf(tmp, "%s/%s, %s/%s, %s/%s",
+              u_stringify_int(IB(0), afl->stage_finds[STAGE_INTEREST8]),
+              u_stringify_int(IB(1), afl->stage_cycles[STAGE_INTEREST8]),
+              u_stringify_int(IB(2), afl->stage_finds[STAGE_INTEREST16]),
+              u_stringify_int(IB(3), afl->stage_cycles[STAGE_INTEREST16]),
+              u_stringify_int(IB(4), afl->stage_finds[STAGE_INTEREST32]),
+              u_stringify_int(IB(5), afl->stage_cycles[STAGE_INTEREST32]));
+
+    }
+
+    SAYF(bV bSTOP "  known ints : " cRST "%-36s " bSTG bV bSTOP
+                  " own finds : " cRST "%-10s" bSTG       bV "\n",
+         tmp, u_stringify_int(IB(0), afl->queued_discovered));
+
+  }
 
   if (unlikely(!afl->skip_deterministic)) {
 
@@ -12,6 +12,7 @@
 #include <netdb.h>
 #include <unistd.h>
 #include "afl-fuzz.h"
+#include "leakage_utils.h"
 
 #define MAX_STATSD_PACKET_SIZE 4096
 #define MAX_TAG_LEN 200
@@ -84,6 +85,23 @@
   ".edges_found%s:%u|g\n" METRIC_PREFIX                                        \
   ".var_byte_count%s:%u|g\n" METRIC_PREFIX ".havoc_expansion%s:%u|g\n"
 
+// Appended when hunting for leaks
+#define STATSD_TAGS_SUFFIX_LEAK_METRICS                                        \
+  METRIC_PREFIX                                                                \
+  ".leaks_candidates:%u|g%s\n" METRIC_PREFIX                                   \
+  ".leaks_confirmed:%llu|g%s\n" METRIC_PREFIX                                  \
+  ".leaks_unstable:%llu|g%s\n" METRIC_PREFIX                                   \
+  ".leak_buckets:%u|g%s\n" METRIC_PREFIX                                       \
+  ".io_map_entries:%u|g%s\n" METRIC_PREFIX ".io_map_bytes:%llu|g%s\n"
+
+#define STATSD_TAGS_MID_LEAK_METRICS                                           \
+  METRIC_PREFIX                                                                \
+  ".leaks_candidates%s:%u|g\n" METRIC_PREFIX                                   \
+  ".leaks_confirmed%s:%llu|g\n" METRIC_PREFIX                                  \
+  ".leaks_unstable%s:%llu|g\n" METRIC_PREFIX                                   \
+  ".leak_buckets%s:%u|g\n" METRIC_PREFIX                                       \
+  ".io_map_entries%s:%u|g\n" METRIC_PREFIX ".io_map_bytes%s:%llu|g\n"
+
 void statsd_setup_format(afl_state_t *afl) {
 
   if (afl->afl_env.afl_statsd_tags_flavor &&
@@ -267,6 +285,28 @@ int statsd_format_metric(afl_state_t *afl, char *buff, size_t bufflen) {
 
   }
 
+  if (afl->fsrv.leakage_hunting) {
+
+    size_t len = strlen(buff);
+
+    if (afl->statsd_metric_format_type == STATSD_TAGS_TYPE_SUFFIX) {
+
+      snprintf(buff + len, bufflen - len, STATSD_TAGS_SUFFIX_LEAK_METRICS,
+               afl->detected_leaks_count, tags, afl->confirmed_leaks_count,
+               tags, afl->leak_unstable_rejects, tags, afl->leak_buckets_cnt,
+               tags, leak_io_map_count(afl), tags, leak_io_map_mem(afl), tags);
+
+    } else {
+
+      snprintf(buff + len, bufflen - len, STATSD_TAGS_MID_LEAK_METRICS, tags,
+               afl->detected_leaks_count, tags, afl->confirmed_leaks_count,
+               tags, afl->leak_unstable_rejects, tags, afl->leak_buckets_cnt,
+               tags, leak_io_map_count(afl), tags, leak_io_map_mem(afl));
+
+    }
+
+  }
+
   return 0;
 
 }
@@ -0,0 +1,157 @@
+/*
+   american fuzzy lop++ - leakage testcase codec
+   ---------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Leakage testcases are JSON objects holding the base64 encoded PUBLIC and
+   SECRET inputs. This file has no afl-fuzz state dependencies, so the
+   standalone tools link it as well.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "debug.h"
+#include "alloc-inl.h"
+#include "base64.h"
+#include "json.h"
+#include "leakage_testcase.h"
+
+#define PUBLIC_KEY "PUBLIC"
+#define SECRET_KEY "SECRET"
+
+/* Parses a testcase_buf to extract pointers and lengths for public and secret
+ * segments of the testcase input. public_input and secret_input are malloced.
+ * Prints nothing and aborts on nothing: returns NULL on success, or what is
+ * wrong with the testcase, and then leaves both inputs NULL and empty. */
+
+const char *parse_public_and_secret_inputs(const char *testcase_buf,
+                                           u32 testcase_len,
+                                           uint8_t **public_input,
+                                           uint32_t *public_len,
+                                           uint8_t **secret_input,
+                                           uint32_t *secret_len) {
+
+  char       *raw_public = NULL, *raw_secret = NULL;
+  const char *err = NULL;
+
+  *public_input = *secret_input = NULL;
+  *public_len = *secret_len = 0;
+
+  json_char  *json = (json_char *)testcase_buf;
+  json_value *value = json_parse(json, testcase_len);
+
+  if (!value) { return "Testcase is not valid JSON"; }
+
+  if (value->type != json_object) {
+
+    json_value_free(value);
+    return "Testcase is not a JSON object";
+
+  }
+
+  for (u32 i = 0; i < value->u.object.length; i++) {
+
+    char       *name = value->u.object.values[i].name;
+    json_value *field = value->u.object.values[i].value;
+
+    if (field->type != json_string) { continue; }
+
+    if (!strcmp(name, PUBLIC_KEY)) {
+
+      raw_public = field->u.string.ptr;
+
+    } else if (!strcmp(name, SECRET_KEY)) {
+
+      raw_secret = field->u.string.ptr;
+
+    }
+
+  }
+
+  if (!raw_public) {
+
+    err = "Failed to find PUBLIC in testcase";
+
+  } else if (!raw_secret) {
+
+    err = "Failed to find SECRET in testcase";
+
+  } else {
+
+    *public_input = malloc(Base64decode_len(raw_public));
+    *secret_input = malloc(Base64decode_len(raw_secret));
+
+    if (!*public_input || !*secret_input) {
+
+      free(*public_input);
+      free(*secret_input);
+      *public_input = *secret_input = NULL;
+      err = "Out of memory decoding testcase";
+
+    } else {
+
+      *public_len = Base64decode((char *)*public_input, raw_public);
+      *secret_len = Base64decode((char *)*secret_input, raw_secret);
+
+    }
+
+  }
+
+  json_value_free(value);
+  return err;
+
+}
+
+/* As parse_public_and_secret_inputs(), but a broken testcase is fatal. */
+
+void find_public_and_secret_inputs(const char *testcase_buf, u32 testcase_len,
+                                   uint8_t **public_input, uint32_t *public_len,
+                                   uint8_t **secret_input, uint32_t *secret_len) {
+
+  const char *err = parse_public_and_secret_inputs(
+      testcase_buf, testcase_len, public_input, public_len, secret_input,
+      secret_len);
+
+  if (err) { FATAL("%s: %.*s", err, testcase_len, testcase_buf); }
+
+}
+
+void create_buffer_from_public_and_secret_inputs(const uint8_t *public_input, u32 public_input_len,
+                                                 const uint8_t *secret_input, u32 secret_input_len,
+                                                 char **combined_buf, u32 *combined_buf_len) {
+
+  const char *json_out_template = "{\n  \"" PUBLIC_KEY "\": \"%s\",\n  \"" SECRET_KEY "\": \"%s\"\n}";
+
+  u32 expected_len = strlen(json_out_template) +
+                     Base64encode_len((int)public_input_len) +
+                     Base64encode_len((int)secret_input_len);
+
+  char *encoded_public = ck_alloc(expected_len);
+  Base64encode(encoded_public, public_input, (int)public_input_len);
+
+  char *encoded_secret = ck_alloc(expected_len);
+  Base64encode(encoded_secret, secret_input, (int)secret_input_len);
+
+  *combined_buf = ck_alloc(expected_len);
+  *combined_buf_len = snprintf(*combined_buf,
+                               expected_len,
+                               json_out_template,
+                               encoded_public,
+                               encoded_secret);
+
+  if (*combined_buf_len >= expected_len) {
+    FATAL("Would expect the output str to be shorter than %u characters, was %u chars\nRAW: %s", expected_len, *combined_buf_len, *combined_buf);
+  }
+
+  ck_free(encoded_public);
+  ck_free(encoded_secret);
+}
+
@@ -26,6 +26,7 @@
 #include "afl-fuzz.h"
 #include "cmplog.h"
 #include "leakage_utils.h"
+#include "leak_obs.h"
 #include <limits.h>
 #include <stdlib.h>
 #ifndef USEMMAP
@@ -219,6 +220,15 @@ static void usage(u8 *argv0, int more_help) {
       "AFL_IGNORE_UNKNOWN_ENVS: don't warn on unknown env vars\n"
       "AFL_IMPORT_FIRST: sync and import test cases from other fuzzer instances first\n"
       "AFL_KILL_SIGNAL: Signal ID delivered to child processes on timeout, etc. (default: SIGKILL)\n"
+      "AFL_LEAK_BATCH: pair public inputs with pooled secrets in one exec, for\n"
+      "                targets built with utils/leakage_driver\n"
+      "AFL_LEAK_BUCKET_EXEMPLARS: leaks logged per root cause bucket (default: "
+      STRINGIFY(LEAK_BUCKET_EXEMPLARS) ", 0 = all)\n"
+      "AFL_LEAK_EXEC_CACHE: recent exec results kept to skip repeated testcases\n"
+      "                     (default: " STRINGIFY(LEAK_EXEC_CACHE_SIZE) ", 0 = off)\n"
+      "AFL_LEAK_SECRETS_DIR: directory of secret inputs to seed the secret pool with\n"
+      "AFL_LEAK_SNAPSHOT: fork runs that only change the secret from the target's\n"
+      "                   __AFL_LEAK_SNAPSHOT() point\n"
       "AFL_MAP_SIZE: the shared memory size for that target. must be >= the size\n"
       "              the target was compiled for\n"
       "AFL_MAX_DET_EXTRAS: if more entries are in the dictionary list than this value\n"
@@ -418,8 +428,10 @@ int main(int argc, char **argv_orig, char **envp) {
   afl->debug = debug;
   afl_fsrv_init(&afl->fsrv);
   if (debug) { afl->fsrv.debug = true; }
+  afl->fsrv.leakage_hunting = true;
   read_afl_environment(afl, envp);
   if (afl->shm.map_size) { afl->fsrv.map_size = afl->shm.map_size; }
+  afl->fsrv.leak_snapshot = afl->afl_env.afl_leak_snapshot;
   exit_1 = !!afl->afl_env.afl_bench_just_one;
 
   SAYF(cCYA "afl-fuzz" VERSION cRST
@@ -1317,6 +1329,45 @@ int main(int argc, char **argv_orig, char **envp) {
 
   }
 
+  if (afl->afl_env.afl_leak_bucket_exemplars) {
+
+    s32 exemplars = atoi(afl->afl_env.afl_leak_bucket_exemplars);
+    if (exemplars < 0) { FATAL("Invalid value for AFL_LEAK_BUCKET_EXEMPLARS"); }
+    afl->leak_bucket_exemplars = (u32)exemplars;
+
+  } else {
+
+    afl->leak_bucket_exemplars = LEAK_BUCKET_EXEMPLARS;
+
+  }
+
+  if (afl->afl_env.afl_leak_exec_cache) {
+
+    s32 entries = atoi(afl->afl_env.afl_leak_exec_cache);
+    if (entries < 0) { FATAL("Invalid value for AFL_LEAK_EXEC_CACHE"); }
+    afl->leak_exec_cache_size = (u32)entries;
+
+  } else {
+
+    afl->leak_exec_cache_size = LEAK_EXEC_CACHE_SIZE;
+
+  }
+
+  if (afl->leak_exec_cache_size) {
+
+    afl->leak_exec_cache_size = next_pow2(afl->leak_exec_cache_size);
+    afl->leak_exec_cache = ck_alloc(afl->leak_exec_cache_size *
+                                    sizeof(struct leak_exec_result));
+
+  }
+
+  if (afl->afl_env.afl_leak_obs_map) {
+
+    afl->leak_obs_seen = ck_alloc(LEAK_OBS_MAP_SIZE / 8);
+    afl->leak_obs_path_cnt = ck_alloc(LEAK_OBS_PATHS);
+
+  }
+
   if (afl->afl_env.afl_testcache_size) {
 
     afl->q_testcase_max_cache_size =
@@ -1560,6 +1611,24 @@ int main(int argc, char **argv_orig, char **envp) {
   // read_foreign_testcases(afl, 1); for the moment dont do this
   OKF("Loaded a total of %u seeds.", afl->queued_paths);
 
+  if (afl->fsrv.leakage_hunting && afl->in_place_resume) {
+
+    resume_secret_pool(afl);
+
+  }
+
+  if (afl->fsrv.leakage_hunting && afl->afl_env.afl_leak_secrets_dir) {
+
+    load_secret_pool(afl, afl->afl_env.afl_leak_secrets_dir);
+
+  }
+
+  if (afl->fsrv.leakage_hunting && afl->afl_env.afl_leak_secret_spec) {
+
+    load_secret_spec(afl, afl->afl_env.afl_leak_secret_spec);
+
+  }
+
   pivot_inputs(afl);
 
   if (!afl->timeout_given) { find_timeout(afl); }  // only for resumes!
@@ -1671,6 +1740,7 @@ int main(int argc, char **argv_orig, char **envp) {
   #endif
 
   if (afl->shmem_testcase_mode) { setup_testcase_shmem(afl); }
+  if (afl->fsrv.leakage_hunting) { setup_leak_obs_shmem(afl); }
 
   afl->start_time = get_cur_time();
 
@@ -1710,14 +1780,9 @@ int main(int argc, char **argv_orig, char **envp) {
 
   }
 
-  afl->fsrv.leakage_hunting = true;
   if (afl->fsrv.leakage_hunting) {
     afl->disable_trim = true;
-    afl->public_input_to_output_map = hashmap_new_with_allocator(
-        ck_alloc, ck_realloc, ck_free,
-        sizeof(struct input_output_hashes), 0, 0, 0,
-        input_hash, input_compare, NULL,
-        NULL);
+    afl->public_input_to_output_map = leak_iomap_new();
   }
 
   afl->argv = use_argv;
@@ -1872,6 +1937,61 @@ int main(int argc, char **argv_orig, char **envp) {
 
   perform_dry_run(afl);
 
+  /* Batch harnesses say so in the observation shm on their first run. */
+
+  if (afl->afl_env.afl_leak_batch) {
+
+    if (afl->fsrv.leak_obs->batch_max >= SECRET_PAIRING_BATCH) {
+
+      afl->leak_batch = 1;
+      OKF("Target runs batches of up to %u secrets per exec.",
+          afl->fsrv.leak_obs->batch_max);
+
+    } else {
+
+      WARNF("AFL_LEAK_BATCH is set, but the target does not take batches.");
+
+    }
+
+  }
+
+  /* Targets built with AFL_USE_DFSAN say so when they label the secret.
+     The taint map was not cleared so far, it holds the dry run's edges. */
+
+  if (afl->fsrv.leak_obs->taint_active) {
+
+    afl->leak_taint = afl->fsrv.leak_taint = 1;
+    afl->virgin_taint = ck_alloc(LEAK_TAINT_MAP_SIZE);
+    memset(afl->virgin_taint, 255, LEAK_TAINT_MAP_SIZE);
+    leak_taint_new_bits(afl, &afl->fsrv, 1);
+    OKF("Target reports branches on the secret, %u tainted edges so far.",
+        afl->leak_taint_edges);
+
+  }
+
+  if (afl->fsrv.leak_obs_digested) {
+
+    OKF("Target publishes digests of its output, stdout is read for leaks "
+        "only.");
+
+  }
+
+  /* Started only now, so that it knows about the taint map as well. */
+
+  if (afl->afl_env.afl_leak_dual_fsrv) {
+
+    if (afl->leak_batch) {
+
+      WARNF("AFL_LEAK_DUAL_FSRV is of no use with AFL_LEAK_BATCH, ignoring it.");
+
+    } else {
+
+      setup_leak_fsrv(afl);
+
+    }
+
+  }
+
   if (afl->q_testcase_max_cache_entries) {
 
     afl->q_testcase_cache =
@@ -2289,6 +2409,7 @@ stop_fuzzing:
   if (frida_afl_preload) { ck_free(frida_afl_preload); }
 
   fclose(afl->fsrv.plot_file);
+  leak_log_close(afl);
   destroy_queue(afl);
   destroy_extras(afl);
   destroy_custom_mutators(afl);
@@ -2301,8 +2422,28 @@ stop_fuzzing:
 
   }
 
+  if (afl->shm_leak_obs) {
+
+    afl_shm_deinit(afl->shm_leak_obs);
+    ck_free(afl->shm_leak_obs);
+
+  }
+
   afl_fsrv_deinit(&afl->fsrv);
 
+  if (afl->leak_fsrv.out_file) {
+
+    afl_fsrv_deinit(&afl->leak_fsrv);
+    afl_shm_deinit(&afl->leak_shm);
+    if (afl->leak_shm_fuzz) { afl_shm_deinit(afl->leak_shm_fuzz); }
+    afl_shm_deinit(afl->leak_shm_obs);
+    ck_free(afl->leak_shm_fuzz);
+    ck_free(afl->leak_shm_obs);
+    (void)unlink(afl->leak_fsrv.out_file);
+    ck_free(afl->leak_fsrv.out_file);
+
+  }
+
   /* remove tmpfile */
   if (afl->tmp_dir != NULL && !afl->in_place_resume && afl->fsrv.out_file) {
 
@@ -0,0 +1,476 @@
+/*
+   american fuzzy lop++ - leakage pipeline benchmark
+   -------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Every exec in leakage hunting mode goes through the same steps: the
+   public and secret inputs are serialized into a testcase, the testcase is
+   written out, the fork server runs the target, its stdout is drained and
+   hashed, and the io map is probed with the hash of the public input. This
+   tool times each of these steps on its own, with the functions afl-fuzz
+   uses, and leakage_fuzz_stuff() end to end against a target that does
+   nothing but write a fixed amount of output. The fork server for it is
+   built in, no instrumented binary is needed.
+
+   Results go to stdout, and with -o to a CSV file (stage, ops, ns/op,
+   ops/s) that is easy to track across builds.
+
+ */
+
+#define AFL_MAIN
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+#include "leakage_testcase.h"
+#include "leak_obs.h"
+
+#include <sys/wait.h>
+
+static u32   noop_out_len;                   /* Bytes the target writes     */
+static char *self_path;
+static FILE *csv;
+
+static u64 now_ns(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+}
+
+static void report(const char *stage, u32 ops, u64 elapsed_ns) {
+
+  double ns_op = (double)elapsed_ns / ops;
+
+  SAYF("%-28s %9u ops %12.1f ns/op %12.0f ops/s\n", stage, ops, ns_op,
+       1e9 / ns_op);
+
+  if (csv) { fprintf(csv, "%s,%u,%.1f,%.0f\n", stage, ops, ns_op, 1e9 / ns_op); }
+
+}
+
+#define BENCH(_stage, _ops, _code)              \
+  do {                                          \
+                                                \
+    u64 _start = now_ns();                      \
+    for (u32 i = 0; i < (_ops); ++i) { _code; } \
+    report(_stage, (_ops), now_ns() - _start);  \
+                                                \
+  } while (0)
+
+/* The fork server protocol without any target behind it: each child writes
+   out_len bytes to stdout and exits. */
+
+static void noop_target(u32 out_len) {
+
+  static u8 out[65536];
+  u32       tmp = 0;
+  s32       status, pid;
+
+  memset(out, 'o', sizeof(out));
+
+  if (write(FORKSRV_FD + 1, &tmp, 4) != 4) { _exit(1); }
+
+  while (1) {
+
+    if (read(FORKSRV_FD, &tmp, 4) != 4) { _exit(0); }
+
+    pid = fork();
+    if (pid < 0) { _exit(1); }
+
+    if (!pid) {
+
+      if (out_len && write(1, out, out_len) < 0) { _exit(1); }
+      _exit(0);
+
+    }
+
+    if (write(FORKSRV_FD + 1, &pid, 4) != 4) { _exit(1); }
+    if (waitpid(pid, &status, 0) < 0) { _exit(1); }
+    if (write(FORKSRV_FD + 1, &status, 4) != 4) { _exit(1); }
+
+  }
+
+}
+
+/* Runs in the fork server process instead of execv() of a target. It execs
+   this binary as the no-op target: a fork of the benchmark itself would
+   drag the io map and all into every fork(). */
+
+static void exec_noop_target(afl_forkserver_t *fsrv, char **argv) {
+
+  char len_str[16];
+
+  (void)fsrv;
+  (void)argv;
+
+  snprintf(len_str, sizeof(len_str), "%u", noop_out_len);
+  execl(self_path, "afl-leak-bench", "--noop-target", len_str, NULL);
+
+  WARNF("Execv failed in forkserver.");
+
+}
+
+/* (Re)start the fork server with the given output size. */
+
+static void start_noop_target(afl_state_t *afl, u32 out_len) {
+
+  static char *argv[] = {"afl-leak-bench", NULL};
+
+  if (afl->fsrv.fsrv_pid > 0) { afl_fsrv_kill(&afl->fsrv); }
+
+  noop_out_len = out_len;
+  afl->fsrv.init_child_func = exec_noop_target;
+  afl_fsrv_start(&afl->fsrv, argv, &afl->stop_soon, 0);
+
+}
+
+/* The generic hashmap the io map used to be, for comparison. */
+
+static uint64_t legacy_hash(const void *item, uint64_t seed0, uint64_t seed1) {
+
+  (void)seed0;
+  (void)seed1;
+  return ((const struct input_output_hashes *)item)->public_input_hash;
+
+}
+
+static int legacy_compare(const void *a, const void *b, void *udata) {
+
+  u64 x = ((const struct input_output_hashes *)a)->public_input_hash,
+      y = ((const struct input_output_hashes *)b)->public_input_hash;
+
+  (void)udata;
+  return (x > y) - (x < y);
+
+}
+
+/* A public input of its own for every i, as mutations would produce. */
+
+static void vary(u8 *buf, u32 len, u32 i) {
+
+  memcpy(buf, &i, MIN(len, sizeof(i)));
+
+}
+
+static void usage(u8 *argv0) {
+
+  SAYF(
+      "\n%s [ options ]\n\n"
+
+      "Benchmark settings:\n"
+      "  -n execs      - target runs per exec stage (default: 10000)\n"
+      "  -N ops        - iterations per in-process stage (default: 1000000)\n"
+      "  -p bytes      - public input length (default: 32)\n"
+      "  -s bytes      - secret input length (default: 16)\n"
+      "  -b bytes      - output written by the target per run (default: 64)\n"
+      "  -m entries    - public inputs in the io map (default: 100000)\n"
+      "  -o file       - also write the results to this CSV file\n\n"
+
+      "For additional tips, please consult %s/README.md.\n\n",
+      argv0, doc_path);
+
+  exit(1);
+
+}
+
+/* Main entry point */
+
+int main(int argc, char **argv) {
+
+  s32 opt;
+  u32 execs = 10000, ops = 1000000, pub_len = 32, sec_len = 16, out_len = 64,
+      map_entries = 100000, i;
+  u8 *csv_fn = NULL;
+
+  if (argc == 3 && !strcmp(argv[1], "--noop-target")) {
+
+    noop_target(strtoul(argv[2], NULL, 10));
+
+  }
+
+#ifdef __linux__
+  self_path = "/proc/self/exe";
+#else
+  self_path = argv[0];
+#endif
+
+  SAYF(cCYA "afl-leak-bench" VERSION cRST "\n");
+
+  while ((opt = getopt(argc, argv, "+n:N:p:s:b:m:o:h")) > 0) {
+
+    switch (opt) {
+
+      case 'n':
+        execs = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'N':
+        ops = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'p':
+        pub_len = strtoul(optarg, NULL, 10);
+        break;
+
+      case 's':
+        sec_len = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'b':
+        out_len = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'm':
+        map_entries = strtoul(optarg, NULL, 10);
+        break;
+
+      case 'o':
+        csv_fn = optarg;
+        break;
+
+      case 'h':
+      default:
+        usage(argv[0]);
+
+    }
+
+  }
+
+  if (optind != argc || !execs || !ops || !map_entries) { usage(argv[0]); }
+  if (!pub_len || pub_len > MAX_FILE / 4 || sec_len > MAX_FILE / 4) {
+
+    FATAL("Bad value for -p or -s");
+
+  }
+
+  /* The target writes in one go, it must fit into the pipe. */
+
+  if (out_len > 65536) { FATAL("Bad value for -b, at most 65536"); }
+
+  if (csv_fn) {
+
+    csv = fopen(csv_fn, "w");
+    if (!csv) { PFATAL("Unable to create '%s'", csv_fn); }
+    fprintf(csv, "stage,ops,ns_per_op,ops_per_sec\n");
+
+  }
+
+  SAYF("execs=%u, ops=%u, public=%u, secret=%u, output=%u, io_map=%u\n\n",
+       execs, ops, pub_len, sec_len, out_len, map_entries);
+
+  /* Just enough of afl-fuzz to run the pipeline. */
+
+  afl_state_t *afl = calloc(1, sizeof(afl_state_t));
+  if (!afl) { FATAL("Could not create afl state"); }
+
+  be_quiet = 1;
+  afl_state_init(afl, MAP_SIZE);
+  afl_fsrv_init(&afl->fsrv);
+  afl->fsrv.leakage_hunting = true;
+  afl->fsrv.map_size = MAP_SIZE;
+  afl->fsrv.trace_bits = ck_alloc(MAP_SIZE);
+  afl->fsrv.dev_null_fd = open("/dev/null", O_RDWR);
+  if (afl->fsrv.dev_null_fd < 0) { PFATAL("Unable to open /dev/null"); }
+
+  memset(afl->virgin_bits, 255, MAP_SIZE);
+  afl->n_fuzz = ck_alloc(N_FUZZ_SIZE * sizeof(u32));
+  afl->stats_update_freq = UINT32_MAX;
+  afl->stage_cur = 1;
+
+  FILE *tmp = tmpfile();
+  if (!tmp) { PFATAL("tmpfile() failed"); }
+  afl->fsrv.out_fd = dup(fileno(tmp));
+  fclose(tmp);
+
+  setup_leak_obs_shmem(afl);
+
+  afl->public_input_to_output_map = leak_iomap_new();
+
+  u8 *pub = ck_alloc(pub_len), *sec = ck_alloc(sec_len + 1);
+  for (i = 0; i < pub_len; ++i) { pub[i] = 'A' + i % 26; }
+  for (i = 0; i < sec_len; ++i) { sec[i] = 'a' + i % 26; }
+
+  char *buf;
+  u32   len;
+
+  /* Testcase side. */
+
+  BENCH("serialize", ops, {
+
+    create_buffer_from_public_and_secret_inputs(pub, pub_len, sec, sec_len,
+                                                &buf, &len);
+    ck_free(buf);
+
+  });
+
+  create_buffer_from_public_and_secret_inputs(pub, pub_len, sec, sec_len, &buf,
+                                              &len);
+
+  BENCH("write_testcase", ops, write_to_testcase(afl, buf, len));
+
+  /* Target side. */
+
+  start_noop_target(afl, 0);
+
+  BENCH("fork_roundtrip", execs,
+        fuzz_run_target(afl, &afl->fsrv, afl->fsrv.exec_tmout));
+
+  afl_fsrv_kill(&afl->fsrv);
+
+  /* Drain from a pipe of our own that holds one run's worth of output. */
+
+  s32 pipe_fd[2];
+  u8 *out = ck_alloc(out_len + 1);
+  u64 elapsed = 0;
+
+  if (pipe(pipe_fd)) { PFATAL("pipe() failed"); }
+  fcntl(pipe_fd[0], F_SETFL, fcntl(pipe_fd[0], F_GETFL) | O_NONBLOCK);
+  memset(out, 'o', out_len);
+  afl->fsrv.fsrv_stdout_fd = pipe_fd[0];
+
+  for (i = 0; i < ops; ++i) {
+
+    if (out_len && write(pipe_fd[1], out, out_len) != out_len) {
+
+      PFATAL("write() to pipe failed");
+
+    }
+
+    u64 start = now_ns();
+    afl_fsrv_read_stdout(&afl->fsrv);
+    elapsed += now_ns() - start;
+
+  }
+
+  report("stdout_drain", ops, elapsed);
+  close(pipe_fd[0]);
+  close(pipe_fd[1]);
+
+  volatile u64 sink;
+
+  BENCH("output_hash", ops, sink = leak_output_hash(&afl->fsrv));
+  BENCH("public_input_hash", ops, sink = hash64(pub, pub_len, HASH_CONST));
+
+  /* io map, filled with other public inputs first. The generic hashmap it
+     used to be goes first, for comparison, and is gone before the rest. */
+
+  struct input_output_hashes sought = {0};
+  u64 *keys = ck_alloc(map_entries * sizeof(u64));
+  u32  k = 0;
+
+  for (i = 0; i < map_entries; ++i) {
+
+    keys[i] = hash64((u8 *)&i, sizeof(i), HASH_CONST);
+
+  }
+
+#define NEXT_KEY keys[k = (k + 1 == map_entries ? 0 : k + 1)]
+
+  struct hashmap *legacy = hashmap_new_with_allocator(
+      ck_alloc, ck_realloc, ck_free, sizeof(struct input_output_hashes), 0, 0,
+      0, legacy_hash, legacy_compare, NULL, NULL);
+
+  BENCH("hashmap_insert", map_entries, {
+
+    sought.public_input_hash = keys[i];
+    hashmap_set(legacy, &sought);
+
+  });
+
+  BENCH("hashmap_probe_hit", ops, {
+
+    sought.public_input_hash = NEXT_KEY;
+    sink = !!hashmap_get(legacy, &sought);
+
+  });
+
+  BENCH("hashmap_probe_miss", ops, {
+
+    sought.public_input_hash = NEXT_KEY ^ 0x5555555555555555ULL;
+    sink = !!hashmap_get(legacy, &sought);
+
+  });
+
+  hashmap_free(legacy);
+
+  BENCH("io_map_insert", map_entries, {
+
+    sought.public_input_hash = keys[i];
+    leak_iomap_put(afl->public_input_to_output_map, &sought);
+
+  });
+
+  BENCH("io_map_probe_hit", ops,
+        sink = !!leak_iomap_get(afl->public_input_to_output_map, NEXT_KEY));
+
+  BENCH("io_map_probe_miss", ops,
+        sink = !!leak_iomap_get(afl->public_input_to_output_map,
+                                NEXT_KEY ^ 0x5555555555555555ULL));
+
+#undef NEXT_KEY
+
+  ck_free(keys);
+  (void)sink;
+
+  /* The bookkeeping after a run, with the output the target would have
+     written. A known public input with the same output is the common case;
+     a new public input adds an io map entry. */
+
+  afl->fsrv.stdout_raw_buffer_len = out_len;
+  memcpy(afl->fsrv.stdout_raw_buffer, out, out_len);
+
+  BENCH("save_if_interesting_known", ops,
+        leakage_save_if_interesting(afl, &afl->fsrv, buf, len, pub, pub_len,
+                                    sec, sec_len, FSRV_RUN_OK));
+
+  BENCH("save_if_interesting_new", ops, {
+
+    vary(pub, pub_len, i);
+    leakage_save_if_interesting(afl, &afl->fsrv, buf, len, pub, pub_len, sec,
+                                sec_len, FSRV_RUN_OK);
+
+  });
+
+  /* End to end. */
+
+  start_noop_target(afl, out_len);
+
+  memset(pub, 'P', pub_len);
+  BENCH("fuzz_stuff_known", execs,
+        leakage_fuzz_stuff(afl, pub, pub_len, sec, sec_len));
+
+  BENCH("fuzz_stuff_new", execs, {
+
+    vary(pub, pub_len, i + ops);
+    leakage_fuzz_stuff(afl, pub, pub_len, sec, sec_len);
+
+  });
+
+  SAYF("\nio map: %u entries\n", leak_io_map_count(afl));
+
+  if (csv) {
+
+    fclose(csv);
+    OKF("Results written to '%s'.", csv_fn);
+
+  }
+
+  afl_fsrv_deinit(&afl->fsrv);
+  afl_shm_deinit(afl->shm_leak_obs);
+  ck_free(afl->shm_leak_obs);
+  ck_free(buf);
+  ck_free(out);
+  ck_free(pub);
+  ck_free(sec);
+
+  return 0;
+
+}
+
@@ -0,0 +1,329 @@
+/*
+   american fuzzy lop++ - leak log exporter
+   ----------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   afl-fuzz appends confirmed leaks to an indexed log in <out_dir>/leaks
+   (see include/leak_log.h). This tool lists the log and materializes
+   individual leaks as reproducers: two testcases in the usual
+   {"PUBLIC": ..., "SECRET": ...} format that share the public input but
+   make the target produce different observations, plus a "full" report
+   with both testcases, the target outputs and their hashes.
+
+ */
+
+#define AFL_MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "types.h"
+#include "debug.h"
+#include "alloc-inl.h"
+#include "hash.h"
+#include "common.h"
+#include "leak_log.h"
+#include "leakage_testcase.h"
+
+static s32 index_fd = -1,               /* leaks/index                      */
+    blobs_fd = -1;                      /* leaks/blobs                      */
+
+static u8 *index_fn, *blobs_fn;
+
+/* Read the data a record refers to. The blob header is checked against
+   the reference, so a damaged log does not produce bogus reproducers. */
+
+static u8 *read_blob(struct leak_log_ref *ref) {
+
+  struct leak_log_blob hdr;
+  u8 *                 buf = ck_alloc(ref->len + 1);
+
+  if (pread(blobs_fd, &hdr, sizeof(hdr), ref->offset) != sizeof(hdr) ||
+      hdr.len != ref->len ||
+      pread(blobs_fd, buf, ref->len, ref->offset + sizeof(hdr)) !=
+          (ssize_t)ref->len) {
+
+    FATAL("Blob at offset %llu is truncated or damaged", ref->offset);
+
+  }
+
+  if (hash64(buf, ref->len, HASH_CONST) != hdr.hash) {
+
+    WARNF("Blob at offset %llu does not match its hash", ref->offset);
+
+  }
+
+  return buf;
+
+}
+
+/* Write one testcase in the JSON format afl-fuzz uses for the queue. */
+
+static void write_testcase(FILE *f, u8 *pub, u32 pub_len, u8 *sec,
+                           u32 sec_len) {
+
+  char *buf;
+  u32   len;
+
+  create_buffer_from_public_and_secret_inputs(pub, pub_len, sec, sec_len, &buf,
+                                              &len);
+  fwrite(buf, 1, len, f);
+  ck_free(buf);
+
+}
+
+static FILE *create_leak_file(u8 *out_dir, struct leak_log_record *rec, u8 *what) {
+
+  u8 *fn = alloc_printf("%s/leak_id:%04u,time:%llu,%s", out_dir, rec->id,
+                        rec->time_ms, what);
+
+  s32 fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, DEFAULT_PERMISSION);
+  if (fd < 0) { PFATAL("Unable to create '%s'", fn); }
+
+  FILE *f = fdopen(fd, "w");
+  if (!f) { PFATAL("fdopen() failed"); }
+
+  ck_free(fn);
+  return f;
+
+}
+
+/* Materialize one leak as input_1, input_2 and full in out_dir. */
+
+static void export_record(u8 *out_dir, struct leak_log_record *rec) {
+
+  u8 *pub = read_blob(&rec->public_input);
+
+  FILE *full = create_leak_file(out_dir, rec, "full");
+
+  for (u32 i = 0; i < 2; ++i) {
+
+    u8 *sec = read_blob(&rec->secret_input[i]);
+    u8 *out = read_blob(&rec->output[i]);
+
+    u8 *  what = alloc_printf("input_%u", i + 1);
+    FILE *f = create_leak_file(out_dir, rec, what);
+    write_testcase(f, pub, rec->public_input.len, sec,
+                   rec->secret_input[i].len);
+    fclose(f);
+    ck_free(what);
+
+    if (i) { fputs("\n\n", full); }
+    write_testcase(full, pub, rec->public_input.len, sec,
+                   rec->secret_input[i].len);
+    fputs("\n\n", full);
+    fwrite(out, 1, rec->output[i].len, full);
+    fprintf(full, "\n%llu", rec->output_hash[i]);
+
+    ck_free(sec);
+    ck_free(out);
+
+  }
+
+  fclose(full);
+  ck_free(pub);
+
+}
+
+static void list_record(struct leak_log_record *rec) {
+
+  SAYF("%6u %6u %10llu.%03llu %8u %8u %8u %016llx %016llx\n", rec->id,
+       rec->bucket, rec->time_ms / 1000, rec->time_ms % 1000,
+       rec->public_input.len,
+       rec->secret_input[0].len, rec->secret_input[1].len,
+       rec->output_hash[0], rec->output_hash[1]);
+
+}
+
+/* Open the log in dir, which is either a leaks/ directory or the output
+   directory of an afl-fuzz instance. Returns the number of complete
+   records; a record still being written by afl-fuzz is ignored. */
+
+static u32 open_log(u8 *dir) {
+
+  struct leak_log_header hdr;
+  struct stat            st;
+
+  index_fn = alloc_printf("%s/leaks/" LEAK_LOG_INDEX, dir);
+
+  if (access(index_fn, F_OK)) {
+
+    ck_free(index_fn);
+    index_fn = alloc_printf("%s/" LEAK_LOG_INDEX, dir);
+    blobs_fn = alloc_printf("%s/" LEAK_LOG_BLOBS, dir);
+
+  } else {
+
+    blobs_fn = alloc_printf("%s/leaks/" LEAK_LOG_BLOBS, dir);
+
+  }
+
+  index_fd = open(index_fn, O_RDONLY);
+  if (index_fd < 0) { PFATAL("Unable to open '%s'", index_fn); }
+
+  blobs_fd = open(blobs_fn, O_RDONLY);
+  if (blobs_fd < 0) { PFATAL("Unable to open '%s'", blobs_fn); }
+
+  ck_read(index_fd, &hdr, sizeof(hdr), index_fn);
+
+  if (hdr.magic != LEAK_LOG_MAGIC) {
+
+    FATAL("'%s' is not a leak log", index_fn);
+
+  }
+
+  if (hdr.version != LEAK_LOG_VERSION ||
+      hdr.record_size != sizeof(struct leak_log_record)) {
+
+    FATAL("'%s' was written by an incompatible version of afl-fuzz (%u)",
+          index_fn, hdr.version);
+
+  }
+
+  if (fstat(index_fd, &st)) { PFATAL("fstat() failed"); }
+
+  return (st.st_size - sizeof(hdr)) / sizeof(struct leak_log_record);
+
+}
+
+static void usage(u8 *argv0) {
+
+  SAYF(
+      "\n%s [ options ] -i leak_dir\n\n"
+
+      "Required parameters:\n"
+      "  -i dir        - afl-fuzz output directory, or its leaks/ "
+      "subdirectory\n\n"
+
+      "Export settings:\n"
+      "  -o dir        - write reproducers to this directory\n"
+      "  -n id[-id]    - only process this leak id or range of ids\n"
+      "  -l            - list the leaks instead of exporting them\n\n"
+
+      "For each leak, three files are written: input_1 and input_2 are\n"
+      "testcases with the same public and different secret inputs, full\n"
+      "holds both testcases together with the outputs they produced.\n\n"
+
+      "For additional tips, please consult %s/README.md.\n\n",
+      argv0, doc_path);
+
+  exit(1);
+
+}
+
+/* Main entry point */
+
+int main(int argc, char **argv) {
+
+  s32 opt;
+  u8 *in_dir = NULL, *out_dir = NULL, list = 0;
+  u32 first_id = 1, last_id = UINT32_MAX;
+
+  SAYF(cCYA "afl-leak-export" VERSION cRST "\n");
+
+  while ((opt = getopt(argc, argv, "+i:o:n:lh")) > 0) {
+
+    switch (opt) {
+
+      case 'i':
+        if (in_dir) { FATAL("Multiple -i options not supported"); }
+        in_dir = optarg;
+        break;
+
+      case 'o':
+        if (out_dir) { FATAL("Multiple -o options not supported"); }
+        out_dir = optarg;
+        break;
+
+      case 'n': {
+
+        char *dash;
+
+        first_id = strtoul(optarg, &dash, 10);
+        last_id = first_id;
+        if (*dash == '-') { last_id = strtoul(dash + 1, NULL, 10); }
+        if (!first_id || last_id < first_id) {
+
+          FATAL("Bad value for -n, expected id or first-last");
+
+        }
+
+        break;
+
+      }
+
+      case 'l':
+        list = 1;
+        break;
+
+      case 'h':
+      default:
+        usage(argv[0]);
+
+    }
+
+  }
+
+  if (optind != argc || !in_dir || (!out_dir && !list)) { usage(argv[0]); }
+
+  u32 cnt = open_log(in_dir);
+
+  if (out_dir && mkdir(out_dir, 0700) && errno != EEXIST) {
+
+    PFATAL("Unable to create '%s'", out_dir);
+
+  }
+
+  if (list) {
+
+    SAYF("%6s %6s %14s %8s %8s %8s %16s %16s\n", "id", "bucket", "time",
+         "public",
+         "secret1", "secret2", "output_hash1", "output_hash2");
+
+  }
+
+  struct leak_log_record rec;
+  u32                    exported = 0;
+
+  for (u32 i = 0; i < cnt; ++i) {
+
+    ck_read(index_fd, &rec, sizeof(rec), index_fn);
+    if (rec.id < first_id || rec.id > last_id) { continue; }
+
+    if (list) {
+
+      list_record(&rec);
+
+    } else {
+
+      export_record(out_dir, &rec);
+      ++exported;
+
+    }
+
+  }
+
+  if (!list) { OKF("Exported %u of %u leaks to '%s'.", exported, cnt, out_dir); }
+
+  close(index_fd);
+  close(blobs_fd);
+  ck_free(index_fn);
+  ck_free(blobs_fn);
+
+  return 0;
+
+}
+
@@ -27,6 +27,11 @@
    Exit code is 2 if the target program crashes; 1 if it times out or
    there is a problem executing it; or 0 if execution is successful.
 
+   With -L, the target's stdout is captured the same way afl-fuzz does when
+   hunting for leaks, and its hash is reported as the observation class of
+   the input next to the tuples. afl-cmin -L uses this to keep one input
+   per (tuple, observation class) pair instead of one per tuple.
+
  */
 
 #define AFL_MAIN
@@ -77,6 +82,10 @@ static u32 tcnt, highest;              /* tuple content information         */
 
 static u32 in_len;                     /* Input data length                 */
 
+static u64 obs_class;                  /* Observation class of the last run */
+static u64 *obs_classes;               /* Observation classes seen (-C -L)  */
+static u32 obs_classes_cnt;            /* Entries in obs_classes            */
+
 static u32 map_size = MAP_SIZE;
 
 static bool quiet_mode,                /* Hide non-essential messages?      */
@@ -91,7 +100,8 @@ static bool quiet_mode,                /* Hide non-essential messages?      */
     no_classify,                       /* do not classify counts            */
     debug,                             /* debug mode                        */
     print_filenames,                   /* print the current filename        */
-    wait_for_gdb;
+    wait_for_gdb,
+    leak_mode;                         /* Record observation classes (-L)   */
 
 static volatile u8 stop_soon,          /* Ctrl-C pressed?                   */
     child_crashed;                     /* Child crashed?                    */
@@ -187,6 +197,54 @@ static sharedmem_t *deinit_shmem(afl_forkserver_t *fsrv,
 
 }
 
+/* Set obs_class from what the target wrote to stdout. */
+
+static void set_obs_class(u8 *out, u32 len) {
+
+  obs_class = hash64(out, len, HASH_CONST);
+
+  if (!quiet_mode) { fwrite(out, 1, len, stdout); }
+
+  if (collect_coverage) {
+
+    if (!(obs_classes_cnt & 1023)) {
+
+      obs_classes =
+          ck_realloc(obs_classes, (obs_classes_cnt + 1024) * sizeof(u64));
+
+    }
+
+    obs_classes[obs_classes_cnt++] = obs_class;
+
+  }
+
+}
+
+static int compare_u64(const void *a, const void *b) {
+
+  u64 x = *(const u64 *)a, y = *(const u64 *)b;
+  return x < y ? -1 : x > y;
+
+}
+
+/* Number of distinct observation classes seen with -C. */
+
+static u32 count_obs_classes(void) {
+
+  u32 i, ret = 0;
+
+  qsort(obs_classes, obs_classes_cnt, sizeof(u64), compare_u64);
+
+  for (i = 0; i < obs_classes_cnt; i++) {
+
+    if (!i || obs_classes[i] != obs_classes[i - 1]) { ret++; }
+
+  }
+
+  return ret;
+
+}
+
 /* Get rid of temp files (atexit handler). */
 
 static void at_exit_handler(void) {
@@ -279,6 +337,23 @@ static u32 write_results_to_file(afl_forkserver_t *fsrv, u8 *outfile) {
     ck_write(fd, fsrv->trace_bits, map_size, outfile);
     close(fd);
 
+  } else if (cmin_mode && leak_mode) {
+
+    FILE *f = fdopen(fd, "w");
+
+    if (!f) { PFATAL("fdopen() failed"); }
+
+    for (i = 0; i < map_size; i++) {
+
+      if (!fsrv->trace_bits[i]) { continue; }
+      ret++;
+
+      fprintf(f, "%u%u:%016llx\n", fsrv->trace_bits[i], i, obs_class);
+
+    }
+
+    fclose(f);
+
   } else {
 
     FILE *f = fdopen(fd, "w");
@@ -305,6 +380,12 @@ static u32 write_results_to_file(afl_forkserver_t *fsrv, u8 *outfile) {
 
     }
 
+    if (leak_mode && !cmin_mode && !collect_coverage) {
+
+      fprintf(f, "observation:%016llx\n", obs_class);
+
+    }
+
     fclose(f);
 
   }
@@ -329,6 +410,12 @@ static void showmap_run_target_forkserver(afl_forkserver_t *fsrv, u8 *mem,
 
   }
 
+  if (leak_mode) {
+
+    set_obs_class(fsrv->stdout_raw_buffer, fsrv->stdout_raw_buffer_len);
+
+  }
+
   if (fsrv->trace_bits[0] == 1) {
 
     fsrv->trace_bits[0] = 0;
@@ -444,9 +531,15 @@ static void showmap_run_target(afl_forkserver_t *fsrv, char **argv) {
 
   static struct itimerval it;
   int                     status = 0;
+  FILE *                  out_f = NULL;
 
   if (!quiet_mode) { SAYF("-- Program output begins --\n" cRST); }
 
+  /* Without a fork server, stdout is collected in a temp file rather than
+     a pipe, so a chatty target cannot block before we wait for it. */
+
+  if (leak_mode && !(out_f = tmpfile())) { PFATAL("tmpfile() failed"); }
+
   MEM_BARRIER();
 
   fsrv->child_pid = fork();
@@ -472,6 +565,13 @@ static void showmap_run_target(afl_forkserver_t *fsrv, char **argv) {
 
     }
 
+    if (out_f && dup2(fileno(out_f), 1) < 0) {
+
+      *(u32 *)fsrv->trace_bits = EXEC_FAIL_SIG;
+      PFATAL("Descriptor initialization failed");
+
+    }
+
     if (fsrv->mem_limit) {
 
       r.rlim_max = r.rlim_cur = ((rlim_t)fsrv->mem_limit) << 20;
@@ -540,6 +640,20 @@ static void showmap_run_target(afl_forkserver_t *fsrv, char **argv) {
 
   }
 
+  if (out_f) {
+
+    s32 fd = fileno(out_f);
+    u32 len = lseek(fd, 0, SEEK_END);
+    u8 *out = ck_alloc_nozero(len + 1);
+
+    if (pread(fd, out, len, 0) != (ssize_t)len) { PFATAL("pread() failed"); }
+    set_obs_class(out, len);
+
+    ck_free(out);
+    fclose(out_f);
+
+  }
+
   if (fsrv->trace_bits[0] == 1) {
 
     fsrv->trace_bits[0] = 0;
@@ -840,7 +954,10 @@ static void usage(u8 *argv0) {
       "  -e         - show edge coverage only, ignore hit counts\n"
       "  -r         - show real tuple values instead of AFL filter values\n"
       "  -s         - do not classify the map\n"
-      "  -c         - allow core dumps\n\n"
+      "  -c         - allow core dumps\n"
+      "  -L         - leakage mode: capture the program's stdout and record "
+      "its\n"
+      "               hash as the observation class of each input\n\n"
 
       "This tool displays raw tuple data captured by AFL instrumentation.\n"
       "For additional help, consult %s/README.md.\n\n"
@@ -896,7 +1013,7 @@ int main(int argc, char **argv_orig, char **envp) {
 
   if (getenv("AFL_QUIET") != NULL) { be_quiet = true; }
 
-  while ((opt = getopt(argc, argv, "+i:o:f:m:t:A:eqCZOQUWbcrsh")) > 0) {
+  while ((opt = getopt(argc, argv, "+i:o:f:m:t:A:eqCZOQUWbcrsLh")) > 0) {
 
     switch (opt) {
 
@@ -1081,6 +1198,13 @@ int main(int argc, char **argv_orig, char **envp) {
         raw_instr_output = true;
         break;
 
+      case 'L':
+
+        if (leak_mode) { FATAL("Multiple -L options not supported"); }
+        leak_mode = true;
+        fsrv->leakage_hunting = true;
+        break;
+
       case 'h':
         usage(argv[0]);
         return -1;
@@ -1102,6 +1226,12 @@ int main(int argc, char **argv_orig, char **envp) {
 
   }
 
+  if (leak_mode && unicorn_mode) {
+
+    FATAL("-L is not supported in Unicorn mode");
+
+  }
+
   if (fsrv->qemu_mode && !mem_limit_given) { fsrv->mem_limit = MEM_LIMIT_QEMU; }
   if (unicorn_mode && !mem_limit_given) { fsrv->mem_limit = MEM_LIMIT_UNICORN; }
 
@@ -1393,6 +1523,9 @@ int main(int argc, char **argv_orig, char **envp) {
           "with %llu input files.",
           tcnt, map_size, ((float)tcnt * 100) / (float)map_size,
           fsrv->total_execs);
+    if (collect_coverage && leak_mode)
+      OKF("The inputs fall into %u distinct observation classes.",
+          count_obs_classes());
 
   }
 
@@ -1426,6 +1559,7 @@ int main(int argc, char **argv_orig, char **envp) {
 
   if (stdin_file) { ck_free(stdin_file); }
   if (collect_coverage) { free(coverage_map); }
+  ck_free(obs_classes);
 
   argv_cpy_free(argv);
   if (fsrv->qemu_mode) { free(use_argv[2]); }
@@ -25,6 +25,10 @@
    *or* producing consistent instrumentation output (the mode is auto-selected
    based on the initially observed behavior).
 
+   In leakage mode (-L), it instead takes the two testcases of a leak and
+   minimizes their shared public input and both secrets, as long as the two
+   secrets still make the binary produce different output.
+
  */
 
 #define AFL_MAIN
@@ -37,6 +41,7 @@
 #include "forkserver.h"
 #include "sharedmem.h"
 #include "common.h"
+#include "leakage_testcase.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -88,6 +93,19 @@ static afl_forkserver_t *fsrv;
 static sharedmem_t       shm;
 static sharedmem_t *     shm_fuzz;
 
+/* Leakage mode: the two secrets of a leak pair run on separate fork servers
+   at the same time, so every candidate costs a single exec of wall clock. */
+
+static u8 *leak_file,                  /* Second testcase of the pair (-L)  */
+    *leak_out_file;                    /* Input file of the 2nd fork server */
+
+static u8 *leak_parts[3];              /* Public input, secret 1, secret 2  */
+static u32 leak_part_len[3],           /* Their lengths                     */
+    leak_part_cur;                     /* Part currently being minimized    */
+
+static afl_forkserver_t leak_fsrv;     /* Fork server for secret 2          */
+static sharedmem_t      leak_shm;
+
 /*
  * forkserver section
  */
@@ -206,6 +224,13 @@ static void at_exit_handler(void) {
   afl_fsrv_killall();
   if (remove_out_file) unlink(out_file);
 
+  if (leak_file) {
+
+    if (remove_shm && leak_shm.map) afl_shm_deinit(&leak_shm);
+    if (leak_out_file) unlink(leak_out_file);
+
+  }
+
 }
 
 /* Read initial file. */
@@ -236,6 +261,63 @@ static void read_initial_file(void) {
 
 }
 
+/* Leakage mode: read both testcases of the leak pair and split them into
+   their public and secret parts. The public part must be the same. */
+
+static void read_leak_pair(void) {
+
+  u8 *pub[2], *sec[2], *data[2], *orig_in_file = in_file;
+  u32 pub_len[2], sec_len[2], i;
+
+  for (i = 0; i < 2; ++i) {
+
+    in_file = i ? leak_file : orig_in_file;
+    read_initial_file();
+    data[i] = in_data;
+
+    find_public_and_secret_inputs((char *)in_data, in_len, &pub[i],
+                                  &pub_len[i], &sec[i], &sec_len[i]);
+
+  }
+
+  in_file = orig_in_file;
+
+  if (pub_len[0] != pub_len[1] || memcmp(pub[0], pub[1], pub_len[0])) {
+
+    FATAL("'%s' and '%s' do not share the same public input", in_file,
+          leak_file);
+
+  }
+
+  leak_part_len[0] = pub_len[0];
+  leak_part_len[1] = sec_len[0];
+  leak_part_len[2] = sec_len[1];
+
+  for (i = 0; i < 3; ++i) {
+
+    u8 *src = i ? sec[i - 1] : pub[0];
+    leak_parts[i] = ck_alloc_nozero(leak_part_len[i] + 1);
+    memcpy(leak_parts[i], src, leak_part_len[i]);
+
+  }
+
+  for (i = 0; i < 2; ++i) {
+
+    free(pub[i]);
+    free(sec[i]);
+    ck_free(data[i]);
+
+  }
+
+  OKF("Leak pair: public input %u bytes, secrets %u and %u bytes.",
+      leak_part_len[0], leak_part_len[1], leak_part_len[2]);
+
+  leak_part_cur = 0;
+  in_data = leak_parts[0];
+  in_len = leak_part_len[0];
+
+}
+
 /* Write output file. */
 
 static s32 write_to_file(u8 *path, u8 *mem, u32 len) {
@@ -256,12 +338,173 @@ static s32 write_to_file(u8 *path, u8 *mem, u32 len) {
 
 }
 
+/* Leakage mode: write the minimized pair as input_1 and input_2 into the
+   output directory. */
+
+static void write_leak_output(void) {
+
+  leak_part_len[leak_part_cur] = in_len;
+
+  if (mkdir(output_file, 0700) && errno != EEXIST) {
+
+    PFATAL("Unable to create '%s'", output_file);
+
+  }
+
+  for (u32 i = 1; i < 3; ++i) {
+
+    char *buf;
+    u32   len;
+    u8 *  fn = alloc_printf("%s/input_%u", output_file, i);
+
+    create_buffer_from_public_and_secret_inputs(
+        leak_parts[0], leak_part_len[0], leak_parts[i], leak_part_len[i], &buf,
+        &len);
+    close(write_to_file(fn, buf, len));
+    ck_free(buf);
+    ck_free(fn);
+
+  }
+
+}
+
+/* Leakage mode: mem replaces the part of the leak pair that is currently
+   being minimized. Both secrets are run at the same time, and the change is
+   kept if they still produce different output. */
+
+static u8 tmin_run_leak(u8 *mem, u32 len, u8 first_run) {
+
+  u8 *parts[3] = {leak_parts[0], leak_parts[1], leak_parts[2]};
+  u32 lens[3] = {leak_part_len[0], leak_part_len[1], leak_part_len[2]};
+
+  afl_forkserver_t *fsrvs[2] = {fsrv, &leak_fsrv};
+  fsrv_run_result_t ret[2] = {FSRV_RUN_OK, FSRV_RUN_OK};
+  u32               i;
+
+  parts[leak_part_cur] = mem;
+  lens[leak_part_cur] = len;
+
+  for (i = 0; i < 2; ++i) {
+
+    char *buf;
+    u32   buf_len;
+
+    create_buffer_from_public_and_secret_inputs(parts[0], lens[0], parts[i + 1],
+                                                lens[i + 1], &buf, &buf_len);
+    afl_fsrv_write_to_testcase(fsrvs[i], buf, buf_len);
+    ck_free(buf);
+
+  }
+
+  if (!afl_fsrv_run_target_start(fsrvs[0], &stop_soon) &&
+      !afl_fsrv_run_target_start(fsrvs[1], &stop_soon)) {
+
+    for (i = 0; i < 2; ++i) {
+
+      ret[i] =
+          afl_fsrv_run_target_finish(fsrvs[i], fsrvs[i]->exec_tmout, &stop_soon);
+
+    }
+
+  }
+
+  if (stop_soon) {
+
+    SAYF(cRST cLRD "\n+++ Minimization aborted by user +++\n" cRST);
+    write_leak_output();
+    exit(1);
+
+  }
+
+  for (i = 0; i < 2; ++i) {
+
+    if (ret[i] == FSRV_RUN_ERROR) { FATAL("Couldn't run child"); }
+
+    if (ret[i] == FSRV_RUN_TMOUT) {
+
+      missed_hangs++;
+      return 0;
+
+    }
+
+    if (ret[i] == FSRV_RUN_CRASH) {
+
+      if (first_run) { FATAL("Secret #%u of the leak pair crashes", i + 1); }
+      missed_crashes++;
+      return 0;
+
+    }
+
+  }
+
+  u64 digest1 = hash64(fsrvs[0]->stdout_raw_buffer,
+                       fsrvs[0]->stdout_raw_buffer_len, HASH_CONST);
+  u64 digest2 = hash64(fsrvs[1]->stdout_raw_buffer,
+                       fsrvs[1]->stdout_raw_buffer_len, HASH_CONST);
+
+  if (digest1 != digest2) { return 1; }
+
+  if (first_run) {
+
+    FATAL("Both secrets produce the same output, '%s' and '%s' do not leak",
+          in_file, leak_file);
+
+  }
+
+  missed_paths++;
+  return 0;
+
+}
+
+/* Leakage mode: run the regular minimization on each part of the leak pair
+   in turn, until none of them shrinks any further. */
+
+static void minimize(afl_forkserver_t *fsrv);
+
+static void minimize_leak(afl_forkserver_t *fsrv) {
+
+  static const char *part_names[3] = {"public input", "secret #1",
+                                      "secret #2"};
+
+  u32 total = leak_part_len[0] + leak_part_len[1] + leak_part_len[2],
+      prev_total;
+
+  do {
+
+    prev_total = total;
+
+    for (leak_part_cur = 0; leak_part_cur < 3; ++leak_part_cur) {
+
+      if (!leak_part_len[leak_part_cur]) { continue; }
+
+      ACTF(cBRI "Minimizing the %s" cRST " (%u bytes)...",
+           part_names[leak_part_cur], leak_part_len[leak_part_cur]);
+
+      in_data = leak_parts[leak_part_cur];
+      in_len = leak_part_len[leak_part_cur];
+      minimize(fsrv);
+      leak_part_len[leak_part_cur] = in_len;
+
+    }
+
+    total = leak_part_len[0] + leak_part_len[1] + leak_part_len[2];
+
+  } while (total < prev_total);
+
+  leak_part_cur = 0;
+  in_data = leak_parts[0];
+  in_len = leak_part_len[0];
+
+}
+
 /* Execute target application. Returns 0 if the changes are a dud, or
    1 if they should be kept. */
 
 static u8 tmin_run_target(afl_forkserver_t *fsrv, u8 *mem, u32 len,
                           u8 first_run) {
 
+  if (leak_file) { return tmin_run_leak(mem, len, first_run); }
+
   afl_fsrv_write_to_testcase(fsrv, mem, len);
 
   fsrv_run_result_t ret =
@@ -866,6 +1109,9 @@ static void usage(u8 *argv0) {
       "  -e            - solve for edge coverage only, ignore hit counts\n"
       "  -x            - treat non-zero exit codes as crashes\n\n"
       "  -H            - minimize a hang (hang mode)\n"
+      "  -L file       - leakage mode: minimize the leak pair -i and file,\n"
+      "                  keeping their outputs different. -o is a directory\n"
+      "                  that receives input_1 and input_2\n"
 
       "For additional tips, please consult %s/README.md.\n\n"
 
@@ -910,7 +1156,7 @@ int main(int argc, char **argv_orig, char **envp) {
 
   SAYF(cCYA "afl-tmin" VERSION cRST " by Michal Zalewski\n");
 
-  while ((opt = getopt(argc, argv, "+i:o:f:m:t:B:xeOQUWHh")) > 0) {
+  while ((opt = getopt(argc, argv, "+i:o:f:m:t:B:L:xeOQUWHh")) > 0) {
 
     switch (opt) {
 
@@ -1070,6 +1316,12 @@ int main(int argc, char **argv_orig, char **envp) {
         hang_mode = 1;
         break;
 
+      case 'L':                                             /* Leak mode */
+
+        if (leak_file) { FATAL("Multiple -L options not supported"); }
+        leak_file = optarg;
+        break;
+
       case 'B':                                              /* load bitmap */
 
         /* This is a secret undocumented option! It is speculated to be useful
@@ -1104,6 +1356,16 @@ int main(int argc, char **argv_orig, char **envp) {
 
   if (optind == argc || !in_file || !output_file) { usage(argv[0]); }
 
+  if (leak_file) {
+
+    if (hang_mode) { FATAL("-L and -H are mutually exclusive"); }
+    if (out_file) { FATAL("-L needs the target to read stdin or @@, not -f"); }
+    if (unicorn_mode) { FATAL("-L is not supported in Unicorn mode"); }
+
+    fsrv->leakage_hunting = true;
+
+  }
+
   check_environment_vars(envp);
 
   if (getenv("AFL_NO_FORKSRV")) {             /* if set, use the fauxserver */
@@ -1123,6 +1385,13 @@ int main(int argc, char **argv_orig, char **envp) {
 
   fsrv->target_path = find_binary(argv[optind]);
   fsrv->trace_bits = afl_shm_init(&shm, map_size, 0);
+
+  /* The second fork server needs its own copy of the command line, with @@
+     pointing to its own input file. */
+
+  char **leak_argv = NULL;
+  if (leak_file) { leak_argv = argv_cpy_dup(argc, argv_orig); }
+
   detect_file_args(argv + optind, out_file, &fsrv->use_stdin);
 
   if (fsrv->qemu_mode) {
@@ -1189,25 +1458,36 @@ int main(int argc, char **argv_orig, char **envp) {
 
   }
 
-  shm_fuzz = ck_alloc(sizeof(sharedmem_t));
+  /* A shared memory testcase would have to be set up per fork server, so
+     leakage mode sticks to stdin or files. */
 
-  /* initialize cmplog_mode */
-  shm_fuzz->cmplog_mode = 0;
-  u8 *map = afl_shm_init(shm_fuzz, MAX_FILE + sizeof(u32), 1);
-  shm_fuzz->shmemfuzz_mode = 1;
-  if (!map) { FATAL("BUG: Zero return from afl_shm_init."); }
+  if (!leak_file) {
+
+    shm_fuzz = ck_alloc(sizeof(sharedmem_t));
+
+    /* initialize cmplog_mode */
+    shm_fuzz->cmplog_mode = 0;
+    u8 *map = afl_shm_init(shm_fuzz, MAX_FILE + sizeof(u32), 1);
+    shm_fuzz->shmemfuzz_mode = 1;
+    if (!map) { FATAL("BUG: Zero return from afl_shm_init."); }
 #ifdef USEMMAP
-  setenv(SHM_FUZZ_ENV_VAR, shm_fuzz->g_shm_file_path, 1);
+    setenv(SHM_FUZZ_ENV_VAR, shm_fuzz->g_shm_file_path, 1);
 #else
-  u8 *shm_str = alloc_printf("%d", shm_fuzz->shm_id);
-  setenv(SHM_FUZZ_ENV_VAR, shm_str, 1);
-  ck_free(shm_str);
+    u8 *shm_str = alloc_printf("%d", shm_fuzz->shm_id);
+    setenv(SHM_FUZZ_ENV_VAR, shm_str, 1);
+    ck_free(shm_str);
 #endif
-  fsrv->support_shmem_fuzz = 1;
-  fsrv->shmem_fuzz_len = (u32 *)map;
-  fsrv->shmem_fuzz = map + sizeof(u32);
+    fsrv->support_shmem_fuzz = 1;
+    fsrv->shmem_fuzz_len = (u32 *)map;
+    fsrv->shmem_fuzz = map + sizeof(u32);
 
-  read_initial_file();
+    read_initial_file();
+
+  } else {
+
+    read_leak_pair();
+
+  }
 
   if (!fsrv->qemu_mode && !unicorn_mode) {
 
@@ -1258,6 +1538,49 @@ int main(int argc, char **argv_orig, char **envp) {
   if (fsrv->support_shmem_fuzz && !fsrv->use_shmem_fuzz)
     shm_fuzz = deinit_shmem(fsrv, shm_fuzz);
 
+  if (leak_file) {
+
+    afl_fsrv_init_dup(&leak_fsrv, fsrv);
+    leak_fsrv.leakage_hunting = true;
+    leak_fsrv.use_fauxsrv = fsrv->use_fauxsrv;
+    leak_fsrv.target_path = ck_strdup(fsrv->target_path);
+
+    leak_out_file = alloc_printf("%s.2", out_file);
+    unlink(leak_out_file);
+    leak_fsrv.out_file = leak_out_file;
+    leak_fsrv.out_fd =
+        open(leak_out_file, O_RDWR | O_CREAT | O_EXCL, DEFAULT_PERMISSION);
+    if (leak_fsrv.out_fd < 0) { PFATAL("Unable to create '%s'", leak_out_file); }
+
+    detect_file_args(leak_argv + optind, leak_out_file, &leak_fsrv.use_stdin);
+
+    char **leak_use_argv = leak_argv + optind;
+
+    if (fsrv->qemu_mode) {
+
+      if (use_wine) {
+
+        leak_use_argv = get_wine_argv(argv[0], &leak_fsrv.target_path,
+                                      argc - optind, leak_argv + optind);
+
+      } else {
+
+        leak_use_argv = get_qemu_argv(argv[0], &leak_fsrv.target_path,
+                                      argc - optind, leak_argv + optind);
+
+      }
+
+    }
+
+    leak_fsrv.trace_bits = afl_shm_init(&leak_shm, map_size, 0);
+    afl_fsrv_start(&leak_fsrv, leak_use_argv, &stop_soon,
+                   (get_afl_env("AFL_DEBUG_CHILD") ||
+                    get_afl_env("AFL_DEBUG_CHILD_OUTPUT"))
+                       ? 1
+                       : 0);
+
+  }
+
   ACTF("Performing dry run (mem limit = %llu MB, timeout = %u ms%s)...",
        fsrv->mem_limit, fsrv->exec_tmout, edges_only ? ", edges only" : "");
 
@@ -1280,7 +1603,12 @@ int main(int argc, char **argv_orig, char **envp) {
 
   }
 
-  if (hang_mode) {
+  if (leak_file) {
+
+    OKF("The secrets produce different output, minimizing in " cCYA
+        "leakage" cRST " mode.");
+
+  } else if (hang_mode) {
 
     OKF("Program hangs as expected, minimizing in " cCYA "hang" cRST " mode.");
 
@@ -1299,7 +1627,15 @@ int main(int argc, char **argv_orig, char **envp) {
 
   }
 
-  minimize(fsrv);
+  if (leak_file) {
+
+    minimize_leak(fsrv);
+
+  } else {
+
+    minimize(fsrv);
+
+  }
 
   ACTF("Writing output to '%s'...", output_file);
 
@@ -1307,7 +1643,15 @@ int main(int argc, char **argv_orig, char **envp) {
   if (out_file) { ck_free(out_file); }
   out_file = NULL;
 
-  close(write_to_file(output_file, in_data, in_len));
+  if (leak_file) {
+
+    write_leak_output();
+
+  } else {
+
+    close(write_to_file(output_file, in_data, in_len));
+
+  }
 
   OKF("We're done here. Have a nice day!\n");
 
@@ -1317,7 +1661,22 @@ int main(int argc, char **argv_orig, char **envp) {
   afl_fsrv_deinit(fsrv);
   if (fsrv->target_path) { ck_free(fsrv->target_path); }
   if (mask_bitmap) { ck_free(mask_bitmap); }
-  if (in_data) { ck_free(in_data); }
+
+  if (leak_file) {
+
+    afl_shm_deinit(&leak_shm);
+    afl_fsrv_deinit(&leak_fsrv);
+    unlink(leak_out_file);
+    ck_free(leak_out_file);
+    ck_free(leak_fsrv.target_path);
+    for (u32 i = 0; i < 3; ++i) { ck_free(leak_parts[i]); }
+    argv_cpy_free(leak_argv);
+
+  } else if (in_data) {
+
+    ck_free(in_data);
+
+  }
 
   argv_cpy_free(argv);
 
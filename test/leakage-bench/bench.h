@@ -0,0 +1,73 @@
+/*
+   american fuzzy lop++ - leakage benchmark targets
+   ------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Shared main() of the benchmark targets: reads a {"PUBLIC": ..., "SECRET":
+   ...} testcase from stdin and hands the decoded inputs to leak_target(),
+   which writes the observation to stdout.
+
+ */
+
+#ifndef _LEAK_BENCH_H
+#define _LEAK_BENCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_MAX 4096
+
+static void leak_target(const unsigned char *pub, unsigned int pub_len,
+                        const unsigned char *sec, unsigned int sec_len);
+
+static unsigned int bench_field(const char *buf, const char *tag,
+                                unsigned char *out) {
+
+  const char *alpha =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const char * p = strstr(buf, tag), *v;
+  unsigned int bits = 0, n = 0, len = 0;
+
+  if (!p) { return 0; }
+
+  for (p += strlen(tag); *p && *p != '"' && (v = strchr(alpha, *p)); ++p) {
+
+    bits = (bits << 6) | (unsigned int)(v - alpha);
+    n += 6;
+
+    if (n >= 8 && len < BENCH_MAX) {
+
+      n -= 8;
+      out[len++] = bits >> n;
+
+    }
+
+  }
+
+  return len;
+
+}
+
+int main(void) {
+
+  static char          buf[BENCH_MAX * 3];
+  static unsigned char pub[BENCH_MAX], sec[BENCH_MAX];
+
+  ssize_t len = read(0, buf, sizeof(buf) - 1);
+  if (len <= 0) { return 0; }
+  buf[len] = 0;
+
+  leak_target(pub, bench_field(buf, "\"PUBLIC\": \"", pub), sec,
+              bench_field(buf, "\"SECRET\": \"", sec));
+
+  return 0;
+
+}
+
+#endif                                                  /* !_LEAK_BENCH_H */
@@ -0,0 +1,25 @@
+/*
+   Control target without a leak: the comparison runs in constant time and
+   the output depends on the public input only. Any leak reported here is a
+   false positive.
+ */
+
+#include "bench.h"
+
+static void leak_target(const unsigned char *pub, unsigned int pub_len,
+                        const unsigned char *sec, unsigned int sec_len) {
+
+  unsigned int  i, h = 5381;
+  unsigned char diff = pub_len != sec_len;
+
+  for (i = 0; i < pub_len; ++i) {
+
+    diff |= pub[i] ^ (i < sec_len ? sec[i] : 0);
+    h = h * 33 + pub[i];
+
+  }
+
+  printf("request %08x\n", h);
+  (void)diff;
+
+}
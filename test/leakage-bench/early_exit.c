@@ -0,0 +1,28 @@
+/*
+   Planted leak: a password check that stops at the first mismatch. Once two
+   characters are right it takes the slow path, and the audit line says so.
+   Found when the public guess matches the first two bytes of one secret but
+   not of another.
+ */
+
+#include "bench.h"
+
+static void leak_target(const unsigned char *pub, unsigned int pub_len,
+                        const unsigned char *sec, unsigned int sec_len) {
+
+  unsigned int i;
+
+  for (i = 0; i < pub_len && i < sec_len && pub[i] == sec[i]; ++i)
+    ;
+
+  if (i == sec_len && pub_len == sec_len) {
+
+    puts("access granted");
+
+  } else {
+
+    printf("access denied%s\n", i >= 2 ? " (audit: slow path)" : "");
+
+  }
+
+}
@@ -0,0 +1,23 @@
+/*
+   Planted leak: the secret's length. The target "encrypts" the public input
+   with the secret as a key, padding both to whole 16 byte blocks, and
+   reports the ciphertext length: a key longer than the message shows.
+ */
+
+#include "bench.h"
+
+static void leak_target(const unsigned char *pub, unsigned int pub_len,
+                        const unsigned char *sec, unsigned int sec_len) {
+
+  unsigned int len = pub_len > sec_len ? pub_len : sec_len;
+
+  if (!pub_len) {
+
+    puts("nothing to encrypt");
+    return;
+
+  }
+
+  printf("ciphertext: %u bytes\n", (len + 15) & ~15U);
+
+}
@@ -0,0 +1,35 @@
+/*
+   Planted leak behind magic bytes: only a public input that starts with
+   "LK\x7f\x01" reaches the debug output, which prints the parity of the
+   first secret byte. The checks are nested, so coverage leads there one byte
+   at a time.
+ */
+
+#include "bench.h"
+
+static void leak_target(const unsigned char *pub, unsigned int pub_len,
+                        const unsigned char *sec, unsigned int sec_len) {
+
+  puts("request parsed");
+
+  if (pub_len < 4) { return; }
+
+  if (pub[0] == 'L') {
+
+    if (pub[1] == 'K') {
+
+      if (pub[2] == 0x7f) {
+
+        if (pub[3] == 0x01) {
+
+          printf("debug: key parity %u\n", sec_len ? sec[0] & 1 : 0);
+
+        }
+
+      }
+
+    }
+
+  }
+
+}
@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# american fuzzy lop++ - leakage benchmark runner
+# -----------------------------------------------
+#
+# Fuzzes every benchmark target once per RNG seed for a fixed time and
+# reports execs/s, the time to the first confirmed leak and confirmed leaks
+# per hour. Compare two afl-fuzz builds by running this with the same
+# settings against each (AFL_FUZZ=/path/to/afl-fuzz).
+#
+# Usage: ./run.sh [-t seconds] [-s "seed ..."] [-o results.csv] [target ...]
+#
+
+TIME=60
+SEEDS="1 2 3"
+CSV=results.csv
+
+while getopts "t:s:o:h" opt; do
+
+  case $opt in
+    t) TIME=$OPTARG ;;
+    s) SEEDS=$OPTARG ;;
+    o) CSV=$OPTARG ;;
+    *) sed -n '3,12p' "$0" | sed 's/^# \?//' ; exit 1 ;;
+  esac
+
+done
+
+shift $((OPTIND - 1))
+TARGETS=${*:-early_exit table_lookup length magic constant_time}
+
+test -e ./run.sh -a -e ./bench.h || { echo Error: this script must be run from the directory in which it lies. ; exit 1 ; }
+
+AFL_FUZZ=${AFL_FUZZ:-../../afl-fuzz}
+AFL_LEAK_EXPORT=${AFL_LEAK_EXPORT:-../../afl-leak-export}
+test -x "$AFL_FUZZ" -a -x "$AFL_LEAK_EXPORT" || { echo Error: build afl-fuzz and afl-leak-export first. ; exit 1 ; }
+
+make -s $TARGETS || exit 1
+
+unset AFL_LEAK_SECRETS_DIR AFL_LEAK_BATCH AFL_PRELOAD AFL_DEBUG
+export AFL_NO_UI=1
+export AFL_SKIP_CPUFREQ=1
+export AFL_I_DONT_CARE_ABOUT_MISSING_CRASHES=1
+export AFL_NO_AFFINITY=${AFL_NO_AFFINITY:-1}
+
+echo "target,seed,seconds,execs_per_sec,execs_done,first_leak_s,leaks_confirmed,leak_buckets,leaks_per_hour" > "$CSV"
+printf "%-14s %5s %10s %12s %10s %8s %10s\n" target seed execs/s first_leak leaks buckets leaks/h
+
+for TARGET in $TARGETS; do
+
+  for SEED in $SEEDS; do
+
+    OUT=`mktemp -d`
+    "$AFL_FUZZ" -s "$SEED" -V "$TIME" -i in -o "$OUT" -- "./$TARGET" > "$OUT/log" 2>&1
+
+    STATS=$OUT/default/fuzzer_stats
+    test -e "$STATS" || { echo "Error: $TARGET did not run, see $OUT/log" ; exit 1 ; }
+
+    stat() { awk -v key="$1" '$1 == key { print $3 }' "$STATS" ; }
+
+    EXECS=`stat execs_per_sec`
+    DONE=`stat execs_done`
+    LEAKS=`stat leaks_confirmed`
+    BUCKETS=`stat leak_buckets`
+    SECS=$((`stat last_update` - `stat start_time`))
+    test "$SECS" -gt 0 || SECS=1
+    FIRST=`"$AFL_LEAK_EXPORT" -l -i "$OUT/default" 2>/dev/null | awk '$1 == 1 { print $3 }'`
+    PER_HOUR=`awk -v l="$LEAKS" -v s="$SECS" 'BEGIN { printf "%.1f", l * 3600 / s }'`
+
+    echo "$TARGET,$SEED,$SECS,$EXECS,$DONE,$FIRST,$LEAKS,$BUCKETS,$PER_HOUR" >> "$CSV"
+    printf "%-14s %5s %10s %12s %10s %8s %10s\n" "$TARGET" "$SEED" "$EXECS" "${FIRST:--}" "$LEAKS" "$BUCKETS" "$PER_HOUR"
+
+    rm -rf "$OUT"
+
+  done
+
+done
+
+echo
+echo "Summary (first_leak: median over the seeds that found one):"
+printf "%-14s %6s %12s %12s %10s\n" target found execs/s first_leak leaks/h
+
+for TARGET in $TARGETS; do
+
+  FIRST=`awk -F, -v t="$TARGET" '$1 == t && $6 != "" { print $6 }' "$CSV" | sort -n | \
+    awk '{ v[NR] = $1 } END { if (NR) print NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'`
+
+  awk -F, -v t="$TARGET" -v first="${FIRST:--}" '
+    $1 == t { n++; execs += $4; hour += $9; if ($6 != "") found++ }
+    END {
+      if (n) printf "%-14s %3d/%-2d %12.1f %12s %10.1f\n", t, found, n, execs / n, first, hour / n
+    }' "$CSV"
+
+done
+
+echo
+echo "Results written to $CSV"
@@ -0,0 +1,38 @@
+/*
+   Planted leak: a secret-indexed table lookup. In verbose mode (public input
+   starting with 'V') the target reports which 64-entry block of the table it
+   used, which gives away the top bits of secret ^ public.
+ */
+
+#include "bench.h"
+
+static void leak_target(const unsigned char *pub, unsigned int pub_len,
+                        const unsigned char *sec, unsigned int sec_len) {
+
+  static unsigned char table[256];
+  unsigned int         i, idx, sum = 0;
+
+  for (i = 0; i < 256; ++i) {
+
+    table[i] = (unsigned char)(i * 167 + 13);
+
+  }
+
+  for (i = 0; i < pub_len && i < sec_len; ++i) {
+
+    sum += table[pub[i] ^ sec[i]];
+
+  }
+
+  printf("processed %u bytes\n", pub_len);
+
+  if (pub_len > 1 && pub[0] == 'V') {
+
+    idx = sec_len ? pub[1] ^ sec[0] : pub[1];
+    printf("lookup block %u\n", idx >> 6);
+
+  }
+
+  (void)sum;
+
+}
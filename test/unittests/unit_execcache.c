@@ -0,0 +1,195 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <assert.h>
+#include <cmocka.h>
+/* cmocka < 1.0 didn't support these features we need */
+#ifndef assert_ptr_equal
+#define assert_ptr_equal(a, b) \
+    _assert_int_equal(cast_ptr_to_largest_integral_type(a), \
+                      cast_ptr_to_largest_integral_type(b), \
+                      __FILE__, __LINE__)
+#define CMUnitTest UnitTest
+#define cmocka_unit_test unit_test
+#define cmocka_run_group_tests(t, setup, teardown) run_tests(t)
+#endif
+
+
+extern void mock_assert(const int result, const char* const expression,
+                        const char * const file, const int line);
+#undef assert
+#define assert(expression) \
+    mock_assert((int)(expression), #expression, __FILE__, __LINE__);
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+
+/* remap exit -> assert, then use cmocka's mock_assert
+    (compile with `--wrap=exit`) */
+extern void exit(int status);
+extern void __real_exit(int status);
+void __wrap_exit(int status);
+void __wrap_exit(int status) {
+    (void)status;
+    assert(0);
+}
+
+/* ignore all printfs */
+#undef printf
+extern int printf(const char *format, ...);
+extern int __real_printf(const char *format, ...);
+int __wrap_printf(const char *format, ...);
+int __wrap_printf(const char *format, ...) {
+    (void)format;
+    return 1;
+}
+
+/* The io map and the last run, as far as the cache sees them */
+static u8  settled = 1;
+static u64 settled_output, last_output;
+
+u8 leak_io_map_settled(afl_state_t *afl, u64 public_input_hash,
+                       u8 *secret_input_buf, u32 secret_len,
+                       u64 output_hash) {
+    (void)afl;
+    (void)public_input_hash;
+    (void)secret_input_buf;
+    (void)secret_len;
+    settled_output = output_hash;
+    return settled;
+}
+
+u64 leak_output_hash(afl_forkserver_t *fsrv) {
+    (void)fsrv;
+    return last_output;
+}
+
+#define CACHE_SIZE 16
+
+static afl_state_t *new_afl(void) {
+    afl_state_t *afl = calloc(1, sizeof(afl_state_t));
+    assert_non_null(afl);
+    afl->leak_exec_cache_size = CACHE_SIZE;
+    afl->leak_exec_cache = calloc(CACHE_SIZE, sizeof(struct leak_exec_result));
+    afl->fsrv.map_size = 64;
+    afl->fsrv.trace_bits = calloc(1, afl->fsrv.map_size);
+    afl->n_fuzz = calloc(N_FUZZ_SIZE, sizeof(u32));
+    settled = 1;
+    return afl;
+}
+
+static void free_afl(afl_state_t *afl) {
+    free(afl->leak_exec_cache);
+    free(afl->fsrv.trace_bits);
+    free(afl->n_fuzz);
+    free(afl);
+}
+
+static u8 lookup(afl_state_t *afl, u64 key, u8 *fault) {
+    u8 pub[] = "pub", sec[] = "sec";
+    return leak_exec_cache_lookup(afl, key, pub, 3, sec, 3, fault);
+}
+
+static void test_hit(void **state) {
+    (void)state;
+
+    afl_state_t *afl = new_afl();
+    u8 fault = FSRV_RUN_TMOUT;
+
+    assert_false(lookup(afl, 0x101, &fault));
+
+    last_output = 42;
+    leak_exec_cache_add(afl, &afl->fsrv, 0x101, FSRV_RUN_OK);
+
+    assert_true(lookup(afl, 0x101, &fault));
+    assert_int_equal(fault, FSRV_RUN_OK);
+    assert_int_equal(settled_output, 42);
+
+    /* another key in the same slot */
+    assert_false(lookup(afl, 0x101 + CACHE_SIZE, &fault));
+
+    assert_int_equal(afl->leak_exec_cache_lookups, 3);
+    assert_int_equal(afl->leak_exec_cache_hits, 1);
+    free_afl(afl);
+}
+
+/* A hit is only a hit if the io map would not change */
+static void test_unsettled(void **state) {
+    (void)state;
+
+    afl_state_t *afl = new_afl();
+    u8 fault;
+
+    leak_exec_cache_add(afl, &afl->fsrv, 0x102, FSRV_RUN_OK);
+    settled = 0;
+    assert_false(lookup(afl, 0x102, &fault));
+    assert_int_equal(afl->leak_exec_cache_hits, 0);
+    free_afl(afl);
+}
+
+/* Timeouts and crashes are not cached, and evict the testcase */
+static void test_faults(void **state) {
+    (void)state;
+
+    afl_state_t *afl = new_afl();
+    u8 fault;
+
+    leak_exec_cache_add(afl, &afl->fsrv, 0x103, FSRV_RUN_TMOUT);
+    assert_false(lookup(afl, 0x103, &fault));
+    leak_exec_cache_add(afl, &afl->fsrv, 0x104, FSRV_RUN_CRASH);
+    assert_false(lookup(afl, 0x104, &fault));
+
+    leak_exec_cache_add(afl, &afl->fsrv, 0x105, FSRV_RUN_OK);
+    leak_exec_cache_add(afl, &afl->fsrv, 0x105, FSRV_RUN_TMOUT);
+    assert_false(lookup(afl, 0x105, &fault));
+
+    /* but leave other testcases in their slot alone */
+    leak_exec_cache_add(afl, &afl->fsrv, 0x106, FSRV_RUN_OK);
+    leak_exec_cache_add(afl, &afl->fsrv, 0x106 + CACHE_SIZE, FSRV_RUN_CRASH);
+    assert_true(lookup(afl, 0x106, &fault));
+
+    assert_int_equal(afl->total_tmouts, 0);
+    free_afl(afl);
+}
+
+/* The schedules that count path frequencies see hits as runs */
+static void test_n_fuzz(void **state) {
+    (void)state;
+
+    afl_state_t *afl = new_afl();
+    u8 fault;
+
+    afl->fsrv.trace_bits[7] = 1;
+    u64 cksum = hash64(afl->fsrv.trace_bits, afl->fsrv.map_size, HASH_CONST);
+
+    afl->schedule = EXPLORE;
+    leak_exec_cache_add(afl, &afl->fsrv, 0x107, FSRV_RUN_OK);
+    assert_true(lookup(afl, 0x107, &fault));
+    assert_int_equal(afl->n_fuzz[cksum % N_FUZZ_SIZE], 0);
+
+    afl->schedule = FAST;
+    leak_exec_cache_add(afl, &afl->fsrv, 0x107, FSRV_RUN_OK);
+    assert_true(lookup(afl, 0x107, &fault));
+    assert_true(lookup(afl, 0x107, &fault));
+    assert_int_equal(afl->n_fuzz[cksum % N_FUZZ_SIZE], 2);
+
+    free_afl(afl);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_hit),
+        cmocka_unit_test(test_unsettled),
+        cmocka_unit_test(test_faults),
+        cmocka_unit_test(test_n_fuzz)
+    };
+
+    //return cmocka_run_group_tests (tests, setup, teardown);
+    __real_exit( cmocka_run_group_tests (tests, NULL, NULL) );
+
+    // fake return for dumb compilers
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <assert.h>
+#include <cmocka.h>
+/* cmocka < 1.0 didn't support these features we need */
+#ifndef assert_ptr_equal
+#define assert_ptr_equal(a, b) \
+    _assert_int_equal(cast_ptr_to_largest_integral_type(a), \
+                      cast_ptr_to_largest_integral_type(b), \
+                      __FILE__, __LINE__)
+#define CMUnitTest UnitTest
+#define cmocka_unit_test unit_test
+#define cmocka_run_group_tests(t, setup, teardown) run_tests(t)
+#endif
+
+
+extern void mock_assert(const int result, const char* const expression,
+                        const char * const file, const int line);
+#undef assert
+#define assert(expression) \
+    mock_assert((int)(expression), #expression, __FILE__, __LINE__);
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+
+/* remap exit -> assert, then use cmocka's mock_assert
+    (compile with `--wrap=exit`) */
+extern void exit(int status);
+extern void __real_exit(int status);
+void __wrap_exit(int status);
+void __wrap_exit(int status) {
+    (void)status;
+    assert(0);
+}
+
+/* ignore all printfs */
+#undef printf
+extern int printf(const char *format, ...);
+extern int __real_printf(const char *format, ...);
+int __wrap_printf(const char *format, ...);
+int __wrap_printf(const char *format, ...) {
+    (void)format;
+    return 1;
+}
+
+/* The io map takes public input hashes as keys, spread them the same way */
+static u64 key_of(u64 i) {
+    u64 z = i + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static struct input_output_hashes *put(struct leak_iomap *m, u64 key,
+                                       u64 payload) {
+    struct input_output_hashes e = {0};
+    e.public_input_hash = key;
+    e.secret_input_hash = payload;
+    e.output_hashes[0] = ~payload;
+    return leak_iomap_put(m, &e);
+}
+
+static void test_put_get(void **state) {
+    (void)state;
+
+    struct leak_iomap *m = leak_iomap_new();
+    assert_int_equal(leak_iomap_count(m), 0);
+    assert_null(leak_iomap_get(m, key_of(0)));
+
+    for (u64 i = 0; i < 3; ++i) {
+        struct input_output_hashes *e = put(m, key_of(i), i);
+        assert_non_null(e);
+        assert_int_equal(e->public_input_hash, key_of(i));
+    }
+
+    assert_int_equal(leak_iomap_count(m), 3);
+
+    for (u64 i = 0; i < 3; ++i) {
+        struct input_output_hashes *e = leak_iomap_get(m, key_of(i));
+        assert_non_null(e);
+        assert_int_equal(e->public_input_hash, key_of(i));
+        assert_int_equal(e->secret_input_hash, i);
+        assert_int_equal(e->output_hashes[0], ~i);
+    }
+
+    assert_null(leak_iomap_get(m, key_of(3)));
+    leak_iomap_free(m);
+}
+
+/* A key that is there already keeps its entry */
+static void test_duplicate(void **state) {
+    (void)state;
+
+    struct leak_iomap *m = leak_iomap_new();
+
+    struct input_output_hashes *first = put(m, key_of(7), 1);
+    struct input_output_hashes *again = put(m, key_of(7), 2);
+
+    assert_ptr_equal(first, again);
+    assert_int_equal(again->secret_input_hash, 1);
+    assert_int_equal(leak_iomap_count(m), 1);
+
+    leak_iomap_free(m);
+}
+
+/* Keys that agree in the bits that pick the group and in the control byte
+   only differ in the key comparison, and have to probe further */
+static void test_collisions(void **state) {
+    (void)state;
+
+    struct leak_iomap *m = leak_iomap_new();
+    u64 i;
+
+    for (i = 0; i < 300; ++i)
+        put(m, (i << 40) | 0x1234, i);
+
+    assert_int_equal(leak_iomap_count(m), 300);
+
+    for (i = 0; i < 300; ++i) {
+        struct input_output_hashes *e = leak_iomap_get(m, (i << 40) | 0x1234);
+        assert_non_null(e);
+        assert_int_equal(e->secret_input_hash, i);
+    }
+
+    assert_null(leak_iomap_get(m, (300ULL << 40) | 0x1234));
+    leak_iomap_free(m);
+}
+
+/* Several grows of the slots and several chunks of entries. Entries never
+   move */
+static void test_growth(void **state) {
+    (void)state;
+
+    struct leak_iomap *m = leak_iomap_new();
+    u64 mem = leak_iomap_mem(m), i, n = 40000;
+
+    struct input_output_hashes *first = put(m, key_of(0), 0);
+
+    for (i = 1; i < n; ++i)
+        put(m, key_of(i), i);
+
+    assert_int_equal(leak_iomap_count(m), n);
+    assert_true(leak_iomap_mem(m) > mem);
+    assert_ptr_equal(leak_iomap_get(m, key_of(0)), first);
+
+    for (i = 0; i < n; ++i) {
+        struct input_output_hashes *e = leak_iomap_get(m, key_of(i));
+        assert_non_null(e);
+        assert_int_equal(e->secret_input_hash, i);
+    }
+
+    for (i = n; i < n + 1000; ++i)
+        assert_null(leak_iomap_get(m, key_of(i)));
+
+    leak_iomap_free(m);
+}
+
+/* The table frees the buffers its entries hold */
+static void test_free_buffers(void **state) {
+    (void)state;
+
+    struct leak_iomap *m = leak_iomap_new();
+    struct input_output_hashes e = {0};
+
+    e.public_input_hash = key_of(1);
+    e.public_input_buf = ck_alloc(4);
+    e.public_input_buf_len = 4;
+    e.secret_input_bufs_filled = 1;
+    e.secret_input_bufs[0] = ck_alloc(8);
+    e.secret_input_buf_len[0] = 8;
+    e.public_output_bufs[0] = ck_alloc(16);
+    e.public_output_buf_len[0] = 16;
+
+    assert_ptr_equal(leak_iomap_put(m, &e)->public_input_buf,
+                     e.public_input_buf);
+
+    leak_iomap_free(m);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_put_get),
+        cmocka_unit_test(test_duplicate),
+        cmocka_unit_test(test_collisions),
+        cmocka_unit_test(test_growth),
+        cmocka_unit_test(test_free_buffers)
+    };
+
+    //return cmocka_run_group_tests (tests, setup, teardown);
+    __real_exit( cmocka_run_group_tests (tests, NULL, NULL) );
+
+    // fake return for dumb compilers
+    return 0;
+}
@@ -0,0 +1,352 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <assert.h>
+#include <cmocka.h>
+/* cmocka < 1.0 didn't support these features we need */
+#ifndef assert_ptr_equal
+#define assert_ptr_equal(a, b) \
+    _assert_int_equal(cast_ptr_to_largest_integral_type(a), \
+                      cast_ptr_to_largest_integral_type(b), \
+                      __FILE__, __LINE__)
+#define CMUnitTest UnitTest
+#define cmocka_unit_test unit_test
+#define cmocka_run_group_tests(t, setup, teardown) run_tests(t)
+#endif
+
+
+extern void mock_assert(const int result, const char* const expression,
+                        const char * const file, const int line);
+#undef assert
+#define assert(expression) \
+    mock_assert((int)(expression), #expression, __FILE__, __LINE__);
+
+#include "afl-fuzz.h"
+#include "leakage_utils.h"
+#include "leak_log.h"
+
+/* remap exit -> assert, then use cmocka's mock_assert
+    (compile with `--wrap=exit`) */
+extern void exit(int status);
+extern void __real_exit(int status);
+void __wrap_exit(int status);
+void __wrap_exit(int status) {
+    (void)status;
+    assert(0);
+}
+
+/* ignore all printfs */
+#undef printf
+extern int printf(const char *format, ...);
+extern int __real_printf(const char *format, ...);
+int __wrap_printf(const char *format, ...);
+int __wrap_printf(const char *format, ...) {
+    (void)format;
+    return 1;
+}
+
+/* hash64 with collisions on demand (compile with `--wrap=hash64`) */
+static u8 collide;
+u64 __real_hash64(u8 *key, u32 len, u64 seed);
+u64 __wrap_hash64(u8 *key, u32 len, u64 seed);
+u64 __wrap_hash64(u8 *key, u32 len, u64 seed) {
+    return collide ? 0x1234 : __real_hash64(key, len, seed);
+}
+
+/* The target, as far as importing leaks goes: every run observes the next
+   of outputs[] */
+static u64 outputs[8];
+static u32 output_cnt, runs;
+
+void write_to_testcase(afl_state_t *afl, void *mem, u32 len) {
+    (void)afl;
+    (void)mem;
+    (void)len;
+}
+
+fsrv_run_result_t fuzz_run_target(afl_state_t *afl, afl_forkserver_t *fsrv,
+                                  u32 timeout) {
+    (void)afl;
+    (void)fsrv;
+    (void)timeout;
+    ++runs;
+    return FSRV_RUN_OK;
+}
+
+u64 leak_output_hash(afl_forkserver_t *fsrv) {
+    (void)fsrv;
+    return runs <= output_cnt ? outputs[runs - 1] : 0;
+}
+
+static struct leak_bucket bucket = {.id = 1};
+
+struct leak_bucket *leak_bucket_classify(afl_state_t *afl,
+                                         afl_forkserver_t *fsrv,
+                                         struct input_output_hashes *leak) {
+    (void)afl;
+    (void)fsrv;
+    (void)leak;
+    ++bucket.count;
+    return &bucket;
+}
+
+static char base[] = "/tmp/unit_leaklog.XXXXXX";
+
+static afl_state_t *new_afl(const char *name) {
+    afl_state_t *afl = calloc(1, sizeof(afl_state_t));
+    assert_non_null(afl);
+    afl->out_dir = alloc_printf("%s/%s", base, name);
+    afl->sync_dir = (u8 *)base;
+    afl->public_input_to_output_map = leak_iomap_new();
+
+    u8 *leaks = alloc_printf("%s/leaks", afl->out_dir);
+    u8 *synced = alloc_printf("%s/.synced", afl->out_dir);
+    assert_int_equal(mkdir((char *)afl->out_dir, 0700), 0);
+    assert_int_equal(mkdir((char *)leaks, 0700), 0);
+    assert_int_equal(mkdir((char *)synced, 0700), 0);
+    ck_free(leaks);
+    ck_free(synced);
+
+    leak_log_open(afl);
+    return afl;
+}
+
+static void free_afl(afl_state_t *afl) {
+    leak_log_close(afl);
+    leak_iomap_free(afl->public_input_to_output_map);
+    ck_free(afl->out_dir);
+    free(afl);
+}
+
+/* Log a leak of public input pub with secrets s0/s1 that gave outputs
+   o0/o1; the output hashes are made up from the outputs' last bytes */
+static void add(afl_state_t *afl, const char *pub, const char *s0,
+                const char *s1, u8 *o0, u32 o0_len, u8 *o1, u32 o1_len) {
+    struct input_output_hashes leak = {0};
+
+    leak.public_input_buf = (u8 *)pub;
+    leak.public_input_buf_len = strlen(pub);
+    leak.public_input_hash = hash64((u8 *)pub, strlen(pub), HASH_CONST);
+    leak.secret_input_bufs[0] = (u8 *)s0;
+    leak.secret_input_buf_len[0] = strlen(s0);
+    leak.secret_input_bufs[1] = (u8 *)s1;
+    leak.secret_input_buf_len[1] = strlen(s1);
+    leak.public_output_bufs[0] = o0;
+    leak.public_output_buf_len[0] = o0_len;
+    leak.public_output_bufs[1] = o1;
+    leak.public_output_buf_len[1] = o1_len;
+    leak.output_hashes[0] = 100 + o0[o0_len - 1];
+    leak.output_hashes[1] = 100 + o1[o1_len - 1];
+    leak.secret_input_bufs_filled = SECRET_BUFS_COUNT;
+
+    ++afl->stored_hypertest_leaks_count;
+    leak_log_add(afl, &leak, 1);
+}
+
+static s32 open_log(afl_state_t *afl, const char *file) {
+    u8 *fn = alloc_printf("%s/leaks/%s", afl->out_dir, file);
+    s32 fd = open((char *)fn, O_RDONLY);
+    assert_true(fd >= 0);
+    ck_free(fn);
+    return fd;
+}
+
+static void read_record(s32 fd, u32 n, struct leak_log_record *rec) {
+    assert_int_equal(pread(fd, rec, sizeof(*rec),
+                           sizeof(struct leak_log_header) + n * sizeof(*rec)),
+                     sizeof(*rec));
+}
+
+/* The blob ref points to holds data */
+static void check_blob(s32 fd, struct leak_log_ref *ref, const void *data,
+                       u32 len) {
+    struct leak_log_blob hdr;
+    u8 *buf = malloc(len + 1);
+
+    assert_int_equal(ref->len, len);
+    assert_int_equal(pread(fd, &hdr, sizeof(hdr), ref->offset), sizeof(hdr));
+    assert_int_equal(hdr.len, len);
+    assert_int_equal(pread(fd, buf, len, ref->offset + sizeof(hdr)), len);
+    assert_memory_equal(buf, data, len);
+    free(buf);
+}
+
+static void test_records(void **state) {
+    (void)state;
+
+    afl_state_t *afl = new_afl("records");
+    struct leak_log_header hdr;
+    struct leak_log_record rec[2];
+
+    add(afl, "pubA", "sec0", "sec1", (u8 *)"out0", 4, (u8 *)"out1", 4);
+    add(afl, "pubB", "sec0", "sec1", (u8 *)"out0", 4, (u8 *)"out2", 4);
+
+    assert_true(leak_log_seen(afl, hash64((u8 *)"pubA", 4, HASH_CONST)));
+    assert_false(leak_log_seen(afl, hash64((u8 *)"pubC", 4, HASH_CONST)));
+
+    leak_log_flush(afl);
+
+    s32 index_fd = open_log(afl, LEAK_LOG_INDEX);
+    s32 blobs_fd = open_log(afl, LEAK_LOG_BLOBS);
+
+    assert_int_equal(read(index_fd, &hdr, sizeof(hdr)), sizeof(hdr));
+    assert_int_equal(hdr.magic, LEAK_LOG_MAGIC);
+    assert_int_equal(hdr.version, LEAK_LOG_VERSION);
+    assert_int_equal(hdr.record_size, sizeof(struct leak_log_record));
+
+    read_record(index_fd, 0, &rec[0]);
+    read_record(index_fd, 1, &rec[1]);
+    assert_int_equal(rec[0].id, 1);
+    assert_int_equal(rec[1].id, 2);
+    assert_int_equal(rec[1].output_hash[1], 100 + '2');
+
+    check_blob(blobs_fd, &rec[0].public_input, "pubA", 4);
+    check_blob(blobs_fd, &rec[1].public_input, "pubB", 4);
+    check_blob(blobs_fd, &rec[1].secret_input[1], "sec1", 4);
+    check_blob(blobs_fd, &rec[1].output[1], "out2", 4);
+
+    /* identical data is stored once */
+    assert_int_equal(rec[0].secret_input[0].offset,
+                     rec[1].secret_input[0].offset);
+    assert_int_equal(rec[0].output[0].offset, rec[1].output[0].offset);
+    assert_int_not_equal(rec[0].output[1].offset, rec[1].output[1].offset);
+
+    close(index_fd);
+    close(blobs_fd);
+    free_afl(afl);
+}
+
+/* Blobs larger than the write buffer, and blobs that are on disk already,
+   are shared as well */
+static void test_large_blobs(void **state) {
+    (void)state;
+
+    afl_state_t *afl = new_afl("large");
+    struct leak_log_record rec[2];
+    u32 len = LEAK_LOG_BUF_SIZE * 2;
+    u8 *out0 = calloc(1, len), *out1 = calloc(1, len);
+
+    out1[0] = 1;
+    add(afl, "pubA", "sec0", "sec1", out0, len, out1, len);
+    leak_log_flush(afl);
+    add(afl, "pubB", "sec0", "sec1", out0, len, out1, len);
+    leak_log_flush(afl);
+
+    s32 index_fd = open_log(afl, LEAK_LOG_INDEX);
+    s32 blobs_fd = open_log(afl, LEAK_LOG_BLOBS);
+
+    read_record(index_fd, 0, &rec[0]);
+    read_record(index_fd, 1, &rec[1]);
+    assert_int_equal(rec[0].output[0].offset, rec[1].output[0].offset);
+    assert_int_equal(rec[0].output[1].offset, rec[1].output[1].offset);
+    assert_int_equal(rec[0].secret_input[0].offset,
+                     rec[1].secret_input[0].offset);
+    check_blob(blobs_fd, &rec[1].output[1], out1, len);
+
+    close(index_fd);
+    close(blobs_fd);
+    free(out0);
+    free(out1);
+    free_afl(afl);
+}
+
+/* Same hash and length is not the same data */
+static void test_hash_collision(void **state) {
+    (void)state;
+
+    afl_state_t *afl = new_afl("collision");
+    struct leak_log_record rec;
+
+    collide = 1;
+    add(afl, "pubA", "sec0", "sec1", (u8 *)"out0", 4, (u8 *)"out1", 4);
+    collide = 0;
+    leak_log_flush(afl);
+
+    s32 index_fd = open_log(afl, LEAK_LOG_INDEX);
+    s32 blobs_fd = open_log(afl, LEAK_LOG_BLOBS);
+
+    read_record(index_fd, 0, &rec);
+    check_blob(blobs_fd, &rec.public_input, "pubA", 4);
+    check_blob(blobs_fd, &rec.secret_input[0], "sec0", 4);
+    check_blob(blobs_fd, &rec.secret_input[1], "sec1", 4);
+    check_blob(blobs_fd, &rec.output[0], "out0", 4);
+    check_blob(blobs_fd, &rec.output[1], "out1", 4);
+
+    close(index_fd);
+    close(blobs_fd);
+    free_afl(afl);
+}
+
+/* Leaks of a peer are imported if both secrets still give the logged
+   outputs, and only once */
+static void test_sync(void **state) {
+    (void)state;
+
+    afl_state_t *peer = new_afl("peer");
+    add(peer, "pubA", "sec0", "sec1", (u8 *)"out0", 4, (u8 *)"out1", 4);
+    add(peer, "pubB", "sec0", "sec1", (u8 *)"out2", 4, (u8 *)"out3", 4);
+    add(peer, "pubC", "sec0", "sec1", (u8 *)"out4", 4, (u8 *)"out4", 4);
+    leak_log_flush(peer);
+
+    afl_state_t *afl = new_afl("sync");
+
+    /* pubB does not reproduce, pubC is no leak and is not run at all */
+    outputs[0] = 100 + '0';
+    outputs[1] = 100 + '1';
+    outputs[2] = 100 + '2';
+    outputs[3] = 0;
+    output_cnt = 4;
+    runs = 0;
+
+    leak_log_sync(afl, (u8 *)"peer");
+    assert_int_equal(runs, 4);
+    assert_int_equal(afl->leaks_imported, 1);
+    assert_int_equal(afl->stored_hypertest_leaks_count, 1);
+
+    u64 pub_a = hash64((u8 *)"pubA", 4, HASH_CONST);
+    assert_true(leak_log_seen(afl, pub_a));
+    assert_false(leak_log_seen(afl, hash64((u8 *)"pubB", 4, HASH_CONST)));
+
+    /* the io map took the leak over */
+    struct input_output_hashes *e =
+        leak_iomap_get(afl->public_input_to_output_map, pub_a);
+    assert_non_null(e);
+    assert_int_equal(e->secret_input_bufs_filled, SECRET_BUFS_COUNT);
+    assert_memory_equal(e->secret_input_bufs[1], "sec1", 4);
+    assert_int_equal(e->output_hashes[1], 100 + '1');
+    assert_int_equal(e->secret_input_hash,
+                     hash64((u8 *)"sec0", 4, HASH_CONST));
+
+    /* what was looked at is not looked at again */
+    runs = 0;
+    leak_log_sync(afl, (u8 *)"peer");
+    assert_int_equal(runs, 0);
+
+    free_afl(afl);
+    free_afl(peer);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    assert_non_null(mkdtemp(base));
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_records),
+        cmocka_unit_test(test_large_blobs),
+        cmocka_unit_test(test_hash_collision),
+        cmocka_unit_test(test_sync)
+    };
+
+    int ret = cmocka_run_group_tests (tests, NULL, NULL);
+
+    char *cmd = alloc_printf("rm -rf %s", base);
+    if (system(cmd)) { ret = 1; }
+    ck_free(cmd);
+
+    __real_exit(ret);
+
+    // fake return for dumb compilers
+    return 0;
+}
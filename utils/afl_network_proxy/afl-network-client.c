@@ -20,6 +20,8 @@
 #include "config.h"
 #include "types.h"
 #include "debug.h"
+#include "leak_obs.h"
+#include "leakage_testcase.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,6 +51,9 @@
 
 u8 *__afl_area_ptr;
 
+/* Observation shm of afl-fuzz, set when hunting leaks */
+static struct leak_obs_map *leak_obs;
+
 #ifdef __ANDROID__
 u32 __afl_map_size = MAP_SIZE;
 #else
@@ -161,6 +166,134 @@ static void __afl_map_shm(void) {
 
 }
 
+/* In leakage hunting mode, afl-fuzz also shares its observation shm. */
+
+static void __afl_map_leak_obs(void) {
+
+  char *id_str = getenv(LEAK_OBS_SHM_ENV_VAR);
+
+  if (!id_str) return;
+
+#ifdef USEMMAP
+  int shm_fd = shm_open(id_str, O_RDWR, 0600);
+  if (shm_fd == -1) PFATAL("shm_open() of the observation shm failed");
+
+  leak_obs = mmap(0, sizeof(struct leak_obs_map), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, shm_fd, 0);
+  close(shm_fd);
+  if (leak_obs == MAP_FAILED) PFATAL("mmap() of the observation shm failed");
+#else
+  leak_obs = shmat(atoi(id_str), 0, 0);
+  if (leak_obs == (void *)-1) PFATAL("shmat() of the observation shm failed");
+#endif
+
+}
+
+static void recv_all(int s, void *buf, u32 len, const char *what) {
+
+  u32 received = 0;
+  s32 ret;
+
+  while (received < len &&
+         (ret = recv(s, (u8 *)buf + received, len - received, 0)) > 0)
+    received += ret;
+  if (received != len) FATAL("did not receive %s", what);
+
+}
+
+/* Send a leakage testcase as a leak frame: public and secret input raw,
+   instead of the JSON, and whether we need the output itself. It goes out
+   in one piece, split up it would wait for delayed ACKs. */
+
+static void send_leak_testcase(int s, u8 *buf, u32 len) {
+
+  static u8 *frame;
+  static u32 frame_size;
+  u8 *       pub, *sec;
+  u32        hdr[3], frame_len;
+  const char *err;
+
+  /* stdout is the observation pipe of afl-fuzz, nothing else may go there.
+     A testcase that does not parse runs as an empty pair. */
+
+  if ((err = parse_public_and_secret_inputs((char *)buf, len, &pub, &hdr[1],
+                                            &sec, &hdr[2])))
+    fprintf(stderr, "[afl-network-client] %s, sending an empty one\n", err);
+
+  hdr[0] = LEAK_NET_FRAME | (leak_obs->want_bytes ? LEAK_NET_WANT_BYTES : 0);
+  frame_len = sizeof(hdr) + hdr[1] + hdr[2];
+
+  if (frame_len > frame_size) {
+
+    frame_size = frame_len;
+    if ((frame = realloc(frame, frame_size)) == NULL)
+      PFATAL("can not allocate %u memory", frame_size);
+
+  }
+
+  memcpy(frame, hdr, sizeof(hdr));
+  if (hdr[1]) memcpy(frame + sizeof(hdr), pub, hdr[1]);
+  if (hdr[2]) memcpy(frame + sizeof(hdr) + hdr[1], sec, hdr[2]);
+
+  if (send(s, frame, frame_len, 0) != frame_len)
+    PFATAL("sending test data failed");
+
+  free(pub);
+  free(sec);
+
+}
+
+/* The server answers a leak frame with the observation of the run. Hand it
+   to afl-fuzz as if the target ran here: the digest through the shm, the
+   bytes, when asked for, through stdout. */
+
+static void recv_observation(int s) {
+
+  static u8 *out;
+  static u32 out_size;
+  u8         hdr[16];
+  u64        digest;
+  u32        len, bytes_len;
+
+  recv_all(s, hdr, 16, "observation");
+  memcpy(&digest, hdr, 8);
+  memcpy(&len, hdr + 8, 4);
+  memcpy(&bytes_len, hdr + 12, 4);
+
+  if (bytes_len) {
+
+    if (bytes_len > out_size) {
+
+      out_size = bytes_len;
+      if ((out = realloc(out, out_size)) == NULL)
+        PFATAL("can not allocate %u memory", out_size);
+
+    }
+
+    recv_all(s, out, bytes_len, "observed output");
+
+    u8 *ptr = out;
+    while (bytes_len) {
+
+      ssize_t n = write(STDOUT_FILENO, ptr, bytes_len);
+      if (n <= 0) break;
+      ptr += n;
+      bytes_len -= n;
+
+    }
+
+  }
+
+  if (!leak_obs->want_bytes) {
+
+    leak_obs->digest[0] = digest;
+    leak_obs->len[0] = len;
+    leak_obs->count = 1;
+
+  }
+
+}
+
 /* Fork server logic. */
 
 static void __afl_start_forkserver(void) {
@@ -314,6 +447,7 @@ int main(int argc, char *argv[]) {
 
   /* we initialize the shared memory map and start the forkserver */
   __afl_map_shm();
+  __afl_map_leak_obs();
   __afl_start_forkserver();
 
   int i = 1, j, status, ret, received;
@@ -322,40 +456,49 @@ int main(int argc, char *argv[]) {
   while ((*lenptr = __afl_next_testcase(buf + 4, max_len)) > 0) {
 
     // fprintf(stderr, "Sending testcase with len %u\n", *lenptr);
-#ifdef USE_DEFLATE
-  #ifdef COMPRESS_TESTCASES
-    // we only compress the testcase if it does not fit in the TCP packet
-    if (*lenptr > 1500 - 20 - 32 - 4) {
-
-      // set highest byte to signify compression
-      *lenptr1 = (*lenptr | 0xff000000);
-      *lenptr2 = (u32)libdeflate_deflate_compress(compressor, buf + 4, *lenptr,
-                                                  buf2 + 8, buf2_len);
-      if (send(s, buf2, *lenptr2 + 8, 0) != *lenptr2 + 8)
-        PFATAL("sending test data failed");
-      // fprintf(stderr, "COMPRESS (%u->%u):\n", *lenptr, *lenptr2);
-      // for (u32 i = 0; i < *lenptr; i++)
-      //  fprintf(stderr, "%02x", buf[i + 4]);
-      // fprintf(stderr, "\n");
-      // for (u32 i = 0; i < *lenptr2; i++)
-      //  fprintf(stderr, "%02x", buf2[i + 8]);
-      // fprintf(stderr, "\n");
+    if (leak_obs) {
+
+      send_leak_testcase(s, buf + 4, *lenptr);
+      recv_observation(s);
 
     } else {
 
+#ifdef USE_DEFLATE
+  #ifdef COMPRESS_TESTCASES
+      // we only compress the testcase if it does not fit in the TCP packet
+      if (*lenptr > 1500 - 20 - 32 - 4) {
+
+        // set highest byte to signify compression
+        *lenptr1 = (*lenptr | 0xff000000);
+        *lenptr2 = (u32)libdeflate_deflate_compress(
+            compressor, buf + 4, *lenptr, buf2 + 8, buf2_len);
+        if (send(s, buf2, *lenptr2 + 8, 0) != *lenptr2 + 8)
+          PFATAL("sending test data failed");
+        // fprintf(stderr, "COMPRESS (%u->%u):\n", *lenptr, *lenptr2);
+        // for (u32 i = 0; i < *lenptr; i++)
+        //  fprintf(stderr, "%02x", buf[i + 4]);
+        // fprintf(stderr, "\n");
+        // for (u32 i = 0; i < *lenptr2; i++)
+        //  fprintf(stderr, "%02x", buf2[i + 8]);
+        // fprintf(stderr, "\n");
+
+      } else {
+
   #endif
 #endif
-      if (send(s, buf, *lenptr + 4, 0) != *lenptr + 4)
-        PFATAL("sending test data failed");
+        if (send(s, buf, *lenptr + 4, 0) != *lenptr + 4)
+          PFATAL("sending test data failed");
 #ifdef USE_DEFLATE
   #ifdef COMPRESS_TESTCASES
-      // fprintf(stderr, "unCOMPRESS (%u)\n", *lenptr);
+        // fprintf(stderr, "unCOMPRESS (%u)\n", *lenptr);
 
-    }
+      }
 
   #endif
 #endif
 
+    }
+
     received = 0;
     while (received < 4 &&
            (ret = recv(s, &status + received, 4 - received, 0)) > 0)
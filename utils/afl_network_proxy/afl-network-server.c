@@ -32,6 +32,8 @@
 #include "forkserver.h"
 #include "sharedmem.h"
 #include "common.h"
+#include "leak_obs.h"
+#include "leakage_testcase.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -74,6 +76,10 @@ static s32 in_len;
 static s32 buf2_len;
 static u32 map_size = MAP_SIZE;
 
+static sharedmem_t leak_obs_shm;       /* Observation shm of the target     */
+static u8 *leak_public, *leak_secret;  /* Split payloads of a leak frame    */
+static u8  leak_frame, leak_want;      /* Last testcase was one, wants bytes*/
+
 static volatile u8 stop_soon;          /* Ctrl-C pressed?                   */
 
 /* See if any bytes are set in the bitmap. */
@@ -283,6 +289,11 @@ static void usage(u8 *argv0) {
 
       "  -i port       - the port to listen for the client to connect to\n\n"
 
+      "Leakage hunting settings:\n"
+
+      "  -L            - observe the stdout of the target and answer leakage\n"
+      "                  testcases from afl-network-client with its digest\n\n"
+
       "Execution control settings:\n"
 
       "  -f file       - input file read by the tested program (stdin)\n"
@@ -309,6 +320,106 @@ static void usage(u8 *argv0) {
 
 }
 
+static void recv_all(int s, void *buf, u32 len, const char *what) {
+
+  u32 received = 0;
+  s32 ret;
+
+  while (received < len &&
+         (ret = recv(s, (u8 *)buf + received, len - received, 0)) > 0)
+    received += ret;
+  if (received != len) FATAL("did not receive %s", what);
+
+}
+
+/* The observation goes ahead of the coverage map, in the same segments. */
+
+#ifndef MSG_MORE
+  #define MSG_MORE 0
+#endif
+
+static void send_more(int s, const void *buf, u32 len) {
+
+  u32 sent = 0;
+  s32 ret;
+
+  while (sent < len &&
+         (ret = send(s, (u8 *)buf + sent, len - sent, MSG_MORE)) > 0)
+    sent += ret;
+  if (sent != len) FATAL("could not send data");
+
+}
+
+/* A leak frame carries public and secret input raw, one after the other.
+   Put them back together into the testcase the target expects. */
+
+static u32 recv_leak_testcase(int s, void **buf, u32 flags) {
+
+  u32  lens[2], len;
+  char *combined;
+
+  recv_all(s, lens, 8, "leak frame lengths");
+
+  /* Both inputs come out of a testcase of at most MAX_FILE bytes, anything
+     longer is a broken frame. Checked before anything is allocated. */
+
+  if (lens[0] > MAX_FILE || lens[1] > MAX_FILE ||
+      (u64)lens[0] + lens[1] > MAX_FILE)
+    FATAL("leak frame too long (%u + %u bytes)", lens[0], lens[1]);
+
+  leak_public = afl_realloc((void **)&leak_public, lens[0] + 1);
+  leak_secret = afl_realloc((void **)&leak_secret, lens[1] + 1);
+  if (unlikely(!leak_public || !leak_secret)) { PFATAL("Alloc"); }
+
+  recv_all(s, leak_public, lens[0], "public input");
+  recv_all(s, leak_secret, lens[1], "secret input");
+
+  create_buffer_from_public_and_secret_inputs(leak_public, lens[0],
+                                              leak_secret, lens[1], &combined,
+                                              &len);
+
+  *buf = afl_realloc(buf, len);
+  if (unlikely(!*buf)) { PFATAL("Alloc"); }
+  memcpy(*buf, combined, len);
+  ck_free(combined);
+
+  leak_frame = 1;
+  leak_want = !!(flags & LEAK_NET_WANT_BYTES);
+  return len;
+
+}
+
+/* Digest and length of what the target let us observe, and the bytes
+   themselves if the client asked for them. The digest is the one afl-fuzz
+   would have taken locally. */
+
+static void send_observation(int s, afl_forkserver_t *fsrv) {
+
+  u8  hdr[16];
+  u64 digest;
+  u32 len, bytes_len = 0;
+
+  if (fsrv->leak_obs_digested) {
+
+    digest = fsrv->leak_obs_digest;
+    len = fsrv->leak_obs->len[0];
+
+  } else {
+
+    len = fsrv->stdout_raw_buffer ? fsrv->stdout_raw_buffer_len : 0;
+    digest = hash64(fsrv->stdout_raw_buffer, len, HASH_CONST);
+    if (leak_want) { bytes_len = len; }
+
+  }
+
+  memcpy(hdr, &digest, 8);
+  memcpy(hdr + 8, &len, 4);
+  memcpy(hdr + 12, &bytes_len, 4);
+  send_more(s, hdr, 16);
+  if (bytes_len) { send_more(s, fsrv->stdout_raw_buffer, bytes_len); }
+
+}
+
 int recv_testcase(int s, void **buf) {
 
   u32    size;
@@ -322,6 +433,20 @@ int recv_testcase(int s, void **buf) {
   if (size == 0) FATAL("did not receive valid size information");
   // fprintf(stderr, "received size information of %d\n", size);
 
+  leak_frame = leak_want = 0;
+
+  if ((size & 0xff000000) == LEAK_NET_FRAME) {
+
+    if (!leak_obs_shm.map) {
+
+      FATAL("Received a leakage testcase, restart with -L");
+
+    }
+
+    return recv_leak_testcase(s, buf, size & ~LEAK_NET_FRAME);
+
+  }
+
   if ((size & 0xff000000) != 0xff000000) {
 
     *buf = afl_realloc(buf, size);
@@ -401,7 +526,7 @@ int main(int argc, char **argv_orig, char **envp) {
 
   if ((send_buf = malloc(map_size + 4)) == NULL) PFATAL("malloc");
 
-  while ((opt = getopt(argc, argv, "+i:f:m:t:QUWh")) > 0) {
+  while ((opt = getopt(argc, argv, "+i:f:m:t:LQUWh")) > 0) {
 
     switch (opt) {
 
@@ -491,6 +616,11 @@ int main(int argc, char **argv_orig, char **envp) {
 
         break;
 
+      case 'L':
+
+        fsrv->leakage_hunting = true;
+        break;
+
       case 'Q':
 
         if (fsrv->qemu_mode) { FATAL("Multiple -Q options not supported"); }
@@ -536,6 +666,23 @@ int main(int argc, char **argv_orig, char **envp) {
   sharedmem_t shm = {0};
   fsrv->trace_bits = afl_shm_init(&shm, map_size, 0);
 
+  if (fsrv->leakage_hunting) {
+
+    /* Targets that observe themselves leave their digest here, see
+       leak_obs.h. */
+
+    fsrv->leak_obs = (struct leak_obs_map *)afl_shm_init(
+        &leak_obs_shm, sizeof(struct leak_obs_map), 1);
+#ifdef USEMMAP
+    setenv(LEAK_OBS_SHM_ENV_VAR, leak_obs_shm.g_shm_file_path, 1);
+#else
+    u8 *shm_str = alloc_printf("%d", leak_obs_shm.shm_id);
+    setenv(LEAK_OBS_SHM_ENV_VAR, shm_str, 1);
+    ck_free(shm_str);
+#endif
+
+  }
+
   in_data = afl_realloc((void **)&in_data, 65536);
   if (unlikely(!in_data)) { PFATAL("Alloc"); }
 
@@ -641,7 +788,9 @@ int main(int argc, char **argv_orig, char **envp) {
   while ((in_len = recv_testcase(s, (void **)&in_data)) > 0) {
 
     // fprintf(stderr, "received %u\n", in_len);
+    if (fsrv->leak_obs) { fsrv->leak_obs->want_bytes = leak_want; }
     (void)run_target(fsrv, use_argv, in_data, in_len, 1);
+    if (leak_frame) { send_observation(s, fsrv); }
 
     memcpy(send_buf + 4, fsrv->trace_bits, fsrv->map_size);
 
@@ -669,9 +818,12 @@ int main(int argc, char **argv_orig, char **envp) {
   out_file = NULL;
 
   afl_shm_deinit(&shm);
+  if (fsrv->leak_obs) { afl_shm_deinit(&leak_obs_shm); }
   afl_fsrv_deinit(fsrv);
   if (fsrv->target_path) { ck_free(fsrv->target_path); }
   afl_free(in_data);
+  afl_free(leak_public);
+  afl_free(leak_secret);
 #if USE_DEFLATE
   afl_free(buf2);
   libdeflate_free_compressor(compressor);
@@ -55,17 +55,16 @@
 #define MAX_CMDLINE_LEN 100000
 #define MAX_CMDLINE_PAR 50000
 
-static char **afl_init_argv(int *argc) {
+/* Split in_buf, which must end in two NULs, into the argv array. */
+
+static char **afl_split_argv(char *in_buf, int *argc) {
 
-  static char  in_buf[MAX_CMDLINE_LEN];
   static char *ret[MAX_CMDLINE_PAR];
 
   char *ptr = in_buf;
   int   rc = 0;
 
-  if (read(0, in_buf, MAX_CMDLINE_LEN - 2) < 0) {}
-
-  while (*ptr && rc < MAX_CMDLINE_PAR) {
+  while (*ptr && rc < MAX_CMDLINE_PAR - 1) {
 
     ret[rc] = ptr;
     if (ret[rc][0] == 0x02 && !ret[rc][1]) ret[rc]++;
@@ -77,12 +76,26 @@ static char **afl_init_argv(int *argc) {
 
   }
 
+  ret[rc] = NULL;
   *argc = rc;
 
   return ret;
 
 }
 
+static __attribute__((unused)) char **afl_init_argv(int *argc) {
+
+  static char in_buf[MAX_CMDLINE_LEN];
+
+  ssize_t len = read(0, in_buf, MAX_CMDLINE_LEN - 2);
+
+  if (len < 0) { len = 0; }
+  in_buf[len] = in_buf[len + 1] = 0;
+
+  return afl_split_argv(in_buf, argc);
+
+}
+
 #undef MAX_CMDLINE_LEN
 #undef MAX_CMDLINE_PAR
 
@@ -0,0 +1,216 @@
+/*
+   american fuzzy lop++ - persistent shared memory argv fuzzing
+   ------------------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   argv-fuzz-inl.h reads the command line from stdin once per process, so
+   every testcase costs a fork. This variant runs the body of main() in a
+   persistent loop instead, with the command line taken from the shared
+   memory testcase. Compile the target with afl-clang-fast/afl-gcc-fast,
+   include
+
+   #include "/path/to/argv-fuzz-shm-inl.h"
+
+   after the standard includes of the file containing main(), rename main()
+   to, say, target_main(), and put
+
+   AFL_ARGV_PERSISTENT_MAIN(1000, target_main)
+
+   after it. This defines a main() that calls target_main(argc, argv) with a
+   fresh argc/argv for every testcase, up to the given number of testcases
+   per process. main() itself is never called again, so this works in C++
+   too. argv uses the format of argv-fuzz-inl.h.
+
+   In leakage hunting mode the testcase is a {"PUBLIC": ..., "SECRET": ...}
+   pair. The command line is then taken from the public input, and the
+   secret is left in afl_argv_secret / afl_argv_secret_len for the target
+   to pick up (a key file, an environment variable, ...).
+
+   Between two runs, the getopt() state is reset. Anything else
+   target_main() leaves behind - other globals, open files, memory - is up
+   to the target. A call to exit() is fine, but ends the persistent process.
+
+   Do not combine with __AFL_FUZZ_INIT(), it is already taken care of.
+   Without afl-cc, the main() of AFL_ARGV_PERSISTENT_MAIN() falls back to
+   reading stdin once, like AFL_INIT_ARGV().
+
+*/
+
+#ifndef _HAVE_ARGV_FUZZ_SHM_INL
+#define _HAVE_ARGV_FUZZ_SHM_INL
+
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "argv-fuzz-inl.h"
+
+#define AFL_ARGV_MAX_LEN 100000
+
+static char         afl_argv_secret[AFL_ARGV_MAX_LEN];
+static unsigned int afl_argv_secret_len;
+
+/* Decode the base64 string after tag in buf, up to the closing quote.
+   Returns the decoded length, or -1 if tag is not there. */
+
+static int afl_argv_b64_field(const char *buf, unsigned int len,
+                              const char *tag, char *out, unsigned int max) {
+
+  const char * end = buf + len, *p = buf;
+  unsigned int tag_len = strlen(tag), bits = 0, n = 0, out_len = 0;
+
+  while (p + tag_len <= end && memcmp(p, tag, tag_len))
+    p++;
+  if (p + tag_len > end) return -1;
+
+  for (p += tag_len; p < end && *p != '"' && out_len < max; ++p) {
+
+    const char *alpha =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char *v = *p ? strchr(alpha, *p) : NULL;
+
+    if (!v) break;
+
+    bits = (bits << 6) | (unsigned int)(v - alpha);
+    n += 6;
+
+    if (n >= 8) {
+
+      n -= 8;
+      out[out_len++] = (char)(bits >> n);
+
+    }
+
+  }
+
+  return out_len;
+
+}
+
+/* Build argv from the testcase in buf. A private copy is split, since the
+   target may well modify its arguments. */
+
+static char **afl_init_argv_buf(const char *buf, unsigned int len,
+                                int *argc) {
+
+  static char in_buf[AFL_ARGV_MAX_LEN];
+
+  int pub_len = afl_argv_b64_field(buf, len, "\"PUBLIC\": \"", in_buf,
+                                   AFL_ARGV_MAX_LEN - 2);
+
+  if (pub_len < 0) {
+
+    /* Not a leakage testcase, the whole buffer is the command line. */
+
+    pub_len = len < AFL_ARGV_MAX_LEN - 2 ? len : AFL_ARGV_MAX_LEN - 2;
+    memcpy(in_buf, buf, pub_len);
+    afl_argv_secret_len = 0;
+
+  } else {
+
+    int sec_len = afl_argv_b64_field(buf, len, "\"SECRET\": \"",
+                                     afl_argv_secret, AFL_ARGV_MAX_LEN - 1);
+    afl_argv_secret_len = sec_len < 0 ? 0 : sec_len;
+
+  }
+
+  afl_argv_secret[afl_argv_secret_len] = 0;
+#ifdef __AFL_LEAK_SECRET
+  __AFL_LEAK_SECRET(afl_argv_secret, afl_argv_secret_len);
+#endif
+  in_buf[pub_len] = in_buf[pub_len + 1] = 0;
+
+  return afl_split_argv(in_buf, argc);
+
+}
+
+/* Make the next getopt() start over. glibc only drops its internal state
+   (e.g. the position inside a group of short options) when optind is 0,
+   the BSDs have optreset for that. */
+
+static __attribute__((unused)) void afl_reset_getopt(void) {
+
+#if defined(__GLIBC__)
+  optind = 0;
+#else
+  optind = 1;
+  #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__OpenBSD__) || defined(__DragonFly__)
+  optreset = 1;
+  #endif
+#endif
+  optarg = NULL;
+  opterr = 1;
+
+}
+
+#ifdef __AFL_LOOP
+int                   __afl_sharedmem_fuzzing = 1;
+extern unsigned int * __afl_fuzz_len;
+extern unsigned char *__afl_fuzz_ptr;
+#endif
+
+/* The next testcase, from shared memory or, if afl-fuzz does not provide
+   it that way, from stdin. */
+
+static char **afl_next_argv(int *argc) {
+
+  static char stdin_buf[AFL_ARGV_MAX_LEN];
+  ssize_t     len;
+
+#ifdef __AFL_LOOP
+  if (__afl_fuzz_ptr) {
+
+    return afl_init_argv_buf((char *)__afl_fuzz_ptr, *__afl_fuzz_len, argc);
+
+  }
+
+#endif
+
+  len = read(0, stdin_buf, AFL_ARGV_MAX_LEN);
+  if (len < 0) len = 0;
+  lseek(0, 0, SEEK_SET);
+
+  return afl_init_argv_buf(stdin_buf, len, argc);
+
+}
+
+#ifdef __AFL_LOOP
+
+  #define AFL_ARGV_PERSISTENT_MAIN(_n, _fn)    \
+    int main(int argc, char **argv) {          \
+                                               \
+      int _afl_ret = 0;                        \
+                                               \
+      while (__AFL_LOOP(_n)) {                 \
+                                               \
+        argv = afl_next_argv(&argc);           \
+        afl_reset_getopt();                    \
+        _afl_ret = _fn(argc, argv);            \
+                                               \
+      }                                        \
+                                               \
+      return _afl_ret;                         \
+                                               \
+    }
+
+#else
+
+  #define AFL_ARGV_PERSISTENT_MAIN(_n, _fn)    \
+    int main(int argc, char **argv) {          \
+                                               \
+      (void)(_n);                              \
+      argv = afl_next_argv(&argc);             \
+      return _fn(argc, argv);                  \
+                                               \
+    }
+
+#endif                                                       /* ^__AFL_LOOP */
+
+#endif                                          /* !_HAVE_ARGV_FUZZ_SHM_INL */
+
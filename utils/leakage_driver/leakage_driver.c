@@ -0,0 +1,345 @@
+/*
+   american fuzzy lop++ - in-process leakage driver
+   ------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A persistent mode driver for leakage hunting, in the spirit of
+   aflpp_driver. The harness provides
+
+     int LLVMFuzzerTestLeakage(const uint8_t *pub, size_t pub_len,
+                               const uint8_t *sec, size_t sec_len);
+
+   which runs the code under test and writes whatever an attacker gets to
+   see to stdout. Optionally, LLVMFuzzerLeakageReset() puts back any global
+   state between two runs, and LLVMFuzzerInitialize() works as in libFuzzer.
+
+   Normal testcases ({"PUBLIC": ..., "SECRET": ...}) run once, their output
+   goes to afl-fuzz through the stdout pipe as usual. Batch testcases (see
+   include/leak_obs.h) run once per secret, with stdout captured in a
+   temporary file; each observation is hashed the way afl-fuzz hashes
+   stdout, and only the digests travel back, in the leak_obs_map. With
+   AFL_LEAK_BATCH=1, afl-fuzz pairs public inputs with a whole batch of
+   pooled secrets in a single exec.
+
+   Build:
+
+     afl-clang-fast -c leakage_driver.c -I../../include
+     afl-clang-fast -o fuzz harness.c leakage_driver.o
+
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "types.h"
+#include "leak_obs.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#undef XXH_INLINE_ALL
+
+int LLVMFuzzerTestLeakage(const uint8_t *pub, size_t pub_len,
+                          const uint8_t *sec, size_t sec_len);
+__attribute__((weak)) void LLVMFuzzerLeakageReset(void);
+__attribute__((weak)) int  LLVMFuzzerInitialize(int *argc, char ***argv);
+
+// Notify AFL about persistent mode.
+static volatile char AFL_PERSISTENT[] __attribute__((used)) =
+    "##SIG_AFL_PERSISTENT##";
+int                  __afl_persistent_loop(unsigned int);
+
+// Notify AFL about deferred forkserver.
+static volatile char AFL_DEFER_FORKSVR[] __attribute__((used)) =
+    "##SIG_AFL_DEFER_FORKSRV##";
+void                 __afl_manual_init();
+
+int                         __afl_sharedmem_fuzzing = 1;
+extern unsigned int *       __afl_fuzz_len;
+extern unsigned char *      __afl_fuzz_ptr;
+extern struct leak_obs_map *__afl_leak_obs;
+extern unsigned char *      __afl_area_ptr;
+extern unsigned int         __afl_map_size;
+
+static u8 *input_buf, *public_buf, *secret_buf, *capture_buf, *trace_max;
+static u32 capture_size;
+static int capture_fd = -1, stdout_fd = -1;
+
+/* Decode base64 up to the closing quote. Returns the decoded length. */
+
+static u32 b64_decode(const u8 *in, const u8 *end, u8 *out) {
+
+  u32 bits = 0, n = 0, len = 0;
+
+  for (; in < end && *in != '"'; ++in) {
+
+    u8 c = *in, v;
+
+    if (c >= 'A' && c <= 'Z') {
+
+      v = c - 'A';
+
+    } else if (c >= 'a' && c <= 'z') {
+
+      v = c - 'a' + 26;
+
+    } else if (c >= '0' && c <= '9') {
+
+      v = c - '0' + 52;
+
+    } else if (c == '+') {
+
+      v = 62;
+
+    } else if (c == '/') {
+
+      v = 63;
+
+    } else {
+
+      break;
+
+    }
+
+    bits = (bits << 6) | v;
+    n += 6;
+
+    if (n >= 8) {
+
+      n -= 8;
+      out[len++] = bits >> n;
+
+    }
+
+  }
+
+  return len;
+
+}
+
+static u32 json_field(const u8 *buf, u32 len, const char *tag, u8 *out) {
+
+  const u8 *p = memmem(buf, len, tag, strlen(tag));
+  if (!p) { return 0; }
+  p += strlen(tag);
+  return b64_decode(p, buf + len, out);
+
+}
+
+/* Summed up, the hit counts of a batch would look like new coverage every
+   time. Keep the highest count of any single run instead, and start each
+   run with a clean map. */
+
+static void trace_merge(void) {
+
+  u64 *cur = (u64 *)__afl_area_ptr, *max = (u64 *)trace_max;
+  u32  i, j;
+
+  for (i = 0; i < __afl_map_size / 8; ++i) {
+
+    if (!cur[i]) { continue; }
+
+    u8 *c = (u8 *)&cur[i], *m = (u8 *)&max[i];
+
+    for (j = 0; j < 8; ++j) {
+
+      if (c[j] > m[j]) { m[j] = c[j]; }
+
+    }
+
+    cur[i] = 0;
+
+  }
+
+}
+
+static void run_one(const u8 *pub, u32 pub_len, const u8 *sec, u32 sec_len) {
+
+#ifdef __AFL_LEAK_SECRET
+  __AFL_LEAK_SECRET(sec, sec_len);
+#endif
+  LLVMFuzzerTestLeakage(pub, pub_len, sec, sec_len);
+  fflush(stdout);
+
+}
+
+/* Run every secret of the batch against the public input, and leave a
+   digest of each one's output in the shm. Harnesses that observe their
+   output with __AFL_LEAK_OBSERVE() leave their digest in the first slot,
+   so the digests are collected here and only published at the end. */
+
+static void run_batch(u8 *buf, u32 len) {
+
+  struct leak_batch_header *hdr = (struct leak_batch_header *)buf;
+  u8 *                      pos = buf + sizeof(*hdr);
+  u32                       i;
+  u64                       total = sizeof(*hdr) + (u64)hdr->public_len;
+  u64                       digest[LEAK_BATCH_MAX];
+  u32                       digest_len[LEAK_BATCH_MAX];
+
+  /* At most LEAK_BATCH_MAX lengths of 32 bits each, the sum cannot wrap. */
+
+  if (hdr->count > LEAK_BATCH_MAX) { return; }
+  for (i = 0; i < hdr->count; ++i) {
+
+    total += hdr->secret_len[i];
+
+  }
+
+  if (total > len) { return; }
+
+  u8 *pub = pos;
+  pos += hdr->public_len;
+
+  if (!trace_max) {
+
+    trace_max = malloc(__afl_map_size);
+    if (!trace_max) { abort(); }
+
+  }
+
+  memset(trace_max, 0, __afl_map_size);
+
+  for (i = 0; i < hdr->count; ++i) {
+
+    fflush(stdout);
+    dup2(capture_fd, STDOUT_FILENO);
+    lseek(capture_fd, 0, SEEK_SET);
+
+    if (i && LLVMFuzzerLeakageReset) { LLVMFuzzerLeakageReset(); }
+    __afl_leak_obs->count = 0;
+    run_one(pub, hdr->public_len, pos, hdr->secret_len[i]);
+    pos += hdr->secret_len[i];
+
+    if (__afl_leak_obs->count) {
+
+      digest[i] = __afl_leak_obs->digest[0];
+      digest_len[i] = __afl_leak_obs->len[0];
+      trace_merge();
+      continue;
+
+    }
+
+    off_t out_len = lseek(capture_fd, 0, SEEK_CUR);
+    if (out_len < 0) { out_len = 0; }
+
+    if ((u32)out_len > capture_size) {
+
+      capture_size = out_len;
+      capture_buf = realloc(capture_buf, capture_size);
+      if (!capture_buf) { abort(); }
+
+    }
+
+    if (out_len && pread(capture_fd, capture_buf, out_len, 0) != out_len) {
+
+      abort();
+
+    }
+
+    digest[i] = XXH64(capture_buf, out_len, HASH_CONST);
+    digest_len[i] = out_len;
+
+    trace_merge();
+
+  }
+
+  memcpy(__afl_area_ptr, trace_max, __afl_map_size);
+  dup2(stdout_fd, STDOUT_FILENO);
+  memcpy(__afl_leak_obs->digest, digest, hdr->count * sizeof(u64));
+  memcpy(__afl_leak_obs->len, digest_len, hdr->count * sizeof(u32));
+  __afl_leak_obs->count = hdr->count;
+
+}
+
+static void run_testcase(u8 *buf, u32 len) {
+
+  if (__afl_leak_obs && len >= sizeof(struct leak_batch_header) &&
+      *(u64 *)buf == LEAK_BATCH_MAGIC) {
+
+    run_batch(buf, len);
+    return;
+
+  }
+
+  u32 pub_len = json_field(buf, len, "\"PUBLIC\": \"", public_buf);
+  u32 sec_len = json_field(buf, len, "\"SECRET\": \"", secret_buf);
+
+  run_one(public_buf, pub_len, secret_buf, sec_len);
+
+}
+
+int main(int argc, char **argv) {
+
+  if (LLVMFuzzerInitialize) { LLVMFuzzerInitialize(&argc, &argv); }
+
+  input_buf = malloc(MAX_FILE);
+  public_buf = malloc(MAX_FILE);
+  secret_buf = malloc(MAX_FILE);
+  if (!input_buf || !public_buf || !secret_buf) { abort(); }
+
+  FILE *f = tmpfile();
+  if (!f || (capture_fd = dup(fileno(f))) < 0 ||
+      (stdout_fd = dup(STDOUT_FILENO)) < 0) {
+
+    perror("leakage_driver: unable to set up output capture");
+    abort();
+
+  }
+
+  fclose(f);
+
+  int N = INT_MAX;
+  if (argc == 2 && argv[1][0] == '-' && argv[1][1]) { N = atoi(argv[1] + 1); }
+
+  __afl_manual_init();
+
+  while (__afl_persistent_loop(N)) {
+
+    u8 *buf = __afl_fuzz_ptr;
+    u32 len;
+
+    if (__afl_leak_obs) {
+
+      __afl_leak_obs->batch_max = LEAK_BATCH_MAX;
+      __afl_leak_obs->count = 0;
+
+    }
+
+    if (buf) {
+
+      len = *__afl_fuzz_len;
+
+    } else {
+
+      ssize_t r;
+
+      lseek(STDIN_FILENO, 0, SEEK_SET);
+      r = read(STDIN_FILENO, input_buf, MAX_FILE);
+      len = r > 0 ? r : 0;
+      buf = input_buf;
+
+    }
+
+    if (len) { run_testcase(buf, len); }
+    if (LLVMFuzzerLeakageReset) { LLVMFuzzerLeakageReset(); }
+
+  }
+
+  return 0;
+
+}
+
@@ -0,0 +1,39 @@
+/*
+   Example harness for leakage_driver: a password check that returns as
+   soon as a byte differs, and reports how many bytes it compared.
+
+   The public input is the guess, the secret is the password.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+static unsigned long checks;
+
+int LLVMFuzzerTestLeakage(const uint8_t *pub, size_t pub_len,
+                          const uint8_t *sec, size_t sec_len) {
+
+  size_t i;
+
+  ++checks;
+
+  for (i = 0; i < pub_len && i < sec_len; ++i) {
+
+    if (pub[i] != sec[i]) { break; }
+
+  }
+
+  printf("compared %zu bytes\n", i);
+  return 0;
+
+}
+
+/* Not needed here, but this is where global state gets put back. */
+
+void LLVMFuzzerLeakageReset(void) {
+
+  checks = 0;
+
+}
+
@@ -0,0 +1,887 @@
+/*
+   american fuzzy lop++ - leakage-aware socket proxy
+   -------------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Runs as the target of afl-fuzz and speaks the fork server protocol itself,
+   like utils/afl_proxy. Every testcase is taken apart: the public input is
+   sent to a TCP server as client traffic, the secret reaches the server
+   through a file or its environment. What the server sends back is hashed
+   as it arrives and the digest is left in the observation shm (see
+   include/leak_obs.h), so the response only goes through the stdout pipe
+   when afl-fuzz asks for the bytes of a leak.
+
+   The server either runs already, or is started with the command after
+   '--'. An instrumented server started this way writes its coverage into
+   the map of afl-fuzz directly, and its crashes are reported as crashes.
+
+   A response ends when the server closes the connection, with a length
+   prefix (-l) or a delimiter (-d) if the protocol has them, and otherwise
+   when the server has been quiet for a while (-t).
+
+   See README.md for more info.
+
+ */
+
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+  #include <sys/prctl.h>
+#endif
+
+#include "config.h"
+#include "types.h"
+#include "leak_obs.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#undef XXH_INLINE_ALL
+
+#define MAX_DELIM 32
+
+static u8 *                 trace_bits;
+static u32                  map_size = MAP_SIZE;
+static struct leak_obs_map *obs;
+
+static char * host = "127.0.0.1", *port, *secret_file, *secret_env;
+static char **server_argv;
+static u8     keep_alive, reloads;
+static u32    idle_ms = 100, wait_ms = 5000, len_prefix;
+static u8     delim[MAX_DELIM];
+static u32    delim_len;
+
+static struct addrinfo *server_addr;
+static pid_t            server_pid;
+static int              server_status, conn = -1;
+
+static u8 *input, *public_buf, *secret_buf, *last_secret;
+static u32 input_size, public_len, secret_len, last_secret_len;
+static u8  have_secret;
+
+static u8 recv_buf[65536];
+
+static void die(const char *msg) {
+
+  fprintf(stderr, "afl-leak-socket: %s%s%s\n", msg, errno ? ": " : "",
+          errno ? strerror(errno) : "");
+  if (server_pid > 0) { kill(server_pid, SIGKILL); }
+  exit(1);
+
+}
+
+/* Map one of the shms of afl-fuzz, NULL if not run by it. *size is cut
+   down to what afl-fuzz allocated, if that is less. */
+
+static void *map_shm(const char *env, u32 *size) {
+
+  char *id_str = getenv(env);
+  void *ptr;
+
+  if (!id_str) { return NULL; }
+
+#ifdef USEMMAP
+  struct stat st;
+  int         shm_fd = shm_open(id_str, O_RDWR, DEFAULT_PERMISSION);
+  if (shm_fd == -1) { die("shm_open() failed"); }
+
+  if (!fstat(shm_fd, &st) && st.st_size < *size) { *size = st.st_size; }
+
+  ptr = mmap(0, *size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  close(shm_fd);
+  if (ptr == MAP_FAILED) { die("mmap() failed"); }
+#else
+  struct shmid_ds ds;
+  int             shm_id = atoi(id_str);
+
+  if (!shmctl(shm_id, IPC_STAT, &ds) && ds.shm_segsz < *size) {
+
+    *size = ds.shm_segsz;
+
+  }
+
+  ptr = shmat(shm_id, NULL, 0);
+  if (ptr == (void *)-1) { die("shmat() failed"); }
+#endif
+
+  return ptr;
+
+}
+
+/* Decode base64 up to the closing quote. Returns the decoded length. */
+
+static u32 b64_decode(const u8 *in, const u8 *end, u8 *out) {
+
+  u32 bits = 0, n = 0, len = 0;
+
+  for (; in < end && *in != '"'; ++in) {
+
+    u8 c = *in, v;
+
+    if (c >= 'A' && c <= 'Z') {
+
+      v = c - 'A';
+
+    } else if (c >= 'a' && c <= 'z') {
+
+      v = c - 'a' + 26;
+
+    } else if (c >= '0' && c <= '9') {
+
+      v = c - '0' + 52;
+
+    } else if (c == '+') {
+
+      v = 62;
+
+    } else if (c == '/') {
+
+      v = 63;
+
+    } else {
+
+      break;
+
+    }
+
+    bits = (bits << 6) | v;
+    n += 6;
+
+    if (n >= 8) {
+
+      n -= 8;
+      out[len++] = bits >> n;
+
+    }
+
+  }
+
+  return len;
+
+}
+
+static u32 json_field(const u8 *buf, u32 len, const char *tag, u8 *out) {
+
+  const u8 *p = memmem(buf, len, tag, strlen(tag));
+  if (!p) { return 0; }
+  p += strlen(tag);
+  return b64_decode(p, buf + len, out);
+
+}
+
+/* Read the whole testcase from stdin, afl-fuzz rewinds it for every run. */
+
+static u32 read_testcase(void) {
+
+  u32     len = 0;
+  ssize_t n;
+
+  lseek(0, 0, SEEK_SET);
+
+  while ((n = read(0, input + len, input_size - len)) > 0) {
+
+    len += n;
+
+    if (len == input_size) {
+
+      input_size *= 2;
+      input = realloc(input, input_size);
+      public_buf = realloc(public_buf, input_size);
+      secret_buf = realloc(secret_buf, input_size);
+      last_secret = realloc(last_secret, input_size);
+      if (!input || !public_buf || !secret_buf || !last_secret) {
+
+        die("out of memory");
+
+      }
+
+    }
+
+  }
+
+  return len;
+
+}
+
+/* Hand the secret to the server file the atomic way, so that a server
+   reading it at the wrong moment never sees half of it. */
+
+static void write_secret_file(void) {
+
+  char tmp[PATH_MAX];
+  int  fd;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", secret_file);
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) { die("unable to write the secret file"); }
+  if (write(fd, secret_buf, secret_len) != (ssize_t)secret_len) {
+
+    die("short write to the secret file");
+
+  }
+
+  close(fd);
+  if (rename(tmp, secret_file)) { die("unable to rename the secret file"); }
+
+}
+
+static void close_conn(void) {
+
+  if (conn >= 0) {
+
+    close(conn);
+    conn = -1;
+
+  }
+
+}
+
+static void stop_server(void) {
+
+  close_conn();
+
+  if (server_pid > 0) {
+
+    kill(server_pid, SIGKILL);
+    waitpid(server_pid, NULL, 0);
+    server_pid = 0;
+
+  }
+
+}
+
+/* Start the server with the current secret. It inherits the coverage map,
+   but not the fork server descriptors or the observation shm, which are
+   ours, nor stdin and stdout, which carry testcase and observation. */
+
+static void start_server(void) {
+
+  int null_fd = open("/dev/null", O_RDWR);
+
+  if (null_fd < 0) { die("unable to open /dev/null"); }
+
+  server_pid = fork();
+  if (server_pid < 0) { die("fork() failed"); }
+
+  if (!server_pid) {
+
+#ifdef __linux__
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+
+    close(FORKSRV_FD);
+    close(FORKSRV_FD + 1);
+    dup2(null_fd, 0);
+    dup2(null_fd, 1);
+    close(null_fd);
+
+    unsetenv(LEAK_OBS_SHM_ENV_VAR);
+    unsetenv(SHM_FUZZ_ENV_VAR);
+
+    if (secret_env) {
+
+      /* The environment ends a secret at its first NUL byte. */
+
+      secret_buf[secret_len] = 0;
+      setenv(secret_env, (char *)secret_buf, 1);
+
+    }
+
+    execvp(server_argv[0], server_argv);
+    fprintf(stderr, "afl-leak-socket: unable to execute '%s': %s\n",
+            server_argv[0], strerror(errno));
+    _exit(1);
+
+  }
+
+  close(null_fd);
+
+}
+
+/* Ask an instrumented server for the size of its coverage map: start it
+   once with a fork server pipe of our own, take the size from its hello and
+   kill it. A server that does not say hello in time gets MAP_SIZE. */
+
+static u32 probe_map_size(void) {
+
+  int           ctl_pipe[2], st_pipe[2];
+  u32           status = 0;
+  pid_t         pid;
+  struct pollfd pfd;
+
+  if (pipe(ctl_pipe) || pipe(st_pipe)) { die("pipe() failed"); }
+
+  pid = fork();
+  if (pid < 0) { die("fork() failed"); }
+
+  if (!pid) {
+
+    int null_fd = open("/dev/null", O_RDWR);
+
+    if (dup2(ctl_pipe[0], FORKSRV_FD) < 0 ||
+        dup2(st_pipe[1], FORKSRV_FD + 1) < 0) {
+
+      _exit(1);
+
+    }
+
+    close(ctl_pipe[0]);
+    close(ctl_pipe[1]);
+    close(st_pipe[0]);
+    close(st_pipe[1]);
+
+    if (null_fd >= 0) {
+
+      dup2(null_fd, 0);
+      dup2(null_fd, 1);
+      close(null_fd);
+
+    }
+
+    unsetenv(SHM_ENV_VAR);
+    unsetenv(LEAK_OBS_SHM_ENV_VAR);
+    unsetenv(SHM_FUZZ_ENV_VAR);
+
+    execvp(server_argv[0], server_argv);
+    _exit(1);
+
+  }
+
+  close(ctl_pipe[0]);
+  close(st_pipe[1]);
+
+  pfd.fd = st_pipe[0];
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, wait_ms) <= 0 || read(st_pipe[0], &status, 4) != 4) {
+
+    status = 0;
+
+  }
+
+  close(ctl_pipe[1]);
+  close(st_pipe[0]);
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+
+  if ((status & FS_OPT_ENABLED) && (status & FS_OPT_MAPSIZE)) {
+
+    return FS_OPT_GET_MAPSIZE(status);
+
+  }
+
+  return MAP_SIZE;
+
+}
+
+/* Connect to the server, retrying while it is coming up. */
+
+static void open_conn(void) {
+
+  struct addrinfo *ai;
+  struct timespec  delay = {0, 10 * 1000 * 1000};
+  u32              waited = 0;
+  int              one = 1;
+
+  while (1) {
+
+    for (ai = server_addr; ai; ai = ai->ai_next) {
+
+      conn = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (conn < 0) { continue; }
+      if (!connect(conn, ai->ai_addr, ai->ai_addrlen)) { break; }
+      close(conn);
+      conn = -1;
+
+    }
+
+    if (conn >= 0) { break; }
+
+    if (server_pid > 0 &&
+        waitpid(server_pid, &server_status, WNOHANG) == server_pid) {
+
+      server_pid = 0;
+      break;
+
+    }
+
+    if (waited >= wait_ms) { die("unable to connect to the server"); }
+    nanosleep(&delay, NULL);
+    waited += 10;
+
+  }
+
+  if (conn >= 0) {
+
+    setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  }
+
+}
+
+static u8 send_all(const u8 *buf, u32 len) {
+
+  while (len) {
+
+    ssize_t n = send(conn, buf, len, MSG_NOSIGNAL);
+    if (n <= 0) { return 0; }
+    buf += n;
+    len -= n;
+
+  }
+
+  return 1;
+
+}
+
+static void write_all(int fd, const u8 *buf, u32 len) {
+
+  while (len) {
+
+    ssize_t n = write(fd, buf, len);
+    if (n <= 0) { return; }
+    buf += n;
+    len -= n;
+
+  }
+
+}
+
+/* Drop whatever the server sent after the end of the last response, so
+   that it does not count for this run. */
+
+static void drain_conn(void) {
+
+  while (conn >= 0) {
+
+    ssize_t n = recv(conn, recv_buf, sizeof(recv_buf), MSG_DONTWAIT);
+
+    if (n > 0) { continue; }
+    if (n < 0 && errno == EINTR) { continue; }
+    if (!n || (errno != EAGAIN && errno != EWOULDBLOCK)) { close_conn(); }
+    break;
+
+  }
+
+}
+
+/* How many of the n bytes at buf, received after total bytes of the
+   response, still belong to it. Sets *done if the response ends there,
+   going by the length prefix or the delimiter. */
+
+static u32 response_part(const u8 *buf, u32 n, u64 total, u8 *done) {
+
+  static u8  window[MAX_DELIM];
+  static u64 want;
+  u32        i;
+
+  if (!total) { want = 0; }
+
+  if (len_prefix) {
+
+    for (i = 0; i < n && total + i < len_prefix; ++i) {
+
+      want = (want << 8) | buf[i];
+
+    }
+
+    if (total + n < len_prefix) { return n; }
+    if (total + n < len_prefix + want) { return n; }
+
+    *done = 1;
+    return len_prefix + want - total;
+
+  }
+
+  if (delim_len) {
+
+    for (i = 0; i < n; ++i) {
+
+      memmove(window, window + 1, delim_len - 1);
+      window[delim_len - 1] = buf[i];
+
+      if (total + i + 1 >= delim_len && !memcmp(window, delim, delim_len)) {
+
+        *done = 1;
+        return i + 1;
+
+      }
+
+    }
+
+  }
+
+  return n;
+
+}
+
+/* Send the public input and hash the response as it comes in, until it is
+   complete (see response_part()), the server closes the connection or has
+   been quiet for idle_ms. The bytes are not kept, unless afl-fuzz wants
+   them (or is not hunting leaks). */
+
+static void run_once(void) {
+
+  XXH64_state_t state;
+  u64           total = 0;
+  u8            to_stdout = !obs || obs->want_bytes, done = 0;
+
+  XXH64_reset(&state, HASH_CONST);
+
+  drain_conn();
+  if (conn < 0 && (!server_argv || server_pid > 0)) { open_conn(); }
+
+  if (conn >= 0 && send_all(public_buf, public_len)) {
+
+    struct pollfd pfd = {.fd = conn, .events = POLLIN};
+
+    if (!keep_alive) { shutdown(conn, SHUT_WR); }
+
+    while (!done && poll(&pfd, 1, idle_ms) > 0) {
+
+      ssize_t n = recv(conn, recv_buf, sizeof(recv_buf), 0);
+
+      if (n <= 0) {
+
+        close_conn();
+        break;
+
+      }
+
+      n = response_part(recv_buf, n, total, &done);
+      XXH64_update(&state, recv_buf, n);
+      total += n;
+      if (to_stdout) { write_all(STDOUT_FILENO, recv_buf, n); }
+
+    }
+
+  } else {
+
+    close_conn();
+
+  }
+
+  if (!keep_alive) { close_conn(); }
+
+  if (obs) {
+
+    obs->digest[0] = XXH64_digest(&state);
+    obs->len[0] = total;
+    obs->count = 1;
+
+  }
+
+}
+
+/* Take the delimiter of -d, with \n, \r, \t, \\ and \xHH escapes. */
+
+static void parse_delim(const char *str) {
+
+  while (*str) {
+
+    u8 c = *str++;
+
+    if (c == '\\' && *str) {
+
+      c = *str++;
+
+      if (c == 'n') {
+
+        c = '\n';
+
+      } else if (c == 'r') {
+
+        c = '\r';
+
+      } else if (c == 't') {
+
+        c = '\t';
+
+      } else if (c == 'x' && str[0] && str[1]) {
+
+        char hex[3] = {str[0], str[1], 0};
+        c = strtoul(hex, NULL, 16);
+        str += 2;
+
+      }
+
+    }
+
+    if (delim_len >= MAX_DELIM) {
+
+      fprintf(stderr, "afl-leak-socket: -d takes up to %u bytes\n", MAX_DELIM);
+      exit(1);
+
+    }
+
+    delim[delim_len++] = c;
+
+  }
+
+}
+
+static void usage(char *argv0) {
+
+  fprintf(stderr,
+          "Usage: %s [options] -p port [-- /path/to/server args]\n\n"
+          "  -h host    - host of the server (default: 127.0.0.1)\n"
+          "  -p port    - TCP port of the server\n"
+          "  -s file    - write the secret to this file\n"
+          "  -e name    - put the secret in this environment variable of the\n"
+          "               server\n"
+          "  -r         - the server reads the secret file for every\n"
+          "               connection, no restart when it changes\n"
+          "  -k         - keep the connection open from run to run\n"
+          "  -l bytes   - responses start with their length, big endian, in\n"
+          "               1, 2, 4 or 8 bytes that do not count themselves\n"
+          "  -d delim   - responses end with delim (\\n, \\r, \\t, \\xHH)\n"
+          "  -t msec    - the response is complete after msec without data\n"
+          "               (default: 100)\n"
+          "  -w msec    - how long the server may take to accept (default: "
+          "5000)\n\n"
+          "The public input of every testcase is sent to the server, the "
+          "secret reaches\nit through -s or -e. A server given after '--' "
+          "is started by %s, and\nrestarted whenever the secret changes "
+          "(unless -r).\n",
+          argv0, argv0);
+  exit(1);
+
+}
+
+int main(int argc, char **argv) {
+
+  u32 status = 0;
+  s32 opt;
+
+  while ((opt = getopt(argc, argv, "h:p:s:e:rkl:d:t:w:")) > 0) {
+
+    switch (opt) {
+
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = optarg;
+        break;
+      case 's':
+        secret_file = optarg;
+        break;
+      case 'e':
+        secret_env = optarg;
+        break;
+      case 'r':
+        reloads = 1;
+        break;
+      case 'k':
+        keep_alive = 1;
+        break;
+      case 'l':
+        len_prefix = atoi(optarg);
+        if (len_prefix != 1 && len_prefix != 2 && len_prefix != 4 &&
+            len_prefix != 8) {
+
+          usage(argv[0]);
+
+        }
+
+        break;
+      case 'd':
+        parse_delim(optarg);
+        if (!delim_len) { usage(argv[0]); }
+        break;
+      case 't':
+        idle_ms = atoi(optarg);
+        break;
+      case 'w':
+        wait_ms = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+
+    }
+
+  }
+
+  if (!port) { usage(argv[0]); }
+  if (optind < argc) { server_argv = argv + optind; }
+
+  struct addrinfo hints = {.ai_socktype = SOCK_STREAM};
+  if (getaddrinfo(host, port, &hints, &server_addr)) {
+
+    fprintf(stderr, "afl-leak-socket: unable to resolve %s:%s\n", host, port);
+    exit(1);
+
+  }
+
+  if (secret_env && !server_argv) {
+
+    fprintf(stderr, "afl-leak-socket: -e needs the server command\n");
+    exit(1);
+
+  }
+
+  /* A running server never sees a new environment: it has to restart. */
+
+  if (reloads && (!secret_file || secret_env)) {
+
+    fprintf(stderr, "afl-leak-socket: -r needs -s, and cannot go with -e\n");
+    exit(1);
+
+  }
+
+  input_size = 65536;
+  input = malloc(input_size);
+  public_buf = malloc(input_size);
+  secret_buf = malloc(input_size);
+  last_secret = malloc(input_size);
+  if (!input || !public_buf || !secret_buf || !last_secret) {
+
+    die("out of memory");
+
+  }
+
+  if (len_prefix && delim_len) {
+
+    fprintf(stderr, "afl-leak-socket: -l and -d are mutually exclusive\n");
+    exit(1);
+
+  }
+
+  /* The coverage map is as large as the server says, or as AFL_MAP_SIZE
+     for a server that we do not start. */
+
+  if (server_argv && getenv(SHM_ENV_VAR)) {
+
+    map_size = probe_map_size();
+
+  } else if (getenv("AFL_MAP_SIZE") && atoi(getenv("AFL_MAP_SIZE")) > 0) {
+
+    map_size = atoi(getenv("AFL_MAP_SIZE"));
+
+  }
+
+  if (map_size > FS_OPT_MAX_MAPSIZE) { map_size = FS_OPT_MAX_MAPSIZE; }
+
+  /* If the map of afl-fuzz is smaller, it starts us again with a larger
+     one once it knows the size. */
+
+  u32 obs_size = sizeof(struct leak_obs_map);
+  status = FS_OPT_ENABLED | FS_OPT_MAPSIZE | FS_OPT_SET_MAPSIZE(map_size);
+  trace_bits = map_shm(SHM_ENV_VAR, &map_size);
+  obs = map_shm(LEAK_OBS_SHM_ENV_VAR, &obs_size);
+
+  /* Tell afl-fuzz we are up. Without it, run once on stdin and exit, to try
+     the setup by hand. */
+
+  if (write(FORKSRV_FD + 1, &status, 4) != 4) {
+
+    u32 len = read_testcase();
+    public_len = json_field(input, len, "\"PUBLIC\": \"", public_buf);
+    secret_len = json_field(input, len, "\"SECRET\": \"", secret_buf);
+    if (secret_file) { write_secret_file(); }
+    if (server_argv) { start_server(); }
+    run_once();
+    stop_server();
+    return 0;
+
+  }
+
+  if (trace_bits) { trace_bits[0] = 1; }
+
+  while (1) {
+
+    u32 was_killed, len;
+    s32 pid = 0xffffff;
+
+    if (read(FORKSRV_FD, &was_killed, 4) != 4) { break; }
+
+    len = read_testcase();
+    public_len = json_field(input, len, "\"PUBLIC\": \"", public_buf);
+    secret_len = json_field(input, len, "\"SECRET\": \"", secret_buf);
+
+    /* There is no child to kill, the server stays up. */
+
+    if (write(FORKSRV_FD + 1, &pid, 4) != 4) { break; }
+
+    server_status = 0;
+
+    if (!have_secret || secret_len != last_secret_len ||
+        memcmp(secret_buf, last_secret, secret_len)) {
+
+      if (secret_file) { write_secret_file(); }
+      if (server_argv && !reloads) { stop_server(); }
+      close_conn();
+
+      memcpy(last_secret, secret_buf, secret_len);
+      last_secret_len = secret_len;
+      have_secret = 1;
+
+    }
+
+    if (server_pid > 0 &&
+        waitpid(server_pid, &server_status, WNOHANG) == server_pid) {
+
+      server_pid = 0;
+      server_status = 0;
+      close_conn();
+
+    }
+
+    if (server_argv && !server_pid) {
+
+      start_server();
+
+      /* What the server did to come up does not depend on the public
+         input, and depends on the secret only in runs that restart it. */
+
+      open_conn();
+      if (trace_bits) { memset(trace_bits, 0, map_size); }
+
+    }
+
+    run_once();
+
+    /* A server that died on this input crashed on it. */
+
+    if (server_pid > 0 &&
+        waitpid(server_pid, &server_status, WNOHANG) == server_pid) {
+
+      server_pid = 0;
+      close_conn();
+
+    }
+
+    status = WIFSIGNALED(server_status) ? server_status : 0;
+    if (write(FORKSRV_FD + 1, &status, 4) != 4) { break; }
+
+  }
+
+  stop_server();
+  return 0;
+
+}
+
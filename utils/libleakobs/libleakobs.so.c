@@ -0,0 +1,319 @@
+/*
+   american fuzzy lop++ - leakage observation shim
+   -----------------------------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   This Linux-only companion library observes targets that cannot be
+   rebuilt for leakage hunting: uninstrumented (-n) ones and binary-only
+   ones. It interposes write(), writev(), send() and fwrite() on the
+   observed descriptors, feeds whatever they write into a running XXH64,
+   and publishes digest and length in the observation shm of afl-fuzz
+   (see include/leak_obs.h) after every write.
+
+   What goes to stdout is normally kept from the pipe altogether, afl-fuzz
+   compares the digest. Only while it sets want_bytes, to store a leak, the
+   bytes are written out; those written to other observed descriptors are
+   then copied to stdout as well, in the order they were hashed.
+
+   See README.md for more info.
+
+ */
+
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+
+#include "config.h"
+#include "types.h"
+#include "leak_obs.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#undef XXH_INLINE_ALL
+
+#if !defined __linux__
+  #error "Sorry, this library is unsupported in this platform for now!"
+#endif
+
+static ssize_t (*real_write)(int, const void *, size_t);
+static ssize_t (*real_writev)(int, const struct iovec *, int);
+static ssize_t (*real_send)(int, const void *, size_t, int);
+static size_t (*real_fwrite)(const void *, size_t, size_t, FILE *);
+
+static struct leak_obs_map *obs;
+static u8                   observed[LEAK_OBS_MAX_FD];
+static XXH64_state_t        state;
+static u64                  total_len;
+static pthread_mutex_t      lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void resolve(void) {
+
+  if (real_write) { return; }
+
+  real_writev = dlsym(RTLD_NEXT, "writev");
+  real_send = dlsym(RTLD_NEXT, "send");
+  real_fwrite = dlsym(RTLD_NEXT, "fwrite");
+  real_write = dlsym(RTLD_NEXT, "write");
+
+}
+
+static inline u8 is_observed(int fd) {
+
+  return obs && fd >= 0 && fd < LEAK_OBS_MAX_FD && observed[fd];
+
+}
+
+/* Write all of buf, for copies to stdout. */
+
+static void write_all(int fd, const u8 *buf, size_t len) {
+
+  while (len) {
+
+    ssize_t n = real_write(fd, buf, len);
+    if (n <= 0) { return; }
+    buf += n;
+    len -= n;
+
+  }
+
+}
+
+/* Feed bytes written to fd into the digest. afl-fuzz zeroes count before
+   every run, so that is where a new observation starts. */
+
+static void observe(int fd, const u8 *buf, size_t len) {
+
+  if (!obs->count) {
+
+    XXH64_reset(&state, HASH_CONST);
+    total_len = 0;
+
+  }
+
+  XXH64_update(&state, buf, len);
+  total_len += len;
+
+  if (fd != STDOUT_FILENO && obs->want_bytes) {
+
+    write_all(STDOUT_FILENO, buf, len);
+
+  }
+
+  obs->digest[0] = XXH64_digest(&state);
+  obs->len[0] = total_len;
+  obs->count = 1;
+
+}
+
+/* Stdout of the target goes to the pipe only on request. */
+
+static inline u8 swallow(int fd) {
+
+  return fd == STDOUT_FILENO && !obs->want_bytes;
+
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+
+  resolve();
+  if (!is_observed(fd)) { return real_write(fd, buf, count); }
+
+  ssize_t ret = count;
+
+  pthread_mutex_lock(&lock);
+  if (!swallow(fd)) { ret = real_write(fd, buf, count); }
+  if (ret > 0) { observe(fd, buf, ret); }
+  pthread_mutex_unlock(&lock);
+
+  return ret;
+
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+
+  resolve();
+  if (!is_observed(fd)) { return real_writev(fd, iov, iovcnt); }
+
+  ssize_t ret = 0, left;
+  int     i;
+
+  pthread_mutex_lock(&lock);
+
+  if (swallow(fd)) {
+
+    for (i = 0; i < iovcnt; ++i) {
+
+      ret += iov[i].iov_len;
+
+    }
+
+  } else {
+
+    ret = real_writev(fd, iov, iovcnt);
+
+  }
+
+  for (i = 0, left = ret; i < iovcnt && left > 0; ++i) {
+
+    size_t n = iov[i].iov_len < (size_t)left ? iov[i].iov_len : (size_t)left;
+    observe(fd, iov[i].iov_base, n);
+    left -= n;
+
+  }
+
+  pthread_mutex_unlock(&lock);
+
+  return ret;
+
+}
+
+ssize_t send(int fd, const void *buf, size_t len, int flags) {
+
+  resolve();
+  if (!is_observed(fd)) { return real_send(fd, buf, len, flags); }
+
+  ssize_t ret = len;
+
+  pthread_mutex_lock(&lock);
+  if (!swallow(fd)) { ret = real_send(fd, buf, len, flags); }
+  if (ret > 0) { observe(fd, buf, ret); }
+  pthread_mutex_unlock(&lock);
+
+  return ret;
+
+}
+
+/* Streams on an observed descriptor skip their buffer, stdio would not go
+   through write() above. stdout and stderr are replaced in the constructor,
+   and report fileno() -1. */
+
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
+
+  resolve();
+
+  int fd = fileno(stream);
+  if (!is_observed(fd) || !size) {
+
+    return real_fwrite(ptr, size, nmemb, stream);
+
+  }
+
+  fflush(stream);
+
+  ssize_t ret = write(fd, ptr, size * nmemb);
+  return ret > 0 ? ret / size : 0;
+
+}
+
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size) {
+
+  ssize_t ret = write((int)(intptr_t)cookie, buf, size);
+  return ret < 0 ? 0 : ret;
+
+}
+
+/* printf() and friends write to the stream with the internal write() of the
+   C library. Give them a stream that calls ours. */
+
+static FILE *observed_stream(FILE *orig, int fd, int mode) {
+
+  cookie_io_functions_t io = {.write = cookie_write};
+  FILE *                f = fopencookie((void *)(intptr_t)fd, "w", io);
+
+  if (!f) { return orig; }
+
+  fflush(orig);
+  setvbuf(f, NULL, mode, BUFSIZ);
+  return f;
+
+}
+
+static void fork_prepare(void) {
+
+  pthread_mutex_lock(&lock);
+
+}
+
+static void fork_done(void) {
+
+  pthread_mutex_unlock(&lock);
+
+}
+
+__attribute__((constructor)) void __leakobs_init(void) {
+
+  char *id_str = getenv(LEAK_OBS_SHM_ENV_VAR), *fds;
+
+  resolve();
+
+  /* Not run by afl-fuzz in leakage hunting mode, stay out of the way. */
+
+  if (!id_str) { return; }
+
+#ifdef USEMMAP
+  int shm_fd = shm_open(id_str, O_RDWR, DEFAULT_PERMISSION);
+  if (shm_fd == -1) { return; }
+
+  obs = mmap(0, sizeof(struct leak_obs_map), PROT_READ | PROT_WRITE,
+             MAP_SHARED, shm_fd, 0);
+  close(shm_fd);
+  if (obs == MAP_FAILED) { obs = NULL; }
+#else
+  obs = (struct leak_obs_map *)shmat(atoi(id_str), NULL, 0);
+  if (obs == (void *)-1) { obs = NULL; }
+#endif
+
+  if (!obs) {
+
+    perror("libleakobs: unable to map the observation shm");
+    return;
+
+  }
+
+  /* Stdout is always observed, afl-fuzz relies on the digest for it. */
+
+  observed[STDOUT_FILENO] = 1;
+
+  if ((fds = getenv("AFL_LEAK_OBS_FDS"))) {
+
+    while (*fds) {
+
+      char *end;
+      long  fd = strtol(fds, &end, 10);
+
+      if (end == fds) { break; }
+      if (fd >= 0 && fd < LEAK_OBS_MAX_FD) { observed[fd] = 1; }
+      fds = *end ? end + 1 : end;
+
+    }
+
+  }
+
+  pthread_atfork(fork_prepare, fork_done, fork_done);
+
+  stdout = observed_stream(stdout, STDOUT_FILENO, _IOFBF);
+  if (observed[STDERR_FILENO]) {
+
+    stderr = observed_stream(stderr, STDERR_FILENO, _IONBF);
+
+  }
+
+}
+